@@ -12,7 +12,7 @@ Command::Command(Controller *controller, uint64_t sector, size_t numSectors, arc
 		CommandType type) : controller_{controller}, sector_{sector}, numSectors_{numSectors}, numBytes_{view.size()},
 	view_{view}, type_{type}, event_{} {
 
-	// TODO: Requests larger than 64k need to be split
+	// Larger requests are split by Port::transfer_().
 	assert(numBytes_ < 65536);
 
 	if (logCommands) {
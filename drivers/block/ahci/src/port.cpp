@@ -1,5 +1,6 @@
 #include <inttypes.h>
 #include <print>
+#include <unistd.h>
 
 #include <helix/memory.hpp>
 #include <helix/timer.hpp>
@@ -333,15 +334,25 @@ async::result<void> Port::submitCommand_(Command *cmd) {
 }
 
 async::result<void> Port::readSectors(uint64_t sector, arch::dma_buffer_view view) {
-	Command cmd{controller_, sector, view.size() >> sectorShift, view, CommandType::read};
-	pendingCmdQueue_.put(&cmd);
-	co_await cmd.getFuture();
+	co_await transfer_(sector, view, CommandType::read);
 }
 
 async::result<void> Port::writeSectors(uint64_t sector, arch::dma_buffer_view view) {
-	Command cmd{controller_, sector, view.size() >> sectorShift, view, CommandType::write};
-	pendingCmdQueue_.put(&cmd);
-	co_await cmd.getFuture();
+	co_await transfer_(sector, view, CommandType::write);
+}
+
+async::result<void> Port::transfer_(uint64_t sector, arch::dma_buffer_view view, CommandType type) {
+	// A command table has one PRDT entry per page (plus one if the buffer is not page aligned),
+	// and Command only supports transfers below 64 KiB. Split larger requests accordingly.
+	static size_t maxChunk = (commandTable::prdtEntries - 2) * getpagesize();
+
+	for (size_t progress = 0; progress < view.size(); progress += maxChunk) {
+		auto chunk = view.subview(progress, std::min(maxChunk, view.size() - progress));
+		Command cmd{controller_, sector + (progress >> sectorShift), chunk.size() >> sectorShift,
+				chunk, type};
+		pendingCmdQueue_.put(&cmd);
+		co_await cmd.getFuture();
+	}
 }
 
 async::result<size_t> Port::getSize() {
@@ -37,6 +37,7 @@ private:
 	async::result<size_t> findFreeSlot_();
 	async::detached submitPendingLoop_();
 	async::result<void> submitCommand_(Command *cmd);
+	async::result<void> transfer_(uint64_t sector, arch::dma_buffer_view view, CommandType type);
 	void start_();
 	void stop_();
 
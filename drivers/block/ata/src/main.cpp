@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <algorithm>
 #include <iostream>
 #include <queue>
 #include <memory>
@@ -98,6 +99,7 @@ private:
 		async::oneshot_primitive event;
 	};
 
+	async::result<void> _transfer(bool isWrite, uint64_t sector, arch::dma_buffer_view view);
 	async::result<void> _performRequest(Request *request);
 
 	async::result<bool> _detectDevice();
@@ -217,33 +219,35 @@ auto Controller::_waitForBsyIrq() -> async::result<IoResult> {
 }
 
 async::result<void> Controller::readSectors(uint64_t sector, arch::dma_buffer_view view) {
-	auto numSectors = (view.size() + sectorSize - 1) >> sectorShift;
-
-	Request request{};
-	request.isWrite = false;
-	request.sector = sector;
-	request.numSectors = numSectors;
-	request.view = view;
-
-	_requestQueue.push(&request);
-	_doorbell.raise();
-
-	co_await request.event.wait();
+	co_await _transfer(false, sector, view);
 }
 
 async::result<void> Controller::writeSectors(uint64_t sector, arch::dma_buffer_view view) {
+	co_await _transfer(true, sector, view);
+}
+
+async::result<void> Controller::_transfer(bool isWrite, uint64_t sector, arch::dma_buffer_view view) {
 	auto numSectors = (view.size() + sectorSize - 1) >> sectorShift;
 
-	Request request{};
-	request.isWrite = true;
-	request.sector = sector;
-	request.numSectors = numSectors;
-	request.view = view;
+	// The sector count register is 8 bits wide (16 bits with LBA48),
+	// hence larger transfers are split into multiple requests.
+	size_t maxSectors = _supportsLBA48 ? 65535 : 255;
+
+	for(size_t progress = 0; progress < numSectors; progress += maxSectors) {
+		auto chunkSectors = std::min(maxSectors, numSectors - progress);
+		auto offset = progress << sectorShift;
 
-	_requestQueue.push(&request);
-	_doorbell.raise();
+		Request request{};
+		request.isWrite = isWrite;
+		request.sector = sector + progress;
+		request.numSectors = chunkSectors;
+		request.view = view.subview(offset, std::min(chunkSectors << sectorShift, view.size() - offset));
 
-	co_await request.event.wait();
+		_requestQueue.push(&request);
+		_doorbell.raise();
+
+		co_await request.event.wait();
+	}
 }
 
 async::result<size_t> Controller::getSize() {
@@ -316,7 +320,7 @@ async::result<void> Controller::_performRequest(Request *request) {
 				<< " sectors from " << request->sector << std::endl;
 
 	assert(!(request->sector & ~((size_t(1) << 48) - 1)));
-	assert(request->numSectors <= 255);
+	assert(request->numSectors <= (_supportsLBA48 ? 65535 : 255));
 
 	_ioSpace.store(regs::outDevice, kDeviceLba);
 	// TODO: There should be a 400ns delay after drive selection.
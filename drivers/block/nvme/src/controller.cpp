@@ -1,5 +1,7 @@
 #include <arch/bit.hpp>
+#include <algorithm>
 #include <format>
+#include <thread>
 #include <helix/timer.hpp>
 #include <protocols/mbus/client.hpp>
 
@@ -21,6 +23,7 @@ namespace flags {
 	namespace cap {
 		constexpr arch::field<uint64_t, uint16_t> mqes{0, 16};
 		constexpr arch::field<uint64_t, uint8_t> dstrd{32, 4};
+		constexpr arch::field<uint64_t, uint8_t> mpsmin{48, 4};
 	} // namespace cap
 
 	namespace vs {
@@ -158,7 +161,9 @@ async::result<void> PciExpressController::disable() {
 
 async::result<void> PciExpressController::setupIOQueueInterrupts(size_t queueId, size_t vector) {
 	if(irqMode_ == InterruptMode::Msi || irqMode_ == InterruptMode::MsiX) {
-		auto irq = co_await hwDevice_.installMsi(vector);
+		// Spread the queues' interrupts across CPUs.
+		auto cpu = queueId % std::max(std::thread::hardware_concurrency(), 1u);
+		auto irq = co_await hwDevice_.installMsi(vector, cpu);
 		handleMsis(std::move(irq), queueId, irqMode_ == InterruptMode::MsiX);
 	}
 }
@@ -169,6 +174,7 @@ async::result<void> PciExpressController::reset() {
 
 	queueDepth_ = std::min((cap & flags::cap::mqes) + 1, IO_QUEUE_DEPTH);
 	dbStride_ = 1 << (cap & flags::cap::dstrd);
+	minPageSize_ = size_t{1} << (12 + (cap & flags::cap::mpsmin));
 
 	version_ = regs_.load(regs::vs);
 
@@ -352,6 +358,10 @@ async::result<void> Controller::scanNamespaces() {
 
 	nn = convert_endian<endian::little>(idCtrl->nn);
 
+	// MDTS is given as a power of two in units of the minimum page size; zero means no limit.
+	if (idCtrl->mdts)
+		maxTransferSize_ = minPageSize_ << idCtrl->mdts;
+
 	model = std::string{idCtrl->mn, sizeof(idCtrl->mn)};
 	serial = std::string{idCtrl->sn, sizeof(idCtrl->sn)};
 	fw_rev = std::string{idCtrl->fr, sizeof(idCtrl->fr)};
@@ -59,6 +59,11 @@ struct Controller {
 		return preferredDataTransfer_;
 	}
 
+	// Maximum number of bytes that a single I/O command can transfer (zero if unlimited).
+	size_t maxTransferSize() const {
+		return maxTransferSize_;
+	}
+
 	arch::contiguous_pool &memoryPool() {
 		return pool_;
 	}
@@ -72,6 +77,10 @@ protected:
 	std::string location_;
 	const ControllerType type_;
 
+	// Minimum memory page size (CAP.MPSMIN), which is the unit of MDTS.
+	size_t minPageSize_ = 0x1000;
+	size_t maxTransferSize_ = 0;
+
 	arch::contiguous_pool pool_{{.addressBits = 64, .allocateContigous = false}};
 
 	std::string serial;
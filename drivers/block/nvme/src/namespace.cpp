@@ -31,39 +31,40 @@ async::detached Namespace::run() {
 }
 
 async::result<void> Namespace::readSectors(uint64_t sector, arch::dma_buffer_view view) {
-	using arch::convert_endian;
-	using arch::endian;
-
-	auto cmd = std::make_unique<Command>();
-	auto &cmdBuf = cmd->getCommandBuffer().readWrite;
-
-	auto numSectors = (view.size() + sectorSize - 1) >> sectorShift;
-
-	cmdBuf.opcode = spec::kRead;
-	cmdBuf.nsid = convert_endian<endian::little, endian::native>(nsid_);
-	cmdBuf.startLba = convert_endian<endian::little, endian::native>(sector);
-	cmdBuf.length = convert_endian<endian::little, endian::native>(numSectors - 1);
-	co_await cmd->setupBuffer(controller_, view, controller_->dataTransferPolicy());
-
-	co_await controller_->submitIoCommand(std::move(cmd));
+	co_await transfer_(spec::kRead, sector, view);
 }
 
 async::result<void> Namespace::writeSectors(uint64_t sector, arch::dma_buffer_view view) {
+	co_await transfer_(spec::kWrite, sector, view);
+}
+
+async::result<void> Namespace::transfer_(uint8_t opcode, uint64_t sector, arch::dma_buffer_view view) {
 	using arch::convert_endian;
 	using arch::endian;
 
-	auto cmd = std::make_unique<Command>();
-	auto &cmdBuf = cmd->getCommandBuffer().readWrite;
+	// Split the request into commands that respect the controller's MDTS
+	// and the 16-bit sector count of read and write commands.
+	size_t maxChunk = size_t{1} << (16 + sectorShift);
+	if (auto mdts = controller_->maxTransferSize(); mdts)
+		maxChunk = std::min(maxChunk, mdts);
+
+	for (size_t progress = 0; progress < view.size(); progress += maxChunk) {
+		auto chunk = view.subview(progress, std::min(maxChunk, view.size() - progress));
 
-	auto numSectors = (view.size() + sectorSize - 1) >> sectorShift;
+		auto cmd = std::make_unique<Command>();
+		auto &cmdBuf = cmd->getCommandBuffer().readWrite;
+
+		auto numSectors = (chunk.size() + sectorSize - 1) >> sectorShift;
 
-	cmdBuf.opcode = spec::kWrite;
-	cmdBuf.nsid = convert_endian<endian::little, endian::native>(nsid_);
-	cmdBuf.startLba = convert_endian<endian::little, endian::native>(sector);
-	cmdBuf.length = convert_endian<endian::little, endian::native>(numSectors - 1);
-	co_await cmd->setupBuffer(controller_, view, controller_->dataTransferPolicy());
+		cmdBuf.opcode = opcode;
+		cmdBuf.nsid = convert_endian<endian::little, endian::native>(nsid_);
+		cmdBuf.startLba = convert_endian<endian::little, endian::native>(
+				sector + (progress >> sectorShift));
+		cmdBuf.length = convert_endian<endian::little, endian::native>(numSectors - 1);
+		co_await cmd->setupBuffer(controller_, chunk, controller_->dataTransferPolicy());
 
-	co_await controller_->submitIoCommand(std::move(cmd));
+		co_await controller_->submitIoCommand(std::move(cmd));
+	}
 }
 
 async::result<size_t> Namespace::getSize() {
@@ -19,6 +19,8 @@ struct Namespace : blockfs::BlockDevice {
 	async::result<void> handleIoctl(managarm::fs::GenericIoctlRequest &req, helix::BorrowedDescriptor conversation) override;
 
 private:
+	async::result<void> transfer_(uint8_t opcode, uint64_t sector, arch::dma_buffer_view view);
+
 	Controller *controller_;
 	unsigned int nsid_;
 	int lbaShift_;
@@ -2,8 +2,14 @@
 #ifndef LIBFS_COMMON_H
 #define LIBFS_COMMON_H
 
+#include <stdint.h>
+
 namespace blockfs {
 
+// Base-2 logarithm of the largest manage request (in bytes) that we ask the kernel for.
+// Managers turn each request into as few disk I/Os as the on-disk layout allows.
+inline constexpr uint32_t maxManageRequestShift = 20;
+
 enum FileType {
 	kTypeNone,
 	kTypeRegular,
@@ -921,9 +921,9 @@ async::result<void> FileSystem::init() {
 	HelHandle block_bitmap_frontal, inode_bitmap_frontal;
 	HelHandle block_bitmap_backing, inode_bitmap_backing;
 	HEL_CHECK(helCreateManagedMemory(numBlockGroups << blockPagesShift,
-			0, &block_bitmap_backing, &block_bitmap_frontal));
+			maxManageRequestShift << kHelManagedMaxRequestShift, &block_bitmap_backing, &block_bitmap_frontal));
 	HEL_CHECK(helCreateManagedMemory(numBlockGroups << blockPagesShift,
-			0, &inode_bitmap_backing, &inode_bitmap_frontal));
+			maxManageRequestShift << kHelManagedMaxRequestShift, &inode_bitmap_backing, &inode_bitmap_frontal));
 	blockBitmap = helix::UniqueDescriptor{block_bitmap_frontal};
 	blockBitmapMapping = helix::Mapping{blockBitmap,
 			0, numBlockGroups << blockPagesShift,
@@ -941,7 +941,7 @@ async::result<void> FileSystem::init() {
 	HelHandle inode_table_frontal;
 	HelHandle inode_table_backing;
 	HEL_CHECK(helCreateManagedMemory(inodesPerGroup * inodeSize * numBlockGroups,
-			0, &inode_table_backing, &inode_table_frontal));
+			maxManageRequestShift << kHelManagedMaxRequestShift, &inode_table_backing, &inode_table_frontal));
 	inodeTable = helix::UniqueDescriptor{inode_table_frontal};
 	inodeTableMapping = helix::Mapping{inodeTable,
 			0, inodesPerGroup * inodeSize * numBlockGroups,
@@ -980,26 +980,38 @@ async::detached FileSystem::manageBlockBitmap(helix::UniqueDescriptor memory) {
 
 		auto view = pool->importMemory(memory, manage.offset(), manage.length());
 
-		for(size_t progress = 0; progress < manage.length(); progress += (1 << blockPagesShift)) {
+		size_t progress = 0;
+		while(progress < manage.length()) {
 			auto bg_idx = (manage.offset() + progress) >> blockPagesShift;
 			auto block = bgdt[bg_idx].blockBitmap;
 			assert(block);
 
-			auto subview = view.view().subview(progress, 1 << blockPagesShift);
+			// Coalesce groups whose bitmaps are adjacent on disk (e.g., with flex_bg).
+			// This only works if each bitmap fills its frame.
+			size_t numGroups = 1;
+			if(blockShift == blockPagesShift) {
+				while(progress + (numGroups << blockPagesShift) < manage.length()
+						&& bgdt[bg_idx + numGroups].blockBitmap == block + numGroups)
+					numGroups++;
+			}
+			auto chunk = numGroups << blockPagesShift;
+
+			auto subview = view.view().subview(progress, chunk);
 
 			if(manage.type() == kHelManageInitialize) {
 				co_await device->readSectors(block * sectorsPerBlock, subview);
-				HEL_CHECK(helUpdateMemory(memory.getHandle(), kHelManageInitialize,
-						manage.offset() + progress, 1 << blockPagesShift));
 			}else{
 				assert(manage.type() == kHelManageWriteback);
 
 				co_await device->writeSectors(block * sectorsPerBlock, subview);
-				HEL_CHECK(helUpdateMemory(memory.getHandle(), kHelManageWriteback,
-						manage.offset() + progress, 1 << blockPagesShift));
 			}
+
+			progress += chunk;
 		}
 
+		HEL_CHECK(helUpdateMemory(memory.getHandle(), manage.type(),
+				manage.offset(), manage.length()));
+
 		ostContext.emit(
 			ostEvtExt2ManageBlockBitmap,
 			ostAttrTime(timer.elapsed())
@@ -1022,26 +1034,38 @@ async::detached FileSystem::manageInodeBitmap(helix::UniqueDescriptor memory) {
 
 		auto view = pool->importMemory(memory, manage.offset(), manage.length());
 
-		for(size_t progress = 0; progress < manage.length(); progress += (1 << blockPagesShift)) {
+		size_t progress = 0;
+		while(progress < manage.length()) {
 			auto bg_idx = (manage.offset() + progress) >> blockPagesShift;
 			auto block = bgdt[bg_idx].inodeBitmap;
 			assert(block);
 
-			auto subview = view.view().subview(progress, 1 << blockPagesShift);
+			// Coalesce groups whose bitmaps are adjacent on disk (e.g., with flex_bg).
+			// This only works if each bitmap fills its frame.
+			size_t numGroups = 1;
+			if(blockShift == blockPagesShift) {
+				while(progress + (numGroups << blockPagesShift) < manage.length()
+						&& bgdt[bg_idx + numGroups].inodeBitmap == block + numGroups)
+					numGroups++;
+			}
+			auto chunk = numGroups << blockPagesShift;
+
+			auto subview = view.view().subview(progress, chunk);
 
 			if(manage.type() == kHelManageInitialize) {
 				co_await device->readSectors(block * sectorsPerBlock, subview);
-				HEL_CHECK(helUpdateMemory(memory.getHandle(), kHelManageInitialize,
-						manage.offset() + progress, 1 << blockPagesShift));
 			}else{
 				assert(manage.type() == kHelManageWriteback);
 
 				co_await device->writeSectors(block * sectorsPerBlock, subview);
-				HEL_CHECK(helUpdateMemory(memory.getHandle(), kHelManageWriteback,
-						manage.offset() + progress, 1 << blockPagesShift));
 			}
+
+			progress += chunk;
 		}
 
+		HEL_CHECK(helUpdateMemory(memory.getHandle(), manage.type(),
+				manage.offset(), manage.length()));
+
 		ostContext.emit(
 			ostEvtExt2ManageInodeBitmap,
 			ostAttrTime(timer.elapsed())
@@ -1079,8 +1103,12 @@ async::detached FileSystem::manageInodeTable(helix::UniqueDescriptor memory) {
 			auto block = bgdt[bg_idx].inodeTable;
 			assert(block);
 
-			// Do not cross block group boundaries.
+			// Do not cross block group boundaries,
+			// unless the inode tables are adjacent on disk (e.g., with flex_bg).
 			auto chunk = std::min(manage.length() - progress, sizePerGroup - bg_offset);
+			for(size_t n = 1; progress + chunk < manage.length()
+					&& bgdt[bg_idx + n].inodeTable == block + n * (sizePerGroup >> blockShift); n++)
+				chunk += std::min(manage.length() - progress - chunk, sizePerGroup);
 			assert(!(progress & (pageSize - 1))); // Guaranteed by the next assertion.
 			assert(!(chunk & (pageSize - 1))); // Otherwise, the panic above would trigger.
 
@@ -1312,7 +1340,8 @@ async::detached FileSystem::initiateInode(std::shared_ptr<Inode> inode) {
 
 	// Allocate a page cache for the file.
 	auto cache_size = (inode->fileSize() + 0xFFF) & ~size_t(0xFFF);
-	HEL_CHECK(helCreateManagedMemory(cache_size, kHelManagedReadahead,
+	HEL_CHECK(helCreateManagedMemory(cache_size,
+			kHelManagedReadahead | (maxManageRequestShift << kHelManagedMaxRequestShift),
 			&inode->backingMemory, &inode->frontalMemory));
 
 	if (inode->fileType == kTypeDirectory) {
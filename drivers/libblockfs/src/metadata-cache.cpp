@@ -1,6 +1,7 @@
 #include <bit>
 #include <string.h>
 
+#include "common.hpp"
 #include "metadata-cache.hpp"
 
 namespace blockfs {
@@ -19,7 +20,7 @@ MetadataCache::MetadataCache(BlockDevice *device, uint64_t numBlocks, size_t blo
 
 	HelHandle backing, frontal;
 	HEL_CHECK(helCreateManagedMemory(numBlocks << blockPagesShift_,
-			0, &backing, &frontal));
+			maxManageRequestShift << kHelManagedMaxRequestShift, &backing, &frontal));
 	frontal_ = helix::UniqueDescriptor{frontal};
 
 	manage_(helix::UniqueDescriptor{backing});
@@ -67,21 +68,33 @@ async::detached MetadataCache::manage_(helix::UniqueDescriptor backing) {
 
 		auto view = device_->pagePool->importMemory(backing, manage.offset(), manage.length());
 
-		for(size_t progress = 0; progress < manage.length(); progress += frameSize) {
-			auto block = (manage.offset() + progress) >> blockPagesShift_;
-			assert(block < numBlocks_);
-
-			auto subview = view.view().subview(progress, blockSize_);
+		if(blockSize_ == frameSize) {
+			// Frames are packed just like the blocks on disk: transfer the request at once.
+			auto block = manage.offset() >> blockPagesShift_;
+			assert(block + (manage.length() >> blockPagesShift_) <= numBlocks_);
 
 			if(manage.type() == kHelManageInitialize) {
-				co_await device_->readSectors(block * sectorsPerBlock_, subview);
-				// Zero the tail of the frame that no disk block backs.
-				if(blockSize_ < frameSize)
-					memset(view.view().subview(progress + blockSize_,
-							frameSize - blockSize_).data(), 0, frameSize - blockSize_);
+				co_await device_->readSectors(block * sectorsPerBlock_, view.view());
 			}else{
 				assert(manage.type() == kHelManageWriteback);
-				co_await device_->writeSectors(block * sectorsPerBlock_, subview);
+				co_await device_->writeSectors(block * sectorsPerBlock_, view.view());
+			}
+		}else{
+			for(size_t progress = 0; progress < manage.length(); progress += frameSize) {
+				auto block = (manage.offset() + progress) >> blockPagesShift_;
+				assert(block < numBlocks_);
+
+				auto subview = view.view().subview(progress, blockSize_);
+
+				if(manage.type() == kHelManageInitialize) {
+					co_await device_->readSectors(block * sectorsPerBlock_, subview);
+					// Zero the tail of the frame that no disk block backs.
+					memset(view.view().subview(progress + blockSize_,
+							frameSize - blockSize_).data(), 0, frameSize - blockSize_);
+				}else{
+					assert(manage.type() == kHelManageWriteback);
+					co_await device_->writeSectors(block * sectorsPerBlock_, subview);
+				}
 			}
 		}
 
@@ -165,6 +165,11 @@ rawPread(void *object, int64_t offset, helix_ng::CredentialsView, void *buffer,
 	co_return chunkSize;
 }
 
+async::result<helix::BorrowedDescriptor> rawAccessMemory(void *object) {
+	auto self = static_cast<raw::OpenFile *>(object);
+	co_return helix::BorrowedDescriptor{self->rawFs->frontalMemory};
+}
+
 async::result<protocols::fs::Error> rawFlock(void *object, int flags) {
 	auto self = static_cast<raw::OpenFile*>(object);
 
@@ -214,6 +219,7 @@ constinit protocols::fs::FileOperations rawOperations {
 	.seekEof = rawSeekEof,
 	.read = rawRead,
 	.pread = rawPread,
+	.accessMemory = rawAccessMemory,
 	.ioctl = rawIoctl,
 	.flock = rawFlock,
 };
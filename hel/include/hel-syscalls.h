@@ -222,6 +222,15 @@ extern inline __attribute__ (( always_inline )) HelError helMemoryInfo(HelHandle
 	return error;
 };
 
+extern inline __attribute__ (( always_inline )) HelError helQueryMemoryNodes(
+		struct HelMemoryNodeStats *stats, size_t max_nodes, size_t *num_nodes) {
+	HelWord num_word;
+	HelError error = helSyscall2_1(kHelCallQueryMemoryNodes, (HelWord)stats,
+			(HelWord)max_nodes, &num_word);
+	*num_nodes = (size_t)num_word;
+	return error;
+};
+
 extern inline __attribute__ (( always_inline )) HelError helUpdateMemory(HelHandle handle,
 		int type, uintptr_t offset, size_t length) {
 	return helSyscall4(kHelCallUpdateMemory, (HelWord)handle, (HelWord)type,
@@ -18,7 +18,7 @@
 
 enum {
 	// largest system call number plus 1
-	kHelNumCalls = 110,
+	kHelNumCalls = 111,
 
 	kHelCallLog = 1,
 	kHelCallPanic = 10,
@@ -110,6 +110,8 @@ enum {
 
 	kHelCallCreateToken = 104,
 
+	kHelCallQueryMemoryNodes = 110,
+
 	kHelCallSuper = 0x80000000
 };
 
@@ -453,6 +455,12 @@ enum HelManagedFlags {
 	kHelManagedReadahead = 1
 };
 
+//! Bits 8 to 15 of the flags of helCreateManagedMemory() contain the base-2 logarithm
+//! of the maximal length (in bytes) of a single manage request.
+//! Zero selects a default that is chosen by the kernel.
+static const uint32_t kHelManagedMaxRequestShift = 8;
+static const uint32_t kHelManagedMaxRequestMask = UINT32_C(0xFF) << 8;
+
 enum HelManageRequests {
 	kHelManageInitialize = 1,
 	kHelManageWriteback = 2
@@ -686,6 +694,10 @@ struct HelQueueParameters {
 	unsigned int numSqChunks;
 };
 
+//! Flag for helCreateQueue: while helDriveQueue() processes SQ elements,
+//! coalesce all wakeups of the queue into a single one at the end of the call.
+static const uint32_t kHelQueueBatchCompletions = (1 << 0);
+
 //! Set in userNotify after kernel has written progress.
 static const int kHelUserNotifyCqProgress = (1 << 0);
 //! Set in userNotify after kernel has supplied new SQ chunks.
@@ -737,6 +749,8 @@ static const uint32_t kHelSubmitWritebackFence = 14;
 static const uint32_t kHelSubmitInvalidateMemory = 15;
 //! SQ opcode: populate a space.
 static const uint32_t kHelSubmitPopulateSpace = 16;
+//! SQ opcode: fork the areas of a space.
+static const uint32_t kHelSubmitForkSpace = 17;
 
 //! In-memory kernel/user-space queue.
 struct HelQueue {
@@ -757,6 +771,10 @@ struct HelQueue {
 	//! Index of the first chunk of the submission queue.
 	//! Written by the kernel and read by userspace.
 	int sqFirst;
+
+	//! Number of times that the kernel had to wait for userspace to supply CQ chunks.
+	//! Written by the kernel and read by userspace.
+	unsigned int cqStalls;
 };
 
 //! Marks the next field as present.
@@ -937,6 +955,55 @@ struct HelSqPopulateSpace {
 	size_t length;
 };
 
+//! Flags for kHelSubmitForkSpace.
+enum HelForkSpaceFlags {
+	//! Map the present pages of all areas into the new space right away.
+	//! Pages of forked memory objects are mapped read-only.
+	kHelForkSpacePopulate = 1
+};
+
+//! Flags for HelForkArea.
+enum HelForkAreaFlags {
+	//! Fork the memory object (see ::helForkMemory) and map the forked object.
+	//! Otherwise, the memory object itself is mapped.
+	kHelForkAreaCopyOnWrite = 1
+};
+
+//! Maximal number of areas per kHelSubmitForkSpace submission.
+static const uint32_t kHelForkSpaceMaxAreas = 64;
+
+//! Describes an area of kHelSubmitForkSpace.
+struct HelForkArea {
+	//! Handle to the memory object.
+	HelHandle memory;
+	//! Combination of ::HelForkAreaFlags.
+	uint32_t flags;
+	//! Protection flags (kHelMapProt*) and kHelMapDontRequireBacking.
+	uint32_t mapFlags;
+	//! Address of the area in the new space.
+	uintptr_t address;
+	//! Offset within the memory object.
+	uintptr_t offset;
+	//! Length of the area.
+	size_t length;
+};
+
+//! SQ data for kHelSubmitForkSpace.
+//!
+//! Followed by @p count HelForkArea structs.
+//! Memory objects that are used by multiple copy-on-write areas are only forked once.
+//! The result is a HelSimpleResult, followed by one HelHandle per area.
+//! The handle refers to the forked memory object for copy-on-write areas
+//! and is ::kHelNullHandle otherwise.
+struct HelSqForkSpace {
+	//! Handle to the address space that the areas are mapped into.
+	HelHandle space;
+	//! Combination of ::HelForkSpaceFlags.
+	uint32_t flags;
+	//! Number of areas (at most ::kHelForkSpaceMaxAreas).
+	uint32_t count;
+};
+
 struct HelSimpleResult {
 	HelError error;
 	int reserved;
@@ -1006,6 +1073,20 @@ struct HelThreadStats {
 	uint64_t userTime;
 };
 
+//! Physical memory statistics of a NUMA node; returned by helQueryMemoryNodes.
+struct HelMemoryNodeStats {
+	//! ID of the node (i.e., the ACPI proximity domain).
+	uint32_t node;
+	//! Lowest index of a CPU on this node or -1 if the node has no CPUs.
+	int32_t firstCpu;
+	//! Number of physical pages on this node.
+	uint64_t totalPages;
+	//! Number of free pages on this node.
+	uint64_t freePages;
+	//! Number of used pages on this node.
+	uint64_t usedPages;
+};
+
 enum {
   kHelVmexitHlt = 0,
   kHelVmexitTranslationFault = 1,
@@ -1197,9 +1278,13 @@ HEL_C_LINKAGE HelError helResizeMemory(HelHandle handle, size_t newSize);
 //!
 //!    The @p backingHandle is used to manage the memory object, while
 //! the @p frontalHandle provides a view on the memory object for consumers.
+//! Adjacent pages are merged into a single manage request, up to the maximal
+//! request length that is encoded in @p flags (see ::kHelManagedMaxRequestMask).
 //! @param[in] size
 //!    	Size of the memory object in bytes.
 //!    	Must be aligned to the system's page size.
+//! @param[in] flags
+//!    	Combination of ::HelManagedFlags and the maximal request length.
 //! @param[out] backingHandle
 //!    	Handle to the new memory object (for management)
 //! @param[out] frontalHandle
@@ -1313,6 +1398,19 @@ HEL_C_LINKAGE HelError helMemoryInfo(HelHandle handle,
 
 HEL_C_LINKAGE HelError helUpdateMemory(HelHandle handle, int type, uintptr_t offset, size_t length);
 
+//! Queries physical memory statistics of all NUMA nodes.
+//!
+//! Physical memory is allocated from the node of the CPU that allocates it
+//! (e.g., the faulting CPU) if possible.
+//! @param[out] stats
+//!     Array that receives the statistics of the first @p max_nodes nodes.
+//! @param[in] max_nodes
+//!     Number of elements in @p stats.
+//! @param[out] num_nodes
+//!     Total number of nodes (which can exceed @p max_nodes).
+HEL_C_LINKAGE HelError helQueryMemoryNodes(struct HelMemoryNodeStats *stats, size_t max_nodes,
+		size_t *num_nodes);
+
 //! Notifies the kernel that a certain range of memory should be preloaded.
 //!
 //! This acts as a hint to the kernel and is meant purely as a performance optimization.
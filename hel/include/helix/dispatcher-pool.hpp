@@ -0,0 +1,77 @@
+#pragma once
+
+#include <helix/ipc.hpp>
+#include <async/result.hpp>
+
+#include <atomic>
+#include <coroutine>
+#include <thread>
+#include <vector>
+
+namespace helix {
+
+// A set of threads that each drive their own Dispatcher.
+// Work that is handed to the pool is spread across the threads in round-robin order,
+// such that servers can complete IPC on multiple CPUs.
+// Note that pools are never torn down; they are expected to live until the program exits.
+struct DispatcherPool {
+	struct ScheduleOperation {
+		bool await_ready() {
+			return false;
+		}
+
+		void await_suspend(std::coroutine_handle<> handle) {
+			dispatcher->post([handle] {
+				handle.resume();
+			});
+		}
+
+		void await_resume() { }
+
+		Dispatcher *dispatcher;
+	};
+
+	explicit DispatcherPool(unsigned int numThreads = std::thread::hardware_concurrency());
+
+	DispatcherPool(const DispatcherPool &) = delete;
+
+	DispatcherPool &operator= (const DispatcherPool &) = delete;
+
+	unsigned int size() {
+		return _dispatchers.size();
+	}
+
+	Dispatcher &dispatcher(unsigned int n) {
+		return *_dispatchers[n];
+	}
+
+	// Returns the index of the thread that should receive the next piece of work.
+	unsigned int pick() {
+		return _next.fetch_add(1, std::memory_order_relaxed) % _dispatchers.size();
+	}
+
+	template<typename F>
+	void post(F f) {
+		dispatcher(pick()).post(std::move(f));
+	}
+
+	// Starts the sender on one of the pool's threads without waiting for it to complete.
+	template<typename S>
+	void detach(S sender) {
+		post([s = std::move(sender)] () mutable {
+			async::detach(std::move(s));
+		});
+	}
+
+	// Suspends the calling coroutine and resumes it on one of the pool's threads.
+	// All helix operations that the coroutine submits afterwards use that thread's Dispatcher.
+	ScheduleOperation schedule() {
+		return {&dispatcher(pick())};
+	}
+
+private:
+	std::vector<Dispatcher *> _dispatchers;
+	std::atomic<unsigned int> _next{0};
+};
+
+} // namespace helix
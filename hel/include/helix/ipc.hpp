@@ -3,6 +3,8 @@
 #include <assert.h>
 #include <tuple>
 #include <array>
+#include <functional>
+#include <mutex>
 #include <vector>
 #include <span>
 
@@ -173,7 +175,7 @@ public:
 
 	Dispatcher()
 	: _handle{kHelNullHandle}, _queue{nullptr},
-			_numCqChunks{0}, _numSqChunks{0}, _chunkSize{0},
+			_numCqChunks{0}, _numActiveCqChunks{0}, _numSqChunks{0}, _chunkSize{0},
 			_retrieveChunk{0}, _tailChunk{0}, _lastProgress{0},
 			_sqCurrentChunk{0}, _sqProgress{0} { }
 
@@ -183,12 +185,15 @@ public:
 
 	HelHandle acquire() {
 		if(!_handle) {
-			_numCqChunks = 8;
+			// Only the first half of the CQ chunks is supplied initially;
+			// the remaining ones are supplied if the CQ runs low (see _growCq()).
+			_numCqChunks = 16;
+			_numActiveCqChunks = 8;
 			_numSqChunks = 8;
 			_chunkSize = 4096;
 
 			HelQueueParameters params {
-				.flags = 0,
+				.flags = kHelQueueBatchCompletions,
 				.numChunks = _numCqChunks,
 				.chunkSize = _chunkSize,
 				.numSqChunks = _numSqChunks,
@@ -218,9 +223,9 @@ public:
 			// Set up CQ: chunks 0 to numCqChunks-1.
 			__atomic_store_n(&_queue->cqFirst, 0 | kHelNextPresent, __ATOMIC_RELEASE);
 
-			// Supply the remaining CQ chunks.
+			// Supply the remaining active CQ chunks.
 			_tailChunk = 0;
-			for (unsigned int i = 1; i < _numCqChunks; ++i)
+			for (unsigned int i = 1; i < _numActiveCqChunks; ++i)
 				_supplyChunk(i);
 			_retrieveChunk = 0;
 
@@ -241,17 +246,69 @@ public:
 		return _nextAsyncId++;
 	}
 
+	// Number of CQ chunks that are currently in circulation.
+	unsigned int numActiveCqChunks() {
+		return _numActiveCqChunks;
+	}
+
+	// Number of times that the kernel had to wait for CQ chunks.
+	unsigned int numCqStalls() {
+		if(!_queue)
+			return 0;
+		return __atomic_load_n(&_queue->cqStalls, __ATOMIC_RELAXED);
+	}
+
+	// Number of times that pushSq() had to wait for SQ chunks.
+	unsigned int numSqStalls() {
+		return _numSqStalls;
+	}
+
+	// Enables busy-polling: before wait() sleeps in the kernel, it spins on the queue
+	// for up to the given number of iterations. This trades CPU time for wakeup latency
+	// and is only useful for threads that run on a dedicated CPU. Zero disables polling.
+	void setPollBudget(unsigned int iterations) {
+		_pollBudget = iterations;
+	}
+
+	// Number of times that polling avoided (or failed to avoid) sleeping in the kernel.
+	uint64_t numPollHits() {
+		return _numPollHits;
+	}
+
+	uint64_t numPollMisses() {
+		return _numPollMisses;
+	}
+
+	// Queues a function that is run by the thread that owns this dispatcher
+	// (i.e., the thread that calls wait()). This can be called from any thread,
+	// but the owning thread must have called acquire() before.
+	void post(std::move_only_function<void()> f) {
+		assert(_handle != kHelNullHandle);
+		{
+			std::lock_guard lock{_postMutex};
+			_posted.push_back(std::move(f));
+		}
+		HEL_CHECK(helAlertQueue(_handle));
+	}
+
 	void wait() {
 		while(true) {
-			bool done;
-			_waitProgressFutex(&done);
+			bool done, posted;
+			_waitProgressFutex(&done, &posted);
+			if(posted) {
+				_runPosted();
+				return;
+			}
 			if(done) {
 				auto cn = _retrieveChunk;
 				auto next = __atomic_load_n(&_chunks[cn]->next, __ATOMIC_ACQUIRE);
+				assert(_numAheadCqChunks > 0);
+				_numAheadCqChunks--;
 				_surrender(cn);
 
 				_lastProgress = 0;
 				_retrieveChunk = next & ~kHelNextPresent;
+				_growCq();
 				continue;
 			}
 
@@ -289,13 +346,45 @@ private:
 	void _supplyChunk(int cn) {
 		__atomic_store_n(&_chunks[_tailChunk]->next, cn | kHelNextPresent, __ATOMIC_RELEASE);
 		_tailChunk = cn;
+		_numAheadCqChunks++;
 		_wakeHeadFutex();
 	}
 
+	// Supplies one of the reserve CQ chunks if the kernel stalled on the CQ
+	// or if only few chunks are left (e.g., because ElementHandles keep chunks alive).
+	void _growCq() {
+		if(_numActiveCqChunks == _numCqChunks)
+			return;
+
+		auto stalls = numCqStalls();
+		if(stalls == _seenCqStalls && _numAheadCqChunks >= 2)
+			return;
+		_seenCqStalls = stalls;
+
+		auto cn = _numActiveCqChunks++;
+		_resetChunk(cn);
+		_supplyChunk(cn);
+	}
+
 	void _reference(int cn) {
 		_refCounts[cn]++;
 	}
 
+	bool _havePosted() {
+		std::lock_guard lock{_postMutex};
+		return !_posted.empty();
+	}
+
+	void _runPosted() {
+		std::vector<std::move_only_function<void()>> items;
+		{
+			std::lock_guard lock{_postMutex};
+			items.swap(_posted);
+		}
+		for(auto &f : items)
+			f();
+	}
+
 public:
 	// Push an element to the SQ using a gather list.
 	void pushSq(uint32_t opcode, uintptr_t context,
@@ -312,10 +401,15 @@ public:
 		if (_sqProgress + elementSize > _chunkSize) {
 			// Wait for next chunk to become available.
 			int nextWord;
+			bool stalled = false;
 			while (true) {
 				nextWord = __atomic_load_n(&_chunks[_sqCurrentChunk]->next, __ATOMIC_ACQUIRE);
 				if (nextWord & kHelNextPresent)
 					break;
+				if (!stalled) {
+					_numSqStalls++;
+					stalled = true;
+				}
 				auto notify = __atomic_load_n(&_queue->userNotify, __ATOMIC_RELAXED);
 				if (!(notify & kHelUserNotifySupplySqChunks)) {
 					HEL_CHECK(helDriveQueue(_handle, 0, 0));
@@ -365,15 +459,43 @@ public:
 	}
 
 private:
+	static void _cpuRelax() {
+#if defined(__x86_64__)
+		__builtin_ia32_pause();
+#elif defined(__aarch64__)
+		asm volatile ("yield");
+#endif
+	}
+
+	// Spins until userNotify has any bits not in notifyMask set or until the budget is exhausted.
+	// Returns true (and the new value of userNotify) if a notification arrived.
+	bool _pollUserNotify(int notifyMask, int *notify) {
+		// The kernel only processes SQ elements in helDriveQueue(); do that before we spin.
+		if (__atomic_load_n(&_queue->kernelNotify, __ATOMIC_RELAXED) & kHelKernelNotifySqProgress)
+			HEL_CHECK(helDriveQueue(_handle, 0, 0));
+
+		for (unsigned int i = 0; i < _pollBudget; ++i) {
+			auto n = __atomic_load_n(&_queue->userNotify, __ATOMIC_RELAXED);
+			if (n & ~notifyMask) {
+				*notify = n;
+				_numPollHits++;
+				return true;
+			}
+			_cpuRelax();
+		}
+		_numPollMisses++;
+		return false;
+	}
+
 	void _wakeHeadFutex() {
 		auto futex = __atomic_fetch_or(&_queue->kernelNotify, kHelKernelNotifySupplyCqChunks, __ATOMIC_RELEASE);
 		if(!(futex & kHelKernelNotifySupplyCqChunks))
 			HEL_CHECK(helDriveQueue(_handle, 0, 0));
 	}
 
-	void _waitProgressFutex(bool *done) {
+	void _waitProgressFutex(bool *done, bool *posted) {
 		// userNotify bits checked by this function (these MUST be checked in the loop below!).
-		const auto relevantNotify = kHelUserNotifyCqProgress;
+		const auto relevantNotify = kHelUserNotifyCqProgress | kHelUserNotifyAlert;
 		// userNotify bits ignored by this function.
 		const auto maskedNotify = kHelUserNotifySupplySqChunks;
 
@@ -388,14 +510,28 @@ private:
 			if (_pendingNotify & kHelUserNotifyCqProgress) {
 				auto progress = __atomic_load_n(&_chunks[_retrieveChunk]->progressFutex, __ATOMIC_ACQUIRE);
 				assert(!(progress & ~(kHelProgressMask | kHelProgressFull | kHelProgressDone)));
+				// The kernel is waiting for the next chunk; try to supply a reserve chunk.
+				if ((progress & kHelProgressFull) && !(progress & kHelProgressDone))
+					_growCq();
 				if (progress & kHelProgressFull)
 					assert(_retrieveChunk != _tailChunk);
 				if(_lastProgress != (progress & kHelProgressMask)) {
 					*done = false;
+					*posted = false;
 					return;
 				}else if(progress & kHelProgressDone) {
 					assert(progress & kHelProgressFull);
 					*done = true;
+					*posted = false;
+					return;
+				}
+			}
+
+			// Other threads alert the queue after calling post().
+			if (_pendingNotify & kHelUserNotifyAlert) {
+				if (_havePosted()) {
+					*done = false;
+					*posted = true;
 					return;
 				}
 			}
@@ -408,6 +544,9 @@ private:
 				// The only remaining bits must be masked ones (otherwise we are missing checks above).
 				assert(!(_pendingNotify & ~maskedNotify));
 
+				if (_pollBudget && _pollUserNotify(maskedNotify, &notify))
+					continue;
+
 				auto e = helDriveQueue(_handle, kHelDriveWait, maskedNotify);
 				if (e != kHelErrCancelled)
 					HEL_CHECK(e);
@@ -424,10 +563,12 @@ private:
 private:
 	HelHandle _handle;
 	HelQueue *_queue;
-	HelChunk *_chunks[16];
+	HelChunk *_chunks[24];
 
 	// Queue parameters.
 	unsigned int _numCqChunks;
+	// CQ chunks [0, _numActiveCqChunks) are in circulation, the others are held in reserve.
+	unsigned int _numActiveCqChunks;
 	unsigned int _numSqChunks;
 	size_t _chunkSize;
 
@@ -436,6 +577,11 @@ private:
 	// General state.
 	int _pendingNotify{0};
 
+	// Busy-polling state.
+	unsigned int _pollBudget{0};
+	uint64_t _numPollHits{0};
+	uint64_t _numPollMisses{0};
+
 	// CQ state.
 	// Chunk that we are currently retrieving from.
 	int _retrieveChunk;
@@ -443,14 +589,23 @@ private:
 	int _tailChunk;
 	// Progress into the current CQ chunk.
 	int _lastProgress;
+	// Number of CQ chunks that are linked after _retrieveChunk.
+	unsigned int _numAheadCqChunks{0};
+	// Value of HelQueue::cqStalls when we last grew the CQ.
+	unsigned int _seenCqStalls{0};
 	// Per-chunk reference counts.
-	int _refCounts[16];
+	int _refCounts[24];
 
 	// SQ state.
 	// Chunk that we are currently writing to.
 	int _sqCurrentChunk;
 	// Progress into the current SQ chunk.
 	int _sqProgress;
+	unsigned int _numSqStalls{0};
+
+	// Functions queued by post().
+	std::mutex _postMutex;
+	std::vector<std::move_only_function<void()>> _posted;
 };
 
 inline void CurrentDispatcherToken::wait() {
@@ -1561,4 +1716,115 @@ inline auto populateSpace(BorrowedDescriptor space, uintptr_t address, size_t le
 	return PopulateSpaceSender{std::move(space), address, length};
 }
 
+// --------------------------------------------------------------------
+// ForkSpace
+// --------------------------------------------------------------------
+
+struct ForkSpaceResult {
+	ForkSpaceResult(size_t count)
+	: count_{count} { }
+
+	HelError error() {
+		assert(valid_);
+		return error_;
+	}
+
+	// Returns the forked memory object for each copy-on-write area
+	// (and an empty descriptor for all other areas).
+	std::vector<UniqueDescriptor> descriptors() {
+		assert(valid_);
+		HEL_CHECK(error());
+		return std::move(descriptors_);
+	}
+
+	void parse(void *&ptr, const ElementHandle &) {
+		auto result = reinterpret_cast<HelSimpleResult *>(ptr);
+		error_ = result->error;
+		auto handles = reinterpret_cast<HelHandle *>((char *)ptr + sizeof(HelSimpleResult));
+		for(size_t i = 0; i < count_; i++) {
+			if(!error_ && handles[i] != kHelNullHandle) {
+				descriptors_.push_back(UniqueDescriptor{handles[i]});
+			}else{
+				descriptors_.push_back(UniqueDescriptor{});
+			}
+		}
+		ptr = (char *)ptr + sizeof(HelSimpleResult)
+				+ ((count_ * sizeof(HelHandle) + 7) & ~size_t(7));
+		valid_ = true;
+	}
+
+private:
+	size_t count_;
+	bool valid_ = false;
+	HelError error_;
+	std::vector<UniqueDescriptor> descriptors_;
+};
+
+template <typename Receiver>
+struct ForkSpaceOperation : private Context {
+	ForkSpaceOperation(BorrowedDescriptor space, std::span<const HelForkArea> areas,
+			uint32_t flags, Receiver r)
+	: space_{std::move(space)}, areas_{areas}, flags_{flags}, r_{std::move(r)} {}
+
+	void start() {
+		HelSqForkSpace header;
+		header.space = space_.getHandle();
+		header.flags = flags_;
+		header.count = areas_.size();
+
+		std::array segments{
+			std::as_bytes(std::span{&header, 1}),
+			std::as_bytes(areas_)
+		};
+
+		auto context = static_cast<Context *>(this);
+		Dispatcher::global().pushSq(kHelSubmitForkSpace,
+				reinterpret_cast<uintptr_t>(context), segments);
+	}
+
+	ForkSpaceOperation(const ForkSpaceOperation &) = delete;
+	ForkSpaceOperation &operator= (const ForkSpaceOperation &) = delete;
+
+private:
+	void complete(ElementHandle element) override {
+		ForkSpaceResult result{areas_.size()};
+		void *ptr = element.data();
+		result.parse(ptr, element);
+		async::execution::set_value(r_, std::move(result));
+	}
+
+	BorrowedDescriptor space_;
+	std::span<const HelForkArea> areas_;
+	uint32_t flags_;
+	Receiver r_;
+};
+
+struct [[nodiscard]] ForkSpaceSender {
+	using value_type = ForkSpaceResult;
+
+	ForkSpaceSender(BorrowedDescriptor space, std::span<const HelForkArea> areas, uint32_t flags)
+	: space_{std::move(space)}, areas_{areas}, flags_{flags} { }
+
+	template<typename Receiver>
+	ForkSpaceOperation<Receiver> connect(Receiver receiver) {
+		return {std::move(space_), areas_, flags_, std::move(receiver)};
+	}
+
+private:
+	BorrowedDescriptor space_;
+	std::span<const HelForkArea> areas_;
+	uint32_t flags_;
+};
+
+inline async::sender_awaiter<ForkSpaceSender, ForkSpaceResult>
+operator co_await (ForkSpaceSender sender) {
+	return {std::move(sender)};
+}
+
+// The areas must stay alive until the operation completes.
+inline auto forkSpace(BorrowedDescriptor space, std::span<const HelForkArea> areas,
+		uint32_t flags = 0) {
+	return ForkSpaceSender{std::move(space), areas, flags};
+}
+
 } // namespace helix_ng
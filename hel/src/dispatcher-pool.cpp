@@ -0,0 +1,27 @@
+#include <latch>
+
+#include <helix/dispatcher-pool.hpp>
+
+namespace helix {
+
+DispatcherPool::DispatcherPool(unsigned int numThreads)
+: _dispatchers(numThreads ? numThreads : 1, nullptr) {
+	std::latch ready{static_cast<ptrdiff_t>(_dispatchers.size())};
+
+	for(size_t i = 0; i < _dispatchers.size(); ++i) {
+		std::thread thread{[this, i, &ready] {
+			// Dispatchers are thread-local; they must be set up before other threads post to them.
+			auto &dispatcher = Dispatcher::global();
+			dispatcher.acquire();
+			_dispatchers[i] = &dispatcher;
+			ready.count_down();
+
+			async::run_forever(currentDispatcher);
+		}};
+		thread.detach();
+	}
+
+	ready.wait();
+}
+
+} // namespace helix
@@ -31,16 +31,22 @@ uintptr_t mmapEnd = 0;
 
 eir::Mb2Tag *acpiTag = nullptr;
 
+// The MB2 info structure is not reserved, hence we copy the RSDP into Eir's image.
+// This does not require allocation, such that ACPI tables are available before
+// the memory regions are finalized (e.g., to split them at NUMA node boundaries).
+alignas(8) constinit uint8_t rsdpCopy[64]{};
+
 initgraph::Task setupAcpiInfo{
     &globalInitEngine,
     "mb2.setup-acpi-info",
-    initgraph::Requires{getAllocationAvailableStage()},
     initgraph::Entails{getKernelLoadableStage(), acpi::getRsdpAvailableStage()},
     [] {
 	    if (acpiTag) {
-		    auto *rsdpPtr = bootAlloc<uint8_t>(acpiTag->size - sizeof(Mb2TagRSDP));
-		    memcpy(rsdpPtr, acpiTag->data, acpiTag->size - sizeof(Mb2TagRSDP));
-		    eirRsdpAddr = reinterpret_cast<uint64_t>(rsdpPtr);
+		    auto size = acpiTag->size - sizeof(Mb2TagRSDP);
+		    if (size > sizeof(rsdpCopy))
+			    panicLogger() << "eir: RSDP in MB2 tag is too large" << frg::endlog;
+		    memcpy(rsdpCopy, acpiTag->data, size);
+		    eirRsdpAddr = reinterpret_cast<uint64_t>(rsdpCopy);
 	    }
     }
 };
@@ -34,6 +34,9 @@ struct Region {
 	address_t buddyTree;
 	address_t buddyOverhead;
 	address_t buddyMap;
+
+	// NUMA node (i.e., ACPI proximity domain) that contains the region.
+	uint32_t numaNode;
 };
 
 extern Region regions[eirMaxMemoryRegions];
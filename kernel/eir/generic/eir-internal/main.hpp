@@ -33,8 +33,13 @@ initgraph::Stage *getReservedRegionsKnownStage();
 // Before this stage, all memory regions must be available.
 initgraph::Stage *getMemoryRegionsKnownStage();
 
+// Before this stage, memory regions may be split (e.g., at NUMA node boundaries).
+// Ordered after getMemoryRegionsKnownStage().
+initgraph::Stage *getMemoryRegionsSplitStage();
+
 // After this stage, physical memory can be allocated.
-// Ordered after getReservedRegionsKnownStage() and getMemoryRegionsKnownStage().
+// Ordered after getReservedRegionsKnownStage(), getMemoryRegionsKnownStage()
+// and getMemoryRegionsSplitStage().
 initgraph::Stage *getAllocationAvailableStage();
 
 // After this stage, memory can be mapped into Thor's address space.
@@ -41,6 +41,11 @@ initgraph::Stage *getMemoryRegionsKnownStage() {
 	return &s;
 }
 
+initgraph::Stage *getMemoryRegionsSplitStage() {
+	static initgraph::Stage s{&globalInitEngine, "generic.memory-regions-split"};
+	return &s;
+}
+
 initgraph::Stage *getInitrdAvailableStage() {
 	static initgraph::Stage s{&globalInitEngine, "generic.initrd-available"};
 	return &s;
@@ -86,7 +91,7 @@ static initgraph::Task parseInitrdInfo{
 static initgraph::Task setupRegions{
     &globalInitEngine,
     "generic.setup-regions",
-    initgraph::Requires{getMemoryRegionsKnownStage()},
+    initgraph::Requires{getMemoryRegionsKnownStage(), getMemoryRegionsSplitStage()},
     initgraph::Entails{getAllocationAvailableStage()},
     [] {
 	    setupRegionStructs();
@@ -140,6 +145,7 @@ static initgraph::Task mapRegions{
 		    regionInfos[j].order = regions[i].order;
 		    regionInfos[j].numRoots = regions[i].numRoots;
 		    regionInfos[j].buddyTree = regions[i].buddyMap;
+		    regionInfos[j].numaNode = regions[i].numaNode;
 		    j++;
 	    }
 	    physicalMemoryNote.numRegions = n;
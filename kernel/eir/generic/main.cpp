@@ -111,6 +111,7 @@ void createInitialRegion(address_t base, address_t size) {
 	region->regionType = RegionType::allocatable;
 	region->address = address;
 	region->size = limit - address;
+	region->numaNode = 0;
 }
 
 void createInitialRegions(InitialRegion region, frg::span<InitialRegion> reserved) {
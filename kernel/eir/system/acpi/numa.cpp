@@ -0,0 +1,116 @@
+#include <eir-internal/acpi/acpi.hpp>
+#include <eir-internal/debug.hpp>
+#include <eir-internal/generic.hpp>
+#include <eir-internal/main.hpp>
+#include <frg/scope_exit.hpp>
+#include <uacpi/acpi.h>
+#include <uacpi/tables.h>
+
+namespace eir::acpi {
+
+namespace {
+
+// SRAT memory affinity structure (type 1).
+struct [[gnu::packed]] SratMemoryEntry {
+	uint8_t type;
+	uint8_t length;
+	uint32_t proximityDomain;
+	uint16_t reserved0;
+	uint64_t base;
+	uint64_t length64;
+	uint32_t reserved1;
+	uint32_t flags;
+	uint64_t reserved2;
+};
+
+constexpr uint8_t sratMemoryType = 1;
+constexpr uint32_t sratMemoryEnabled = 1;
+
+// Size of the SRAT header (including the reserved fields after the SDT header).
+constexpr size_t sratHeaderSize = sizeof(acpi_sdt_hdr) + 12;
+
+// Calls fn for each enabled SRAT memory affinity structure.
+template <typename F>
+void forEachSratMemoryEntry(uacpi_table &sratTbl, F fn) {
+	auto *srat = sratTbl.hdr;
+
+	size_t offset = sratHeaderSize;
+	while (offset + 2 <= srat->length) {
+		acpi_entry_hdr generic;
+		auto genericPtr = reinterpret_cast<void *>(sratTbl.virt_addr + offset);
+		memcpy(&generic, genericPtr, sizeof(generic));
+		if (generic.length < sizeof(generic) || offset + generic.length > srat->length)
+			break;
+
+		if (generic.type == sratMemoryType && generic.length >= sizeof(SratMemoryEntry)) {
+			SratMemoryEntry entry;
+			memcpy(&entry, genericPtr, sizeof(entry));
+			if (entry.flags & sratMemoryEnabled)
+				fn(entry);
+		}
+		offset += generic.length;
+	}
+}
+
+// Splits each allocatable region that contains the given address such that
+// the address becomes a region boundary.
+void splitRegionsAt(address_t boundary) {
+	for (size_t i = 0; i < eirMaxMemoryRegions; ++i) {
+		if (regions[i].regionType != RegionType::allocatable)
+			continue;
+		auto base = regions[i].address;
+		auto limit = regions[i].address + regions[i].size;
+		if (boundary <= base || boundary >= limit)
+			continue;
+
+		// createInitialRegion() re-applies alignment and minimum size constraints
+		// (and may reuse slot i, which does not matter since we are done with it).
+		regions[i].regionType = RegionType::null;
+		createInitialRegion(base, boundary - base);
+		createInitialRegion(boundary, limit - boundary);
+	}
+}
+
+// Splits the memory regions at the boundaries of the SRAT memory affinity structures
+// (before the buddy allocators are set up), such that each region belongs to a single
+// NUMA node. Afterwards, tags each region with its proximity domain.
+initgraph::Task assignNumaNodes{
+    &globalInitEngine,
+    "acpi.assign-numa-nodes",
+    initgraph::Requires{getTablesAvailableStage(), getMemoryRegionsKnownStage()},
+    initgraph::Entails{getMemoryRegionsSplitStage()},
+    [] {
+	    if (!haveTables())
+		    return;
+
+	    uacpi_table sratTbl;
+	    if (uacpi_table_find_by_signature("SRAT", &sratTbl) != UACPI_STATUS_OK) {
+		    infoLogger() << "eir: No SRAT found" << frg::endlog;
+		    return;
+	    }
+	    frg::scope_exit finish{[&] { uacpi_table_unref(&sratTbl); }};
+
+	    forEachSratMemoryEntry(sratTbl, [](const SratMemoryEntry &entry) {
+		    splitRegionsAt(entry.base);
+		    splitRegionsAt(entry.base + entry.length64);
+	    });
+
+	    forEachSratMemoryEntry(sratTbl, [](const SratMemoryEntry &entry) {
+		    for (size_t i = 0; i < eirMaxMemoryRegions; ++i) {
+			    if (regions[i].regionType != RegionType::allocatable)
+				    continue;
+			    if (regions[i].address < entry.base
+			        || regions[i].address - entry.base >= entry.length64)
+				    continue;
+			    regions[i].numaNode = entry.proximityDomain;
+			    infoLogger() << "eir: Memory region at 0x" << frg::hex_fmt{regions[i].address}
+			                 << " is in proximity domain " << entry.proximityDomain
+			                 << frg::endlog;
+		    }
+	    });
+    }
+};
+
+} // namespace
+
+} // namespace eir::acpi
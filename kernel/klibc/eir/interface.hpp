@@ -19,6 +19,7 @@ struct EirRegion {
 	EirSize order; // TODO: This could be an int.
 	EirSize numRoots;
 	EirPtr buddyTree;
+	EirSize numaNode;
 };
 
 struct EirFramebuffer {
@@ -189,11 +189,7 @@ void handleGicIrq(IrqImageAccessor image, ClaimedExternalIrq irq) {
 			assert(!irqMutex().nesting());
 			disableUserAccess();
 
-			for (auto &binding : asidData.get()->bindings) {
-				binding.shootdown();
-			}
-
-			asidData.get()->globalBinding.shootdown();
+			handleShootdownIpi();
 		} else if (irq.irq == 2) {
 			assert(!irqMutex().nesting());
 			disableUserAccess();
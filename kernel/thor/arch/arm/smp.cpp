@@ -514,16 +514,20 @@ static initgraph::Task initAPs{&globalInitEngine, "arm.init-aps",
 		size_t apCpuIndex = 1;
 		auto bootApFromDt = [&](DeviceTreeNode *node) {
 			auto affinity = node->reg()[0].addr;
-			if (affinity == bspAffinity)
+			if (affinity == bspAffinity) {
+				discoverCpuTopologyFromDt(getCpuData(), node);
 				return;
+			}
 
 			if (static_cast<uint64_t>(apCpuIndex) >= cpuConfigNote->totalCpus) {
 				panicLogger() << "thor: CPU index " << apCpuIndex
 						<< " exceeds expected number of CPUs " << cpuConfigNote->totalCpus
 						<< frg::endlog;
 			}
-			if (apCpuIndex < cpuConfigNote->effectiveCpus)
+			if (apCpuIndex < cpuConfigNote->effectiveCpus) {
+				discoverCpuTopologyFromDt(getCpuData(apCpuIndex), node);
 				bootSecondaryFromDt(node, apCpuIndex);
+			}
 			++apCpuIndex;
 		};
 		if (auto it = root->children().find("cpus"); it != root->children().end()) {
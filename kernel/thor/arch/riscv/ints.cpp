@@ -45,6 +45,14 @@ void sendShootdownIpi() {
 	}
 }
 
+void sendShootdownIpi(CpuData *dstData) {
+	if (!dstData->cpuInitialized.load(std::memory_order_acquire))
+		return;
+
+	if (raiseIpiBit(dstData, PlatformCpuData::ipiShootdown))
+		doSendIpi(dstData);
+}
+
 void sendSelfCallIpi() {
 	auto *selfData = getCpuData();
 	if (raiseIpiBit(selfData, PlatformCpuData::ipiSelfCall))
@@ -203,8 +203,10 @@ initgraph::Task initAPs{
 		    if (reg.size() != 1)
 			    panicLogger() << "thor: Expect exactly one 'reg' entry for RISC-V CPUs"
 			                  << frg::endlog;
-		    if (reg.front().addr == bspHartId)
+		    if (reg.front().addr == bspHartId) {
+			    discoverCpuTopologyFromDt(getCpuData(), node);
 			    return;
+		    }
 
 		    if (static_cast<uint64_t>(apCpuIndex) >= cpuConfigNote->totalCpus) {
 			    panicLogger() << "thor: CPU index " << apCpuIndex
@@ -212,8 +214,10 @@ initgraph::Task initAPs{
 			                  << frg::endlog;
 		    }
 
-		    if (apCpuIndex < cpuConfigNote->effectiveCpus)
+		    if (apCpuIndex < cpuConfigNote->effectiveCpus) {
+			    discoverCpuTopologyFromDt(getCpuData(apCpuIndex), node);
 			    bootAp(reg.front().addr, apCpuIndex);
+		    }
 		    ++apCpuIndex;
 	    };
 
@@ -1,3 +1,4 @@
+#include <thor-internal/acpi/acpi.hpp>
 #include <thor-internal/arch/hpet.hpp>
 #include <thor-internal/arch/vmx.hpp>
 #include <thor-internal/arch/svm.hpp>
@@ -578,6 +579,98 @@ void setupBootCpuContext() {
 
 }
 
+namespace {
+
+// Returns the number of bits that are needed to distinguish n IDs.
+unsigned int idBits(uint32_t n) {
+	unsigned int bits = 0;
+	while(bits < 32 && (uint32_t(1) << bits) < n)
+		bits++;
+	return bits;
+}
+
+// Number of low APIC ID bits that select a CPU within a core, LLC and package.
+struct ApicIdLayout {
+	unsigned int smtShift{0};
+	unsigned int llcShift{0};
+	unsigned int packageShift{0};
+};
+
+// We assume that all CPUs share the layout of the BSP.
+// This allows us to place APs before they are booted.
+ApicIdLayout decodeApicIdLayout() {
+	ApicIdLayout layout;
+	auto maxLeaf = common::x86::cpuid(0)[0];
+	auto maxExtendedLeaf = common::x86::cpuid(0x8000'0000)[0];
+
+	if(maxLeaf >= 0xB && common::x86::cpuid(0xB, 0)[1]) {
+		// Extended topology enumeration. Level type 1 is SMT, level type 2 is core.
+		for(uint32_t level = 0; level < 8; level++) {
+			auto leaf = common::x86::cpuid(0xB, level);
+			auto type = (leaf[2] >> 8) & 0xFF;
+			if(!type)
+				break;
+			auto shift = leaf[0] & 0x1F;
+			if(type == 1)
+				layout.smtShift = shift;
+			layout.packageShift = shift;
+		}
+	}else if(common::x86::cpuid(0x01)[3] & (uint32_t(1) << 28)) {
+		// Legacy HTT: EBX[23:16] is the number of logical CPUs per package.
+		layout.packageShift = idBits((common::x86::cpuid(0x01)[1] >> 16) & 0xFF);
+	}
+
+	// Deterministic cache parameters: AMD's leaf 0x8000001D (if TOPOEXT is supported)
+	// has the same format as Intel's leaf 4. EAX[25:14] + 1 is the number of
+	// logical CPUs that share the cache.
+	uint32_t cacheLeaf = 0;
+	if(maxExtendedLeaf >= 0x8000'001D
+			&& (common::x86::cpuid(0x8000'0001)[2] & (uint32_t(1) << 22))) {
+		cacheLeaf = 0x8000'001D;
+	}else if(maxLeaf >= 4) {
+		cacheLeaf = 4;
+	}
+
+	layout.llcShift = layout.packageShift;
+	if(cacheLeaf) {
+		unsigned int llcLevel = 0;
+		for(uint32_t i = 0; i < 16; i++) {
+			auto leaf = common::x86::cpuid(cacheLeaf, i);
+			if(!(leaf[0] & 0x1F))
+				break;
+			auto level = (leaf[0] >> 5) & 0x7;
+			if(level > llcLevel) {
+				llcLevel = level;
+				layout.llcShift = idBits(((leaf[0] >> 14) & 0xFFF) + 1);
+			}
+		}
+	}
+
+	return layout;
+}
+
+// Fills in the topology of a CPU whose localApicId is already known.
+// Runs on the BSP (also for APs) since the SRAT is only accessed from the BSP.
+void discoverCpuTopology(CpuData *context) {
+	auto layout = decodeApicIdLayout();
+	uint32_t apicId = context->localApicId;
+
+	context->topology.core = apicId >> layout.smtShift;
+	context->topology.llc = apicId >> layout.llcShift;
+	// Without an SRAT, we treat the system as a single NUMA node.
+	context->topology.numaNode = 0;
+	if(auto domain = acpi::getApicProximityDomain(apicId); domain)
+		context->topology.numaNode = *domain;
+	context->topology.valid = true;
+
+	debugLogger() << "thor: CPU #" << context->cpuIndex << " (APIC " << apicId
+			<< ") is on core " << context->topology.core
+			<< ", LLC " << context->topology.llc
+			<< ", NUMA node " << context->topology.numaNode << frg::endlog;
+}
+
+} // namespace
+
 static initgraph::Task initBootProcessorTask{&globalInitEngine, "x86.init-boot-processor",
 	initgraph::Requires{getCpuFeaturesKnownStage(),
 		getApicDiscoveryStage(),
@@ -590,6 +683,7 @@ static initgraph::Task initBootProcessorTask{&globalInitEngine, "x86.init-boot-p
 		cpuData.get().localApicId = getLocalApicId();
 		debugLogger() << "Booting on CPU #" << cpuData.get().localApicId
 				<< frg::endlog;
+		discoverCpuTopology(&cpuData.get());
 
 		initializeThisProcessor();
 	}
@@ -852,6 +946,7 @@ void bootSecondary(unsigned int apic_id, size_t cpuIndex) {
 
 	auto *context = getCpuData(cpuIndex);
 	context->localApicId = apic_id;
+	discoverCpuTopology(context);
 
 	// Participate in global TLB invalidation *before* paging is used by the target CPU.
 	initializeAsidContext(context);
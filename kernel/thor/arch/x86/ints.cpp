@@ -2,6 +2,7 @@
 #include <thor-internal/cpu-data.hpp>
 #include <thor-internal/int-call.hpp>
 #include <thor-internal/ipl.hpp>
+#include <thor-internal/physical.hpp>
 #include <thor-internal/profile.hpp>
 #include <thor-internal/thread.hpp>
 #include <thor-internal/traps.hpp>
@@ -445,7 +446,15 @@ extern "C" void onPlatformIrq(IrqImageAccessor image, int number) {
 	assert(!irqMutex().nesting());
 	disableUserAccess();
 
-	handleIrq(image, globalIrqSlots[number].pin());
+	auto pin = localIrqSlot(number).pin();
+	if(!pin) {
+		// No IrqPin is linked to this vector on this CPU.
+		infoLogger() << "thor: Spurious IRQ on vector " << (64 + number)
+				<< " of CPU #" << getCpuData()->cpuIndex << frg::endlog;
+		acknowledgeIrq(0);
+	}else{
+		handleIrq(image, pin);
+	}
 
 	if (image.inUserMode()) {
 		auto thisThread = getCurrentThread();
@@ -591,10 +600,7 @@ extern "C" void onPlatformShootdown(IrqImageAccessor image) {
 	assert(!irqMutex().nesting());
 	disableUserAccess();
 
-	for(auto &binding : asidData.get()->bindings)
-		binding.shootdown();
-
-	asidData.get()->globalBinding.shootdown();
+	handleShootdownIpi();
 
 	acknowledgeIpi();
 
@@ -701,6 +707,64 @@ extern "C" void onPlatformCall(IrqImageAccessor image) {
 }
 
 namespace {
+	// Reads a word of user memory by walking the active page tables.
+	// In contrast to regular user accesses, this never faults and can thus be used in NMI context.
+	// Pages (and page tables) are only freed after all CPUs acknowledged the corresponding
+	// shootdown, hence they remain valid while we access them here.
+	// User PTEs can also point to MMIO (e.g., for drivers); reading such memory may have
+	// side effects or fault, hence we only dereference frames that are managed RAM.
+	bool peekUserWord(uintptr_t address, uintptr_t &value) {
+		if (inHigherHalf(address) || (address & (sizeof(uintptr_t) - 1)))
+			return false;
+
+		uint64_t cr3;
+		asm volatile ("mov %%cr3, %0" : "=r"(cr3));
+
+		PhysicalAddr physical = cr3 & pteAddress;
+		for (int level = 3; level >= 0; --level) {
+			if (!physicalAllocator->isManaged(physical))
+				return false;
+			PageAccessor accessor{physical};
+			auto pte = __atomic_load_n(reinterpret_cast<uint64_t *>(accessor.get())
+					+ ((address >> (12 + 9 * level)) & 0x1FF), __ATOMIC_RELAXED);
+			if (!(pte & ptePresent) || !(pte & pteUser))
+				return false;
+
+			if (level && (pte & pteHuge)) {
+				// We do not use 1 GiB pages for user memory.
+				if (level != 1)
+					return false;
+				physical = (pte & pteHugeAddress) + (address & (kHugePageSize - 1) & ~(kPageSize - 1));
+				break;
+			}
+			physical = pte & pteAddress;
+		}
+
+		if (!physicalAllocator->isManaged(physical))
+			return false;
+		PageAccessor accessor{physical};
+		memcpy(&value, reinterpret_cast<char *>(accessor.get()) + (address & (kPageSize - 1)),
+				sizeof(uintptr_t));
+		return true;
+	}
+
+	// Walks a user stack that uses frame pointers.
+	// The functor returns false to stop the walk.
+	template <typename F>
+	void walkUserStack(uintptr_t bp, F functor) {
+		while (bp) {
+			uintptr_t next, ip;
+			if (!peekUserWord(bp, next) || !peekUserWord(bp + sizeof(uintptr_t), ip))
+				return;
+			if (!ip || !functor(ip))
+				return;
+			// Frames of callers are at higher addresses. This also ensures termination.
+			if (next <= bp)
+				return;
+			bp = next;
+		}
+	}
+
 	void interruptIseq(IseqContext *iseq, NmiImageAccessor image) {
 		if (!(iseq->state & IseqContext::STATE_TX)) [[likely]]
 			return;
@@ -737,26 +801,49 @@ extern "C" void onPlatformNmi(NmiImageAccessor image, uint64_t expectedGs) {
 
 	// Each sample is an array of uintptr_t.
 	// Element 0 stores the number of entries and flags.
-	// Elements >0 store the stack trace IPs.
+	// For user samples, elements 1 to 3 store the ID of the address space
+	// and the credentials of the thread.
+	// The remaining elements store the stack trace IPs.
 	auto emitProfileSample = [&] {
 		constexpr size_t maxDepth = 15;
-		uintptr_t buffer[maxDepth + 1];
+		constexpr size_t maxUserDepth = 31;
+		uintptr_t buffer[maxProfileSampleWords];
+		static_assert(1 + 3 + maxUserDepth <= maxProfileSampleWords);
 		size_t n = 0;
-		buffer[1 + n++] = *image.ip();
-#ifdef THOR_HAS_FRAME_POINTERS
-		// We can (obviously) only backtrace in the higher half.
-		// Also, we cannot backtrace if we did not make it out of the entry stubs yet
-		// since the entry stubs may still run with userspace RBP.
-		if (inHigherHalf(*image.ip()) && !inStub(*image.ip())) {
-			walkStack(reinterpret_cast<void *>(*image.bp()), [&] (uintptr_t ip) {
-				if(n < maxDepth)
-					buffer[1 + n++] = ip;
-			});
-		}
-#endif
 		uint32_t flags{0};
 		if (!(*image.rflags() & 0x200))
 			flags |= 1;
+		if (image.inUserMode()) {
+			auto thread = cpuData->activeThread;
+			auto credentials = thread->credentials();
+			buffer[1 + n++] = thread->getAddressSpace()->spaceId();
+			memcpy(&buffer[1 + n++], credentials.data(), sizeof(uintptr_t));
+			memcpy(&buffer[1 + n++], credentials.data() + 8, sizeof(uintptr_t));
+			flags |= 2;
+
+			buffer[1 + n++] = *image.ip();
+			if (*image.cs() == kSelUserCode) {
+				walkUserStack(*image.bp(), [&] (uintptr_t ip) -> bool {
+					if(n >= 3 + maxUserDepth)
+						return false;
+					buffer[1 + n++] = ip;
+					return true;
+				});
+			}
+		} else {
+			buffer[1 + n++] = *image.ip();
+#ifdef THOR_HAS_FRAME_POINTERS
+			// We can (obviously) only backtrace in the higher half.
+			// Also, we cannot backtrace if we did not make it out of the entry stubs yet
+			// since the entry stubs may still run with userspace RBP.
+			if (inHigherHalf(*image.ip()) && !inStub(*image.ip())) {
+				walkStack(reinterpret_cast<void *>(*image.bp()), [&] (uintptr_t ip) {
+					if(n < maxDepth)
+						buffer[1 + n++] = ip;
+				});
+			}
+#endif
+		}
 		buffer[0] = n | (static_cast<uint64_t>(flags) << 32);
 		cpuData->localProfileRing->enqueue(buffer, (1 + n) * sizeof(uintptr_t));
 	};
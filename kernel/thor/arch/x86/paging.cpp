@@ -168,7 +168,8 @@ ClientPageSpace::~ClientPageSpace() {
 		PageAccessor accessor{ps};
 		auto tbl = reinterpret_cast<uint64_t *>(accessor.get());
 		for(int i = 0; i < 512; i++) {
-			if(tbl[i] & ptePresent)
+			// Huge page leaves do not own any page table.
+			if((tbl[i] & ptePresent) && !(tbl[i] & pteHuge))
 				physicalAllocator->free(tbl[i] & pteAddress, kPageSize);
 		}
 	};
@@ -111,13 +111,24 @@ uint64_t getRawTimestampCounter() {
 // IrqSlot
 // --------------------------------------------------------
 
-constinit IrqSlot globalIrqSlots[numIrqSlots];
+struct IrqSlotTable {
+	IrqSlot slots[numIrqSlots];
+	// Protected by irqAllocationLock.
+	bool allocated[numIrqSlots]{};
+};
+
+extern PerCpu<IrqSlotTable> irqSlotTables;
+THOR_DEFINE_PERCPU(irqSlotTables);
 
 void IrqSlot::link(IrqPin *pin) {
 	assert(!_pin.load(std::memory_order_relaxed));
 	_pin.store(pin, std::memory_order_release);
 }
 
+IrqSlot &localIrqSlot(int index) {
+	return irqSlotTables.get().slots[index];
+}
+
 // --------------------------------------------------------
 // Local APIC timer
 // --------------------------------------------------------
@@ -402,6 +413,21 @@ void sendShootdownIpi() {
 	}
 }
 
+void sendShootdownIpi(CpuData *dstData) {
+	auto apic = dstData->localApicId;
+	if(picBase.isUsingX2apic()) {
+		picBase.store(lX2ApicIcr, x2apicIcrLowVector(0xF0) | x2apicIcrLowDelivMode(0)
+				| x2apicIcrLowLevel(true) | x2apicIcrLowShorthand(0) | x2apicIcrHighDestField(apic));
+	} else {
+		picBase.store(lApicIcrHigh, apicIcrHighDestField(apic));
+		picBase.store(lApicIcrLow, apicIcrLowVector(0xF0) | apicIcrLowDelivMode(0)
+				| apicIcrLowLevel(true) | apicIcrLowShorthand(0));
+		while(picBase.load(lApicIcrLow) & apicIcrLowDelivStatus) {
+			// Wait for IPI delivery.
+		}
+	}
+}
+
 void sendPingIpi(CpuData *dstData) {
 	auto apic = dstData->localApicId;
 //	infoLogger() << "thor [CPU" << getLocalApicId() << "]: Sending ping" << frg::endlog;
@@ -455,15 +481,16 @@ void sendGlobalNmi() {
 
 namespace {
 	IrqSpinlock irqAllocationLock;
-	static bool irqSlotAllocated[numIrqSlots]{};
 
-	std::optional<int> allocateIrqSlot() {
+	// Allocates a slot in the interrupt table of the given CPU.
+	std::optional<int> allocateIrqSlot(size_t cpu) {
+		auto &table = irqSlotTables.getFor(cpu);
 		auto guard = frg::guard(&irqAllocationLock);
 
 		for(int i = 0; i < numIrqSlots; i++) {
-			if(irqSlotAllocated[i])
+			if(table.allocated[i])
 				continue;
-			irqSlotAllocated[i] = true;
+			table.allocated[i] = true;
 			return i;
 		}
 
@@ -471,8 +498,8 @@ namespace {
 	}
 
 	struct ApicMsiPin final : MsiPin {
-		ApicMsiPin(frg::string<KernelAlloc> name, unsigned int vector)
-		: MsiPin{std::move(name)}, vector_{vector} { }
+		ApicMsiPin(frg::string<KernelAlloc> name, unsigned int apicId, unsigned int vector)
+		: MsiPin{std::move(name)}, apicId_{apicId}, vector_{vector} { }
 
 		IrqStrategy program(TriggerMode mode, Polarity) override {
 			assert(mode == TriggerMode::edge);
@@ -492,7 +519,8 @@ namespace {
 		}
 
 		uint64_t getMessageAddress() override {
-			return 0xFEE00000;
+			// Physical destination mode; the destination APIC ID is in bits 12 to 19.
+			return 0xFEE00000 | (apicId_ << 12);
 		}
 
 		uint32_t getMessageData() override {
@@ -500,26 +528,35 @@ namespace {
 		}
 
 	private:
+		unsigned int apicId_;
 		unsigned int vector_;
 	};
 }
 
-smarter::shared_ptr<MsiPin> allocateApicMsi(frg::string<KernelAlloc> name) {
-	auto maybeSlotIndex = allocateIrqSlot();
+smarter::shared_ptr<MsiPin> allocateApicMsi(frg::string<KernelAlloc> name, size_t cpu) {
+	// Without interrupt remapping, MSIs can only target the first 256 APIC IDs.
+	if(cpu >= getCpuCount() || getCpuData(cpu)->localApicId > 0xFF) {
+		infoLogger() << "thor: Cannot deliver MSI " << name
+				<< " to CPU #" << cpu << ", using CPU #0" << frg::endlog;
+		cpu = 0;
+	}
+
+	auto maybeSlotIndex = allocateIrqSlot(cpu);
 	if (!maybeSlotIndex)
 		return nullptr;
 	auto slotIndex = *maybeSlotIndex;
 
 	// Create an IRQ pin for the MSI.
-	auto pin = createIrqPin<ApicMsiPin>(std::move(name), 64 + slotIndex);
+	auto pin = createIrqPin<ApicMsiPin>(std::move(name),
+			getCpuData(cpu)->localApicId, 64 + slotIndex);
 	pin->configure(IrqConfiguration{
 		.trigger = TriggerMode::edge,
 		.polarity = Polarity::high
 	});
 
 	infoLogger() << "thor: Allocating IRQ slot " << slotIndex
-			<< " to " << pin->name() << frg::endlog;
-	globalIrqSlots[slotIndex].link(pin.get());
+			<< " of CPU #" << cpu << " to " << pin->name() << frg::endlog;
+	irqSlotTables.getFor(cpu).slots[slotIndex].link(pin.get());
 
 	// Leak a reference until IrqPin teardown exists;
 	// otherwise the slot dangles once the last sink goes away.
@@ -670,13 +707,14 @@ namespace {
 		}
 
 		// Allocate an IRQ vector for the I/O APIC pin.
+		// I/O APIC pins are always delivered to the BSP (see the destination below).
 		if(_vector == -1) {
-			auto maybeSlotIndex = allocateIrqSlot();
+			auto maybeSlotIndex = allocateIrqSlot(0);
 			if (!maybeSlotIndex)
 				panicLogger() << "thor: Could not allocate interrupt vector for "
 						<< name() << frg::endlog;
 			auto slotIndex = *maybeSlotIndex;
-			globalIrqSlots[slotIndex].link(this);
+			irqSlotTables.getFor(0).slots[slotIndex].link(this);
 			_vector = 64 + slotIndex;
 		}
 
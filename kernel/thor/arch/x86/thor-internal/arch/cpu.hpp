@@ -224,6 +224,15 @@ struct NmiImageAccessor {
 	Word *rflags() { return &_frame()->rflags; }
 	Word *bp() { return &_frame()->rbp; }
 
+	bool inUserMode() {
+		if(*cs() == kSelUserCompat
+				|| *cs() == kSelUserCode) {
+			return true;
+		}else{
+			return false;
+		}
+	}
+
 	IplState *iplState() { return &_frame()->iplState; }
 
 private:
@@ -23,10 +23,14 @@ constexpr uint64_t ptePcd = 0x10;
 constexpr uint64_t pteAccessed = 0x20;
 constexpr uint64_t pteDirty = 0x40;
 constexpr uint64_t ptePat = 0x80;
+// In second to last level entries, bit 7 marks huge pages and PAT moves to bit 12.
+constexpr uint64_t pteHuge = 0x80;
+constexpr uint64_t ptePatHuge = 0x1000;
 constexpr uint64_t pteGlobal = 0x100;
 constexpr uint64_t pteAgeMask = UINT64_C(3) << pteAgeShift;
 constexpr uint64_t pteXd = 0x8000000000000000;
 constexpr uint64_t pteAddress = 0x000F'FFFF'FFFF'F000;
+constexpr uint64_t pteHugeAddress = 0x000F'FFFF'FFE0'0000;
 
 inline int getLowerHalfBits() {
 	return 47;
@@ -134,7 +138,7 @@ struct X86CursorPolicy {
 
 
 	static constexpr bool pteTablePresent(uint64_t pte) {
-		return pte & ptePresent;
+		return (pte & ptePresent) && !(pte & pteHuge);
 	}
 
 	static constexpr PhysicalAddr pteTableAddress(uint64_t pte) {
@@ -150,6 +154,32 @@ struct X86CursorPolicy {
 
 		return newPtAddr | ptePresent | pteWrite | pteUser;
 	}
+
+	// Huge pages are only supported in client page spaces.
+
+	static constexpr bool pteIsHuge(uint64_t pte) requires (!Kernel) {
+		return pte & pteHuge;
+	}
+
+	static constexpr PhysicalAddr pteHugeAddress(uint64_t pte) requires (!Kernel) {
+		return pte & thor::pteHugeAddress;
+	}
+
+	static constexpr uint64_t pteBuildHuge(PhysicalAddr physical, PageFlags flags,
+			CachingMode cachingMode) requires (!Kernel) {
+		assert(!(physical & (kHugePageSize - 1)));
+		auto pte = pteBuild(physical, flags, cachingMode);
+		if(pte & ptePat)
+			pte = (pte & ~ptePat) | ptePatHuge;
+		return pte | pteHuge;
+	}
+
+	static constexpr uint64_t pteSplitHuge(uint64_t pte, size_t index) requires (!Kernel) {
+		auto flags = pte & ~(thor::pteHugeAddress | pteHuge | ptePatHuge);
+		if(pte & ptePatHuge)
+			flags |= ptePat;
+		return flags | ((pte & thor::pteHugeAddress) + (index << kPageShift));
+	}
 };
 
 using KernelCursorPolicy = X86CursorPolicy<true>;
@@ -157,6 +187,7 @@ static_assert(CursorPolicy<KernelCursorPolicy>);
 
 using ClientCursorPolicy = X86CursorPolicy<false>;
 static_assert(CursorPolicy<ClientCursorPolicy>);
+static_assert(HugeCursorPolicy<ClientCursorPolicy>);
 
 
 struct KernelPageSpace : PageSpace {
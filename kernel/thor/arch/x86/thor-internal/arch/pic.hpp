@@ -19,7 +19,7 @@ namespace thor {
 static inline constexpr int numIrqSlots = 64;
 
 // Represents a slot in the CPU's interrupt table.
-// Slots might be global or per-CPU.
+// Each CPU has its own set of slots; slot i corresponds to vector 64 + i.
 struct IrqSlot {
 	// Links an IrqPin to this slot.
 	// From now on all IRQ raises will go to this IrqPin.
@@ -33,7 +33,8 @@ private:
 	std::atomic<IrqPin *> _pin{nullptr};
 };
 
-extern IrqSlot globalIrqSlots[numIrqSlots];
+// Returns the slot with the given index on the current CPU.
+IrqSlot &localIrqSlot(int index);
 
 // --------------------------------------------------------
 // Local APIC management
@@ -118,7 +119,8 @@ void sendGlobalNmi();
 // MSI management
 // --------------------------------------------------------
 
-smarter::shared_ptr<MsiPin> allocateApicMsi(frg::string<KernelAlloc> name);
+// Allocates an MSI that is delivered to the given CPU.
+smarter::shared_ptr<MsiPin> allocateApicMsi(frg::string<KernelAlloc> name, size_t cpu = 0);
 
 // --------------------------------------------------------
 // I/O APIC management
@@ -1,16 +1,22 @@
 #include <cstddef>
 #include <type_traits>
+#include <frg/cmdline.hpp>
 #include <frg/container_of.hpp>
 #include <frg/safe_int.hpp>
 #include <thor-internal/address-space.hpp>
 #include <thor-internal/coroutine.hpp>
 #include <thor-internal/physical.hpp>
 #include <thor-internal/fiber.hpp>
+#include <thor-internal/main.hpp>
 #include <thor-internal/timer.hpp>
 #include <thor-internal/types.hpp>
 
 namespace thor {
 
+// Only architectures whose client cursor policy supports huge pages use them by default.
+bool enableHugePages = HugeCursorPolicy<ClientCursorPolicy>;
+constinit HugePageStatistics hugePageStatistics;
+
 namespace {
 	constexpr bool logCleanup = false;
 	constexpr bool logRss = false;
@@ -30,6 +36,61 @@ namespace {
 			pageFlags |= page_access::execute;
 		return pageFlags;
 	}
+
+	// Upper limit for setFaultAroundWindow() (2 MiB).
+	constexpr size_t faultAroundLimit = 512;
+
+	// 64 KiB by default.
+	std::atomic<size_t> faultAroundWindow{16};
+
+	std::atomic<uint64_t> numFaultArounds{0};
+	std::atomic<uint64_t> numFaultAroundPages{0};
+
+	initgraph::Task initHugePages{&globalInitEngine, "generic.init-huge-pages",
+		[] {
+			frg::string_view thpState = "on";
+
+			frg::array args = {
+				frg::option{"thp", frg::as_string_view(thpState)},
+			};
+			frg::parse_arguments(getKernelCmdline(), args);
+
+			if(thpState != "on") {
+				infoLogger() << "thor: Huge pages disabled by command line" << frg::endlog;
+				enableHugePages = false;
+			}
+		}
+	};
+
+	initgraph::Task initFaultAround{&globalInitEngine, "generic.init-fault-around",
+		[] {
+			size_t window = faultAroundWindow.load(std::memory_order_relaxed);
+
+			frg::array args = {
+				frg::option{"faultaround", frg::as_number(window)},
+			};
+			frg::parse_arguments(getKernelCmdline(), args);
+
+			if(!setFaultAroundWindow(window))
+				warningLogger() << "thor: Ignoring invalid fault-around window of "
+						<< window << " pages" << frg::endlog;
+		}
+	};
+}
+
+FaultAroundStatistics getFaultAroundStatistics() {
+	return {
+		.window = faultAroundWindow.load(std::memory_order_relaxed),
+		.numFaults = numFaultArounds.load(std::memory_order_relaxed),
+		.numPages = numFaultAroundPages.load(std::memory_order_relaxed),
+	};
+}
+
+bool setFaultAroundWindow(size_t window) {
+	if(!window || window > faultAroundLimit || (window & (window - 1)))
+		return false;
+	faultAroundWindow.store(window, std::memory_order_relaxed);
+	return true;
 }
 
 // --------------------------------------------------------
@@ -49,6 +110,50 @@ MemorySlice::MemorySlice(CtorToken, smarter::shared_ptr<MemoryView> view,
 	assert(!(_viewSize & (kPageSize - 1)));
 }
 
+// --------------------------------------------------------
+// AddressRangeLock
+// --------------------------------------------------------
+
+coroutine<void> AddressRangeLock::lock(Node *node) {
+	while(true) {
+		{
+			auto irqLock = frg::guard(&irqMutex());
+			auto lock = frg::guard(&mutex_);
+
+			if(!overlaps_(node)) {
+				nodes_.push_back(node);
+				break;
+			}
+		}
+
+		co_await releaseEvent_.async_wait_if([&] () -> bool {
+			auto irqLock = frg::guard(&irqMutex());
+			auto lock = frg::guard(&mutex_);
+
+			return overlaps_(node);
+		});
+	}
+}
+
+void AddressRangeLock::unlock(Node *node) {
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&mutex_);
+
+		nodes_.erase(node);
+	}
+	releaseEvent_.raise();
+}
+
+bool AddressRangeLock::overlaps_(Node *node) {
+	for(auto other : nodes_) {
+		if(node->address < other->address + other->length
+				&& other->address < node->address + node->length)
+			return true;
+	}
+	return false;
+}
+
 // --------------------------------------------------------
 // HoleAggregator
 // --------------------------------------------------------
@@ -274,6 +379,11 @@ void VirtualSpace::retire() {
 		self->cancelAging_.cancel();
 		co_await self->agingDoneEvent_.wait();
 
+		// Wait for all in-flight operations on the space.
+		AddressRangeLock::Node rangeNode{0, ~size_t{0}};
+		co_await self->_rangeLock.lock(&rangeNode);
+		AddressRangeLock::Guard rangeGuard{&self->_rangeLock, &rangeNode};
+
 		co_await self->_consistencyMutex.async_lock();
 		frg::unique_lock consistencyLock{frg::adopt_lock, self->_consistencyMutex};
 
@@ -408,14 +518,29 @@ VirtualSpace::map(smarter::borrowed_ptr<MemorySlice> slice,
 	if(endOffset > slice->length())
 		co_return Error::bufferTooSmall;
 
-	co_await _consistencyMutex.async_lock();
-	frg::unique_lock consistencyLock{frg::adopt_lock, _consistencyMutex};
-
+	// Fixed mappings may replace existing mappings; lock the range to unmap them.
+	// For other mappings, the range is not known in advance but it is
+	// allocated from a hole, so there is nothing to unmap.
+	AddressRangeLock::Node rangeNode{address, length};
+	frg::optional<AddressRangeLock::Guard> rangeGuard;
+	frg::vector<smarter::shared_ptr<Mapping>, KernelAlloc> victims{*kernelAlloc};
 	if (flags & kMapFixed) {
+		co_await _rangeLock.lock(&rangeNode);
+		rangeGuard.emplace(&_rangeLock, &rangeNode);
+
+		co_await _consistencyMutex.async_lock();
+		frg::unique_lock consistencyLock{frg::adopt_lock, _consistencyMutex};
+
 		auto [start, end] = co_await _splitMappings(address, length);
 		assert(start || (!start && !end));
-		co_await _unmapMappings(address, length, start, end);
+		_zombifyMappings(address, length, start, end, victims);
 	}
+	co_await _revokeMappings(victims);
+
+	co_await _consistencyMutex.async_lock();
+	frg::unique_lock consistencyLock{frg::adopt_lock, _consistencyMutex};
+
+	co_await _removeMappings(victims);
 
 	// The shared_ptr to the new Mapping needs to survive until the locks are released.
 	VirtualAddr actualAddress;
@@ -496,6 +621,22 @@ VirtualSpace::map(smarter::borrowed_ptr<MemorySlice> slice,
 	mapping.policy().increment();
 	mapping->view->addObserver(&mapping->observer);
 
+	if(mapping->view->canEvictMemory())
+		spawnOnWorkQueue(*kernelAlloc, WorkQueue::generalQueue().lock(), mapping->runEvictionLoop());
+
+	// Populating does not need _consistencyMutex, since concurrent unmapping
+	// of the new mapping is handled by the exposeRcu protocol.
+	consistencyLock.unlock();
+
+	// exemptFromSwap() sets noSwap_ before it walks the mappings, hence it either
+	// sees the new mapping or we see noSwap_ here.
+	if(noSwap_.load(std::memory_order_seq_cst)) {
+		auto exemptOutcome = co_await mapping->view->exemptFromSwap();
+		if(!exemptOutcome)
+			warningLogger() << "thor: Failed to read back swapped out pages of a mapping"
+					<< frg::endlog;
+	}
+
 	// Not populating the range is the default.
 	// Populating is quite expensive on CoW memory, mostly due to additional shootdowns
 	// that need to happen when an already mapped page is unmapped during copy-on-write.
@@ -530,12 +671,28 @@ VirtualSpace::map(smarter::borrowed_ptr<MemorySlice> slice,
 		}
 	}
 
-	if(mapping->view->canEvictMemory())
-		spawnOnWorkQueue(*kernelAlloc, WorkQueue::generalQueue().lock(), mapping->runEvictionLoop());
-
 	co_return actualAddress;
 }
 
+coroutine<frg::expected<Error>> VirtualSpace::exemptFromSwap() {
+	assert(currentIpl() == ipl::exceptionalWork);
+
+	noSwap_.store(true, std::memory_order_seq_cst);
+
+	frg::vector<smarter::shared_ptr<MemoryView>, KernelAlloc> views{*kernelAlloc};
+	{
+		co_await _consistencyMutex.async_lock();
+		frg::unique_lock consistencyLock{frg::adopt_lock, _consistencyMutex};
+
+		for(auto mapping = _mappings.first(); mapping; mapping = MappingTree::successor(mapping))
+			views.push(mapping->view);
+	}
+
+	for(auto &view : views)
+		FRG_CO_TRY(co_await view->exemptFromSwap());
+	co_return {};
+}
+
 coroutine<frg::expected<Error>>
 VirtualSpace::protect(VirtualAddr address, size_t length, uint32_t flags) {
 	assert(currentIpl() == ipl::exceptionalWork);
@@ -564,17 +721,26 @@ VirtualSpace::protect(VirtualAddr address, size_t length, uint32_t flags) {
 		assert(!(flags & mask));
 	}
 
-	co_await _consistencyMutex.async_lock();
-	frg::unique_lock consistencyLock{frg::adopt_lock, _consistencyMutex};
+	AddressRangeLock::Node rangeNode{address, length};
+	co_await _rangeLock.lock(&rangeNode);
+	AddressRangeLock::Guard rangeGuard{&_rangeLock, &rangeNode};
 
-	auto [start, end] = co_await _splitMappings(address, length);
-	assert(start || (!start && !end));
-	for (auto it = start; it != end;) {
-		auto mapping = it->selfPtr.lock();
-		it = MappingTree::successor(it);
+	frg::vector<smarter::shared_ptr<Mapping>, KernelAlloc> affected{*kernelAlloc};
+	{
+		co_await _consistencyMutex.async_lock();
+		frg::unique_lock consistencyLock{frg::adopt_lock, _consistencyMutex};
 
-		mapping->protect(static_cast<MappingFlags>(mappingFlags));
+		auto [start, end] = co_await _splitMappings(address, length);
+		assert(start || (!start && !end));
+		for (auto it = start; it != end; it = MappingTree::successor(it)) {
+			it->protect(static_cast<MappingFlags>(mappingFlags));
+			affected.push_back(it->selfPtr.lock());
+		}
+	}
 
+	// The range lock keeps the mappings in place, hence we can
+	// update the page tables without holding _consistencyMutex.
+	for (auto &mapping : affected) {
 		assert(mapping->state.load(std::memory_order_relaxed) == MappingState::active);
 
 		auto actualMappingFlags = mapping->flags.load(std::memory_order_relaxed);
@@ -622,12 +788,29 @@ VirtualSpace::protect(VirtualAddr address, size_t length, uint32_t flags) {
 coroutine<frg::expected<Error>> VirtualSpace::unmap(VirtualAddr address, size_t length) {
 	assert(currentIpl() == ipl::exceptionalWork);
 
-	co_await _consistencyMutex.async_lock();
-	frg::unique_lock consistencyLock{frg::adopt_lock, _consistencyMutex};
+	AddressRangeLock::Node rangeNode{address, length};
+	co_await _rangeLock.lock(&rangeNode);
+	AddressRangeLock::Guard rangeGuard{&_rangeLock, &rangeNode};
 
-	auto [start, end] = co_await _splitMappings(address, length);
-	assert(start || (!start && !end));
-	co_await _unmapMappings(address, length, start, end);
+	frg::vector<smarter::shared_ptr<Mapping>, KernelAlloc> victims{*kernelAlloc};
+	{
+		co_await _consistencyMutex.async_lock();
+		frg::unique_lock consistencyLock{frg::adopt_lock, _consistencyMutex};
+
+		auto [start, end] = co_await _splitMappings(address, length);
+		assert(start || (!start && !end));
+		_zombifyMappings(address, length, start, end, victims);
+	}
+
+	// Faults and mapping changes in other ranges can proceed during shootdown.
+	co_await _revokeMappings(victims);
+
+	{
+		co_await _consistencyMutex.async_lock();
+		frg::unique_lock consistencyLock{frg::adopt_lock, _consistencyMutex};
+
+		co_await _removeMappings(victims);
+	}
 
 	co_return {};
 }
@@ -740,6 +923,29 @@ VirtualSpace::handleFault(VirtualAddr address, uint32_t faultFlags) {
 			{
 				LocalRcuEngine::Guard revokeGuard{mapping->revokeRcu};
 
+				// If touchRange() populated a whole huge page, map it at once.
+				if(enableHugePages) {
+					auto hugeVa = address & ~(kHugePageSize - 1);
+					if(hugeVa >= mapping->address
+							&& hugeVa + kHugePageSize <= mapping->address + mapping->length) {
+						auto hugeOffset = mapping->viewOffset + (hugeVa - mapping->address);
+						auto physicalRange = mapping->view->peekRange(hugeOffset, fetchNone);
+						if(physicalRange.physical != PhysicalAddr(-1)
+								&& !(physicalRange.physical & (kHugePageSize - 1))
+								&& physicalRange.size >= kHugePageSize
+								&& (physicalRange.isMutable || !(fetchFlags & fetchRequireMutable))) {
+							auto mapOutcome = _ops->mapPresentPages(hugeVa, mapping->view.get(),
+									hugeOffset, kHugePageSize, compilePageFlags(flags), caching);
+							if(mapOutcome) {
+								notifyRss_(mapOutcome.value());
+								if(mapOutcome.value().anyRevoked)
+									co_await _ops->shootdown(hugeVa, kHugePageSize);
+								co_return {};
+							}
+						}
+					}
+				}
+
 				auto remapOutcome = _ops->faultPage(
 					address & ~(kPageSize - 1),
 					mapping->view.get(),
@@ -764,6 +970,28 @@ VirtualSpace::handleFault(VirtualAddr address, uint32_t faultFlags) {
 					if(remapOutcome.value().anyRevoked)
 						co_await _ops->shootdown(address & ~(kPageSize - 1), kPageSize);
 				}
+
+				// Fault-around: map the neighbours of the page that are already present
+				// in the view (e.g., in the page cache) to avoid faulting on them later.
+				// Write faults do not do this since they usually need to make pages mutable.
+				auto window = faultAroundWindow.load(std::memory_order_relaxed);
+				if(!(faultFlags & VirtualSpace::kFaultWrite) && window > 1) {
+					auto windowSize = window << kPageShift;
+					auto aroundVa = frg::max(address & ~(windowSize - 1), mapping->address);
+					auto aroundEnd = frg::min((address & ~(windowSize - 1)) + windowSize,
+							mapping->address + mapping->length);
+					auto aroundOutcome = _ops->mapAbsentPages(aroundVa, mapping->view.get(),
+							mapping->viewOffset + (aroundVa - mapping->address),
+							aroundEnd - aroundVa, compilePageFlags(flags), caching);
+					if(aroundOutcome && aroundOutcome.value().rssIncrease) {
+						notifyRss_(aroundOutcome.value());
+						numFaultArounds.fetch_add(1, std::memory_order_relaxed);
+						numFaultAroundPages.fetch_add(aroundOutcome.value().rssIncrease >> kPageShift,
+								std::memory_order_relaxed);
+						if(aroundOutcome.value().anyRevoked)
+							co_await _ops->shootdown(aroundVa, aroundEnd - aroundVa);
+					}
+				}
 			}
 			co_return {};
 		}
@@ -806,6 +1034,62 @@ VirtualSpace::retrievePhysical(VirtualAddr address) {
 	}
 }
 
+coroutine<frg::expected<Error>>
+VirtualSpace::loanPage(VirtualAddr address, frg::optional<LoanedPage> &page) {
+	assert(currentIpl() == ipl::exceptionalWork);
+	assert(!(address & (kPageSize - 1)));
+	assert(!page);
+
+	smarter::shared_ptr<Mapping> mapping;
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		auto spaceGuard = frg::guard(&_snapshotMutex);
+
+		mapping = _findMapping(address);
+	}
+	if(!mapping)
+		co_return Error::fault;
+	if(!(mapping->flags.load(std::memory_order_relaxed) & MappingFlags::protRead))
+		co_return Error::fault;
+
+	// Lock the page (instead of staying in the exposeRcu read section) such that
+	// we can suspend while the page is loaned.
+	page.emplace(mapping, mapping->viewOffset + (address - mapping->address));
+	if(auto e = mapping->view->lockRange(page->viewOffset, kPageSize); e != Error::success) {
+		page.reset();
+		co_return e;
+	}
+	page->locked = true;
+
+	while(true) {
+		// Re-validate the mapping since we may have suspended in touchRange().
+		if(!page->stillMapped()) {
+			page.reset();
+			co_return Error::fault;
+		}
+
+		auto physicalRange = mapping->view->peekRange(page->viewOffset, fetchNone);
+		if(physicalRange.physical != PhysicalAddr(-1)) {
+			// Loaned pages are accessed through the direct physical mapping,
+			// which is only suitable for ordinary (write-back) memory.
+			if(physicalRange.cachingMode != CachingMode::null
+					&& physicalRange.cachingMode != CachingMode::writeBack) {
+				page.reset();
+				co_return Error::illegalObject;
+			}
+			page->physical = physicalRange.physical;
+			co_return {};
+		}
+
+		// Otherwise, try to make the page available.
+		auto outcome = co_await mapping->view->touchRange(page->viewOffset, kPageSize, fetchNone);
+		if(!outcome) {
+			page.reset();
+			co_return outcome.error();
+		}
+	}
+}
+
 // Callers must hold _snapshotMutex, or _consistencyMutex (shared or exclusive).
 smarter::shared_ptr<Mapping> VirtualSpace::_findMapping(VirtualAddr address) {
 	auto current = _mappings.get_root();
@@ -1086,110 +1370,124 @@ coroutine<frg::tuple<Mapping *, Mapping *>> VirtualSpace::_splitMappings(uintptr
 }
 
 // Callers must hold _consistencyMutex exclusively.
-coroutine<void> VirtualSpace::_unmapMappings(VirtualAddr address, size_t length, Mapping *start, Mapping *end) {
-	for (auto it = start; it != end;) {
-		auto mapping = it->selfPtr.lock();
-		it = MappingTree::successor(it);
+void VirtualSpace::_zombifyMappings(VirtualAddr address, size_t length,
+		Mapping *start, Mapping *end,
+		frg::vector<smarter::shared_ptr<Mapping>, KernelAlloc> &victims) {
+	for (auto it = start; it != end; it = MappingTree::successor(it)) {
+		if (it->address >= address && (it->address + it->length) <= (address + length)) {
+			assert(it->state.load(std::memory_order_relaxed) == MappingState::active);
+			it->state.store(MappingState::zombie, std::memory_order_relaxed);
+			victims.push_back(it->selfPtr.lock());
+		}
+	}
+}
 
-		if (mapping->address >= address && (mapping->address + mapping->length) <= (address + length)) {
-			assert(mapping->state.load(std::memory_order_relaxed) == MappingState::active);
-			mapping->state.store(MappingState::zombie, std::memory_order_relaxed);
+// Callers must hold _rangeLock for the range of the victims.
+coroutine<void> VirtualSpace::_revokeMappings(
+		frg::vector<smarter::shared_ptr<Mapping>, KernelAlloc> &victims) {
+	for (auto &mapping : victims) {
+		assert(mapping->state.load(std::memory_order_relaxed) == MappingState::zombie);
 
-			co_await mapping->exposeRcu.barrier();
+		co_await mapping->exposeRcu.barrier();
 
-			bool anyRevoked;
-			{
-				LocalRcuEngine::Guard revokeGuard{mapping->revokeRcu};
+		bool anyRevoked;
+		{
+			LocalRcuEngine::Guard revokeGuard{mapping->revokeRcu};
 
-				// Mark pages as dirty and unmap without holding a lock.
-				auto unmapOutcome = _ops->unmapPages(mapping->address, mapping->length);
-				assert(unmapOutcome);
-				notifyRss_(unmapOutcome.value());
-				anyRevoked = unmapOutcome.value().anyRevoked;
+			// Mark pages as dirty and unmap without holding a lock.
+			auto unmapOutcome = _ops->unmapPages(mapping->address, mapping->length);
+			assert(unmapOutcome);
+			notifyRss_(unmapOutcome.value());
+			anyRevoked = unmapOutcome.value().anyRevoked;
 
-				if(anyRevoked)
-					co_await _ops->shootdown(mapping->address, mapping->length);
-			}
-			if(!anyRevoked)
-				co_await mapping->revokeRcu.barrier();
+			if(anyRevoked)
+				co_await _ops->shootdown(mapping->address, mapping->length);
+		}
+		if(!anyRevoked)
+			co_await mapping->revokeRcu.barrier();
+	}
+}
 
-			{
-				auto irqLock = frg::guard(&irqMutex());
-				auto snapshotLock = frg::guard(&_snapshotMutex);
+// Callers must hold _consistencyMutex exclusively.
+coroutine<void> VirtualSpace::_removeMappings(
+		frg::vector<smarter::shared_ptr<Mapping>, KernelAlloc> &victims) {
+	for (auto &mapping : victims) {
+		{
+			auto irqLock = frg::guard(&irqMutex());
+			auto snapshotLock = frg::guard(&_snapshotMutex);
 
-				_mappings.remove(mapping.get());
-			}
+			_mappings.remove(mapping.get());
+		}
 
-			assert(mapping->state.load(std::memory_order_relaxed) == MappingState::zombie);
-			mapping->state.store(MappingState::retired, std::memory_order_relaxed);
+		assert(mapping->state.load(std::memory_order_relaxed) == MappingState::zombie);
+		mapping->state.store(MappingState::retired, std::memory_order_relaxed);
 
-			if(mapping->view->canEvictMemory()) {
-				mapping->cancelEviction.cancel();
-				co_await mapping->evictionDoneEvent.wait();
-			}
-			mapping->view->removeObserver(&mapping->observer);
-			mapping->selfPtr.policy().decrement();
+		if(mapping->view->canEvictMemory()) {
+			mapping->cancelEviction.cancel();
+			co_await mapping->evictionDoneEvent.wait();
+		}
+		mapping->view->removeObserver(&mapping->observer);
+		mapping->selfPtr.policy().decrement();
 
-			// Finally, coalesce the hole in the hole tree.
+		// Finally, coalesce the hole in the hole tree.
 
-			// Find the holes that preceede/succeede mapping.
-			Hole *pre;
-			Hole *succ;
+		// Find the holes that preceede/succeede mapping.
+		Hole *pre;
+		Hole *succ;
 
-			auto current = _holes.get_root();
-			while(true) {
-				assert(current);
-				if(mapping->address < current->address()) {
-					if(HoleTree::get_left(current)) {
-						current = HoleTree::get_left(current);
-					}else{
-						pre = HoleTree::predecessor(current);
-						succ = current;
-						break;
-					}
+		auto current = _holes.get_root();
+		while(true) {
+			assert(current);
+			if(mapping->address < current->address()) {
+				if(HoleTree::get_left(current)) {
+					current = HoleTree::get_left(current);
 				}else{
-					assert(mapping->address >= current->address() + current->length());
-					if(HoleTree::get_right(current)) {
-						current = HoleTree::get_right(current);
-					}else{
-						pre = current;
-						succ = HoleTree::successor(current);
-						break;
-					}
+					pre = HoleTree::predecessor(current);
+					succ = current;
+					break;
+				}
+			}else{
+				assert(mapping->address >= current->address() + current->length());
+				if(HoleTree::get_right(current)) {
+					current = HoleTree::get_right(current);
+				}else{
+					pre = current;
+					succ = HoleTree::successor(current);
+					break;
 				}
 			}
+		}
 
-			// Try to merge the new hole and the existing ones.
-			if(pre && pre->address() + pre->length() == mapping->address
-					&& succ && mapping->address + mapping->length == succ->address()) {
-				auto hole = frg::construct<Hole>(*kernelAlloc, pre->address(),
-						pre->length() + mapping->length + succ->length());
-
-				_holes.remove(pre);
-				_holes.remove(succ);
-				_holes.insert(hole);
-				frg::destruct(*kernelAlloc, pre);
-				frg::destruct(*kernelAlloc, succ);
-			}else if(pre && pre->address() + pre->length() == mapping->address) {
-				auto hole = frg::construct<Hole>(*kernelAlloc,
-						pre->address(), pre->length() + mapping->length);
-
-				_holes.remove(pre);
-				_holes.insert(hole);
-				frg::destruct(*kernelAlloc, pre);
-			}else if(succ && mapping->address + mapping->length == succ->address()) {
-				auto hole = frg::construct<Hole>(*kernelAlloc,
-						mapping->address, mapping->length + succ->length());
-
-				_holes.remove(succ);
-				_holes.insert(hole);
-				frg::destruct(*kernelAlloc, succ);
-			}else{
-				auto hole = frg::construct<Hole>(*kernelAlloc,
-						mapping->address, mapping->length);
+		// Try to merge the new hole and the existing ones.
+		if(pre && pre->address() + pre->length() == mapping->address
+				&& succ && mapping->address + mapping->length == succ->address()) {
+			auto hole = frg::construct<Hole>(*kernelAlloc, pre->address(),
+					pre->length() + mapping->length + succ->length());
+
+			_holes.remove(pre);
+			_holes.remove(succ);
+			_holes.insert(hole);
+			frg::destruct(*kernelAlloc, pre);
+			frg::destruct(*kernelAlloc, succ);
+		}else if(pre && pre->address() + pre->length() == mapping->address) {
+			auto hole = frg::construct<Hole>(*kernelAlloc,
+					pre->address(), pre->length() + mapping->length);
+
+			_holes.remove(pre);
+			_holes.insert(hole);
+			frg::destruct(*kernelAlloc, pre);
+		}else if(succ && mapping->address + mapping->length == succ->address()) {
+			auto hole = frg::construct<Hole>(*kernelAlloc,
+					mapping->address, mapping->length + succ->length());
+
+			_holes.remove(succ);
+			_holes.insert(hole);
+			frg::destruct(*kernelAlloc, succ);
+		}else{
+			auto hole = frg::construct<Hole>(*kernelAlloc,
+					mapping->address, mapping->length);
 
-				_holes.insert(hole);
-			}
+			_holes.insert(hole);
 		}
 	}
 }
@@ -1281,8 +1579,13 @@ void AddressSpace::activate(smarter::shared_ptr<AddressSpace, BindableHandle> sp
 	PageSpace::activate(smarter::shared_ptr<PageSpace>{space->selfPtr.lock(), pageSpace});
 }
 
+namespace {
+	std::atomic<uint64_t> nextSpaceId{1};
+}
+
 AddressSpace::AddressSpace(CtorToken)
-: VirtualSpace{&ops_}, ops_{this} { }
+: VirtualSpace{&ops_}, spaceId_{nextSpaceId.fetch_add(1, std::memory_order_relaxed)},
+		ops_{this} { }
 
 AddressSpace::~AddressSpace() { }
 
@@ -8,16 +8,28 @@
 namespace thor {
 
 THOR_DEFINE_PERCPU(asidData);
+THOR_DEFINE_PERCPU(shootdownData);
 
 namespace {
 
+// If we're invalidating at least this many pages, just invalidate the whole ASID instead.
+constexpr size_t maxPagesPerShootdown = 64;
+
+// Statistics are only written by the owning CPU, so we do not need an atomic RMW.
+void countStat(std::atomic<uint64_t> &counter) {
+	counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void invalidateFullAsid(int asid) {
+	invalidateAsid(asid);
+	countStat(shootdownData.get().numFullFlushes);
+}
+
 void invalidateNode(int asid, ShootNode *node) {
-	// If we're invalidating a lot of pages, just invalidate the
-	// whole ASID instead.
 	// invalidateAsid(globalBindingId) is not allowed, so avoid
 	// the optimization in that case.
-	if(asid != globalBindingId && (node->size >> kPageShift) >= 64) {
-		invalidateAsid(asid);
+	if(asid != globalBindingId && (node->size >> kPageShift) >= maxPagesPerShootdown) {
+		invalidateFullAsid(asid);
 	} else {
 		for(size_t off = 0; off < node->size; off += kPageSize)
 			invalidatePage(asid, reinterpret_cast<void *>(node->address + off));
@@ -26,8 +38,33 @@ void invalidateNode(int asid, ShootNode *node) {
 
 } // namespace anonymous
 
+ShootdownStatistics getShootdownStatistics() {
+	ShootdownStatistics stats{};
+	for(size_t i = 0; i < getCpuCount(); i++) {
+		auto &data = shootdownData.getFor(i);
+		stats.numIpisSent += data.numIpisSent.load(std::memory_order_relaxed);
+		stats.numIpisCoalesced += data.numIpisCoalesced.load(std::memory_order_relaxed);
+		stats.numFullFlushes += data.numFullFlushes.load(std::memory_order_relaxed);
+		stats.numLazyFlushes += data.numLazyFlushes.load(std::memory_order_relaxed);
+	}
+	return stats;
+}
+
+void handleShootdownIpi() {
+	assert(!intsAreEnabled());
+
+	// Clear the flag before looking at the shootdown queues. Shootdowns that are
+	// submitted after this point send a new IPI (if they target this CPU).
+	shootdownData.get().ipiPending.exchange(false, std::memory_order_seq_cst);
+
+	for(auto &binding : asidData.get()->bindings)
+		binding.shootdown();
+
+	asidData.get()->globalBinding.shootdown();
+}
+
 void
-PageBinding::doShootdown_(PageSpace *space) {
+PageBinding::doShootdown_(PageSpace *space, uint64_t upToSequence) {
 	assert(!intsAreEnabled());
 
 	// In the code below, note that we cannot assume that nodes are processed in
@@ -36,26 +73,37 @@ PageBinding::doShootdown_(PageSpace *space) {
 
 	// Find the first unprocessed node by scanning backward from the back of the queue.
 	// We may miss nodes that are concurrently removed but that does not impact correctness.
+	// While doing so, count the pages that we need to invalidate.
 	ShootNode *current = space->shootQueue_.back();
 	if(!current || current->sequence_ <= alreadyShotSequence_)
 		return;
+	size_t numPages = 0;
 	while(true) {
+		if(current->sequence_ <= upToSequence && current->initiatorCpu_ != getCpuData())
+			numPages += current->size >> kPageShift;
 		auto prev = current->queueNode.previous.load(std::memory_order_acquire);
 		if(!prev || prev->sequence_ <= alreadyShotSequence_)
 			break;
 		current = prev;
 	}
 
-	// TODO: If we see too many pages during the backwards traversal above,
-	//       we could simply invalidate the entire space and mark everything as invalidated
-	//       on the forward pass below.
+	// If there are many pages (e.g., from many small unmaps), invalidate the entire ASID once
+	// and only mark the nodes as invalidated on the forward pass below.
+	bool invalidatedAll = false;
+	if(id_ != globalBindingId && numPages >= maxPagesPerShootdown) {
+		invalidateFullAsid(id_);
+		invalidatedAll = true;
+	}
 
 	while(current) {
 		auto next = current->queueNode.next.load(std::memory_order_acquire);
 		auto seq = current->sequence_;
+		if(seq > upToSequence)
+			break;
 
 		if(current->initiatorCpu_ != getCpuData()) {
-			invalidateNode(id_, current);
+			if(!invalidatedAll)
+				invalidateNode(id_, current);
 
 			if(current->bindingsToShoot_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
 				{
@@ -108,6 +156,52 @@ PageBinding::drainShootdown_(PageSpace *space, uint64_t afterSequence, uint64_t
 	}
 }
 
+void PageBinding::makeLazy_() {
+	assert(!intsAreEnabled());
+	assert(boundSpace_);
+	assert(!lazy_);
+	assert(id_ != globalBindingId);
+
+	uint64_t upToSequence;
+	{
+		auto lock = frg::guard(&boundSpace_->mutex_);
+		upToSequence = boundSpace_->shootSequence_;
+		boundSpace_->numActiveBindings_--;
+		if(shootdownData.get().activeSpace.load(std::memory_order_relaxed) == boundSpace_.get())
+			shootdownData.get().activeSpace.store(nullptr, std::memory_order_relaxed);
+	}
+
+	// Shootdowns up to upToSequence still count this binding.
+	doShootdown_(boundSpace_.get(), upToSequence);
+
+	lazy_ = true;
+	lazySequence_ = upToSequence;
+}
+
+bool PageBinding::makeActive_() {
+	assert(!intsAreEnabled());
+	assert(boundSpace_);
+	assert(lazy_);
+
+	uint64_t sequence;
+	{
+		auto lock = frg::guard(&boundSpace_->mutex_);
+		sequence = boundSpace_->shootSequence_;
+		boundSpace_->numActiveBindings_++;
+		shootdownData.get().activeSpace.store(boundSpace_.get(), std::memory_order_relaxed);
+	}
+
+	// Shootdowns in (lazySequence_, sequence] did not count this binding.
+	bool stale = sequence != lazySequence_;
+	if(stale)
+		countStat(shootdownData.get().numLazyFlushes);
+
+	lazy_ = false;
+	lazySequence_ = 0;
+	alreadyShotSequence_ = sequence;
+	return stale;
+}
+
 bool PageBinding::isPrimary() {
 	assert(!intsAreEnabled());
 	auto &context = asidData.get()->pageContext;
@@ -122,7 +216,11 @@ void PageBinding::rebind() {
 
 	// The global binding should always be current
 	assert(id_ != globalBindingId);
-	switchToPageTable(boundSpace_->rootTable(), id_, false);
+
+	if(context.primaryBinding_ && context.primaryBinding_->boundSpace_)
+		context.primaryBinding_->makeLazy_();
+	bool stale = makeActive_();
+	switchToPageTable(boundSpace_->rootTable(), id_, stale);
 
 	primaryStamp_ = context.nextStamp_++;
 	context.primaryBinding_ = this;
@@ -139,6 +237,14 @@ void PageBinding::rebind(smarter::shared_ptr<PageSpace> space) {
 
 	auto unboundSpace = boundSpace_;
 	auto unboundSequence = alreadyShotSequence_;
+	auto unboundLazy = lazy_;
+	auto unboundLazySequence = lazySequence_;
+
+	// The previous primary binding becomes lazy. Note that if we only have a single binding,
+	// this binding is the primary one and it is unbound below.
+	if(context.primaryBinding_ && context.primaryBinding_ != this
+			&& context.primaryBinding_->boundSpace_)
+		context.primaryBinding_->makeLazy_();
 
 	// Bind the new space.
 	uint64_t targetSeq;
@@ -147,10 +253,14 @@ void PageBinding::rebind(smarter::shared_ptr<PageSpace> space) {
 
 		targetSeq = space->shootSequence_;
 		space->numBindings_++;
+		space->numActiveBindings_++;
+		shootdownData.get().activeSpace.store(space.get(), std::memory_order_relaxed);
 	}
 
 	boundSpace_ = space;
 	alreadyShotSequence_ = targetSeq;
+	lazy_ = false;
+	lazySequence_ = 0;
 
 	switchToPageTable(boundSpace_->rootTable(), id_, true);
 
@@ -163,8 +273,11 @@ void PageBinding::rebind(smarter::shared_ptr<PageSpace> space) {
 		RetireNode *retireNode = nullptr;
 		{
 			auto lock = frg::guard(&unboundSpace->mutex_);
-			upToSequence = unboundSpace->shootSequence_;
+			// Lazy bindings are not counted by shootdowns after lazySequence_.
+			upToSequence = unboundLazy ? unboundLazySequence : unboundSpace->shootSequence_;
 			unboundSpace->numBindings_--;
+			if(!unboundLazy)
+				unboundSpace->numActiveBindings_--;
 			if(!unboundSpace->numBindings_ && unboundSpace->retireNode_) {
 				retireNode = unboundSpace->retireNode_;
 				unboundSpace->retireNode_ = nullptr;
@@ -191,6 +304,7 @@ void PageBinding::initialBind(smarter::shared_ptr<PageSpace> space) {
 
 		targetSeq = space->shootSequence_;
 		space->numBindings_++;
+		space->numActiveBindings_++;
 	}
 
 	boundSpace_ = space;
@@ -218,8 +332,14 @@ void PageBinding::unbind() {
 	RetireNode *retireNode = nullptr;
 	{
 		auto lock = frg::guard(&boundSpace_->mutex_);
-		upToSequence = boundSpace_->shootSequence_;
+		// Lazy bindings are not counted by shootdowns after lazySequence_.
+		upToSequence = lazy_ ? lazySequence_ : boundSpace_->shootSequence_;
 		boundSpace_->numBindings_--;
+		if(!lazy_) {
+			boundSpace_->numActiveBindings_--;
+			if(shootdownData.get().activeSpace.load(std::memory_order_relaxed) == boundSpace_.get())
+				shootdownData.get().activeSpace.store(nullptr, std::memory_order_relaxed);
+		}
 		if(!boundSpace_->numBindings_ && boundSpace_->retireNode_) {
 			retireNode = boundSpace_->retireNode_;
 			boundSpace_->retireNode_ = nullptr;
@@ -233,6 +353,8 @@ void PageBinding::unbind() {
 
 	boundSpace_ = nullptr;
 	alreadyShotSequence_ = 0;
+	lazy_ = false;
+	lazySequence_ = 0;
 }
 
 void PageBinding::shootdown() {
@@ -247,7 +369,11 @@ void PageBinding::shootdown() {
 		return;
 	}
 
-	doShootdown_(boundSpace_.get());
+	// Lazy bindings catch up when they become primary again.
+	if(lazy_)
+		return;
+
+	doShootdown_(boundSpace_.get(), ~uint64_t{0});
 }
 
 
@@ -274,7 +400,7 @@ void PageSpace::activate(smarter::shared_ptr<PageSpace> space) {
 
 
 PageSpace::PageSpace(PhysicalAddr rootTable)
-: rootTable_{rootTable}, numBindings_{0}, shootSequence_{0} { }
+: rootTable_{rootTable}, numBindings_{0}, numActiveBindings_{0}, shootSequence_{0} { }
 
 PageSpace::~PageSpace() {
 	assert(!numBindings_);
@@ -305,22 +431,24 @@ bool PageSpace::submitShootdown(ShootNode *node) {
 	assert(!(node->address & (kPageSize - 1)));
 	assert(!(node->size & (kPageSize - 1)));
 
+	bool isKernelSpace = this == &KernelPageSpace::global();
 	{
 		auto irqLock = frg::guard(&irqMutex());
 		auto lock = frg::guard(&mutex_);
 
-		auto unshotBindings = numBindings_;
+		// Lazy bindings do not need to be shot down (see PageBinding::makeActive_()).
+		auto unshotBindings = numActiveBindings_;
 
 		auto &bindings = asidData.get()->bindings;
 
 		// Perform synchronous shootdown.
-		if(this == &KernelPageSpace::global()) {
+		if(isKernelSpace) {
 			assert(unshotBindings);
 			invalidateNode(globalBindingId, node);
 			unshotBindings--;
 		} else {
 			for(size_t i = 0; i < bindings.size(); i++) {
-				if(bindings[i].boundSpace().get() != this)
+				if(bindings[i].boundSpace().get() != this || bindings[i].lazy_)
 					continue;
 
 				assert(unshotBindings);
@@ -338,7 +466,30 @@ bool PageSpace::submitShootdown(ShootNode *node) {
 		shootQueue_.push_back(node);
 	}
 
-	sendShootdownIpi();
+	// The kernel space is active on all CPUs.
+	if(isKernelSpace) {
+		sendShootdownIpi();
+		return false;
+	}
+
+	// Only CPUs on which this space is active need an IPI. CPUs that became lazy
+	// after we pushed the node already performed the shootdown in makeLazy_().
+	auto irqLock = frg::guard(&irqMutex());
+	auto &stats = shootdownData.get();
+	for(size_t i = 0; i < getCpuCount(); i++) {
+		auto dstData = getCpuData(i);
+		if(dstData == getCpuData())
+			continue;
+		auto &data = shootdownData.getFor(i);
+		if(data.activeSpace.load(std::memory_order_acquire) != this)
+			continue;
+		if(data.ipiPending.exchange(true, std::memory_order_seq_cst)) {
+			countStat(stats.numIpisCoalesced);
+			continue;
+		}
+		countStat(stats.numIpisSent);
+		sendShootdownIpi(dstData);
+	}
 	return false;
 }
 
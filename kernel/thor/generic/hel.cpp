@@ -423,10 +423,10 @@ HelError helCreateQueue(const HelQueueParameters *paramsPtr, HelHandle *handle)
 	if(!readUserObject(paramsPtr, params))
 		return kHelErrFault;
 
-	if(params.flags)
+	if(params.flags & ~kHelQueueBatchCompletions)
 		return kHelErrIllegalArgs;
 
-	auto queueOutcome = IpcQueue::create(params.numChunks, params.chunkSize,
+	auto queueOutcome = IpcQueue::create(params.flags, params.numChunks, params.chunkSize,
 			params.numSqChunks);
 	if(!queueOutcome)
 		return translateError(queueOutcome.error());
@@ -455,8 +455,11 @@ HelError helDriveQueue(HelHandle handle, uint32_t flags, uint32_t notifyMask) {
 	// Always raise cqEvent to indicate that kernelNotify may have changed.
 	queue->raiseCqEvent();
 
-	// Process any pending SQ elements.
+	// Process any pending SQ elements. If we wait afterwards, threads that we wake up
+	// can run on this CPU once we block.
+	thisThread->setSyncWakeups(flags & kHelDriveWait);
 	queue->processSq();
+	thisThread->setSyncWakeups(false);
 
 	// If requested, wait until userNotify & kNotifyProgress is non-zero.
 	if(flags & kHelDriveWait) {
@@ -565,16 +568,23 @@ HelError doSubmitResizeMemory(HelHandle handle, smarter::shared_ptr<IpcQueue> qu
 
 HelError helCreateManagedMemory(size_t size, uint32_t flags,
 		HelHandle *backing_handle, HelHandle *frontal_handle) {
-	if(flags & ~uint32_t{kHelManagedReadahead})
+	if(flags & ~(uint32_t{kHelManagedReadahead} | kHelManagedMaxRequestMask))
 		return kHelErrIllegalArgs;
 	if(size & (kPageSize - 1))
 		return kHelErrIllegalArgs;
 
+	size_t maxRequestSize = ManagedSpace::defaultMaxRequestSize;
+	if(auto shift = (flags & kHelManagedMaxRequestMask) >> kHelManagedMaxRequestShift; shift) {
+		if(shift < kPageShift || shift > 30)
+			return kHelErrIllegalArgs;
+		maxRequestSize = size_t{1} << shift;
+	}
+
 	auto thisThread = getCurrentThread();
 	auto thisUniverse = thisThread->getUniverse();
 
 	auto managed = smarter::allocate_shared<ManagedSpace>(*kernelAlloc, size,
-			flags & kHelManagedReadahead);
+			flags & kHelManagedReadahead, maxRequestSize);
 	managed->selfPtr = managed;
 	auto backingOutcome = BackingMemory::create(managed);
 	if(!backingOutcome)
@@ -908,6 +918,178 @@ HelError doSubmitPopulateSpace(HelHandle handle, smarter::shared_ptr<IpcQueue> q
 	return kHelErrNone;
 }
 
+HelError doSubmitForkSpace(HelHandle spaceHandle, smarter::shared_ptr<IpcQueue> queue,
+		std::span<std::byte> payloadSpan, size_t count, uint32_t flags, uintptr_t context) {
+	if(flags & ~uint32_t{kHelForkSpacePopulate})
+		return kHelErrIllegalArgs;
+	if(!count || count > kHelForkSpaceMaxAreas)
+		return kHelErrIllegalArgs;
+
+	if(payloadSpan.size() < count * sizeof(HelForkArea)) {
+		infoLogger() << "Bad length for kHelSubmitForkSpace payload" << frg::endlog;
+		return kHelErrBufferTooSmall;
+	}
+
+	auto this_thread = getCurrentThread();
+	auto this_universe = this_thread->getUniverse();
+
+	auto spaceOutcome = this_universe->resolveObject<DescriptorType::addressSpace>(
+			spaceHandle, kHelRightGrant);
+	if(!spaceOutcome)
+		return translateError(spaceOutcome.error());
+	auto space = std::move(*spaceOutcome);
+
+	struct Area {
+		smarter::shared_ptr<MemoryView> view;
+		uint32_t rights;
+		bool copyOnWrite;
+		VirtualAddr address;
+		uintptr_t offset;
+		size_t length;
+		uint32_t mapFlags;
+	};
+
+	frg::vector<Area, KernelAlloc> areas{*kernelAlloc};
+	for(size_t i = 0; i < count; i++) {
+		HelForkArea recipe;
+		memcpy(&recipe, payloadSpan.data() + i * sizeof(HelForkArea), sizeof(HelForkArea));
+
+		if(recipe.flags & ~uint32_t{kHelForkAreaCopyOnWrite})
+			return kHelErrIllegalArgs;
+		if(recipe.mapFlags & ~uint32_t{kHelMapProtRead | kHelMapProtWrite | kHelMapProtExecute
+				| kHelMapDontRequireBacking})
+			return kHelErrIllegalArgs;
+		if(!recipe.address || !recipe.length || (recipe.address & (kPageSize - 1))
+				|| (recipe.offset & (kPageSize - 1)) || (recipe.length & (kPageSize - 1)))
+			return kHelErrIllegalArgs;
+
+		// Areas are mapped at exactly the given address (replacing existing mappings).
+		uint32_t mapFlags = AddressSpace::kMapFixed;
+		uint32_t requiredRights = kHelRightAssign;
+		if(recipe.mapFlags & kHelMapProtRead) {
+			mapFlags |= AddressSpace::kMapProtRead;
+			requiredRights |= kHelRightRead;
+		}
+		if(recipe.mapFlags & kHelMapProtWrite) {
+			mapFlags |= AddressSpace::kMapProtWrite;
+			requiredRights |= kHelRightWrite;
+		}
+		if(recipe.mapFlags & kHelMapProtExecute) {
+			mapFlags |= AddressSpace::kMapProtExecute;
+			requiredRights |= kHelRightExecute;
+		}
+		if(recipe.mapFlags & kHelMapDontRequireBacking)
+			mapFlags |= AddressSpace::kMapDontRequireBacking;
+		if(flags & kHelForkSpacePopulate)
+			mapFlags |= AddressSpace::kMapPopulate;
+
+		bool copyOnWrite = recipe.flags & kHelForkAreaCopyOnWrite;
+		if(copyOnWrite)
+			requiredRights |= kHelRightRead | kHelRightDerive;
+
+		auto viewOutcome = this_universe->resolveCapability<DescriptorType::memoryView>(
+				recipe.memory, requiredRights);
+		if(!viewOutcome)
+			return translateError(viewOutcome.error());
+		auto [view, rights] = std::move(*viewOutcome);
+
+		areas.push_back(Area{
+			.view = std::move(view),
+			.rights = rights,
+			.copyOnWrite = copyOnWrite,
+			.address = recipe.address,
+			.offset = recipe.offset,
+			.length = recipe.length,
+			.mapFlags = mapFlags,
+		});
+	}
+
+	if(!queue->validSize(ipcSourceSize(sizeof(HelSimpleResult))
+			+ ipcSourceSize(count * sizeof(HelHandle))))
+		return kHelErrQueueTooSmall;
+
+	[](smarter::weak_ptr<Universe> weakUniverse,
+			smarter::shared_ptr<AddressSpace, BindableHandle> space,
+			frg::vector<Area, KernelAlloc> areas,
+			smarter::shared_ptr<IpcQueue> queue, uintptr_t context,
+			enable_detached_coroutine) -> void {
+		// Memory objects that are mapped into the new space (i.e., the forked ones
+		// for copy-on-write areas), indexed like areas.
+		frg::vector<smarter::shared_ptr<MemoryView>, KernelAlloc> mapped{*kernelAlloc};
+		Error error = Error::success;
+
+		for(size_t i = 0; i < areas.size(); i++) {
+			auto &area = areas[i];
+
+			auto view = area.view;
+			if(area.copyOnWrite) {
+				// Areas that were split from the same mapping share their memory object.
+				// In this case, all of them share the same forked memory object.
+				view = nullptr;
+				for(size_t j = 0; j < i; j++) {
+					if(areas[j].copyOnWrite && areas[j].view.get() == area.view.get()) {
+						view = mapped[j];
+						break;
+					}
+				}
+
+				if(!view) {
+					auto forkOutcome = co_await onExceptionalWq(area.view->fork());
+					if(!forkOutcome) {
+						error = forkOutcome.error();
+						break;
+					}
+					view = std::move(forkOutcome.value());
+				}
+			}
+			mapped.push_back(view);
+
+			auto sliceLength = view->getLength();
+			auto sliceOutcome = MemorySlice::create(view, 0, sliceLength);
+			if(!sliceOutcome) {
+				error = sliceOutcome.error();
+				break;
+			}
+			auto slice = std::move(*sliceOutcome);
+
+			auto mapOutcome = co_await onExceptionalWq(space->map(slice,
+					area.address, area.offset, area.length, area.mapFlags));
+			if(!mapOutcome) {
+				error = mapOutcome.error();
+				break;
+			}
+		}
+
+		HelSimpleResult helResult{.error = translateError(error), .reserved = {}};
+		frg::vector<HelHandle, KernelAlloc> handles{*kernelAlloc};
+		for(size_t i = 0; i < areas.size(); i++)
+			handles.push_back(kHelNullHandle);
+
+		auto universe = weakUniverse.lock();
+		if(!universe) {
+			helResult.error = kHelErrThreadTerminated;
+		}else if(error == Error::success) {
+			for(size_t i = 0; i < areas.size(); i++) {
+				if(!areas[i].copyOnWrite)
+					continue;
+				handles[i] = universe->attachDescriptor(
+					AnyDescriptor::make<DescriptorType::memoryView>(
+						mapped[i],
+						areas[i].rights & (kHelRightRead | kHelRightWrite | kHelRightExecute | kHelRightAssign | kHelRightDerive | kHelRightProvision | kHelRightPin | kHelRightFence | kHelRightManage)
+					)
+				);
+			}
+		}
+
+		QueueSource handlesSource{handles.data(), handles.size() * sizeof(HelHandle), nullptr};
+		QueueSource ipcSource{&helResult, sizeof(HelSimpleResult), &handlesSource};
+		co_await queue->submit(&ipcSource, context);
+	}(this_universe.lock(), std::move(space), std::move(areas), std::move(queue), context,
+		enable_detached_coroutine{getCurrentThread()->mainWorkQueue().lock()});
+
+	return kHelErrNone;
+}
+
 HelError helCreateSpace(HelHandle *handle) {
 	auto this_thread = getCurrentThread();
 	auto this_universe = this_thread->getUniverse();
@@ -1726,6 +1908,36 @@ HelError helMemoryInfo(HelHandle handle, size_t *size) {
 	return kHelErrNone;
 }
 
+HelError helQueryMemoryNodes(HelMemoryNodeStats *userStats, size_t maxNodes, size_t *numNodes) {
+	auto n = physicalAllocator->numNodes();
+	for(size_t i = 0; i < frg::min(n, maxNodes); i++) {
+		auto nodeStats = physicalAllocator->nodeStats(i);
+
+		HelMemoryNodeStats stats;
+		memset(&stats, 0, sizeof(HelMemoryNodeStats));
+		stats.node = nodeStats.node;
+		stats.firstCpu = -1;
+		for(size_t cpu = 0; cpu < getCpuCount(); cpu++) {
+			auto &topology = getCpuData(cpu)->topology;
+			// CPUs without topology information are treated as part of the first node.
+			bool onNode = topology.valid ? topology.numaNode == nodeStats.node : !i;
+			if(onNode) {
+				stats.firstCpu = cpu;
+				break;
+			}
+		}
+		stats.totalPages = nodeStats.totalPages;
+		stats.freePages = nodeStats.freePages;
+		stats.usedPages = nodeStats.totalPages - nodeStats.freePages;
+
+		if(!writeUserObject(userStats + i, stats))
+			return kHelErrFault;
+	}
+
+	*numNodes = n;
+	return kHelErrNone;
+}
+
 HelError doSubmitManageMemory(HelHandle handle, smarter::shared_ptr<IpcQueue> queue, uintptr_t context) {
 	auto this_thread = getCurrentThread();
 	auto this_universe = this_thread->getUniverse();
@@ -2981,6 +3193,8 @@ HelError doSubmitExchangeMsgs(HelHandle laneHandle, smarter::shared_ptr<IpcQueue
 
 			// The size of this array must be a power of two.
 			frg::array<frg::unique_memory<KernelAlloc>, 2> xferBuffers;
+			// Used instead of xferBuffers if the sender's pages are lent to the receiver.
+			frg::array<frg::optional<AddressSpace::LoanedPage>, 2> loanedPages;
 
 			size_t i = 0;
 			size_t seenFlows = 0; // Iterates through flows.
@@ -3029,10 +3243,23 @@ HelError doSubmitExchangeMsgs(HelHandle laneHandle, smarter::shared_ptr<IpcQueue
 					// Empty packets are handled by the generic stream code.
 					assert(recipe->length);
 
+					// For page aligned buffers, we lend the sender's pages to the receiver,
+					// such that the payload is only copied once (directly into the receiver).
+					smarter::shared_ptr<AddressSpace, BindableHandle> loanSpace;
+					if(!(reinterpret_cast<uintptr_t>(recipe->buffer) & (kPageSize - 1)))
+						loanSpace = thread->getAddressSpace().lock();
+
 					size_t progress = 0;
 					size_t numSent = 0;
 					size_t numAcked = 0;
 					bool lastTransferSent = false;
+					// Set if the sender unmapped a page while it was loaned to the receiver.
+					bool anyLoanRevoked = false;
+					auto releaseLoan = [&] (frg::optional<AddressSpace::LoanedPage> &lp) {
+						if(lp && !lp->stillMapped())
+							anyLoanRevoked = true;
+						lp.reset();
+					};
 					// Each iteration of this loop sends one transfer packet (or terminates).
 					while(true) {
 						bool anyRemoteFault = false;
@@ -3077,15 +3304,35 @@ HelError doSubmitExchangeMsgs(HelHandle laneHandle, smarter::shared_ptr<IpcQueue
 
 						// Prepare a buffer an send it.
 						assert(numSent - numAcked < xferBuffers.size());
-						auto &xb = xferBuffers[numSent & (xferBuffers.size() - 1)];
-						if(!xb.size())
-							xb = frg::unique_memory<KernelAlloc>{*kernelAlloc, 4096};
-
-						auto chunkSize = frg::min(recipe->length - progress, xb.size());
+						auto slot = numSent & (xferBuffers.size() - 1);
+						void *chunkData = nullptr;
+						size_t chunkSize = 0;
+						bool outcome = true;
+						if(loanSpace) {
+							// The previous loan from this slot was already acked.
+							auto &lp = loanedPages[slot];
+							releaseLoan(lp);
+
+							auto loanOutcome = co_await onExceptionalWq(loanSpace->loanPage(
+									reinterpret_cast<uintptr_t>(recipe->buffer) + progress, lp));
+							if(loanOutcome) {
+								chunkSize = frg::min(recipe->length - progress, size_t{kPageSize});
+								PageAccessor accessor{lp->physical};
+								chunkData = accessor.get();
+							}
+						}
+						// Fall back to copying if the page cannot be lent (this also reports faults).
+						if(!chunkData) {
+							auto &xb = xferBuffers[slot];
+							if(!xb.size())
+								xb = frg::unique_memory<KernelAlloc>{*kernelAlloc, 4096};
+
+							chunkSize = frg::min(recipe->length - progress, xb.size());
+							chunkData = xb.data();
+							outcome = readUserMemory(chunkData,
+									reinterpret_cast<std::byte *>(recipe->buffer) + progress, chunkSize);
+						}
 						assert(chunkSize);
-
-						auto outcome = readUserMemory(xb.data(),
-								reinterpret_cast<std::byte *>(recipe->buffer) + progress, chunkSize);
 						if(!outcome) {
 							// Send the packet (may deallocate the peer!).
 							peer->flowQueue.put({ .terminate = true, .fault = true });
@@ -3106,7 +3353,7 @@ HelError doSubmitExchangeMsgs(HelHandle laneHandle, smarter::shared_ptr<IpcQueue
 						lastTransferSent = (progress + chunkSize == recipe->length);
 						// Send the packet (may deallocate the peer!).
 						peer->flowQueue.put({
-							.data = xb.data(),
+							.data = chunkData,
 							.size = chunkSize,
 							.terminate = lastTransferSent
 						});
@@ -3114,6 +3361,13 @@ HelError doSubmitExchangeMsgs(HelHandle laneHandle, smarter::shared_ptr<IpcQueue
 						progress += chunkSize;
 					}
 
+					// All transfers are acked, hence the receiver does not access our pages anymore.
+					for(auto &lp : loanedPages)
+						releaseLoan(lp);
+					// Report the same fault that copying from the unmapped page would produce.
+					if(anyLoanRevoked && node->_error == Error::success)
+						node->_error = Error::fault;
+
 					node->complete();
 				}else if(recipe->type == kHelActionRecvToBuffer
 						&& peer->tag() == kTagSendKernelBuffer) {
@@ -4129,6 +4383,19 @@ void thor::submitFromSq(smarter::shared_ptr<IpcQueue> queue, uint32_t opcode,
 		error = doSubmitPopulateSpace(sqData.handle, queue, sqData.address, sqData.length, context);
 		break;
 	}
+	case kHelSubmitForkSpace: {
+		if(sqSpan.size() < sizeof(HelSqForkSpace)) {
+			infoLogger() << "Bad length for kHelSubmitForkSpace" << frg::endlog;
+			error = kHelErrBufferTooSmall;
+			break;
+		}
+		HelSqForkSpace sqData;
+		memcpy(&sqData, sqSpan.data(), sizeof(sqData));
+		error = doSubmitForkSpace(sqData.space, queue,
+				sqSpan.subspan(sizeof(HelSqForkSpace)),
+				sqData.count, sqData.flags, context);
+		break;
+	}
 	default:
 		error = kHelErrIllegalSyscall;
 		infoLogger() << "thor: Bad opcode " << opcode << " in submission queue" << frg::endlog;
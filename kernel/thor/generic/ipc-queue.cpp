@@ -1,6 +1,8 @@
 
 #include <string.h>
 
+#include <frg/scope_exit.hpp>
+
 #include <thor-internal/cpu-data.hpp>
 #include <thor-internal/ipc-queue.hpp>
 #include <thor-internal/thread.hpp>
@@ -12,9 +14,10 @@ namespace thor {
 // ----------------------------------------------------------------------------
 
 std::expected<smarter::shared_ptr<IpcQueue>, Error>
-IpcQueue::create(unsigned int numChunks, size_t chunkSize, unsigned int numSqChunks) {
+IpcQueue::create(uint32_t flags, unsigned int numChunks, size_t chunkSize,
+		unsigned int numSqChunks) {
 	auto ptr = smarter::allocate_shared<IpcQueue>(*kernelAlloc, CtorToken{},
-			numChunks, chunkSize, numSqChunks);
+			flags, numChunks, chunkSize, numSqChunks);
 	ptr->selfPtr = ptr;
 
 	auto totalChunks = numChunks + numSqChunks;
@@ -61,8 +64,9 @@ IpcQueue::create(unsigned int numChunks, size_t chunkSize, unsigned int numSqChu
 	return ptr;
 }
 
-IpcQueue::IpcQueue(CtorToken, unsigned int numChunks, size_t chunkSize, unsigned int numSqChunks)
-: _chunkSize{chunkSize}, _chunkOffsets{*kernelAlloc},
+IpcQueue::IpcQueue(CtorToken, uint32_t flags, unsigned int numChunks, size_t chunkSize,
+		unsigned int numSqChunks)
+: _flags{flags}, _chunkSize{chunkSize}, _chunkOffsets{*kernelAlloc},
 		_currentChunk{0}, _currentProgress{0},
 		_numCqChunks{numChunks}, _numSqChunks{numSqChunks} { }
 
@@ -73,6 +77,25 @@ void IpcQueue::notifyError() {
 		_userEvent.raise();
 }
 
+void IpcQueue::raiseUserEvent_() {
+	if(_batchingCompletions.load(std::memory_order_relaxed)) {
+		// This store and the load below synchronize with the store to _batchingCompletions
+		// and the exchange on _pendingUserEvent at the end of processSq():
+		// either we observe that batching has ended or processSq() observes our request.
+		_pendingUserEvent.store(true, std::memory_order_seq_cst);
+		if(_batchingCompletions.load(std::memory_order_seq_cst))
+			return;
+	}
+	_userEvent.raise();
+}
+
+void IpcQueue::countCqStall_() {
+	_numCqStalls.fetch_add(1, std::memory_order_relaxed);
+
+	auto head = _mapping.access<QueueStruct>(0);
+	__atomic_fetch_add(&head->cqStalls, 1, __ATOMIC_RELAXED);
+}
+
 bool IpcQueue::validSize(size_t size) {
 	return sizeof(ElementStruct) + size <= _chunkSize;
 }
@@ -93,10 +116,15 @@ coroutine<void> IpcQueue::submit(QueueSource *source, uintptr_t context) {
 	// Get the initial CQ chunk.
 	if (!_haveCqChunk) {
 		int cqFirst;
+		bool stalled = false;
 		while (true) {
 			cqFirst = __atomic_load_n(&head->cqFirst, __ATOMIC_ACQUIRE);
 			if (cqFirst & kNextPresent)
 				break;
+			if (!stalled) {
+				countCqStall_();
+				stalled = true;
+			}
 			auto notify = __atomic_load_n(&head->kernelNotify, __ATOMIC_RELAXED);
 			if (!(notify & kKernelNotifySupplyCqChunks)) {
 				co_await _cqEvent.async_wait_if([&] () -> bool {
@@ -126,14 +154,19 @@ coroutine<void> IpcQueue::submit(QueueSource *source, uintptr_t context) {
 		// Signal userspace.
 		auto userNotifyFull = __atomic_fetch_or(&head->userNotify, kUserNotifyCqProgress, __ATOMIC_RELEASE);
 		if(!(userNotifyFull & kUserNotifyCqProgress))
-			_userEvent.raise();
+			raiseUserEvent_();
 
 		// Wait for next chunk to become available.
 		int nextWord;
+		bool stalled = false;
 		while (true) {
 			nextWord = __atomic_load_n(&chunkHead->next, __ATOMIC_ACQUIRE);
 			if (nextWord & kNextPresent)
 				break;
+			if (!stalled) {
+				countCqStall_();
+				stalled = true;
+			}
 			auto notify = __atomic_load_n(&head->kernelNotify, __ATOMIC_RELAXED);
 			if (!(notify & kKernelNotifySupplyCqChunks)) {
 				co_await _cqEvent.async_wait_if([&] () -> bool {
@@ -151,7 +184,7 @@ coroutine<void> IpcQueue::submit(QueueSource *source, uintptr_t context) {
 		// Signal userspace.
 		auto userNotify = __atomic_fetch_or(&head->userNotify, kUserNotifyCqProgress, __ATOMIC_RELEASE);
 		if(!(userNotify & kUserNotifyCqProgress))
-			_userEvent.raise();
+			raiseUserEvent_();
 
 		if (!isValidCqChunk(nextWord & ~kNextPresent)) {
 			_haveCqChunk = false;
@@ -188,7 +221,7 @@ coroutine<void> IpcQueue::submit(QueueSource *source, uintptr_t context) {
 	// Signal userspace.
 	auto userNotify = __atomic_fetch_or(&head->userNotify, kUserNotifyCqProgress, __ATOMIC_RELEASE);
 	if(!(userNotify & kUserNotifyCqProgress))
-		_userEvent.raise();
+		raiseUserEvent_();
 
 	_currentProgress += sizeof(ElementStruct) + length;
 }
@@ -211,6 +244,19 @@ void IpcQueue::processSq() {
 		Thread::asyncBlockCurrent(_sqMutex.async_lock(), getCurrentThread()->mainWorkQueue().get());
 	frg::unique_lock lock{frg::adopt_lock, _sqMutex};
 
+	// In batched mode, completions that happen while we dispatch SQ elements
+	// (e.g., of operations that complete immediately) only wake the queue once.
+	bool batching = _flags & kQueueBatchCompletions;
+	if(batching)
+		_batchingCompletions.store(true, std::memory_order_relaxed);
+	frg::scope_exit batchGuard{[&] {
+		if(!batching)
+			return;
+		_batchingCompletions.store(false, std::memory_order_seq_cst);
+		if(_pendingUserEvent.exchange(false, std::memory_order_seq_cst))
+			_userEvent.raise();
+	}};
+
 	// Process SQ elements.
 	while(true) {
 		auto chunkOffset = _chunkOffsets[_sqCurrentChunk];
@@ -273,7 +319,7 @@ void IpcQueue::processSq() {
 			auto userNotify = __atomic_fetch_or(&head->userNotify,
 					kUserNotifySupplySqChunks, __ATOMIC_RELEASE);
 			if(!(userNotify & kUserNotifySupplySqChunks)) {
-				_userEvent.raise();
+				raiseUserEvent_();
 			}
 
 			_sqCurrentChunk = nextWord & ~kNextPresent;
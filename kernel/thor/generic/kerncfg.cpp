@@ -10,8 +10,12 @@
 #include <thor-internal/stream.hpp>
 #include <thor-internal/timer.hpp>
 #include <thor-internal/mbus.hpp>
+#include <thor-internal/address-space.hpp>
+#include <thor-internal/memory-view.hpp>
 #include <thor-internal/physical.hpp>
 #include <thor-internal/elf-notes.hpp>
+#include <thor-internal/work-queue.hpp>
+#include <thor-internal/arch-generic/asid.hpp>
 #include <eir/interface.hpp>
 
 #include <bragi/helpers-frigg.hpp>
@@ -88,6 +92,257 @@ private:
 			resp.set_available_memory(physicalAllocator->numFreePages());
 			resp.set_memory_unit(kPageSize);
 
+			auto cacheStats = physicalAllocator->pageCacheStats();
+			resp.set_page_cache_pages(cacheStats.cachedPages);
+			resp.set_page_cache_hits(cacheStats.hits);
+			resp.set_page_cache_misses(cacheStats.misses);
+			resp.set_huge_pages_mapped(
+					hugePageStatistics.numMapped.load(std::memory_order_relaxed));
+			resp.set_huge_page_splits(
+					hugePageStatistics.numSplits.load(std::memory_order_relaxed));
+
+			auto shootdownStats = getShootdownStatistics();
+			resp.set_tlb_shootdown_ipis(shootdownStats.numIpisSent);
+			resp.set_tlb_shootdown_ipis_coalesced(shootdownStats.numIpisCoalesced);
+			resp.set_tlb_full_flushes(shootdownStats.numFullFlushes);
+			resp.set_tlb_lazy_flushes(shootdownStats.numLazyFlushes);
+
+			frg::unique_memory<KernelAlloc> respBuffer{*kernelAlloc, resp.size_of_head()};
+			bragi::write_head_only(resp, respBuffer);
+			auto respError = co_await sendBuffer(lane, std::move(respBuffer));
+			if(respError != Error::success)
+				co_return respError;
+		}else if(preamble.id() == bragi::message_id<managarm::kerncfg::GetReclaimStatisticsRequest>) {
+			auto req = bragi::parse_head_only<managarm::kerncfg::GetReclaimStatisticsRequest>(reqBuffer, *kernelAlloc);
+
+			if (!req)
+				co_return Error::protocolViolation;
+
+			auto stats = getReclaimStatistics();
+
+			managarm::kerncfg::GetReclaimStatisticsResponse<KernelAlloc> resp(*kernelAlloc);
+			resp.set_error(managarm::kerncfg::Error::SUCCESS);
+			resp.set_reclaimable_pages(stats.cachePages);
+			resp.set_pinned_pages(stats.pinnedPages);
+			resp.set_low_watermark(stats.lowWatermark);
+			resp.set_high_watermark(stats.highWatermark);
+			resp.set_rotations(stats.numRotations);
+			resp.set_pressure_rotations(stats.numPressureRotations);
+			resp.set_posted_pages(stats.numPostedPages);
+			resp.set_evicted_pages(stats.numEvictedPages);
+
+			frg::unique_memory<KernelAlloc> respBuffer{*kernelAlloc, resp.size_of_head()};
+			bragi::write_head_only(resp, respBuffer);
+			auto respError = co_await sendBuffer(lane, std::move(respBuffer));
+			if(respError != Error::success)
+				co_return respError;
+		}else if(preamble.id() == bragi::message_id<managarm::kerncfg::SetReclaimWatermarksRequest>) {
+			auto req = bragi::parse_head_only<managarm::kerncfg::SetReclaimWatermarksRequest>(reqBuffer, *kernelAlloc);
+
+			if (!req)
+				co_return Error::protocolViolation;
+
+			managarm::kerncfg::SvrResponse<KernelAlloc> resp(*kernelAlloc);
+			if(setReclaimWatermarks(req->low_watermark(), req->high_watermark())) {
+				resp.set_error(managarm::kerncfg::Error::SUCCESS);
+			}else{
+				resp.set_error(managarm::kerncfg::Error::ILLEGAL_ARGUMENTS);
+			}
+
+			frg::unique_memory<KernelAlloc> respBuffer{*kernelAlloc, resp.size_of_head()};
+			bragi::write_head_only(resp, respBuffer);
+			auto respError = co_await sendBuffer(lane, std::move(respBuffer));
+			if(respError != Error::success)
+				co_return respError;
+		}else if(preamble.id() == bragi::message_id<managarm::kerncfg::GetSwapStatisticsRequest>) {
+			auto req = bragi::parse_head_only<managarm::kerncfg::GetSwapStatisticsRequest>(reqBuffer, *kernelAlloc);
+
+			if (!req)
+				co_return Error::protocolViolation;
+
+			auto stats = getSwapStatistics();
+
+			managarm::kerncfg::GetSwapStatisticsResponse<KernelAlloc> resp(*kernelAlloc);
+			resp.set_error(managarm::kerncfg::Error::SUCCESS);
+			resp.set_total_pages(stats.totalPages);
+			resp.set_used_pages(stats.usedPages);
+			resp.set_swapped_out_pages(stats.numSwappedOut);
+			resp.set_swapped_in_pages(stats.numSwappedIn);
+
+			frg::unique_memory<KernelAlloc> respBuffer{*kernelAlloc, resp.size_of_head()};
+			bragi::write_head_only(resp, respBuffer);
+			auto respError = co_await sendBuffer(lane, std::move(respBuffer));
+			if(respError != Error::success)
+				co_return respError;
+		}else if(preamble.id() == bragi::message_id<managarm::kerncfg::AttachSwapRequest>) {
+			auto req = bragi::parse_head_only<managarm::kerncfg::AttachSwapRequest>(reqBuffer, *kernelAlloc);
+
+			if (!req)
+				co_return Error::protocolViolation;
+
+			auto [descError, descriptor] = co_await pullDescriptor(lane);
+			if(descError != Error::success)
+				co_return descError;
+
+			managarm::kerncfg::SvrResponse<KernelAlloc> resp(*kernelAlloc);
+			auto viewOutcome = descriptor.resolveObject<DescriptorType::memoryView>(
+					kHelRightRead | kHelRightWrite);
+			if(!viewOutcome) {
+				resp.set_error(managarm::kerncfg::Error::ILLEGAL_ARGUMENTS);
+			}else{
+				auto error = attachSwap(std::move(*viewOutcome));
+				if(error == Error::success) {
+					resp.set_error(managarm::kerncfg::Error::SUCCESS);
+				}else if(error == Error::alreadyExists) {
+					resp.set_error(managarm::kerncfg::Error::ALREADY_EXISTS);
+				}else{
+					resp.set_error(managarm::kerncfg::Error::ILLEGAL_ARGUMENTS);
+				}
+			}
+
+			frg::unique_memory<KernelAlloc> respBuffer{*kernelAlloc, resp.size_of_head()};
+			bragi::write_head_only(resp, respBuffer);
+			auto respError = co_await sendBuffer(lane, std::move(respBuffer));
+			if(respError != Error::success)
+				co_return respError;
+		}else if(preamble.id() == bragi::message_id<managarm::kerncfg::GetReadaheadStatisticsRequest>) {
+			auto req = bragi::parse_head_only<managarm::kerncfg::GetReadaheadStatisticsRequest>(reqBuffer, *kernelAlloc);
+
+			if (!req)
+				co_return Error::protocolViolation;
+
+			auto stats = getReadaheadStatistics();
+
+			managarm::kerncfg::GetReadaheadStatisticsResponse<KernelAlloc> resp(*kernelAlloc);
+			resp.set_error(managarm::kerncfg::Error::SUCCESS);
+			resp.set_max_window_pages(stats.maxWindow);
+			resp.set_readahead_pages(stats.numPages);
+			resp.set_readahead_hits(stats.numHits);
+			resp.set_readahead_misses(stats.numMisses);
+
+			frg::unique_memory<KernelAlloc> respBuffer{*kernelAlloc, resp.size_of_head()};
+			bragi::write_head_only(resp, respBuffer);
+			auto respError = co_await sendBuffer(lane, std::move(respBuffer));
+			if(respError != Error::success)
+				co_return respError;
+		}else if(preamble.id() == bragi::message_id<managarm::kerncfg::SetMaxReadaheadRequest>) {
+			auto req = bragi::parse_head_only<managarm::kerncfg::SetMaxReadaheadRequest>(reqBuffer, *kernelAlloc);
+
+			if (!req)
+				co_return Error::protocolViolation;
+
+			managarm::kerncfg::SvrResponse<KernelAlloc> resp(*kernelAlloc);
+			if(setMaxReadahead(req->max_window_pages())) {
+				resp.set_error(managarm::kerncfg::Error::SUCCESS);
+			}else{
+				resp.set_error(managarm::kerncfg::Error::ILLEGAL_ARGUMENTS);
+			}
+
+			frg::unique_memory<KernelAlloc> respBuffer{*kernelAlloc, resp.size_of_head()};
+			bragi::write_head_only(resp, respBuffer);
+			auto respError = co_await sendBuffer(lane, std::move(respBuffer));
+			if(respError != Error::success)
+				co_return respError;
+		}else if(preamble.id() == bragi::message_id<managarm::kerncfg::GetWritebackStatisticsRequest>) {
+			auto req = bragi::parse_head_only<managarm::kerncfg::GetWritebackStatisticsRequest>(reqBuffer, *kernelAlloc);
+
+			if (!req)
+				co_return Error::protocolViolation;
+
+			auto stats = getWritebackStatistics();
+
+			managarm::kerncfg::GetWritebackStatisticsResponse<KernelAlloc> resp(*kernelAlloc);
+			resp.set_error(managarm::kerncfg::Error::SUCCESS);
+			resp.set_dirty_pages(stats.dirtyPages);
+			resp.set_writeback_pages(stats.writebackPages);
+			resp.set_background_ratio(stats.backgroundRatio);
+			resp.set_dirty_ratio(stats.dirtyRatio);
+			resp.set_expire_time(stats.expireNanos);
+			resp.set_expired_flushes(stats.numExpiredFlushes);
+			resp.set_background_flushes(stats.numBackgroundFlushes);
+			resp.set_throttled_writers(stats.numThrottled);
+			resp.set_throttled_time(stats.throttledNanos);
+
+			frg::unique_memory<KernelAlloc> respBuffer{*kernelAlloc, resp.size_of_head()};
+			bragi::write_head_only(resp, respBuffer);
+			auto respError = co_await sendBuffer(lane, std::move(respBuffer));
+			if(respError != Error::success)
+				co_return respError;
+		}else if(preamble.id() == bragi::message_id<managarm::kerncfg::SetWritebackLimitsRequest>) {
+			auto req = bragi::parse_head_only<managarm::kerncfg::SetWritebackLimitsRequest>(reqBuffer, *kernelAlloc);
+
+			if (!req)
+				co_return Error::protocolViolation;
+
+			managarm::kerncfg::SvrResponse<KernelAlloc> resp(*kernelAlloc);
+			if(setWritebackLimits(req->background_ratio(), req->dirty_ratio(),
+					req->expire_time())) {
+				resp.set_error(managarm::kerncfg::Error::SUCCESS);
+			}else{
+				resp.set_error(managarm::kerncfg::Error::ILLEGAL_ARGUMENTS);
+			}
+
+			frg::unique_memory<KernelAlloc> respBuffer{*kernelAlloc, resp.size_of_head()};
+			bragi::write_head_only(resp, respBuffer);
+			auto respError = co_await sendBuffer(lane, std::move(respBuffer));
+			if(respError != Error::success)
+				co_return respError;
+		}else if(preamble.id() == bragi::message_id<managarm::kerncfg::GetFaultAroundStatisticsRequest>) {
+			auto req = bragi::parse_head_only<managarm::kerncfg::GetFaultAroundStatisticsRequest>(reqBuffer, *kernelAlloc);
+
+			if (!req)
+				co_return Error::protocolViolation;
+
+			auto stats = getFaultAroundStatistics();
+
+			managarm::kerncfg::GetFaultAroundStatisticsResponse<KernelAlloc> resp(*kernelAlloc);
+			resp.set_error(managarm::kerncfg::Error::SUCCESS);
+			resp.set_window_pages(stats.window);
+			resp.set_fault_arounds(stats.numFaults);
+			resp.set_fault_around_pages(stats.numPages);
+
+			frg::unique_memory<KernelAlloc> respBuffer{*kernelAlloc, resp.size_of_head()};
+			bragi::write_head_only(resp, respBuffer);
+			auto respError = co_await sendBuffer(lane, std::move(respBuffer));
+			if(respError != Error::success)
+				co_return respError;
+		}else if(preamble.id() == bragi::message_id<managarm::kerncfg::SetFaultAroundWindowRequest>) {
+			auto req = bragi::parse_head_only<managarm::kerncfg::SetFaultAroundWindowRequest>(reqBuffer, *kernelAlloc);
+
+			if (!req)
+				co_return Error::protocolViolation;
+
+			managarm::kerncfg::SvrResponse<KernelAlloc> resp(*kernelAlloc);
+			if(setFaultAroundWindow(req->window_pages())) {
+				resp.set_error(managarm::kerncfg::Error::SUCCESS);
+			}else{
+				resp.set_error(managarm::kerncfg::Error::ILLEGAL_ARGUMENTS);
+			}
+
+			frg::unique_memory<KernelAlloc> respBuffer{*kernelAlloc, resp.size_of_head()};
+			bragi::write_head_only(resp, respBuffer);
+			auto respError = co_await sendBuffer(lane, std::move(respBuffer));
+			if(respError != Error::success)
+				co_return respError;
+		}else if(preamble.id() == bragi::message_id<managarm::kerncfg::GetWorkQueueStatisticsRequest>) {
+			auto req = bragi::parse_head_only<managarm::kerncfg::GetWorkQueueStatisticsRequest>(reqBuffer, *kernelAlloc);
+
+			if (!req)
+				co_return Error::protocolViolation;
+
+			auto stats = WorkQueue::generalStatistics();
+
+			managarm::kerncfg::GetWorkQueueStatisticsResponse<KernelAlloc> resp(*kernelAlloc);
+			resp.set_error(managarm::kerncfg::Error::SUCCESS);
+			resp.set_executed_worklets(stats.numExecuted);
+			resp.set_stolen_worklets(stats.numStolen);
+			resp.set_queued_worklets(stats.depth);
+			resp.set_max_queued_worklets(stats.maxDepth);
+			resp.set_timed_worklets(stats.numTimed);
+			resp.set_total_latency(stats.totalLatency);
+			resp.set_max_latency(stats.maxLatency);
+			resp.set_max_run_time(stats.maxRunTime);
+
 			frg::unique_memory<KernelAlloc> respBuffer{*kernelAlloc, resp.size_of_head()};
 			bragi::write_head_only(resp, respBuffer);
 			auto respError = co_await sendBuffer(lane, std::move(respBuffer));
@@ -239,7 +239,8 @@ void HeapSlabPolicy::unmap(void *ptr, size_t length) {
 				&KernelPageSpace::global(),
 				address,
 				length,
-				WorkQueue::generalQueue().get()
+				WorkQueue::generalQueue().get(),
+				true
 			),
 			[address, length, physicalStack] {
 				auto physical = physicalStack;
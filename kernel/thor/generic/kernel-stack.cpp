@@ -47,7 +47,8 @@ UniqueKernelStack::~UniqueKernelStack() {
 				&KernelPageSpace::global(),
 				address,
 				guardedSize,
-				WorkQueue::generalQueue().get()
+				WorkQueue::generalQueue().get(),
+				true
 			),
 			[address, guardedSize, physicalStack] {
 				auto physical = physicalStack;
@@ -1,5 +1,7 @@
 #include <frg/unique.hpp>
+#include <thor-internal/arch-generic/ints.hpp>
 #include <thor-internal/load-balancing.hpp>
+#include <thor-internal/schedule.hpp>
 #include <thor-internal/timer.hpp>
 
 namespace thor {
@@ -16,10 +18,46 @@ constexpr uint64_t lbInterval = 100'000'000;
 constexpr uint64_t lbDecay = 184;
 constexpr uint64_t lbDecayInterval = 1'000'000'000;
 
+// Minimum time between two idle pulls on the same CPU.
+constexpr uint64_t lbIdlePullInterval = 1'000'000;
+
+// Place woken threads on idle CPUs in the waker's LLC if their previous CPU is busy.
+constexpr bool enableWakeAffine = true;
+
+// Imbalance (in percent of the ideal load) that we tolerate before moving threads
+// across the boundary of each domain. Moving threads between SMT siblings or
+// within an LLC is cheap, while crossing LLCs or NUMA nodes loses cache and memory locality.
+constexpr frg::array<uint64_t, numLbDomains> lbDomainTolerance{0, 0, 12, 25};
+
+constexpr frg::array<LbDomain, numLbDomains> lbDomainsInnermostFirst{
+	LbDomain::smt, LbDomain::llc, LbDomain::numa, LbDomain::system
+};
+
 frg::eternal<LoadBalancer> loadBalancer;
 
+uint64_t domainTolerance(LbDomain domain, uint64_t idealLoad) {
+	return idealLoad * lbDomainTolerance[static_cast<size_t>(domain)] / 100;
+}
+
 } // namespace
 
+LbDomain commonLbDomain(CpuData *a, CpuData *b) {
+	// Without topology information, each CPU is its own core and all CPUs share
+	// an LLC and NUMA node. This is equivalent to a flat hierarchy.
+	auto &ta = a->topology;
+	auto &tb = b->topology;
+	if (!ta.valid || !tb.valid)
+		return a == b ? LbDomain::smt : LbDomain::llc;
+
+	if (ta.numaNode != tb.numaNode)
+		return LbDomain::system;
+	if (ta.llc != tb.llc)
+		return LbDomain::numa;
+	if (ta.core != tb.core)
+		return LbDomain::llc;
+	return LbDomain::smt;
+}
+
 THOR_DEFINE_PERCPU(lbNode);
 
 LoadBalancer &LoadBalancer::singleton() {
@@ -32,6 +70,10 @@ LoadBalancer::LoadBalancer()
 void LoadBalancer::setOnline(CpuData *cpu) {
 	auto *node = &lbNode.get(cpu);
 	node->cpu = cpu;
+	node->idlePullWorklet.setup([] (Worklet *base) {
+		auto *node = frg::container_of(base, &LbNode::idlePullWorklet);
+		loadBalancer->idlePull_(node->cpu);
+	});
 	spawnOnWorkQueue(*kernelAlloc, cpu->generalWorkQueue, loadBalancer->run_(cpu));
 }
 
@@ -71,6 +113,9 @@ coroutine<void> LoadBalancer::run_(CpuData *cpu) {
 
 		if (debugLb)
 			infoLogger() << "CPU #" << cpu->cpuIndex << " enters load balancing" << frg::endlog;
+		thisNode->inRound = true;
+		if (!cpu->cpuIndex)
+			round_.fetch_add(1, std::memory_order_relaxed);
 
 		bool applyDecay = false;
 		auto now = getClockNanos();
@@ -114,10 +159,11 @@ coroutine<void> LoadBalancer::run_(CpuData *cpu) {
 				cb->load_ = thread->loadLevel();
 				load += cb->load_;
 			}
-		}
 
-		thisNode->totalLoad = load;
-		thisNode->currentLoad = load;
+			// Idle pulls on other CPUs may concurrently modify currentLoad.
+			thisNode->totalLoad.store(load, std::memory_order_relaxed);
+			thisNode->currentLoad.store(load, std::memory_order_relaxed);
+		}
 
 		// Destroy stale CBs outside of locks.
 		while(!staleCbs.empty())
@@ -134,7 +180,7 @@ coroutine<void> LoadBalancer::run_(CpuData *cpu) {
 		//       and might be preferable over synchronization overhead.
 		uint64_t systemLoad = 0;
 		for (size_t i = 0; i < getCpuCount(); ++i)
-			systemLoad += lbNode.getFor(i).totalLoad;
+			systemLoad += lbNode.getFor(i).totalLoad.load(std::memory_order_relaxed);
 		uint64_t idealLoad = systemLoad / getCpuCount();
 		if (debugLb && cpu == getCpuData(0))
 			infoLogger() << "Total system load is " << systemLoad
@@ -142,15 +188,30 @@ coroutine<void> LoadBalancer::run_(CpuData *cpu) {
 
 		if (enableLb) {
 			// Distribute load from other CPUs to this CPU.
+			// We pull from CPUs in the innermost common domain first, such that
+			// threads preferably stay within their core, LLC and NUMA node.
 			// TODO: This loop probably does not scale very well since all CPUs try to pull from
 			//       all other CPUs in the same order (and this can cause lock contention).
-			uint64_t newLoad = thisNode->totalLoad;
-			for (size_t i = 0; i < getCpuCount(); ++i) {
-				auto *toCpu = getCpuData(i);
-				if (cpu != toCpu)
-					balanceBetween_(&lbNode.get(toCpu), thisNode, newLoad, idealLoad);
+			uint64_t newLoad = thisNode->totalLoad.load(std::memory_order_relaxed);
+			for (auto domain : lbDomainsInnermostFirst) {
+				for (size_t i = 0; i < getCpuCount(); ++i) {
+					auto *fromCpu = getCpuData(i);
+					if (cpu == fromCpu || commonLbDomain(cpu, fromCpu) != domain)
+						continue;
+					balanceBetween_(&lbNode.get(fromCpu), thisNode, newLoad, idealLoad, domain);
+				}
 			}
 		}
+		thisNode->inRound = false;
+
+		if (debugLb)
+			infoLogger() << "CPU #" << cpu->cpuIndex << " pulled "
+					<< thisNode->numPulled[0] << "/" << thisNode->numPulled[1] << "/"
+					<< thisNode->numPulled[2] << "/" << thisNode->numPulled[3]
+					<< " threads across SMT/LLC/NUMA/system domains ("
+					<< thisNode->numIdlePulls << " idle pulls), "
+					<< thisNode->numWakeAffine << " wake-affine and "
+					<< thisNode->numSyncWakeups << " sync wakeups" << frg::endlog;
 
 		// Balance load again after some time has passed.
 		// Note that we only wait on CPU zero. All other CPUs wait on the barrier instead.
@@ -161,7 +222,179 @@ coroutine<void> LoadBalancer::run_(CpuData *cpu) {
 	co_return;
 }
 
-void LoadBalancer::balanceBetween_(LbNode *srcNode, LbNode *dstNode, uint64_t &newLoad, uint64_t idealLoad) {
+void LoadBalancer::notifyIdle(CpuData *cpu) {
+	assert(!intsAreEnabled());
+	if (!enableLb)
+		return;
+
+	auto *node = &lbNode.get(cpu);
+	if (!node->cpu || node->inRound || node->idlePullPending)
+		return;
+
+	auto now = getClockNanos();
+	if (now - node->lastIdlePull < lbIdlePullInterval)
+		return;
+	// Avoid waking up idle CPUs over and over if there is nothing to pull.
+	// Loads only change at the start of each round.
+	if (node->idlePullFailedRound == round_.load(std::memory_order_relaxed))
+		return;
+	node->idlePullPending = true;
+	node->lastIdlePull = now;
+
+	cpu->generalWorkQueue->post(&node->idlePullWorklet);
+	// The idle task halts after this function returns. Ping ourselves such that
+	// the scheduler switches to the work queue's fiber immediately.
+	sendPingIpi(cpu);
+}
+
+void LoadBalancer::idlePull_(CpuData *cpu) {
+	auto *thisNode = &lbNode.get(cpu);
+	thisNode->idlePullPending = false;
+	if (thisNode->inRound)
+		return;
+
+	// Use the loads of the last balancing round. They are only updated
+	// at the start of each round, so this is a cheap estimate.
+	// Note that idle pulls do not modify totalLoad (since concurrent balancing rounds
+	// rely on it being constant); they only move load between currentLoad values.
+	uint64_t systemLoad = 0;
+	for (size_t i = 0; i < getCpuCount(); ++i)
+		systemLoad += lbNode.getFor(i).totalLoad.load(std::memory_order_relaxed);
+	uint64_t idealLoad = systemLoad / getCpuCount();
+	if (!idealLoad) {
+		thisNode->idlePullFailedRound = round_.load(std::memory_order_relaxed);
+		return;
+	}
+
+	// Pull from the busiest CPU of the innermost domain that has an overloaded CPU.
+	for (auto domain : lbDomainsInnermostFirst) {
+		LbNode *busiestNode = nullptr;
+		for (size_t i = 0; i < getCpuCount(); ++i) {
+			auto *fromCpu = getCpuData(i);
+			if (cpu == fromCpu || commonLbDomain(cpu, fromCpu) != domain)
+				continue;
+			auto *node = &lbNode.get(fromCpu);
+			if (!node->cpu)
+				continue;
+			if (!busiestNode || node->currentLoad.load(std::memory_order_relaxed)
+					> busiestNode->currentLoad.load(std::memory_order_relaxed))
+				busiestNode = node;
+		}
+		if (!busiestNode
+				|| busiestNode->currentLoad.load(std::memory_order_relaxed)
+					<= idealLoad + domainTolerance(domain, idealLoad))
+			continue;
+
+		if (debugLb)
+			infoLogger() << "CPU #" << cpu->cpuIndex << " is idle, pulling from CPU #"
+					<< busiestNode->cpu->cpuIndex << frg::endlog;
+
+		thisNode->numIdlePulls++;
+		uint64_t oldLoad = thisNode->currentLoad.load(std::memory_order_relaxed);
+		uint64_t newLoad = oldLoad;
+		balanceBetween_(busiestNode, thisNode, newLoad, idealLoad, domain);
+		if (newLoad != oldLoad)
+			return;
+	}
+
+	thisNode->idlePullFailedRound = round_.load(std::memory_order_relaxed);
+}
+
+CpuData *LoadBalancer::selectWakeCpu(LbControlBlock *cb, CpuData *prevCpu, bool sync) {
+	assert(!intsAreEnabled());
+	if (!enableWakeAffine)
+		return prevCpu;
+
+	auto *wakerCpu = getCpuData();
+	auto *wakerNode = &lbNode.get(wakerCpu);
+
+	// If the waker is about to block and nothing else waits for its CPU,
+	// the thread can run on the waker's CPU right away. This avoids an IPI
+	// and keeps data that the waker just produced in the cache.
+	if (sync && wakerCpu != prevCpu
+			&& !localScheduler.get().numWaiting()
+			&& commonLbDomain(wakerCpu, prevCpu) <= LbDomain::llc
+			&& cb->inAffinityMask(wakerCpu->cpuIndex)) {
+		wakerNode->numSyncWakeups++;
+		return wakerCpu;
+	}
+
+	// The previous CPU likely still has the thread's working set in its cache.
+	if (localScheduler.get(prevCpu).isIdle())
+		return prevCpu;
+
+	// Wakeups from IRQs that interrupt the idle task can run the thread locally.
+	if (wakerCpu != prevCpu && localScheduler.get().isIdle()
+			&& commonLbDomain(wakerCpu, prevCpu) <= LbDomain::llc
+			&& cb->inAffinityMask(wakerCpu->cpuIndex)) {
+		wakerNode->numWakeAffine++;
+		return wakerCpu;
+	}
+
+	// Otherwise, look for an idle CPU that shares the waker's LLC.
+	// Prefer CPUs on other cores over the waker's SMT siblings since the waker
+	// keeps running (at least for a while). Start the search after the waker
+	// such that concurrent wakeups on different CPUs spread out.
+	CpuData *siblingCpu = nullptr;
+	for (size_t k = 1; k < getCpuCount(); ++k) {
+		auto *cpu = getCpuData((wakerCpu->cpuIndex + k) % getCpuCount());
+		if (cpu == prevCpu || !localScheduler.get(cpu).isIdle())
+			continue;
+		auto domain = commonLbDomain(wakerCpu, cpu);
+		if (domain > LbDomain::llc)
+			continue;
+		if (domain == LbDomain::smt && siblingCpu)
+			continue;
+		if (!cb->inAffinityMask(cpu->cpuIndex))
+			continue;
+		if (domain == LbDomain::smt) {
+			siblingCpu = cpu;
+			continue;
+		}
+		wakerNode->numWakeAffine++;
+		return cpu;
+	}
+	if (siblingCpu) {
+		wakerNode->numWakeAffine++;
+		return siblingCpu;
+	}
+	return prevCpu;
+}
+
+void LoadBalancer::reassign(LbControlBlock *cb, CpuData *cpu) {
+	assert(!intsAreEnabled());
+	auto *dstNode = &lbNode.get(cpu);
+
+	while (true) {
+		auto *srcNode = cb->node_.load(std::memory_order_relaxed);
+		// If balanceBetween_() currently moves the control block, its assignment wins.
+		if (!srcNode || srcNode == dstNode)
+			return;
+
+		// Lock both nodes in a consistent order.
+		auto *firstNode = srcNode < dstNode ? srcNode : dstNode;
+		auto *secondNode = srcNode < dstNode ? dstNode : srcNode;
+		auto firstLock = frg::guard(&firstNode->mutex);
+		auto secondLock = frg::guard(&secondNode->mutex);
+
+		if (cb->node_.load(std::memory_order_relaxed) != srcNode)
+			continue;
+
+		srcNode->tasks.erase(srcNode->tasks.iterator_to(cb));
+		auto srcLoad = srcNode->currentLoad.load(std::memory_order_relaxed);
+		srcNode->currentLoad.store(srcLoad - frg::min(cb->load_, srcLoad),
+				std::memory_order_relaxed);
+		dstNode->tasks.push_back(cb);
+		dstNode->currentLoad.store(dstNode->currentLoad.load(std::memory_order_relaxed)
+				+ cb->load_, std::memory_order_relaxed);
+		cb->node_.store(dstNode, std::memory_order_relaxed);
+		cb->_assignedCpu.store(cpu, std::memory_order_relaxed);
+		return;
+	}
+}
+
+void LoadBalancer::balanceBetween_(LbNode *srcNode, LbNode *dstNode, uint64_t &newLoad, uint64_t idealLoad,
+		LbDomain domain) {
 	auto improvesBalance = [] (uint64_t srcLoad, uint64_t dstLoad, uint64_t stolenLoad) -> bool {
 		uint64_t srcLoadPostMove = srcLoad - stolenLoad;
 		uint64_t dstLoadPostMove = dstLoad + stolenLoad;
@@ -171,6 +404,8 @@ void LoadBalancer::balanceBetween_(LbNode *srcNode, LbNode *dstNode, uint64_t &n
 		return maxLoadPostMove < maxLoad;
 	};
 
+	auto tolerance = domainTolerance(domain, idealLoad);
+
 	// Remove tasks from srcNode, put them into a temporary list.
 	frg::intrusive_list<
 		LbControlBlock,
@@ -193,7 +428,12 @@ void LoadBalancer::balanceBetween_(LbNode *srcNode, LbNode *dstNode, uint64_t &n
 			// Do not attempt to do load balancing if source and destination are both
 			// undersubscribed. While it may still be possible to improve the balance,
 			// it is probably not worth it in terms of effort and cache degradation.
-			if (srcNode->currentLoad < idealLoad && newLoad < idealLoad)
+			auto srcLoad = srcNode->currentLoad.load(std::memory_order_relaxed);
+			if (srcLoad < idealLoad && newLoad < idealLoad)
+				break;
+
+			// Only move threads across LLCs or NUMA nodes if the imbalance is significant.
+			if (tolerance && srcLoad <= idealLoad + tolerance)
 				break;
 
 			// Do not move threads with tiny contributions to the total load.
@@ -203,7 +443,7 @@ void LoadBalancer::balanceBetween_(LbNode *srcNode, LbNode *dstNode, uint64_t &n
 			if (!cb->inAffinityMask(dstNode->cpu->cpuIndex))
 				continue;
 
-			if (!improvesBalance(srcNode->currentLoad, newLoad, cb->load_))
+			if (!improvesBalance(srcLoad, newLoad, cb->load_))
 				continue;
 
 			if (debugLb)
@@ -212,14 +452,15 @@ void LoadBalancer::balanceBetween_(LbNode *srcNode, LbNode *dstNode, uint64_t &n
 						<< " to CPU " << dstNode->cpu->cpuIndex << frg::endlog;
 
 			// Move ownership from srcNode to dstNode.
-			assert(cb->node_ == srcNode);
+			assert(cb->node_.load(std::memory_order_relaxed) == srcNode);
 			srcNode->tasks.erase(currentIt);
-			cb->node_ = dstNode;
+			cb->node_.store(nullptr, std::memory_order_relaxed);
 			cb->_assignedCpu.store(dstNode->cpu, std::memory_order_relaxed);
 			stolenTasks.push_back(cb);
 
-			srcNode->currentLoad -= cb->load_;
+			srcNode->currentLoad.store(srcLoad - cb->load_, std::memory_order_relaxed);
 			newLoad += cb->load_;
+			dstNode->numPulled[static_cast<size_t>(domain)]++;
 		}
 	}
 
@@ -234,6 +475,13 @@ void LoadBalancer::balanceBetween_(LbNode *srcNode, LbNode *dstNode, uint64_t &n
 		auto irqLock = frg::guard(&irqMutex());
 		auto lock = frg::guard(&dstNode->mutex);
 
+		uint64_t stolenLoad = 0;
+		for (auto *cb : stolenTasks) {
+			cb->node_.store(dstNode, std::memory_order_relaxed);
+			stolenLoad += cb->load_;
+		}
+		dstNode->currentLoad.store(dstNode->currentLoad.load(std::memory_order_relaxed) + stolenLoad,
+				std::memory_order_relaxed);
 		dstNode->tasks.splice(dstNode->tasks.end(), stolenTasks);
 	}
 }
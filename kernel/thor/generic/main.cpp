@@ -91,15 +91,18 @@ extern "C" void thorInitialize() {
 	auto region = reinterpret_cast<EirRegion *>(physicalMemoryNote->regionInfo);
 	for(size_t i = 0; i < physicalMemoryNote->numRegions; i++)
 		physicalAllocator->bootstrapRegion(region[i].address, region[i].order,
-				region[i].numRoots, reinterpret_cast<int8_t *>(region[i].buddyTree));
+				region[i].numRoots, reinterpret_cast<int8_t *>(region[i].buddyTree),
+				region[i].numaNode);
 	infoLogger() << "thor: Number of available pages: "
-			<< physicalAllocator->numFreePages() << frg::endlog;
+			<< physicalAllocator->numFreePages() << " on "
+			<< physicalAllocator->numNodes() << " NUMA node(s)" << frg::endlog;
 
 	kernelAlloc.initialize();
 
 	infoLogger() << "thor: Basic memory management is ready" << frg::endlog;
 
 	runCpuDataInitializers();
+	physicalAllocator->enablePageCaches();
 	initializeAsidContext(getCpuData());
 }
 
@@ -706,6 +709,11 @@ void handleSyscall(SyscallImageAccessor image) {
 		*image.error() = helMemoryInfo((HelHandle)arg0, &size);
 		*image.out0() = size;
 	} break;
+	case kHelCallQueryMemoryNodes: {
+		size_t numNodes;
+		*image.error() = helQueryMemoryNodes((HelMemoryNodeStats *)arg0, (size_t)arg1, &numNodes);
+		*image.out0() = numNodes;
+	} break;
 	case kHelCallUpdateMemory: {
 		*image.error() = helUpdateMemory((HelHandle)arg0, (int)arg1,
 				(uintptr_t)arg2, (size_t)arg3);
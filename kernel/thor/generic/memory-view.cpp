@@ -1,3 +1,6 @@
+#include <utility>
+
+#include <frg/cmdline.hpp>
 #include <frg/scope_exit.hpp>
 #include <thor-internal/address-space.hpp>
 #include <thor-internal/arch-generic/asid.hpp>
@@ -19,13 +22,28 @@ namespace {
 	// The following flags are debugging options to debug the correctness of various components.
 	constexpr bool tortureUncaching = false;
 	constexpr bool disableUncaching = false;
+
+	// Default watermarks (in percent of total memory) if they are not given on the command line.
+	// The low watermark matches the previous fixed threshold (reclaim above 75% usage).
+	constexpr size_t defaultLowWatermarkPercent = 25;
+	constexpr size_t defaultHighWatermarkPercent = 30;
+	// Lower bound for the default watermarks, such that small systems keep some headroom
+	// for allocations that cannot wait for reclaim. Capped at half of total memory.
+	constexpr size_t minWatermarkMib = 64;
 }
 
+// Defined below. Dirty pages cannot be reclaimed, hence the reclaimer
+// lets the writeback daemon flush them under memory pressure.
+static void wakeWritebackOnPressure();
+
 // --------------------------------------------------------
 // Reclaim implementation.
 // --------------------------------------------------------
 
 struct MemoryReclaimer {
+	MemoryReclaimer(size_t lowWatermark, size_t highWatermark)
+	: lowWatermark_{lowWatermark}, highWatermark_{highWatermark} { }
+
 	void registerBundle(CacheBundle *bundle) {
 		auto irqLock = frg::guard(&irqMutex());
 		auto lock = frg::guard(&mutex_);
@@ -46,6 +64,7 @@ struct MemoryReclaimer {
 			page->flags |= CachePage::reclaimRegistered;
 		}
 
+		numCachePages_.fetch_add(1, std::memory_order_relaxed);
 		rotationTurnaround_.fetch_add(1, std::memory_order_relaxed);
 		if (shouldRotate_())
 			rotationEvent_.raise();
@@ -70,6 +89,7 @@ struct MemoryReclaimer {
 			bundle->genLists_[page->generation].erase(it);
 		}
 		page->flags &= ~CachePage::reclaimRegistered;
+		numCachePages_.fetch_sub(1, std::memory_order_relaxed);
 	}
 
 	void bumpPage(CachePage *page) {
@@ -119,17 +139,118 @@ struct MemoryReclaimer {
 		auto irqLock = frg::guard(&irqMutex());
 		auto lock = frg::guard(&bundle->reclaimMutex_);
 
-		out.splice(out.end(), bundle->_reclaimList);
+		uint64_t n = 0;
+		while(!bundle->_reclaimList.empty()) {
+			auto page = bundle->_reclaimList.pop_front();
+			assert(page->flags & CachePage::reclaimRegistered);
+			assert(page->flags & CachePage::reclaimPosted);
+			assert(!(page->flags & CachePage::reclaimInflight));
+
+			page->flags |= CachePage::reclaimInflight;
+			out.push_back(page);
+			n++;
+		}
+		numEvictedPages_.fetch_add(n, std::memory_order_relaxed);
+	}
+
+	// The following functions are used by bundles whose pages belong to different objects
+	// (i.e., anonymous memory). Such bundles need to keep the owner of a page alive
+	// before they can take the owner's lock.
 
-		for(auto page : out) {
+	// Calls pin() on the first page of the reclaim list until pin() succeeds.
+	// Pages that cannot be pinned are moved back to the newest generation.
+	// Returns nullptr if the reclaim list is empty.
+	template<typename F>
+	CachePage *pinPostedPage(CacheBundle *bundle, F pin) {
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&bundle->reclaimMutex_);
+
+		while(!bundle->_reclaimList.empty()) {
+			auto page = bundle->_reclaimList.front();
+			assert(page->flags & CachePage::reclaimPosted);
+			assert(!(page->flags & CachePage::reclaimInflight));
+			if(pin(page))
+				return page;
+
+			bundle->_reclaimList.pop_front();
+			page->flags &= ~CachePage::reclaimPosted;
+			page->generation = bundle->newestGen_;
+			bundle->genLists_[bundle->newestGen_].push_back(page);
+		}
+		return nullptr;
+	}
+
+	// Like reclaimPages() but only takes (up to n) pages for which pred() is true.
+	template<typename F>
+	void reclaimPagesIf(CacheBundle *bundle, CachePagesList &out, size_t n, F pred) {
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&bundle->reclaimMutex_);
+
+		// Bound the amount of work that we do while holding the lock.
+		size_t scanned = 0;
+		uint64_t taken = 0;
+		auto it = bundle->_reclaimList.begin();
+		while(it != bundle->_reclaimList.end() && taken < n && scanned < 4 * n) {
+			auto page = *it;
+			++it;
+			++scanned;
+			if(!pred(page))
+				continue;
 			assert(page->flags & CachePage::reclaimRegistered);
 			assert(page->flags & CachePage::reclaimPosted);
 			assert(!(page->flags & CachePage::reclaimInflight));
 
+			bundle->_reclaimList.erase(bundle->_reclaimList.iterator_to(page));
 			page->flags |= CachePage::reclaimInflight;
+			out.push_back(page);
+			taken++;
+		}
+		numEvictedPages_.fetch_add(taken, std::memory_order_relaxed);
+	}
+
+	// Moves all pages on the reclaim list back to the newest generation.
+	void unpostPages(CacheBundle *bundle) {
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&bundle->reclaimMutex_);
+
+		while(!bundle->_reclaimList.empty()) {
+			auto page = bundle->_reclaimList.pop_front();
+			page->flags &= ~CachePage::reclaimPosted;
+			page->generation = bundle->newestGen_;
+			bundle->genLists_[bundle->newestGen_].push_back(page);
 		}
 	}
 
+	// Whether reclaim should currently free memory (i.e., free memory is below the high watermark).
+	bool underPressure() {
+		return belowHighWatermark_();
+	}
+
+	ReclaimStatistics statistics() {
+		auto cachePages = numCachePages_.load(std::memory_order_relaxed);
+		return {
+			.cachePages = cachePages,
+			.pinnedPages = pinnedPages_(cachePages),
+			.lowWatermark = lowWatermark_.load(std::memory_order_relaxed),
+			.highWatermark = highWatermark_.load(std::memory_order_relaxed),
+			.numRotations = numRotations_.load(std::memory_order_relaxed),
+			.numPressureRotations = numPressureRotations_.load(std::memory_order_relaxed),
+			.numPostedPages = numPostedPages_.load(std::memory_order_relaxed),
+			.numEvictedPages = numEvictedPages_.load(std::memory_order_relaxed),
+		};
+	}
+
+	bool setWatermarks(size_t lowWatermark, size_t highWatermark) {
+		if(lowWatermark > highWatermark || highWatermark > physicalAllocator->numTotalPages())
+			return false;
+		// Readers may briefly observe a mix of old and new values; this is harmless.
+		lowWatermark_.store(lowWatermark, std::memory_order_relaxed);
+		highWatermark_.store(highWatermark, std::memory_order_relaxed);
+		// Let the reclaim fiber re-evaluate the pressure.
+		rotationEvent_.raise();
+		return true;
+	}
+
 	void runReclaimFiber() {
 		KernelFiber::run([this] {
 			if (disableUncaching)
@@ -144,12 +265,16 @@ struct MemoryReclaimer {
 							<< " KiB in use" << frg::endlog;
 				}
 
-				// On memory pressure: rotate generations until pressure drops.
+				// On memory pressure: return the pages of the per-CPU caches to the allocator,
+				// then rotate generations until we reach the high watermark.
 				if (checkPressure_()) {
+					wakeWritebackOnPressure();
+					physicalAllocator->drainPageCaches();
 					for(unsigned int i = 1; i <= CacheBundle::numGenerations; i++) {
-						if(!checkPressure_())
+						if(!belowHighWatermark_())
 							break;
 
+						numPressureRotations_.fetch_add(1, std::memory_order_relaxed);
 						auto result = rotateGenerations_();
 						if(logReclaim) {
 							infoLogger() << frg::fmt(
@@ -204,6 +329,7 @@ private:
 
 	RotateResult rotateGenerations_() {
 		rotationTurnaround_.store(0, std::memory_order_relaxed);
+		numRotations_.fetch_add(1, std::memory_order_relaxed);
 
 		size_t sizeReclaimed = 0;
 		for(auto it = bundleList_.begin(); it != bundleList_.end(); ++it) {
@@ -235,24 +361,36 @@ private:
 			if(anyReclaimed)
 				bundle->_reclaimEvent.raise();
 		}
+		numPostedPages_.fetch_add(sizeReclaimed / kPageSize, std::memory_order_relaxed);
 
 		return {
 			.sizeReclaimed = sizeReclaimed
 		};
 	}
 
+	// Used pages that cannot be reclaimed.
+	size_t pinnedPages_(size_t cachePages) {
+		auto usedPages = physicalAllocator->numUsedPages();
+		// The counters are not updated atomically with respect to each other.
+		return usedPages > cachePages ? usedPages - cachePages : 0;
+	}
+
 	bool shouldRotate_() {
-		// TODO: We assume that half of total memory is available for CachePages.
-		//       Instead, we should track how many non-swappable pages are allocated
-		//       and subtract that from the total page count.
-		auto totalCachePages = physicalAllocator->numTotalPages() / 2;
-		auto threshold = totalCachePages / CacheBundle::numGenerations;
+		// All memory that is not pinned can be used for CachePages.
+		auto totalCachePages = physicalAllocator->numTotalPages()
+				- pinnedPages_(numCachePages_.load(std::memory_order_relaxed));
+		auto threshold = frg::max(totalCachePages / CacheBundle::numGenerations, size_t{1});
 		return rotationTurnaround_.load(std::memory_order_relaxed) >= threshold;
 	}
 
 	bool checkPressure_() {
-		auto watermark = physicalAllocator->numTotalPages() * 3 / 4;
-		return tortureUncaching || physicalAllocator->numUsedPages() >= watermark;
+		return tortureUncaching
+				|| physicalAllocator->numFreePages() < lowWatermark_.load(std::memory_order_relaxed);
+	}
+
+	bool belowHighWatermark_() {
+		return tortureUncaching
+				|| physicalAllocator->numFreePages() < highWatermark_.load(std::memory_order_relaxed);
 	}
 
 	frg::ticket_spinlock mutex_;
@@ -270,6 +408,19 @@ private:
 	// Number of pages bumped since the last generation rotation.
 	std::atomic<size_t> rotationTurnaround_{0};
 
+	// Number of pages that are registered with the reclaimer.
+	std::atomic<size_t> numCachePages_{0};
+
+	// Watermarks in pages of free memory.
+	std::atomic<size_t> lowWatermark_;
+	std::atomic<size_t> highWatermark_;
+
+	// Statistics.
+	std::atomic<uint64_t> numRotations_{0};
+	std::atomic<uint64_t> numPressureRotations_{0};
+	std::atomic<uint64_t> numPostedPages_{0};
+	std::atomic<uint64_t> numEvictedPages_{0};
+
 	async::recurring_event rotationEvent_;
 };
 
@@ -278,11 +429,583 @@ static frg::manual_box<MemoryReclaimer> globalReclaimer;
 static initgraph::Task initReclaim{&globalInitEngine, "generic.init-reclaim",
 	initgraph::Requires{getFibersAvailableStage()},
 	[] {
-		globalReclaimer.initialize();
+		auto totalPages = physicalAllocator->numTotalPages();
+		size_t totalMib = totalPages * kPageSize / (1024 * 1024);
+		size_t floorMib = frg::min(minWatermarkMib, totalMib / 2);
+		size_t lowMib = frg::max(totalMib * defaultLowWatermarkPercent / 100, floorMib);
+		size_t highMib = frg::max(totalMib * defaultHighWatermarkPercent / 100, floorMib);
+
+		frg::array args = {
+			frg::option{"reclaim.low-mib", frg::as_number(lowMib)},
+			frg::option{"reclaim.high-mib", frg::as_number(highMib)},
+		};
+		frg::parse_arguments(getKernelCmdline(), args);
+
+		auto lowWatermark = frg::min(lowMib * (1024 * 1024) / kPageSize, totalPages);
+		auto highWatermark = frg::min(highMib * (1024 * 1024) / kPageSize, totalPages);
+		if(lowWatermark > highWatermark) {
+			warningLogger() << "thor: Ignoring reclaim.high-mib below reclaim.low-mib"
+					<< frg::endlog;
+			highWatermark = lowWatermark;
+		}
+		infoLogger() << "thor: Reclaiming page cache below " << lowWatermark * kPageSize / 1024
+				<< " KiB of free memory (until " << highWatermark * kPageSize / 1024
+				<< " KiB are free)" << frg::endlog;
+
+		globalReclaimer.initialize(lowWatermark, highWatermark);
 		globalReclaimer->runReclaimFiber();
 	}
 };
 
+ReclaimStatistics getReclaimStatistics() {
+	return globalReclaimer->statistics();
+}
+
+bool setReclaimWatermarks(size_t lowWatermark, size_t highWatermark) {
+	return globalReclaimer->setWatermarks(lowWatermark, highWatermark);
+}
+
+// --------------------------------------------------------
+// Writeback implementation.
+// --------------------------------------------------------
+
+namespace {
+	// Default limits; these follow Linux' vm.dirty_* defaults.
+	constexpr unsigned int defaultBackgroundRatio = 10;
+	constexpr unsigned int defaultDirtyRatio = 20;
+	constexpr uint64_t defaultDirtyExpire = 30'000'000'000;
+
+	// The writeback daemon looks for expired dirty pages in this interval.
+	constexpr uint64_t writebackInterval = 5'000'000'000;
+	// Throttled writers wait at most this long, even if writeback does not make progress.
+	// This bounds the pause of servers that (indirectly) throttle themselves.
+	constexpr uint64_t maxThrottlePause = 200'000'000;
+}
+
+// Decides when dirty pages of ManagedSpaces are written back and throttles writers.
+// Each ManagedSpace keeps its dirty pages on its _dirtyList until a flush is requested;
+// flushes are performed by the ManagedSpace's draining coroutine.
+struct WritebackScheduler {
+	void registerSpace(ManagedSpace *space) {
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&mutex_);
+
+		spaceList_.push_back(space);
+	}
+
+	// Accounts for a page that became dirty. firstOfSpace is true if no other page
+	// of the same ManagedSpace is dirty. Returns true if the daemon needs to be woken up.
+	bool addDirty(bool firstOfSpace) {
+		if(firstOfSpace)
+			numDirtySpaces_.fetch_add(1, std::memory_order_relaxed);
+		auto dirtyPages = numDirtyPages_.fetch_add(1, std::memory_order_relaxed) + 1;
+		return dirtyPages > limit_(backgroundRatio_.load(std::memory_order_relaxed))
+				&& !wakeRequested_.exchange(true, std::memory_order_relaxed);
+	}
+
+	// Accounts for a dirty page that became clean.
+	void removeDirty(bool lastOfSpace) {
+		if(lastOfSpace)
+			numDirtySpaces_.fetch_sub(1, std::memory_order_relaxed);
+		numDirtyPages_.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	void addWriteback(size_t numPages) {
+		numWritebackPages_.fetch_add(numPages, std::memory_order_relaxed);
+	}
+
+	void removeWriteback(size_t numPages) {
+		numWritebackPages_.fetch_sub(numPages, std::memory_order_relaxed);
+	}
+
+	void wake() {
+		wakeEvent_.raise();
+	}
+
+	// Called by the reclaimer under memory pressure. flushSpaces_() then flushes
+	// all ManagedSpaces with dirty pages, regardless of the background ratio.
+	void wakeOnPressure() {
+		if(!numDirtyPages_.load(std::memory_order_relaxed))
+			return;
+		if(!wakeRequested_.exchange(true, std::memory_order_relaxed))
+			wakeEvent_.raise();
+	}
+
+	// Wakes up throttled writers. Called after writeback completes.
+	void notifyProgress() {
+		progressEvent_.raise();
+	}
+
+	// Pauses a writer to the given ManagedSpace while dirty pages exceed the dirty ratio
+	// and the ManagedSpace holds more than its share of them (i.e., more than the limit
+	// divided by the number of ManagedSpaces with dirty pages).
+	coroutine<void> throttle(ManagedSpace *space) {
+		auto limit = limit_(dirtyRatio_.load(std::memory_order_relaxed));
+		if(numDirtyPages_.load(std::memory_order_relaxed) <= limit)
+			co_return;
+		auto share = limit / frg::max(numDirtySpaces_.load(std::memory_order_relaxed), size_t{1});
+		{
+			auto irqLock = frg::guard(&irqMutex());
+			auto lock = frg::guard(&space->mutex);
+
+			if(space->numDirtyPages <= share)
+				co_return;
+		}
+
+		space->requestFlush();
+
+		numThrottled_.fetch_add(1, std::memory_order_relaxed);
+		auto start = getClockNanos();
+		co_await async::race_and_cancel(
+			async::lambda([&] (async::cancellation_token ct) -> coroutine<void> {
+				co_await progressEvent_.async_wait_if([&] () -> bool {
+					return numDirtyPages_.load(std::memory_order_relaxed) > limit;
+				}, ct);
+			}),
+			async::lambda([&] (async::cancellation_token ct) -> coroutine<void> {
+				co_await generalTimerEngine()->sleepFor(maxThrottlePause, ct);
+			})
+		);
+		throttledNanos_.fetch_add(getClockNanos() - start, std::memory_order_relaxed);
+	}
+
+	WritebackStatistics statistics() {
+		auto dirtyPages = numDirtyPages_.load(std::memory_order_relaxed);
+		auto writebackPages = numWritebackPages_.load(std::memory_order_relaxed);
+		return {
+			.dirtyPages = dirtyPages,
+			// The counters are not updated atomically with respect to each other.
+			.writebackPages = frg::min(writebackPages, dirtyPages),
+			.backgroundRatio = backgroundRatio_.load(std::memory_order_relaxed),
+			.dirtyRatio = dirtyRatio_.load(std::memory_order_relaxed),
+			.expireNanos = expireNanos_.load(std::memory_order_relaxed),
+			.numExpiredFlushes = numExpiredFlushes_.load(std::memory_order_relaxed),
+			.numBackgroundFlushes = numBackgroundFlushes_.load(std::memory_order_relaxed),
+			.numThrottled = numThrottled_.load(std::memory_order_relaxed),
+			.throttledNanos = throttledNanos_.load(std::memory_order_relaxed),
+		};
+	}
+
+	bool setLimits(unsigned int backgroundRatio, unsigned int dirtyRatio, uint64_t expireNanos) {
+		if(backgroundRatio > dirtyRatio || dirtyRatio > 100 || !expireNanos)
+			return false;
+		// Readers may briefly observe a mix of old and new values; this is harmless.
+		backgroundRatio_.store(backgroundRatio, std::memory_order_relaxed);
+		dirtyRatio_.store(dirtyRatio, std::memory_order_relaxed);
+		expireNanos_.store(expireNanos, std::memory_order_relaxed);
+		// Let the daemon re-evaluate the limits.
+		wakeRequested_.store(true, std::memory_order_relaxed);
+		wakeEvent_.raise();
+		return true;
+	}
+
+	void runWritebackFiber() {
+		KernelFiber::run([this] {
+			while(true) {
+				wakeRequested_.store(false, std::memory_order_relaxed);
+				flushSpaces_();
+
+				KernelFiber::asyncBlockCurrent(
+					async::race_and_cancel(
+						[&] (async::cancellation_token ct) {
+							return async::transform(
+								wakeEvent_.async_wait_if([&] -> bool {
+									return !wakeRequested_.load(std::memory_order_relaxed);
+								}, ct),
+								[] (auto) {}
+							);
+						},
+						[&] (async::cancellation_token ct) {
+							return async::transform(
+								generalTimerEngine()->sleepFor(writebackInterval, ct),
+								[] (auto) {}
+							);
+						}
+					)
+				);
+			}
+		});
+	}
+
+private:
+	size_t limit_(unsigned int ratio) {
+		return physicalAllocator->numTotalPages() / 100 * ratio;
+	}
+
+	// Requests flushes of all ManagedSpaces whose dirty pages expired.
+	// Above the background ratio (or under memory pressure, since dirty pages
+	// cannot be reclaimed), all ManagedSpaces with dirty pages are flushed.
+	void flushSpaces_() {
+		auto now = getClockNanos();
+		auto expire = expireNanos_.load(std::memory_order_relaxed);
+		bool background = numDirtyPages_.load(std::memory_order_relaxed)
+					> limit_(backgroundRatio_.load(std::memory_order_relaxed))
+				|| globalReclaimer->underPressure();
+
+		for(auto it = spaceList_.begin(); it != spaceList_.end(); ++it) {
+			auto *space = *it;
+
+			bool flush = false;
+			{
+				auto irqLock = frg::guard(&irqMutex());
+				auto lock = frg::guard(&space->mutex);
+
+				// Skip ManagedSpaces that already have a flush in progress.
+				if(space->_dirtyList.empty() || space->_flushedSeq != space->_flushSeq)
+					continue;
+
+				if(background) {
+					numBackgroundFlushes_.fetch_add(1, std::memory_order_relaxed);
+					flush = true;
+				}else if(now - space->_dirtiedSince >= expire) {
+					numExpiredFlushes_.fetch_add(1, std::memory_order_relaxed);
+					flush = true;
+				}
+				if(flush)
+					space->_flushSeq++;
+			}
+
+			if(flush)
+				space->_dirtyEvent.raise();
+		}
+	}
+
+	frg::ticket_spinlock mutex_;
+
+	// Protected against modification by mutex_.
+	frg::intrusive_rcu_list<
+		ManagedSpace,
+		frg::locate_member<
+			ManagedSpace,
+			frg::intrusive_rcu_list_hook<ManagedSpace>,
+			&ManagedSpace::writebackHook
+		>
+	> spaceList_;
+
+	std::atomic<size_t> numDirtyPages_{0};
+	std::atomic<size_t> numWritebackPages_{0};
+	// Number of ManagedSpaces with at least one dirty page.
+	std::atomic<size_t> numDirtySpaces_{0};
+
+	std::atomic<unsigned int> backgroundRatio_{defaultBackgroundRatio};
+	std::atomic<unsigned int> dirtyRatio_{defaultDirtyRatio};
+	std::atomic<uint64_t> expireNanos_{defaultDirtyExpire};
+
+	// Statistics.
+	std::atomic<uint64_t> numExpiredFlushes_{0};
+	std::atomic<uint64_t> numBackgroundFlushes_{0};
+	std::atomic<uint64_t> numThrottled_{0};
+	std::atomic<uint64_t> throttledNanos_{0};
+
+	std::atomic<bool> wakeRequested_{false};
+	async::recurring_event wakeEvent_;
+	async::recurring_event progressEvent_;
+};
+
+static frg::manual_box<WritebackScheduler> globalWriteback;
+// Set once globalWriteback is initialized; the reclaimer is initialized independently.
+static std::atomic<bool> writebackInitialized{false};
+
+static initgraph::Task initWriteback{&globalInitEngine, "generic.init-writeback",
+	initgraph::Requires{getFibersAvailableStage()},
+	[] {
+		globalWriteback.initialize();
+		globalWriteback->runWritebackFiber();
+		writebackInitialized.store(true, std::memory_order_release);
+	}
+};
+
+static void wakeWritebackOnPressure() {
+	if(!writebackInitialized.load(std::memory_order_acquire))
+		return;
+	globalWriteback->wakeOnPressure();
+}
+
+WritebackStatistics getWritebackStatistics() {
+	return globalWriteback->statistics();
+}
+
+bool setWritebackLimits(unsigned int backgroundRatio, unsigned int dirtyRatio,
+		uint64_t expireNanos) {
+	return globalWriteback->setLimits(backgroundRatio, dirtyRatio, expireNanos);
+}
+
+// --------------------------------------------------------
+// Swap implementation.
+// --------------------------------------------------------
+
+namespace {
+	// Maximal number of pages of a single CopyOnWriteMemory that are swapped out at once.
+	constexpr size_t maxSwapOutBatch = 64;
+	// Maximal number of slots that we try before giving up on storing a page.
+	constexpr size_t maxDonationAttempts = 16;
+}
+
+// Pages are written to the swap area by donating them to the ManagedSpace that backs it.
+// The ManagedSpace writes them back to userspace and reclaims them like other cache pages.
+struct SwapArea {
+	SwapArea(smarter::shared_ptr<MemoryView> view, smarter::shared_ptr<ManagedSpace> managed,
+			size_t numSlots)
+	: view_{std::move(view)}, managed_{std::move(managed)}, numSlots_{numSlots},
+			slotBitmap_{*kernelAlloc} {
+		slotBitmap_.resize((numSlots + 63) / 64, 0);
+		// Slot zero is never used, such that a swap signature at the start of the device
+		// (e.g., written by mkswap) is preserved.
+		slotBitmap_[0] |= 1;
+	}
+
+	// On success, the physical page is owned by the swap area and the slot is returned.
+	frg::optional<size_t> storePage(PhysicalAddr physical) {
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&mutex_);
+
+		size_t attempts = 0;
+		for(size_t i = 0; i < numSlots_ && attempts < maxDonationAttempts; i++) {
+			auto slot = nextSlot_;
+			nextSlot_ = (nextSlot_ + 1) % numSlots_;
+			if(slotBitmap_[slot / 64] & (uint64_t{1} << (slot % 64)))
+				continue;
+
+			attempts++;
+			if(!managed_->donatePage(slot, physical))
+				continue;
+			slotBitmap_[slot / 64] |= uint64_t{1} << (slot % 64);
+			numUsedSlots_++;
+			numSwappedOut_.fetch_add(1, std::memory_order_relaxed);
+			return slot;
+		}
+		return frg::null_opt;
+	}
+
+	coroutine<frg::expected<Error>> loadPage(size_t slot, void *buffer) {
+		auto outcome = co_await view_->copyFrom(slot << kPageShift, buffer, kPageSize);
+		if(!outcome) {
+			warningLogger() << "thor: Failed to read slot " << slot
+					<< " from the swap area" << frg::endlog;
+			co_return Error::fault;
+		}
+		numSwappedIn_.fetch_add(1, std::memory_order_relaxed);
+		co_return {};
+	}
+
+	void freeSlot(size_t slot) {
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&mutex_);
+
+		assert(slot && slot < numSlots_);
+		assert(slotBitmap_[slot / 64] & (uint64_t{1} << (slot % 64)));
+		slotBitmap_[slot / 64] &= ~(uint64_t{1} << (slot % 64));
+		numUsedSlots_--;
+	}
+
+	// Starts writeback of donated pages. Must be called without holding locks.
+	void kickWriteback() {
+		managed_->requestFlush();
+	}
+
+	SwapStatistics statistics() {
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&mutex_);
+
+		return {
+			.totalPages = numSlots_ - 1,
+			.usedPages = numUsedSlots_,
+			.numSwappedOut = numSwappedOut_.load(std::memory_order_relaxed),
+			.numSwappedIn = numSwappedIn_.load(std::memory_order_relaxed),
+		};
+	}
+
+private:
+	smarter::shared_ptr<MemoryView> view_;
+	smarter::shared_ptr<ManagedSpace> managed_;
+	size_t numSlots_;
+
+	frg::ticket_spinlock mutex_;
+
+	// Protected by mutex_. Set bits correspond to used slots.
+	frg::vector<uint64_t, KernelAlloc> slotBitmap_;
+	size_t nextSlot_ = 1;
+	size_t numUsedSlots_ = 0;
+
+	std::atomic<uint64_t> numSwappedOut_{0};
+	std::atomic<uint64_t> numSwappedIn_{0};
+};
+
+// CacheBundle for the pages of all CopyOnWriteMemory objects.
+// Use counts and swap states are protected by the mutex of the page's owner.
+struct AnonymousBundle final : CacheBundle {
+	void incrementUses(CachePage *cachePage) override;
+	void decrementUses(CachePage *cachePage) override;
+
+	// Anonymous pages are always written to the swap area on swap-out.
+	void markDirty(CachePage *) override { }
+
+	void runSwapOut();
+};
+
+namespace {
+	frg::ticket_spinlock swapAttachMutex;
+	frg::manual_box<SwapArea> globalSwapArea;
+	frg::manual_box<AnonymousBundle> anonymousBundle;
+	// Set (with release semantics) after globalSwapArea and anonymousBundle are initialized.
+	std::atomic<bool> swapAttached{false};
+}
+
+void AnonymousBundle::incrementUses(CachePage *cachePage) {
+	auto page = frg::container_of(cachePage, &CowPage::cachePage);
+	auto owner = page->owner;
+
+	auto irqLock = frg::guard(&irqMutex());
+	auto lock = frg::guard(&owner->_mutex);
+
+	auto cnt = cachePage->useCount.fetch_add(1, std::memory_order_acquire);
+	if(!cnt) {
+		if(page->swapState == SwapState::inReclaimer) {
+			globalReclaimer->removePage(cachePage);
+			page->swapState = SwapState::none;
+		}else if(page->swapState == SwapState::performSwapOut) {
+			page->swapState = SwapState::avertSwapOut;
+		}
+	}
+}
+
+void AnonymousBundle::decrementUses(CachePage *cachePage) {
+	auto page = frg::container_of(cachePage, &CowPage::cachePage);
+	auto owner = page->owner;
+
+	auto irqLock = frg::guard(&irqMutex());
+	auto lock = frg::guard(&owner->_mutex);
+
+	auto cnt = cachePage->useCount.fetch_sub(1, std::memory_order_release);
+	assert(cnt > 0);
+	if(cnt == 1)
+		owner->updateSwapState_(page);
+}
+
+void AnonymousBundle::runSwapOut() {
+	[] (AnonymousBundle *self, enable_detached_coroutine) -> void {
+		while(true) {
+			co_await globalReclaimer->awaitReclaim(self);
+
+			// Generations are also rotated without memory pressure.
+			// We do not want to write anonymous memory to swap in this case.
+			if(!globalReclaimer->underPressure()) {
+				globalReclaimer->unpostPages(self);
+				continue;
+			}
+
+			smarter::shared_ptr<CopyOnWriteMemory> owner;
+			auto first = globalReclaimer->pinPostedPage(self, [&] (CachePage *cachePage) -> bool {
+				auto page = frg::container_of(cachePage, &CowPage::cachePage);
+				owner = page->weakOwner.lock();
+				return static_cast<bool>(owner);
+			});
+			if(!first)
+				continue;
+
+			// Swap out a batch of pages of the same owner, such that a single fence is enough.
+			CachePagesList batch;
+			{
+				auto irqLock = frg::guard(&irqMutex());
+				auto lock = frg::guard(&owner->_mutex);
+
+				globalReclaimer->reclaimPagesIf(self, batch, maxSwapOutBatch,
+						[ownerPtr = owner.get()] (CachePage *cachePage) {
+					return frg::container_of(cachePage, &CowPage::cachePage)->owner == ownerPtr;
+				});
+
+				for(auto cachePage : batch) {
+					auto page = frg::container_of(cachePage, &CowPage::cachePage);
+					assert(page->swappable);
+					assert(page->state == CowState::hasCopy);
+					assert(page->swapState == SwapState::inReclaimer);
+					assert(!page->lockCount);
+					page->swapState = SwapState::performSwapOut;
+					globalReclaimer->removePage(cachePage);
+				}
+			}
+
+			if(batch.empty())
+				continue;
+
+			co_await owner->_evictQueue.fenceEphemeral();
+
+			size_t numStored = 0;
+			{
+				auto irqLock = frg::guard(&irqMutex());
+				auto lock = frg::guard(&owner->_mutex);
+
+				while(!batch.empty()) {
+					auto page = frg::container_of(batch.pop_front(), &CowPage::cachePage);
+
+					if(page->swapState == SwapState::avertSwapOut) {
+						page->swapState = SwapState::none;
+						owner->updateSwapState_(page);
+						continue;
+					}
+					assert(page->swapState == SwapState::performSwapOut);
+					assert(page->swappable);
+					assert(!page->lockCount);
+
+					page->swapState = SwapState::none;
+					auto slot = globalSwapArea->storePage(page->physical);
+					if(!slot) {
+						// The swap area is full. Keep the page in the LRU.
+						owner->updateSwapState_(page);
+						continue;
+					}
+
+					page->state = CowState::swapped;
+					page->physical = PhysicalAddr(-1);
+					page->swapSlot = *slot;
+					numStored++;
+				}
+			}
+
+			if(numStored)
+				globalSwapArea->kickWriteback();
+
+			if(logReclaim)
+				infoLogger() << frg::fmt(
+					"thor: Swapped out 0x{:x} bytes",
+					numStored * kPageSize
+				) << frg::endlog;
+		}
+	}(this, enable_detached_coroutine{WorkQueue::generalQueue().lock()});
+}
+
+SwapStatistics getSwapStatistics() {
+	if(!swapAttached.load(std::memory_order_acquire))
+		return {};
+	return globalSwapArea->statistics();
+}
+
+Error attachSwap(smarter::shared_ptr<MemoryView> view) {
+	auto managed = view->getManagedSpace();
+	if(!managed)
+		return Error::illegalObject;
+	auto numSlots = view->getLength() >> kPageShift;
+	if(numSlots < 2)
+		return Error::illegalArgs;
+
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&swapAttachMutex);
+
+		if(swapAttached.load(std::memory_order_relaxed))
+			return Error::alreadyExists;
+		globalSwapArea.initialize(std::move(view), std::move(managed), numSlots);
+		anonymousBundle.initialize();
+		swapAttached.store(true, std::memory_order_release);
+	}
+
+	infoLogger() << "thor: Attached swap area of " << (numSlots - 1) * kPageSize / 1024
+			<< " KiB" << frg::endlog;
+	globalReclaimer->registerBundle(anonymousBundle.get());
+	anonymousBundle->runSwapOut();
+	return Error::success;
+}
+
 // --------------------------------------------------------
 // MemoryView.
 // --------------------------------------------------------
@@ -298,6 +1021,10 @@ coroutine<frg::expected<Error, smarter::shared_ptr<MemoryView>>> MemoryView::for
 	co_return Error::illegalObject;
 }
 
+coroutine<frg::expected<Error>> MemoryView::exemptFromSwap() {
+	co_return {};
+}
+
 coroutine<frg::expected<Error>> MemoryView::copyTo(uintptr_t offset,
 		const void *pointer, size_t size,
 		FetchFlags flags) {
@@ -402,6 +1129,10 @@ Error MemoryView::setIndirection(size_t, smarter::shared_ptr<MemoryView>,
 	return Error::illegalObject;
 }
 
+smarter::shared_ptr<ManagedSpace> MemoryView::getManagedSpace() {
+	return nullptr;
+}
+
 coroutine<frg::expected<Error>> copyBetweenViews(
 		MemoryView *destView, uintptr_t destOffset,
 		MemoryView *srcView, uintptr_t srcOffset, size_t size) {
@@ -788,7 +1519,7 @@ std::expected<smarter::shared_ptr<AllocatedMemory>, Error> AllocatedMemory::crea
 
 AllocatedMemory::AllocatedMemory(CtorToken, size_t desiredLngth,
 		int addressBits, size_t desiredChunkSize, size_t chunkAlign)
-: _physicalChunks{*kernelAlloc},
+: _physicalChunks{*kernelAlloc}, _hugeBlocks{*kernelAlloc},
 		_addressBits{addressBits}, _chunkAlign{chunkAlign} {
 	static_assert(sizeof(unsigned long) == sizeof(uint64_t), "Fix use of __builtin_clzl");
 	_chunkSize = size_t(1) << (64 - __builtin_clzl(desiredChunkSize - 1));
@@ -806,6 +1537,8 @@ AllocatedMemory::AllocatedMemory(CtorToken, size_t desiredLngth,
 	assert(_chunkAlign % kPageSize == 0);
 	assert(_chunkSize % _chunkAlign == 0);
 	_physicalChunks.resize(length / _chunkSize, PhysicalAddr(-1));
+	if(_useHugePages())
+		_hugeBlocks.resize(length / kHugePageSize, false);
 }
 
 AllocatedMemory::~AllocatedMemory() {
@@ -814,7 +1547,16 @@ AllocatedMemory::~AllocatedMemory() {
 	if(logUsage)
 		infoLogger() << "thor: Releasing AllocatedMemory ("
 				<< (physicalAllocator->numUsedPages() * 4) << " KiB in use)" << frg::endlog;
+	constexpr size_t chunksPerHugePage = kHugePageSize / kPageSize;
 	for(size_t i = 0; i < _physicalChunks.size(); ++i) {
+		if(i % chunksPerHugePage == 0 && i / chunksPerHugePage < _hugeBlocks.size()
+				&& _hugeBlocks[i / chunksPerHugePage]) {
+			for(size_t pg = 0; pg < kHugePageSize; pg += kPageSize)
+				globalPfnDb().erase(_physicalChunks[i] + pg);
+			physicalAllocator->free(_physicalChunks[i], kHugePageSize);
+			i += chunksPerHugePage - 1;
+			continue;
+		}
 		if(_physicalChunks[i] != PhysicalAddr(-1)) {
 			for(size_t pg = 0; pg < _chunkSize; pg += kPageSize)
 				globalPfnDb().erase(_physicalChunks[i] + pg);
@@ -840,6 +1582,8 @@ coroutine<frg::expected<Error>> AllocatedMemory::resize(size_t newSize) {
 		if (numChunks < _physicalChunks.size())
 			co_return Error::illegalArgs;
 		_physicalChunks.resize(numChunks, PhysicalAddr(-1));
+		if(_useHugePages())
+			_hugeBlocks.resize(newSize / kHugePageSize, false);
 	}
 	co_return {};
 }
@@ -865,9 +1609,14 @@ PhysicalRange AllocatedMemory::peekRange(uintptr_t offset, FetchFlags) {
 	if(_physicalChunks[index] == PhysicalAddr(-1))
 		return PhysicalRange{};
 
+	auto size = _chunkSize - misalign;
+	auto hugeIndex = offset / kHugePageSize;
+	if(hugeIndex < _hugeBlocks.size() && _hugeBlocks[hugeIndex])
+		size = kHugePageSize - (offset & (kHugePageSize - 1));
+
 	return PhysicalRange{
 		.physical = _physicalChunks[index] + misalign,
-		.size = _chunkSize - misalign,
+		.size = size,
 		.cachingMode = CachingMode::null,
 		.isMutable = true
 	};
@@ -877,11 +1626,72 @@ coroutine<frg::expected<Error, size_t>>
 AllocatedMemory::touchRange(uintptr_t offset, size_t, FetchFlags) {
 	assert(currentIpl() == ipl::exceptionalWork);
 
-	auto irqLock = frg::guard(&irqMutex());
-	auto lock = frg::guard(&_mutex);
+	constexpr size_t chunksPerHugePage = kHugePageSize / kPageSize;
 
 	auto index = offset / _chunkSize;
 	auto misalign = offset & (_chunkSize - 1);
+	auto hugeIndex = offset / kHugePageSize;
+	auto first = hugeIndex * chunksPerHugePage;
+
+	// Returns true if the entire huge page surrounding offset can be populated at once.
+	// Must be called with _mutex held.
+	auto wantsHugePage = [&] () -> bool {
+		if(_physicalChunks[index] != PhysicalAddr(-1) || hugeIndex >= _hugeBlocks.size())
+			return false;
+		for(size_t i = 0; i < chunksPerHugePage; ++i) {
+			if(_physicalChunks[first + i] != PhysicalAddr(-1))
+				return false;
+		}
+		return true;
+	};
+
+	bool tryHuge;
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&_mutex);
+
+		if(index >= _physicalChunks.size())
+			co_return Error::fault;
+		tryHuge = wantsHugePage();
+	}
+
+	// Try to populate the entire surrounding huge page at once.
+	// Allocating and zeroing 2 MiB takes a while, hence we do it without holding _mutex.
+	if(tryHuge) {
+		auto physical = physicalAllocator->allocate(kHugePageSize, _addressBits);
+		// If this fails, we fall back to allocating individual chunks.
+		if(physical != PhysicalAddr(-1)) {
+			assert(!(physical & (kHugePageSize - 1)));
+			for(size_t i = 0; i < chunksPerHugePage; ++i) {
+				PageAccessor accessor{physical + i * kPageSize};
+				memset(accessor.get(), 0, kPageSize);
+			}
+
+			bool installed = false;
+			{
+				auto irqLock = frg::guard(&irqMutex());
+				auto lock = frg::guard(&_mutex);
+
+				// The memory may have been resized or populated concurrently.
+				if(index < _physicalChunks.size() && wantsHugePage()) {
+					for(size_t i = 0; i < chunksPerHugePage; ++i) {
+						globalPfnDb().insert(physical + i * kPageSize, PfnDescriptor::otherPage());
+						_physicalChunks[first + i] = physical + i * kPageSize;
+					}
+					_hugeBlocks[hugeIndex] = true;
+					installed = true;
+				}
+			}
+			if(installed)
+				co_return kHugePageSize - (offset & (kHugePageSize - 1));
+
+			// Another thread won the race.
+			physicalAllocator->free(physical, kHugePageSize);
+		}
+	}
+
+	auto irqLock = frg::guard(&irqMutex());
+	auto lock = frg::guard(&_mutex);
 
 	if(index >= _physicalChunks.size())
 		co_return Error::fault;
@@ -915,11 +1725,45 @@ size_t AllocatedMemory::getLength() {
 // ManagedSpace
 // --------------------------------------------------------
 
-ManagedSpace::ManagedSpace(size_t length, bool readahead)
-: pages{*kernelAlloc}, numPages{length >> kPageShift}, readahead{readahead} {
+namespace {
+	// Readahead windows (in pages, including the page that is touched) start at this size,
+	// double on each sequential access and halve on each random access.
+	constexpr size_t initialReadahead = 4;
+	// Upper limit for setMaxReadahead(), since readahead requests pages with IRQs disabled.
+	constexpr size_t readaheadLimit = 4096;
+
+	// 2 MiB by default.
+	std::atomic<size_t> maxReadahead{512};
+
+	std::atomic<uint64_t> numReadaheadPages{0};
+	std::atomic<uint64_t> numReadaheadHits{0};
+	std::atomic<uint64_t> numReadaheadMisses{0};
+}
+
+ReadaheadStatistics getReadaheadStatistics() {
+	return {
+		.maxWindow = maxReadahead.load(std::memory_order_relaxed),
+		.numPages = numReadaheadPages.load(std::memory_order_relaxed),
+		.numHits = numReadaheadHits.load(std::memory_order_relaxed),
+		.numMisses = numReadaheadMisses.load(std::memory_order_relaxed),
+	};
+}
+
+bool setMaxReadahead(size_t maxWindow) {
+	if(!maxWindow || maxWindow > readaheadLimit)
+		return false;
+	maxReadahead.store(maxWindow, std::memory_order_relaxed);
+	return true;
+}
+
+ManagedSpace::ManagedSpace(size_t length, bool readahead, size_t maxRequestSize)
+: pages{*kernelAlloc}, numPages{length >> kPageShift}, readahead{readahead},
+		maxRequestPages{maxRequestSize >> kPageShift} {
 	assert(!(length & (kPageSize - 1)));
+	assert(maxRequestPages);
 
 	globalReclaimer->registerBundle(this);
+	globalWriteback->registerSpace(this);
 
 	[] (ManagedSpace *self, enable_detached_coroutine) -> void {
 		while(true) {
@@ -949,7 +1793,7 @@ ManagedSpace::ManagedSpace(size_t length, bool readahead)
 
 			co_await self->_evictQueue.fenceEphemeral();
 
-			bool anyDirty = false;
+			bool wakeWriteback = false;
 			size_t sizeFreed = 0;
 			while(!batch.empty()) {
 				PhysicalAddr physical;
@@ -964,9 +1808,8 @@ ManagedSpace::ManagedSpace(size_t length, bool readahead)
 					if(page->transactionState == TxState::avertReclaim) {
 						if(page->stillDirty) {
 							page->stillDirty = false;
-							page->transactionState = TxState::dirty;
-							self->_dirtyList.push_back(&page->cachePage);
-							anyDirty = true;
+							if(self->_enterDirty(page))
+								wakeWriteback = true;
 						} else if(page->lockCount
 								|| page->cachePage.useCount.load(std::memory_order_relaxed)) {
 							page->transactionState = TxState::none;
@@ -999,8 +1842,8 @@ ManagedSpace::ManagedSpace(size_t length, bool readahead)
 				sizeFreed += kPageSize;
 			}
 
-			if(anyDirty)
-				self->_dirtyEvent.raise();
+			if(wakeWriteback)
+				globalWriteback->wake();
 
 			if(logUncaching)
 				infoLogger() << frg::fmt(
@@ -1012,47 +1855,61 @@ ManagedSpace::ManagedSpace(size_t length, bool readahead)
 
 	[] (ManagedSpace *self, enable_detached_coroutine) -> void {
 		while(true) {
+			// Dirty pages stay on _dirtyList until the writeback daemon
+			// (or a fence) requests a flush.
 			co_await self->_dirtyEvent.async_wait_if([self] () -> bool {
 				auto irqLock = frg::guard(&irqMutex());
 				auto lock = frg::guard(&self->mutex);
-				return self->_dirtyList.empty();
+				return self->_flushedSeq == self->_flushSeq;
 			});
 
 			frg::intrusive_list<
 				CachePage,
 				frg::locate_member<CachePage, frg::default_list_hook<CachePage>, &CachePage::listHook>
 			> pending;
+			uint64_t seq;
 			{
 				auto irqLock = frg::guard(&irqMutex());
 				auto lock = frg::guard(&self->mutex);
+				seq = self->_flushSeq;
 				pending.splice(pending.end(), self->_dirtyList);
 			}
-			if (pending.empty())
-				continue;
 
-			co_await self->_evictQueue.fenceDirty();
+			if(!pending.empty()) {
+				co_await self->_evictQueue.fenceDirty();
 
-			ManageList mgmtPending;
-			{
-				auto irqLock = frg::guard(&irqMutex());
-				auto lock = frg::guard(&self->mutex);
+				ManageList mgmtPending;
+				{
+					auto irqLock = frg::guard(&irqMutex());
+					auto lock = frg::guard(&self->mutex);
+
+					size_t numPromoted = 0;
+					while(!pending.empty()) {
+						auto *cp = pending.pop_front();
+						auto *page = frg::container_of(cp, &ManagedPage::cachePage);
+						assert(page->transactionState == TxState::dirty);
+						page->transactionState = TxState::wantWriteback;
+						page->monitor = frg::allocate_intrusive_shared<TransactionMonitor>(Allocator{});
+						self->_writebackList.push_back(cp);
+						numPromoted++;
+					}
+					globalWriteback->addWriteback(numPromoted);
 
-				while(!pending.empty()) {
-					auto *cp = pending.pop_front();
-					auto *page = frg::container_of(cp, &ManagedPage::cachePage);
-					assert(page->transactionState == TxState::dirty);
-					page->transactionState = TxState::wantWriteback;
-					page->monitor = frg::allocate_intrusive_shared<TransactionMonitor>(Allocator{});
-					self->_writebackList.push_back(cp);
+					self->_progressManagement(mgmtPending);
 				}
 
-				self->_progressManagement(mgmtPending);
+				while(!mgmtPending.empty()) {
+					auto node = mgmtPending.pop_front();
+					node->completionEvent.raise();
+				}
 			}
 
-			while(!mgmtPending.empty()) {
-				auto node = mgmtPending.pop_front();
-				node->completionEvent.raise();
+			{
+				auto irqLock = frg::guard(&irqMutex());
+				auto lock = frg::guard(&self->mutex);
+				self->_flushedSeq = seq;
 			}
+			self->_flushedEvent.raise();
 		}
 	}(this, enable_detached_coroutine{WorkQueue::generalQueue().lock()});
 }
@@ -1130,24 +1987,37 @@ void ManagedSpace::_progressManagement(ManageList &pending) {
 	// "Proper" priorization should probably be done in the userspace driver
 	// (we do not want to store per-page priorities here).
 
-	while(!_writebackList.empty() && !_managementQueue.empty()) {
-		auto page = _writebackList.front();
-		auto index = page->identity;
-
-		// Fuse the request with adjacent pages in the list.
-		ptrdiff_t count = 0;
-		while(!_writebackList.empty()) {
-			auto fuse_cache_page = _writebackList.front();
-			auto fuse_index = fuse_cache_page->identity;
-			auto fuse_managed_page = frg::container_of(fuse_cache_page, &ManagedPage::cachePage);
-			if(fuse_index != index + count)
-				break;
-			assert(fuse_managed_page->transactionState == TxState::wantWriteback);
-			fuse_managed_page->transactionState = TxState::writeback;
+	// Fuses the request for the page at the front of the list with all adjacent pages
+	// that want the same transaction, regardless of their position in the list.
+	// Returns the first index and the number of pages of the request.
+	auto fuse = [&] (auto &list, TxState want, TxState now) -> std::pair<size_t, size_t> {
+		auto page = list.pop_front();
+		auto frontPage = frg::container_of(page, &ManagedPage::cachePage);
+		assert(frontPage->transactionState == want);
+		frontPage->transactionState = now;
+
+		auto take = [&] (size_t index) -> bool {
+			auto pit = pages.find(index);
+			if(!pit || pit->transactionState != want)
+				return false;
+			list.erase(list.iterator_to(&pit->cachePage));
+			pit->transactionState = now;
+			return true;
+		};
+
+		size_t index = page->identity;
+		size_t count = 1;
+		while(count < maxRequestPages && index + count < numPages && take(index + count))
+			count++;
+		while(count < maxRequestPages && index && take(index - 1)) {
+			index--;
 			count++;
-			_writebackList.pop_front();
 		}
-		assert(count);
+		return {index, count};
+	};
+
+	while(!_writebackList.empty() && !_managementQueue.empty()) {
+		auto [index, count] = fuse(_writebackList, TxState::wantWriteback, TxState::writeback);
 
 		auto node = _managementQueue.pop_front();
 		node->setup(Error::success, ManageRequest::writeback,
@@ -1156,23 +2026,8 @@ void ManagedSpace::_progressManagement(ManageList &pending) {
 	}
 
 	while(!_initializationList.empty() && !_managementQueue.empty()) {
-		auto page = _initializationList.front();
-		auto index = page->identity;
-
-		// Fuse the request with adjacent pages in the list.
-		ptrdiff_t count = 0;
-		while(!_initializationList.empty()) {
-			auto fuse_cache_page = _initializationList.front();
-			auto fuse_index = fuse_cache_page->identity;
-			auto fuse_managed_page = frg::container_of(fuse_cache_page, &ManagedPage::cachePage);
-			if(fuse_index != index + count)
-				break;
-			assert(fuse_managed_page->transactionState == TxState::wantInitialization);
-			fuse_managed_page->transactionState = TxState::initialization;
-			count++;
-			_initializationList.pop_front();
-		}
-		assert(count);
+		auto [index, count] = fuse(_initializationList,
+				TxState::wantInitialization, TxState::initialization);
 
 		auto node = _managementQueue.pop_front();
 		node->setup(Error::success, ManageRequest::initialize,
@@ -1181,6 +2036,58 @@ void ManagedSpace::_progressManagement(ManageList &pending) {
 	}
 }
 
+bool ManagedSpace::_requestInitialization(ManagedPage *page) {
+	if(page->loadState != LoadState::missing
+			|| page->transactionState != TxState::none)
+		return false;
+	page->transactionState = TxState::wantInitialization;
+	_initializationList.push_back(&page->cachePage);
+	page->monitor = frg::allocate_intrusive_shared<TransactionMonitor>(Allocator{});
+	return true;
+}
+
+bool ManagedSpace::_readahead(size_t index, bool demand) {
+	auto maxWindow = maxReadahead.load(std::memory_order_relaxed);
+	// Repeated touches of the same page do not break sequential access.
+	bool sequential = index == _raLastIndex || index == _raLastIndex + 1
+			|| (index >= _raStart && index < _raStart + _raSize);
+	_raLastIndex = index;
+
+	size_t start;
+	if(demand) {
+		// The touched page is part of the window.
+		if(sequential) {
+			_raSize = frg::max(2 * _raSize, initialReadahead);
+		}else{
+			_raSize = frg::max(_raSize / 2, initialReadahead);
+		}
+		_raSize = frg::min(_raSize, maxWindow);
+		_raStart = index;
+		_raMarker = index + 1;
+		start = index + 1;
+	}else if(index >= _raMarker && index < _raStart + _raSize) {
+		// Request the next window before the consumer reaches it.
+		_raStart += _raSize;
+		_raSize = frg::min(2 * _raSize, maxWindow);
+		_raMarker = _raStart;
+		start = _raStart;
+	}else{
+		return false;
+	}
+
+	auto end = frg::min(_raStart + _raSize, numPages);
+	bool requested = false;
+	for(auto i = start; i < end; ++i) {
+		auto [page, wasInserted] = pages.find_or_insert(i, this, i);
+		assert(page);
+		if(!_requestInitialization(page))
+			continue;
+		page->readahead = true;
+		numReadaheadPages.fetch_add(1, std::memory_order_relaxed);
+		requested = true;
+	}
+	return requested;
+}
 
 void ManagedSpace::incrementUses(CachePage *cachePage) {
 	auto irqLock = frg::guard(&irqMutex());
@@ -1219,7 +2126,7 @@ void ManagedSpace::decrementUses(CachePage *cachePage) {
 }
 
 void ManagedSpace::markDirty(CachePage *cachePage) {
-	bool needsEvent = false;
+	bool needsWake = false;
 	{
 		auto irqLock = frg::guard(&irqMutex());
 		auto lock = frg::guard(&mutex);
@@ -1234,9 +2141,7 @@ void ManagedSpace::markDirty(CachePage *cachePage) {
 					|| page->transactionState == TxState::inReclaimer)) {
 			if(page->transactionState == TxState::inReclaimer)
 				globalReclaimer->removePage(cachePage);
-			page->transactionState = TxState::dirty;
-			_dirtyList.push_back(cachePage);
-			needsEvent = true;
+			needsWake = _enterDirty(page);
 		} else if(page->transactionState == TxState::performReclaim
 				|| page->transactionState == TxState::avertReclaim) {
 			page->transactionState = TxState::avertReclaim;
@@ -1249,8 +2154,66 @@ void ManagedSpace::markDirty(CachePage *cachePage) {
 		}
 	}
 
-	if(needsEvent)
-		_dirtyEvent.raise();
+	if(needsWake)
+		globalWriteback->wake();
+}
+
+bool ManagedSpace::_enterDirty(ManagedPage *page) {
+	if(_dirtyList.empty())
+		_dirtiedSince = getClockNanos();
+	page->transactionState = TxState::dirty;
+	_dirtyList.push_back(&page->cachePage);
+	return globalWriteback->addDirty(!numDirtyPages++);
+}
+
+void ManagedSpace::requestFlush() {
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&mutex);
+		_flushSeq++;
+	}
+	_dirtyEvent.raise();
+}
+
+coroutine<void> ManagedSpace::flushDirty() {
+	uint64_t seq;
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&mutex);
+		seq = ++_flushSeq;
+	}
+	_dirtyEvent.raise();
+
+	co_await _flushedEvent.async_wait_if([&] () -> bool {
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&mutex);
+		return _flushedSeq < seq;
+	});
+}
+
+bool ManagedSpace::donatePage(size_t index, PhysicalAddr physical) {
+	auto irqLock = frg::guard(&irqMutex());
+	auto lock = frg::guard(&mutex);
+
+	if(index >= numPages)
+		return false;
+	auto [pit, wasInserted] = pages.find_or_insert(index, this, index);
+	assert(pit);
+	// Pages that are still cached (or that are in a transaction) cannot be replaced.
+	if(pit->loadState != LoadState::missing
+			|| pit->transactionState != TxState::none
+			|| pit->lockCount)
+		return false;
+	assert(pit->physical == PhysicalAddr(-1));
+
+	globalPfnDb().insertOrExchange(physical, [&] (frg::optional<PfnDescriptor>) {
+		return PfnDescriptor::cachePage(&pit->cachePage);
+	});
+	pit->physical = physical;
+	pit->loadState = LoadState::present;
+	// The caller requests a flush anyway; hence, there is no need to wake the daemon.
+	_enterDirty(pit);
+	return true;
 }
 
 // --------------------------------------------------------
@@ -1372,6 +2335,7 @@ Error BackingMemory::updateRange(ManageRequest type, size_t offset, size_t lengt
 			&ManagedSpace::TransactionMonitor::pendingHook
 		>
 	> pendingMonitors;
+	bool anyCleaned = false;
 	{
 		auto irqLock = frg::guard(&irqMutex());
 		auto lock = frg::guard(&_managed->mutex);
@@ -1422,6 +2386,9 @@ Error BackingMemory::updateRange(ManageRequest type, size_t offset, size_t lengt
 
 				assert(pit->transactionState == ManagedSpace::TxState::writeback);
 				if(!pit->stillDirty) {
+					globalWriteback->removeDirty(!--_managed->numDirtyPages);
+					globalWriteback->removeWriteback(1);
+					anyCleaned = true;
 					if (pit->lockCount || pit->cachePage.useCount.load(std::memory_order_relaxed)) {
 						pit->transactionState = ManagedSpace::TxState::none;
 					} else {
@@ -1451,6 +2418,9 @@ Error BackingMemory::updateRange(ManageRequest type, size_t offset, size_t lengt
 		monitor->event.raise();
 	}
 
+	if(anyCleaned)
+		globalWriteback->notifyProgress();
+
 	return Error::success;
 }
 
@@ -1460,6 +2430,23 @@ coroutine<frg::expected<Error>> BackingMemory::writebackFence(uintptr_t offset,
 	if (size & (kPageSize - 1))
 		co_return Error::illegalArgs;
 
+	// Dirty pages do not enter writeback before they are flushed.
+	bool anyDirty = false;
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&_managed->mutex);
+
+		for(size_t pg = 0; pg < size; pg += kPageSize) {
+			auto pit = _managed->pages.find((offset + pg) >> kPageShift);
+			if(pit && pit->transactionState == ManagedSpace::TxState::dirty) {
+				anyDirty = true;
+				break;
+			}
+		}
+	}
+	if(anyDirty)
+		co_await _managed->flushDirty();
+
 	size_t pg = 0;
 	while(pg < size) {
 		frg::intrusive_shared_ptr<ManagedSpace::TransactionMonitor, Allocator> monitor;
@@ -1526,6 +2513,7 @@ coroutine<frg::expected<Error>> BackingMemory::invalidateRange(uintptr_t offset,
 		size_t index = (offset + pg) >> kPageShift;
 		frg::intrusive_shared_ptr<ManagedSpace::TransactionMonitor, Allocator> monitor;
 		bool shouldEvict = false;
+		bool needsFlush = false;
 		ManagedSpace::ManagedPage *pit = nullptr;
 		{
 			auto irqLock = frg::guard(&irqMutex());
@@ -1544,6 +2532,9 @@ coroutine<frg::expected<Error>> BackingMemory::invalidateRange(uintptr_t offset,
 					if(!pit->monitor)
 						pit->monitor = frg::allocate_intrusive_shared<ManagedSpace::TransactionMonitor>(Allocator{});
 					monitor = pit->monitor;
+				} else if(pit->transactionState == ManagedSpace::TxState::dirty) {
+					// Wait until the page enters writeback, then wait for its monitor.
+					needsFlush = true;
 				} else if(pit->monitor) {
 					monitor = pit->monitor;
 				} else if(!pit->lockCount) {
@@ -1557,6 +2548,11 @@ coroutine<frg::expected<Error>> BackingMemory::invalidateRange(uintptr_t offset,
 			}
 		}
 
+		if(needsFlush) {
+			co_await _managed->flushDirty();
+			continue;
+		}
+
 		if(shouldEvict) {
 			co_await _managed->_evictQueue.breakRange(index << kPageShift, kPageSize);
 			PhysicalAddr physical;
@@ -1631,6 +2627,13 @@ PhysicalRange FrontalMemory::peekRange(uintptr_t offset, FetchFlags) {
 			pit->transactionState = ManagedSpace::TxState::avertReclaim;
 		}
 
+		// Fault-around maps pages through peekRange() without touchRange();
+		// count pages that were read ahead as hits here, too.
+		if(pit->readahead) {
+			numReadaheadHits.fetch_add(1, std::memory_order_relaxed);
+			pit->readahead = false;
+		}
+
 		return PhysicalRange{
 			.physical = physical + misalign,
 			.size = kPageSize - misalign,
@@ -1647,6 +2650,10 @@ coroutine<frg::expected<Error, size_t>>
 FrontalMemory::touchRange(uintptr_t offset, size_t, FetchFlags flags) {
 	assert(currentIpl() == ipl::exceptionalWork);
 
+	// Writers that dirty more than their share of pages have to wait for writeback.
+	if(flags & fetchRequireMutable)
+		co_await globalWriteback->throttle(_managed.get());
+
 	auto index = offset >> kPageShift;
 	auto misalign = offset & (kPageSize - 1);
 
@@ -1662,6 +2669,14 @@ FrontalMemory::touchRange(uintptr_t offset, size_t, FetchFlags flags) {
 		// Try the fast-paths first.
 		auto [pit, wasInserted] = _managed->pages.find_or_insert(index, _managed.get(), index);
 		assert(pit);
+		if(pit->readahead) {
+			// The flag is stale if the page was evicted before it was touched.
+			if(pit->loadState == ManagedSpace::LoadState::present
+					|| pit->transactionState != ManagedSpace::TxState::none)
+				numReadaheadHits.fetch_add(1, std::memory_order_relaxed);
+			pit->readahead = false;
+		}
+
 		if(pit->loadState == ManagedSpace::LoadState::present) {
 			assert(pit->physical != PhysicalAddr(-1));
 
@@ -1671,43 +2686,30 @@ FrontalMemory::touchRange(uintptr_t offset, size_t, FetchFlags flags) {
 				pit->transactionState = ManagedSpace::TxState::avertReclaim;
 			}
 
-			co_return kPageSize - misalign;
+			// Sequential consumers keep hitting present pages; read ahead of them.
+			if(!_managed->readahead || !_managed->_readahead(index, false))
+				co_return kPageSize - misalign;
+			_managed->_progressManagement(pendingManagement);
 		}else{
 			assert(pit->loadState == ManagedSpace::LoadState::missing);
-		}
-
-		if(flags & fetchDisallowBacking) {
-			urgentLogger() << "thor: Backing of page is disallowed" << frg::endlog;
-			co_return Error::fault;
-		}
 
-		// We have to take the slow-path, i.e., perform the fetch asynchronously.
-		if(pit->loadState == ManagedSpace::LoadState::missing
-				&& pit->transactionState == ManagedSpace::TxState::none) {
-			pit->transactionState = ManagedSpace::TxState::wantInitialization;
-			_managed->_initializationList.push_back(&pit->cachePage);
-			pit->monitor = frg::allocate_intrusive_shared<ManagedSpace::TransactionMonitor>(Allocator{});
-		}
+			if(flags & fetchDisallowBacking) {
+				urgentLogger() << "thor: Backing of page is disallowed" << frg::endlog;
+				co_return Error::fault;
+			}
 
-		// Perform readahead.
-		if(_managed->readahead)
-			for(size_t i = 1; i < 4; ++i) {
-				if(!(index + i < _managed->numPages))
-					break;
-				auto [pit, wasInserted] = _managed->pages.find_or_insert(
-						index + i, _managed.get(), index + i);
-				assert(pit);
-				if(pit->loadState == ManagedSpace::LoadState::missing
-						&& pit->transactionState == ManagedSpace::TxState::none) {
-					pit->transactionState = ManagedSpace::TxState::wantInitialization;
-					_managed->_initializationList.push_back(&pit->cachePage);
-					pit->monitor = frg::allocate_intrusive_shared<ManagedSpace::TransactionMonitor>(Allocator{});
-				}
+			// We have to take the slow-path, i.e., perform the fetch asynchronously.
+			bool demand = _managed->_requestInitialization(pit);
+			if(_managed->readahead) {
+				if(demand)
+					numReadaheadMisses.fetch_add(1, std::memory_order_relaxed);
+				_managed->_readahead(index, demand);
 			}
 
-		_managed->_progressManagement(pendingManagement);
+			_managed->_progressManagement(pendingManagement);
 
-		fetchMonitor = pit->monitor;
+			fetchMonitor = pit->monitor;
+		}
 	}
 
 	while(!pendingManagement.empty()) {
@@ -1715,7 +2717,8 @@ FrontalMemory::touchRange(uintptr_t offset, size_t, FetchFlags flags) {
 		node->completionEvent.raise();
 	}
 
-	co_await fetchMonitor->event.wait();
+	if(fetchMonitor)
+		co_await fetchMonitor->event.wait();
 
 	co_return kPageSize - misalign;
 }
@@ -1725,6 +2728,10 @@ size_t FrontalMemory::getLength() {
 	return _managed->numPages << kPageShift;
 }
 
+smarter::shared_ptr<ManagedSpace> FrontalMemory::getManagedSpace() {
+	return _managed;
+}
+
 // --------------------------------------------------------
 // IndirectMemory
 // --------------------------------------------------------
@@ -1870,8 +2877,17 @@ Error IndirectMemory::setIndirection(size_t slot, smarter::shared_ptr<MemoryView
 // --------------------------------------------------------
 
 CowPage::~CowPage() {
+	if(swapState == SwapState::inReclaimer)
+		globalReclaimer->removePage(&cachePage);
+	// Pages are kept alive (by their owner) while the swap-out logic processes them.
+	assert(swapState == SwapState::none || swapState == SwapState::inReclaimer);
+
 	if(state == CowState::null)
 		return;
+	if(state == CowState::swapped) {
+		globalSwapArea->freeSlot(swapSlot);
+		return;
+	}
 	assert(state == CowState::hasCopy);
 	assert(physical != PhysicalAddr(-1));
 	globalPfnDb().erase(physical);
@@ -1900,6 +2916,142 @@ CopyOnWriteMemory::CopyOnWriteMemory(CtorToken, smarter::shared_ptr<MemoryView>
 CopyOnWriteMemory::~CopyOnWriteMemory() {
 }
 
+void CopyOnWriteMemory::installPage_(CowPage *page, PhysicalAddr physical) {
+	page->state = CowState::hasCopy;
+	page->physical = physical;
+
+	if(!swapAttached.load(std::memory_order_acquire) || _noSwap) {
+		// The page may have been swappable before it was swapped out.
+		page->swappable = false;
+		globalPfnDb().insert(physical, PfnDescriptor::otherPage());
+		return;
+	}
+
+	if(!page->owner) {
+		page->owner = this;
+		page->weakOwner = selfPtr.lock();
+		page->cachePage.bundle = anonymousBundle.get();
+	}
+	assert(page->owner == this);
+	page->swappable = true;
+	globalPfnDb().insert(physical, PfnDescriptor::cachePage(&page->cachePage));
+	// We do not register the page with the reclaimer yet, since it is usually mapped
+	// right away. This happens once it is unmapped or unlocked (see updateSwapState_()).
+}
+
+void CopyOnWriteMemory::makeUnswappable_(CowPage *page) {
+	if(!page->swappable)
+		return;
+	assert(page->state == CowState::hasCopy);
+	page->swappable = false;
+
+	if(page->swapState == SwapState::inReclaimer) {
+		globalReclaimer->removePage(&page->cachePage);
+		page->swapState = SwapState::none;
+	}else if(page->swapState == SwapState::performSwapOut) {
+		page->swapState = SwapState::avertSwapOut;
+	}
+
+	// Mappings of pages in a CowChain do not need to be tracked anymore.
+	globalPfnDb().insertOrExchange(page->physical, [] (frg::optional<PfnDescriptor>) {
+		return PfnDescriptor::otherPage();
+	});
+}
+
+void CopyOnWriteMemory::updateSwapState_(CowPage *page) {
+	if(!page->swappable
+			|| page->state != CowState::hasCopy
+			|| page->swapState != SwapState::none
+			|| page->lockCount
+			|| page->cachePage.useCount.load(std::memory_order_relaxed))
+		return;
+	globalReclaimer->addPage(&page->cachePage);
+	page->swapState = SwapState::inReclaimer;
+}
+
+coroutine<frg::expected<Error>> CopyOnWriteMemory::swapIn_(CowPage *page) {
+	PhysicalAddr physical = physicalAllocator->allocate(kPageSize);
+	assert(physical != PhysicalAddr(-1) && "OOM");
+
+	// The slot cannot be reused while the page is in CowState::inProgress.
+	auto slot = page->swapSlot;
+	bool loaded;
+	{
+		PageAccessor accessor{physical};
+		loaded = static_cast<bool>(co_await globalSwapArea->loadPage(slot, accessor.get()));
+	}
+	if(!loaded) {
+		// Keep the page in the swap area. Accesses fault (or retry the read later).
+		physicalAllocator->free(physical, kPageSize);
+		{
+			auto irqLock = frg::guard(&irqMutex());
+			auto lock = frg::guard(&_mutex);
+
+			assert(page->state == CowState::inProgress);
+			page->state = CowState::swapped;
+		}
+		_copyEvent.raise();
+		co_return Error::fault;
+	}
+
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&_mutex);
+
+		assert(page->state == CowState::inProgress);
+		installPage_(page, physical);
+	}
+	globalSwapArea->freeSlot(slot);
+	_copyEvent.raise();
+	co_return {};
+}
+
+coroutine<frg::expected<Error>> CopyOnWriteMemory::exemptFromSwap() {
+	frg::vector<smarter::shared_ptr<CowPage>, KernelAlloc> swappedPages{*kernelAlloc};
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&_mutex);
+
+		if(_noSwap)
+			co_return {};
+		_noSwap = true;
+		if(!swapAttached.load(std::memory_order_acquire))
+			co_return {};
+
+		for(size_t pg = 0; pg < _length; pg += kPageSize) {
+			auto it = _ownedPages.find(pg >> kPageShift);
+			if(!it)
+				continue;
+			auto page = *it;
+			if(page->state == CowState::hasCopy) {
+				makeUnswappable_(page.get());
+			}else if(page->state == CowState::swapped) {
+				// As in fork(), the extra lock keeps the page alive until it is read back.
+				page->state = CowState::inProgress;
+				page->lockCount++;
+				swappedPages.push(std::move(page));
+			}
+			// Pages in CowState::inProgress observe _noSwap in installPage_().
+		}
+	}
+
+	bool anyFailed = false;
+	for(auto &page : swappedPages) {
+		auto outcome = co_await swapIn_(page.get());
+		if(!outcome)
+			anyFailed = true;
+
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&_mutex);
+
+		assert(page->lockCount > 0);
+		page->lockCount--;
+	}
+	if(anyFailed)
+		co_return Error::fault;
+	co_return {};
+}
+
 size_t CopyOnWriteMemory::getLength() {
 	return _length;
 }
@@ -1913,6 +3065,7 @@ coroutine<frg::expected<Error, smarter::shared_ptr<MemoryView>>> CopyOnWriteMemo
 	smarter::shared_ptr<CopyOnWriteMemory> forked;
 	smarter::shared_ptr<CowChain> newChain;
 	frg::vector<frg::tuple<size_t, smarter::shared_ptr<CowPage>>, KernelAlloc> inProgressPages{*kernelAlloc};
+	frg::vector<frg::tuple<size_t, smarter::shared_ptr<CowPage>>, KernelAlloc> swappedPages{*kernelAlloc};
 	frg::vector<frg::tuple<size_t, smarter::shared_ptr<CowPage>>, KernelAlloc> lockedCopies{*kernelAlloc};
 
 	{
@@ -1932,6 +3085,7 @@ coroutine<frg::expected<Error, smarter::shared_ptr<MemoryView>>> CopyOnWriteMemo
 		forked = smarter::allocate_shared<CopyOnWriteMemory>(*kernelAlloc, CtorToken{},
 				_view, _viewOffset, _length, newChain);
 		forked->selfPtr = forked;
+		forked->_noSwap = _noSwap;
 
 		// Inspect all copied pages owned by the original mapping.
 		for(size_t pg = 0; pg < _length; pg += kPageSize) {
@@ -1956,11 +3110,21 @@ coroutine<frg::expected<Error, smarter::shared_ptr<MemoryView>>> CopyOnWriteMemo
 			auto page = *it;
 			if(page->state == CowState::null) {
 				continue;
+			}else if(page->state == CowState::swapped) {
+				// Swapped out pages are read back before they are moved to the new chain.
+				// The extra lock keeps them from being swapped out again until we move them.
+				page->state = CowState::inProgress;
+				page->lockCount++;
+				swappedPages.push(frg::make_tuple(pg, page));
+				inProgressPages.push(frg::make_tuple(pg, page));
+				continue;
 			}else if(page->state == CowState::inProgress) {
 				// We wait for the in progress pages later, as we
 				// need to drop the locks we're holding before
 				// suspending, but they are ensuring consistency
 				// of the object we're working on.
+				// As above, the extra lock keeps them from being swapped out.
+				page->lockCount++;
 				inProgressPages.push(frg::make_tuple(pg, page));
 				continue;
 			}else
@@ -1971,6 +3135,7 @@ coroutine<frg::expected<Error, smarter::shared_ptr<MemoryView>>> CopyOnWriteMemo
 				lockedCopies.push(frg::make_tuple(pg, page));
 			}else{
 				assert(page->physical != PhysicalAddr(-1));
+				makeUnswappable_(page.get());
 
 				auto pageOffset = _viewOffset + pg;
 				auto newIt = newChain->_pages.insert(pageOffset >> kPageShift);
@@ -1980,6 +3145,14 @@ coroutine<frg::expected<Error, smarter::shared_ptr<MemoryView>>> CopyOnWriteMemo
 		}
 	}
 
+	// If a page cannot be read back, it stays in the original object and the fork fails.
+	bool anySwapInFailed = false;
+	for(auto [pg, page] : swappedPages) {
+		auto outcome = co_await swapIn_(page.get());
+		if(!outcome)
+			anySwapInFailed = true;
+	}
+
 	// Wait for the in progress pages to complete copying.
 	bool stillWaiting = inProgressPages.size() > 0;
 	while (stillWaiting) {
@@ -2002,6 +3175,12 @@ coroutine<frg::expected<Error, smarter::shared_ptr<MemoryView>>> CopyOnWriteMemo
 
 		// Copy all the previously in progress pages now that they're done copying.
 		for (auto [pg, page] : inProgressPages) {
+			assert(page->lockCount > 0);
+			page->lockCount--;
+			if(page->state == CowState::swapped) {
+				assert(anySwapInFailed);
+				continue;
+			}
 			assert(page->state == CowState::hasCopy);
 
 			if(page->lockCount /*|| disableCow */) {
@@ -2009,6 +3188,7 @@ coroutine<frg::expected<Error, smarter::shared_ptr<MemoryView>>> CopyOnWriteMemo
 				lockedCopies.push(frg::make_tuple(pg, page));
 			}else{
 				assert(page->physical != PhysicalAddr(-1));
+				makeUnswappable_(page.get());
 
 				auto pageOffset = _viewOffset + pg;
 				auto newIt = newChain->_pages.insert(pageOffset >> kPageShift);
@@ -2028,14 +3208,17 @@ coroutine<frg::expected<Error, smarter::shared_ptr<MemoryView>>> CopyOnWriteMemo
 		memcpy(copyAccessor.get(), lockedAccessor.get(), kPageSize);
 
 		auto copyPage = smarter::allocate_shared<CowPage>(*kernelAlloc);
-		copyPage->state = CowState::hasCopy;
-		copyPage->physical = copyPhysical;
-		globalPfnDb().insert(copyPhysical, PfnDescriptor::otherPage());
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&forked->_mutex);
+
+		forked->installPage_(copyPage.get(), copyPhysical);
 		auto copyIt = forked->_ownedPages.insert(pg >> kPageShift);
 		*copyIt = copyPage;
 	}
 
 	co_await _evictQueue.breakRange(0, _length);
+	if(anySwapInFailed)
+		co_return Error::fault;
 	co_return smarter::shared_ptr<MemoryView>{std::move(forked)};
 }
 
@@ -2048,6 +3231,14 @@ Error CopyOnWriteMemory::lockRange(uintptr_t offset, size_t size) {
 		if(it) {
 			auto page = *it;
 			page->lockCount++;
+			if(page->lockCount == 1) {
+				if(page->swapState == SwapState::inReclaimer) {
+					globalReclaimer->removePage(&page->cachePage);
+					page->swapState = SwapState::none;
+				}else if(page->swapState == SwapState::performSwapOut) {
+					page->swapState = SwapState::avertSwapOut;
+				}
+			}
 		}else{
 			auto cowPage = smarter::allocate_shared<CowPage>(*kernelAlloc);
 			cowPage->lockCount = 1;
@@ -2069,6 +3260,8 @@ void CopyOnWriteMemory::unlockRange(uintptr_t offset, size_t size) {
 		auto page = *it;
 		assert(page->lockCount > 0);
 		page->lockCount--;
+		if(!page->lockCount)
+			updateSwapState_(page.get());
 	}
 }
 
@@ -2092,6 +3285,8 @@ PhysicalRange CopyOnWriteMemory::peekRange(uintptr_t offset, FetchFlags flags) {
 			auto page = *it;
 			if(page->state == CowState::hasCopy) {
 				assert(page->physical != PhysicalAddr(-1));
+				if(page->swapState == SwapState::performSwapOut)
+					page->swapState = SwapState::avertSwapOut;
 				return PhysicalRange{
 					.physical = page->physical + misalign,
 					.size = kPageSize - misalign,
@@ -2158,6 +3353,7 @@ CopyOnWriteMemory::touchRange(uintptr_t offset, size_t sizeHint, FetchFlags flag
 	//       callers expect touchRange() to make the page available to peekRange().
 	bool passthrough = false;
 	bool waitForCopy = false;
+	bool swapIn = false;
 	{
 		// If the page is present in our private chain, we just return it.
 		auto irqLock = frg::guard(&irqMutex());
@@ -2174,6 +3370,9 @@ CopyOnWriteMemory::touchRange(uintptr_t offset, size_t sizeHint, FetchFlags flag
 				co_return kPageSize - misalign;
 			}else if(cowPage->state == CowState::inProgress) {
 				waitForCopy = true;
+			}else if(cowPage->state == CowState::swapped) {
+				cowPage->state = CowState::inProgress;
+				swapIn = true;
 			}else{
 				assert(cowPage->state == CowState::null);
 				cowPage->state = CowState::inProgress;
@@ -2216,6 +3415,11 @@ CopyOnWriteMemory::touchRange(uintptr_t offset, size_t sizeHint, FetchFlags flag
 		co_return frg::min(affectedSize, kPageSize - misalign);
 	}
 
+	if(swapIn) {
+		FRG_CO_TRY(co_await swapIn_(cowPage.get()));
+		co_return kPageSize - misalign;
+	}
+
 	if(waitForCopy) {
 		bool stillWaiting;
 		do {
@@ -2224,14 +3428,12 @@ CopyOnWriteMemory::touchRange(uintptr_t offset, size_t sizeHint, FetchFlags flag
 				auto irqLock = frg::guard(&irqMutex());
 				auto lock = frg::guard(&_mutex);
 
-				if(cowPage->state == CowState::inProgress)
-					return true;
-				assert(cowPage->state == CowState::hasCopy);
-				return false;
+				return cowPage->state == CowState::inProgress;
 			});
 		} while(stillWaiting);
 
-		co_return kPageSize - misalign;
+		// The page may have been swapped out again in the meantime.
+		co_return co_await touchRange(offset, sizeHint, flags);
 	}
 
 	PhysicalAddr physical = physicalAllocator->allocate(kPageSize);
@@ -2274,9 +3476,7 @@ CopyOnWriteMemory::touchRange(uintptr_t offset, size_t sizeHint, FetchFlags flag
 		auto lock = frg::guard(&_mutex);
 
 		assert(cowPage->state == CowState::inProgress);
-		cowPage->state = CowState::hasCopy;
-		cowPage->physical = physical;
-		globalPfnDb().insert(physical, PfnDescriptor::otherPage());
+		installPage_(cowPage.get(), physical);
 	}
 	_copyEvent.raise();
 	co_return kPageSize - misalign;
@@ -2285,7 +3485,7 @@ CopyOnWriteMemory::touchRange(uintptr_t offset, size_t sizeHint, FetchFlags flag
 // --------------------------------------------------------------------------------------
 
 namespace {
-	frg::eternal<FutexRealm> globalFutexRealm;
+	frg::eternal<FutexRealm> globalFutexRealm{FutexRealm::globalNumBuckets};
 }
 
 FutexRealm *getGlobalFutexRealm() {
@@ -1,8 +1,8 @@
 #include <bragi/helpers-all.hpp>
 #include <bragi/helpers-frigg.hpp>
 #include <frg/cmdline.hpp>
-#include <frg/small_vector.hpp>
 #include <frg/span.hpp>
+#include <frg/tuple.hpp>
 #include <thor-internal/fiber.hpp>
 #include <thor-internal/kernel-io.hpp>
 #include <thor-internal/main.hpp>
@@ -26,9 +26,152 @@ initgraph::Stage *getOsTraceAvailableStage() {
 	return &s;
 }
 
+namespace ostrace {
+
+// Per-CPU ring that records are serialized into.
+// In contrast to the other record rings, entries never wrap around the end of the ring,
+// such that records can be serialized in place. Space at the end of the ring that is too
+// small for an entry is filled by a padding entry.
+// Entries are produced by a single CPU (with IRQs disabled) but may be consumed on any CPU.
+struct Ring {
+	struct Header {
+		// Size of the payload that follows the header.
+		uint32_t size;
+		uint32_t flags;
+		// Timestamp that is used to merge the rings of all CPUs.
+		uint64_t ts;
+	};
+	static_assert(sizeof(Header) == 16);
+
+	static constexpr uint32_t flagPadding = 1;
+
+	Ring(void *storage, size_t size)
+	: ringSize_{size}, buffer_{static_cast<char *>(storage)} {
+		assert(ringSize_ && (ringSize_ & (ringSize_ - 1)) == 0);
+	}
+
+	// Largest payload that can be stored in the ring.
+	size_t maxPayloadSize() {
+		return ringSize_ / 2 - sizeof(Header);
+	}
+
+	char *reserve(size_t size, uint64_t ts) {
+		assert(!reserved_);
+		if(size > maxPayloadSize())
+			return nullptr;
+
+		auto enqPtr = headPtr_.load(std::memory_order_relaxed);
+		auto offset = enqPtr & (ringSize_ - 1);
+		size_t padSize = 0;
+		if(offset + effectiveSize(size) > ringSize_)
+			padSize = ringSize_ - offset;
+
+		// Compute the invalidated part of the ring buffer.
+		auto invalPtr = tailPtr_.load(std::memory_order_relaxed);
+		while(invalPtr + ringSize_ < enqPtr + padSize + effectiveSize(size)) {
+			assert(invalPtr < enqPtr);
+			Header tail;
+			memcpy(&tail, buffer_ + (invalPtr & (ringSize_ - 1)), sizeof(Header));
+			invalPtr += effectiveSize(tail.size);
+		}
+
+		// Invalidate the ring *before* writing to it.
+		tailPtr_.store(invalPtr, std::memory_order_release);
+
+		if(padSize) {
+			Header padding{.size = static_cast<uint32_t>(padSize - sizeof(Header)),
+					.flags = flagPadding, .ts = 0};
+			memcpy(buffer_ + offset, &padding, sizeof(Header));
+			offset = 0;
+		}
+
+		Header header{.size = static_cast<uint32_t>(size), .flags = 0, .ts = ts};
+		memcpy(buffer_ + offset, &header, sizeof(Header));
+		reserved_ = enqPtr + padSize + effectiveSize(size);
+		return buffer_ + offset + sizeof(Header);
+	}
+
+	void commit() {
+		assert(reserved_);
+		// Commit the operation *after* writing to the ring.
+		headPtr_.store(reserved_, std::memory_order_release);
+		reserved_ = 0;
+	}
+
+	// Returns the header of the first entry at or after deqPtr (if any).
+	frg::tuple<bool, uint64_t, Header> peekAt(uint64_t deqPtr) {
+		Header header;
+		while(true) {
+			// Find a valid position to dequeue from.
+			auto beforePtr = tailPtr_.load(std::memory_order_relaxed);
+			if(deqPtr < beforePtr)
+				deqPtr = beforePtr;
+
+			auto validPtr = headPtr_.load(std::memory_order_acquire);
+			if(deqPtr == validPtr)
+				return {false, deqPtr, Header{}};
+			assert(deqPtr < validPtr);
+
+			memcpy(&header, buffer_ + (deqPtr & (ringSize_ - 1)), sizeof(Header));
+
+			// Validate the header *after* copying.
+			auto afterPtr = tailPtr_.load(std::memory_order_acquire);
+			if(deqPtr < afterPtr)
+				continue;
+
+			if(header.flags & flagPadding) {
+				deqPtr += effectiveSize(header.size);
+				continue;
+			}
+			return {true, deqPtr, header};
+		}
+	}
+
+	frg::tuple<bool, uint64_t, uint64_t, Header>
+	dequeueAt(uint64_t deqPtr, void *data, size_t maxSize) {
+		while(true) {
+			auto [success, entryPtr, header] = peekAt(deqPtr);
+			if(!success)
+				return {false, entryPtr, entryPtr, header};
+
+			auto chunkSize = frg::min(size_t{header.size}, maxSize);
+			memcpy(data, buffer_ + (entryPtr & (ringSize_ - 1)) + sizeof(Header), chunkSize);
+
+			// Validate the data *after* copying.
+			auto afterPtr = tailPtr_.load(std::memory_order_acquire);
+			if(entryPtr < afterPtr) {
+				deqPtr = afterPtr;
+				continue;
+			}
+
+			return {true, entryPtr, entryPtr + effectiveSize(header.size), header};
+		}
+	}
+
+private:
+	static constexpr size_t recordAlign = sizeof(Header);
+
+	size_t effectiveSize(size_t size) {
+		return (sizeof(Header) + size + recordAlign - 1) & ~(recordAlign - 1);
+	}
+
+	size_t ringSize_;
+	char *buffer_;
+	// Only accessed by the producer.
+	uint64_t reserved_{0};
+	std::atomic<uint64_t> tailPtr_{0};
+	std::atomic<uint64_t> headPtr_{0};
+};
+
+} // namespace ostrace
+
 namespace {
 
+constexpr size_t localRingSize = 1 << 18;
+constexpr size_t globalRingSize = 1 << 20;
+
 std::atomic<uint64_t> nextId{1};
+// Records of all CPUs are merged into this ring.
 frg::manual_box<LogRingBuffer> globalOsTraceRing;
 
 initgraph::Task initOsTraceCore{&globalInitEngine, "generic.init-ostrace-core",
@@ -43,8 +186,14 @@ initgraph::Task initOsTraceCore{&globalInitEngine, "generic.init-ostrace-core",
 		if(!wantOsTrace)
 			return;
 
-		void *osTraceMemory = kernelAlloc->allocate(1 << 20);
-		globalOsTraceRing.initialize(reinterpret_cast<uintptr_t>(osTraceMemory), 1 << 20);
+		void *osTraceMemory = kernelAlloc->allocate(globalRingSize);
+		globalOsTraceRing.initialize(reinterpret_cast<uintptr_t>(osTraceMemory), globalRingSize);
+
+		for(size_t cpu = 0; cpu < getCpuCount(); ++cpu) {
+			void *ringMemory = kernelAlloc->allocate(localRingSize);
+			ostrace::context.getFor(cpu).ring = frg::construct<ostrace::Ring>(*kernelAlloc,
+					ringMemory, localRingSize);
+		}
 
 		osTraceInUse.store(true);
 
@@ -52,41 +201,97 @@ initgraph::Task initOsTraceCore{&globalInitEngine, "generic.init-ostrace-core",
 	}
 };
 
-void doEmit(frg::span<char> payload) {
+void doEmit(frg::span<char> payload, uint64_t ts) {
 	if(!osTraceInUse.load(std::memory_order_relaxed))
 		return;
 
-	struct Header {
-		uint32_t size;
-	};
-
-	frg::small_vector<char, 64, KernelAlloc> buffer{*kernelAlloc};
-	buffer.resize(sizeof(Header) + payload.size());
-
-	auto hdr = new (buffer.data()) Header;
-	hdr->size = payload.size();
+	auto irqLock = frg::guard(&irqMutex());
 
-	memcpy(buffer.data() + sizeof(Header), payload.data(), payload.size());
-
-	// We want to be able to call this function from any context, but we cannot wake the waiters
-	// in all contexts. For now, only wake waiters if IRQs are enabled.
-	globalOsTraceRing->enqueue(buffer.data(), buffer.size(), !intsAreEnabled());
+	auto buffer = ostrace::reserve(payload.size(), ts);
+	if(!buffer)
+		return;
+	memcpy(buffer, payload.data(), payload.size());
+	ostrace::commitReserved();
 }
 
+// Definitions are emitted with a timestamp of zero such that they are
+// ordered before all events when the rings are merged.
 template<typename R>
 void commitOsTrace(R record) {
 	if(!osTraceInUse.load(std::memory_order_relaxed))
 		return;
 
 	auto ts = record.size_of_tail();
-	frg::small_vector<char, 64, KernelAlloc> ser(*kernelAlloc);
-	ser.resize(8 + ts);
+
+	auto irqLock = frg::guard(&irqMutex());
+
+	auto buffer = ostrace::reserve(8 + ts, 0);
+	if(!buffer)
+		return;
 	bool encodeSuccess = bragi::write_head_tail(record,
-			frg::span<char>(ser.data(), 8),
-			frg::span<char>(ser.data() + 8, ts));
+			frg::span<char>(buffer, 8),
+			frg::span<char>(buffer + 8, ts));
 	assert(encodeSuccess);
+	ostrace::commitReserved();
+}
 
-	doEmit({ser.data(), ser.size()});
+// Header of the records in the global ring.
+struct FrameHeader {
+	// Size of the payload that follows the header.
+	uint32_t size;
+	// CPU that emitted the record.
+	uint32_t source;
+	uint64_t ts;
+};
+
+// Merges the per-CPU rings into the global ring, ordered by timestamp.
+// Records that are committed after younger records of other CPUs were already merged
+// can still appear out of order; consumers need to sort records within a small window.
+void drainLocalRings() {
+	auto numCpus = getCpuCount();
+	frg::vector<uint64_t, KernelAlloc> deqPtrs{*kernelAlloc};
+	deqPtrs.resize(numCpus, 0);
+
+	auto maxPayloadSize = ostrace::context.getFor(0).ring->maxPayloadSize();
+	frg::vector<char, KernelAlloc> buffer{*kernelAlloc};
+	buffer.resize(sizeof(FrameHeader) + maxPayloadSize);
+
+	while(true) {
+		// Find the oldest record among the heads of all rings.
+		bool found = false;
+		size_t oldestCpu = 0;
+		uint64_t oldestTs = 0;
+		for(size_t cpu = 0; cpu < numCpus; ++cpu) {
+			auto [success, entryPtr, header] = ostrace::context.getFor(cpu).ring->peekAt(
+					deqPtrs[cpu]);
+			if(!success)
+				continue;
+			if(!found || header.ts < oldestTs) {
+				found = true;
+				oldestCpu = cpu;
+				oldestTs = header.ts;
+			}
+		}
+
+		if(!found) {
+			KernelFiber::asyncBlockCurrent(generalTimerEngine()->sleepFor(1'000'000));
+			continue;
+		}
+
+		auto [success, entryPtr, nextPtr, header] = ostrace::context.getFor(oldestCpu).ring->dequeueAt(
+				deqPtrs[oldestCpu], buffer.data() + sizeof(FrameHeader), maxPayloadSize);
+		if(!success)
+			continue;
+		if(entryPtr != deqPtrs[oldestCpu])
+			infoLogger() << "thor: Up to " << (entryPtr - deqPtrs[oldestCpu])
+					<< " bytes of ostrace records lost on CPU " << oldestCpu << frg::endlog;
+		deqPtrs[oldestCpu] = nextPtr;
+
+		FrameHeader frame{.size = header.size, .source = static_cast<uint32_t>(oldestCpu),
+				.ts = header.ts};
+		memcpy(buffer.data(), &frame, sizeof(FrameHeader));
+		globalOsTraceRing->enqueue(buffer.data(), sizeof(FrameHeader) + header.size);
+	}
 }
 
 } // anonymous namespace
@@ -171,7 +376,8 @@ private:
 
 			managarm::ostrace::Response<KernelAlloc> resp(*kernelAlloc);
 			if (wantOsTrace) {
-				doEmit({reinterpret_cast<char *>(dataBuffer.data()), dataBuffer.size()});
+				doEmit({reinterpret_cast<char *>(dataBuffer.data()), dataBuffer.size()},
+						getClockNanos());
 				resp.set_error(managarm::ostrace::Error::SUCCESS);
 			}else{
 				resp.set_error(managarm::ostrace::Error::OSTRACE_GLOBALLY_DISABLED);
@@ -245,9 +451,10 @@ initgraph::Task initOsTraceMbus{&globalInitEngine, "generic.init-ostrace-sinks",
 			auto ostrace = frg::construct<OstraceBusObject>(*kernelAlloc);
 			spawnOnWorkQueue(*kernelAlloc, WorkQueue::generalQueue().lock(), ostrace->run());
 
-			// Only dump to an I/O channel if ostrace is supported (otherwise, the ring buffer
-			// does not even exist).
+			// Only drain the rings if ostrace is supported (otherwise, they do not even exist).
 			if(wantOsTrace) {
+				KernelFiber::run(drainLocalRings);
+
 				auto channel = solicitIoChannel("ostrace");
 				if(channel) {
 					infoLogger() << "thor: Connecting ostrace to I/O channel" << frg::endlog;
@@ -287,8 +494,15 @@ void setup() {
 	available.store(true, std::memory_order_relaxed);
 }
 
-void emitBuffer(frg::span<char> payload) {
-	doEmit(payload);
+char *reserve(size_t size, uint64_t ts) {
+	auto ring = context.get().ring;
+	if(!ring)
+		return nullptr;
+	return ring->reserve(size, ts);
+}
+
+void commitReserved() {
+	context.get().ring->commit();
 }
 
 } // namespace ostrace
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <algorithm>
 #include <thor-internal/arch-generic/paging.hpp>
 #include <thor-internal/cpu-data.hpp>
 #include <thor-internal/debug.hpp>
@@ -8,6 +9,9 @@ namespace thor {
 
 static bool logPhysicalAllocs = false;
 
+extern PerCpu<PhysicalPageCache> physicalPageCache;
+THOR_DEFINE_PERCPU(physicalPageCache);
+
 THOR_DEFINE_ELF_NOTE(memoryLayoutNote){elf_note_type::memoryLayout, {}};
 THOR_DEFINE_ELF_NOTE(physicalMemoryNote){elf_note_type::physicalMemory, {}};
 
@@ -32,7 +36,7 @@ PhysicalChunkAllocator::PhysicalChunkAllocator() {
 }
 
 void PhysicalChunkAllocator::bootstrapRegion(PhysicalAddr address,
-		int order, size_t numRoots, int8_t *buddyTree) {
+		int order, size_t numRoots, int8_t *buddyTree, uint32_t numaNode) {
 	if(_numRegions >= static_cast<int>(eirMaxMemoryRegions)) {
 		infoLogger() << "thor: Ignoring memory region (can only handle "
 				<< eirMaxMemoryRegions << " regions)" << frg::endlog;
@@ -44,6 +48,11 @@ void PhysicalChunkAllocator::bootstrapRegion(PhysicalAddr address,
 	_allRegions[n].regionSize = numRoots << (order + kPageShift);
 	_allRegions[n].buddyAccessor = BuddyAccessor{address, kPageShift,
 			buddyTree, numRoots, order};
+	_allRegions[n].numaNode = numaNode;
+	_allRegions[n].numFreePages = numRoots << order;
+
+	if(std::find(_nodes, _nodes + _numNodes, numaNode) == _nodes + _numNodes)
+		_nodes[_numNodes++] = numaNode;
 
 	auto currentTotal = _totalPages.load(std::memory_order_relaxed);
 	auto currentFree = _freePages.load(std::memory_order_relaxed);
@@ -53,13 +62,33 @@ void PhysicalChunkAllocator::bootstrapRegion(PhysicalAddr address,
 
 PhysicalAddr PhysicalChunkAllocator::allocate(size_t size, int addressBits) {
 	auto irq_lock = frg::guard(&irqMutex());
-	auto lock = frg::guard(&_mutex);
 
-	auto currentFree = _freePages.load(std::memory_order_relaxed);
-	auto currentUsed = _usedPages.load(std::memory_order_relaxed);
-	assert(currentFree > size / kPageSize);
-	_freePages.store(currentFree - size / kPageSize, std::memory_order_relaxed);
-	_usedPages.store(currentUsed + size / kPageSize, std::memory_order_relaxed);
+	// Fast path: serve single pages from the per-CPU cache.
+	// Allocations with a constrained address width always go to the buddy allocator.
+	// Note that the cache only contains pages of the local node (see free() below).
+	if(size == kPageSize && addressBits == 64
+			&& _pageCachesEnabled.load(std::memory_order_acquire)) {
+		auto &cache = physicalPageCache.get();
+		auto cacheLock = frg::guard(&cache.mutex);
+
+		auto n = cache.numPages.load(std::memory_order_relaxed);
+		if(n) {
+			cache.numHits.fetch_add(1, std::memory_order_relaxed);
+		}else{
+			cache.numMisses.fetch_add(1, std::memory_order_relaxed);
+			_refillPageCache(cache);
+			n = cache.numPages.load(std::memory_order_relaxed);
+		}
+
+		if(n) {
+			auto physical = cache.pages[n - 1];
+			cache.numPages.store(n - 1, std::memory_order_relaxed);
+			_accountAllocation(1);
+			return physical;
+		}
+		// Otherwise, the buddy allocator is exhausted; fall through to the slow path
+		// (which drains the caches of other CPUs).
+	}
 
 	// TODO: This could be solved better.
 	int target = 0;
@@ -70,17 +99,128 @@ PhysicalAddr PhysicalChunkAllocator::allocate(size_t size, int addressBits) {
 	if(logPhysicalAllocs)
 		infoLogger() << "thor: Allocating physical memory of order "
 					<< (target + kPageShift) << frg::endlog;
-	// Prefer allocating from regions above 4 GiB so that low memory stays available
-	// for allocations that are constrained to a limited address width (e.g. 32-bit DMA).
+
+	// If the buddy allocator cannot satisfy the request, the missing pages
+	// may sit in the per-CPU caches. Return them to the buddy allocator and retry.
+	for(int attempt = 0; attempt < 2; attempt++) {
+		if(attempt) {
+			if(!_pageCachesEnabled.load(std::memory_order_acquire))
+				break;
+			drainPageCaches();
+		}
+
+		auto lock = frg::guard(&_mutex);
+		auto physical = _allocateLocked(target, addressBits, _localNode());
+		if(physical != static_cast<PhysicalAddr>(-1)) {
+			_accountAllocation(size / kPageSize);
+			return physical;
+		}
+	}
+	return static_cast<PhysicalAddr>(-1);
+}
+
+void PhysicalChunkAllocator::free(PhysicalAddr address, size_t size) {
+	auto irq_lock = frg::guard(&irqMutex());
+
+	// Fast path: return single pages to the per-CPU cache.
+	// Pages of remote nodes bypass the cache such that they
+	// are not handed out to threads on this node.
+	if(size == kPageSize
+			&& _pageCachesEnabled.load(std::memory_order_acquire)
+			&& (_numNodes < 2 || _nodeOf(address) == _localNode())) {
+		auto &cache = physicalPageCache.get();
+		auto cacheLock = frg::guard(&cache.mutex);
+
+		if(cache.numPages.load(std::memory_order_relaxed) == PhysicalPageCache::capacity)
+			_drainPageCache(cache, PhysicalPageCache::batchSize);
+
+		auto n = cache.numPages.load(std::memory_order_relaxed);
+		assert(n < PhysicalPageCache::capacity);
+		cache.pages[n] = address;
+		cache.numPages.store(n + 1, std::memory_order_relaxed);
+		_accountFree(1);
+		return;
+	}
+
+	auto lock = frg::guard(&_mutex);
+
+	int target = 0;
+	while(size > (size_t(kPageSize) << target))
+		target++;
+
+	_freeLocked(address, target);
+	_accountFree(size / kPageSize);
+}
+
+void PhysicalChunkAllocator::drainPageCaches() {
+	if(!_pageCachesEnabled.load(std::memory_order_acquire))
+		return;
+
+	auto irq_lock = frg::guard(&irqMutex());
+	for(size_t i = 0; i < getCpuCount(); ++i) {
+		auto &cache = physicalPageCache.getFor(i);
+		auto cacheLock = frg::guard(&cache.mutex);
+
+		auto n = cache.numPages.load(std::memory_order_relaxed);
+		if(n)
+			_drainPageCache(cache, n);
+	}
+}
+
+PhysicalPageCacheStats PhysicalChunkAllocator::pageCacheStats() {
+	PhysicalPageCacheStats stats;
+	for(size_t i = 0; i < getCpuCount(); ++i) {
+		auto &cache = physicalPageCache.getFor(i);
+		stats.cachedPages += cache.numPages.load(std::memory_order_relaxed);
+		stats.hits += cache.numHits.load(std::memory_order_relaxed);
+		stats.misses += cache.numMisses.load(std::memory_order_relaxed);
+		stats.refills += cache.numRefills.load(std::memory_order_relaxed);
+		stats.drains += cache.numDrains.load(std::memory_order_relaxed);
+	}
+	return stats;
+}
+
+PhysicalNodeStats PhysicalChunkAllocator::nodeStats(size_t index) {
+	assert(index < _numNodes);
+	auto irq_lock = frg::guard(&irqMutex());
+	auto lock = frg::guard(&_mutex);
+
+	PhysicalNodeStats stats;
+	stats.node = _nodes[index];
+	for(int i = 0; i < _numRegions; i++) {
+		if(_allRegions[i].numaNode != _nodes[index])
+			continue;
+		stats.totalPages += _allRegions[i].regionSize >> kPageShift;
+		stats.freePages += _allRegions[i].numFreePages;
+	}
+	return stats;
+}
+
+PhysicalAddr PhysicalChunkAllocator::_allocateLocked(int target, int addressBits,
+		uint32_t preferredNode) {
+	// Prefer allocating from the preferred node (over remote nodes) and from
+	// regions above 4 GiB so that low memory stays available for allocations
+	// that are constrained to a limited address width (e.g. 32-bit DMA).
+	// We rather use low memory of the local node than high memory of a remote node.
 	struct Pass {
+		bool allowRemote;
 		bool allowLow;
 	};
-	std::array<Pass, 2> passes{
-		Pass{.allowLow = false},
-		Pass{.allowLow = true},
+	std::array<Pass, 4> passes{
+		Pass{.allowRemote = false, .allowLow = false},
+		Pass{.allowRemote = false, .allowLow = true},
+		Pass{.allowRemote = true, .allowLow = false},
+		Pass{.allowRemote = true, .allowLow = true},
 	};
 	for(auto pass : passes) {
+		// With a single node, the remote passes are redundant.
+		if(pass.allowRemote && _numNodes < 2)
+			break;
+
 		for(int i = 0; i < _numRegions; i++) {
+			bool isLocal = _numNodes < 2 || _allRegions[i].numaNode == preferredNode;
+			if(pass.allowRemote == isLocal)
+				continue;
 			// Note that Eir cuts regions in such a way that they never cross 4GiB.
 			if(!pass.allowLow && _allRegions[i].physicalBase < (PhysicalAddr{1} << 32))
 				continue;
@@ -92,6 +232,7 @@ PhysicalAddr PhysicalChunkAllocator::allocate(size_t size, int addressBits) {
 				continue;
 		//	infoLogger() << "Allocate " << (void *)physical << frg::endlog;
 			assert(!(physical % (size_t(kPageSize) << target)));
+			_allRegions[i].numFreePages -= size_t(1) << target;
 			return physical;
 		}
 	}
@@ -99,14 +240,8 @@ PhysicalAddr PhysicalChunkAllocator::allocate(size_t size, int addressBits) {
 	return static_cast<PhysicalAddr>(-1);
 }
 
-void PhysicalChunkAllocator::free(PhysicalAddr address, size_t size) {
-	auto irq_lock = frg::guard(&irqMutex());
-	auto lock = frg::guard(&_mutex);
-	
-	int target = 0;
-	while(size > (size_t(kPageSize) << target))
-		target++;
-
+void PhysicalChunkAllocator::_freeLocked(PhysicalAddr address, int target) {
+	size_t size = size_t(kPageSize) << target;
 	for(int i = 0; i < _numRegions; i++) {
 		if(address < _allRegions[i].physicalBase)
 			continue;
@@ -114,17 +249,87 @@ void PhysicalChunkAllocator::free(PhysicalAddr address, size_t size) {
 			continue;
 
 		_allRegions[i].buddyAccessor.free(address, target);
-		auto currentFree = _freePages.load(std::memory_order_relaxed);
-		auto currentUsed = _usedPages.load(std::memory_order_relaxed);
-		assert(currentUsed > size / kPageSize);
-		_freePages.store(currentFree + size / kPageSize, std::memory_order_relaxed);
-		_usedPages.store(currentUsed - size / kPageSize, std::memory_order_relaxed);
+		_allRegions[i].numFreePages += size_t(1) << target;
 		return;
 	}
 
 	assert(!"Physical page is not part of any region");
 }
 
+void PhysicalChunkAllocator::_refillPageCache(PhysicalPageCache &cache) {
+	auto lock = frg::guard(&_mutex);
+
+	auto node = _localNode();
+	auto n = cache.numPages.load(std::memory_order_relaxed);
+	while(n < PhysicalPageCache::batchSize) {
+		auto physical = _allocateLocked(0, 64, node);
+		if(physical == static_cast<PhysicalAddr>(-1))
+			break;
+		cache.pages[n++] = physical;
+		// _allocateLocked() only returns remote pages once the local node is exhausted.
+		// Stop refilling in that case to avoid hoarding remote memory in the cache.
+		if(_numNodes > 1 && _nodeOf(physical) != node)
+			break;
+	}
+	cache.numPages.store(n, std::memory_order_relaxed);
+	cache.numRefills.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PhysicalChunkAllocator::_drainPageCache(PhysicalPageCache &cache, size_t numPages) {
+	auto lock = frg::guard(&_mutex);
+
+	// Return the least recently freed pages; the remaining ones are more likely to be cache-hot.
+	auto n = cache.numPages.load(std::memory_order_relaxed);
+	assert(n >= numPages);
+	for(size_t i = 0; i < numPages; ++i)
+		_freeLocked(cache.pages[i], 0);
+	for(size_t i = numPages; i < n; ++i)
+		cache.pages[i - numPages] = cache.pages[i];
+	cache.numPages.store(n - numPages, std::memory_order_relaxed);
+	cache.numDrains.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint32_t PhysicalChunkAllocator::_localNode() {
+	// Before the per-CPU data is initialized (i.e., before the page caches are enabled),
+	// we do not know the current CPU's node. Topology discovery happens even later.
+	if(_numNodes < 2 || !_pageCachesEnabled.load(std::memory_order_acquire))
+		return _nodes[0];
+	auto &topology = getCpuData()->topology;
+	if(!topology.valid)
+		return _nodes[0];
+	return topology.numaNode;
+}
+
+bool PhysicalChunkAllocator::isManaged(PhysicalAddr address) {
+	for(int i = 0; i < _numRegions; i++) {
+		if(address - _allRegions[i].physicalBase < _allRegions[i].regionSize)
+			return true;
+	}
+	return false;
+}
+
+uint32_t PhysicalChunkAllocator::_nodeOf(PhysicalAddr address) {
+	// Regions are constant after bootstrap, hence no lock is required.
+	for(int i = 0; i < _numRegions; i++) {
+		if(address - _allRegions[i].physicalBase < _allRegions[i].regionSize)
+			return _allRegions[i].numaNode;
+	}
+	assert(!"Physical page is not part of any region");
+	__builtin_unreachable();
+}
+
+void PhysicalChunkAllocator::_accountAllocation(size_t numPages) {
+	[[maybe_unused]] auto previousFree = _freePages.fetch_sub(numPages, std::memory_order_relaxed);
+	assert(previousFree > numPages);
+	_usedPages.fetch_add(numPages, std::memory_order_relaxed);
+}
+
+void PhysicalChunkAllocator::_accountFree(size_t numPages) {
+	[[maybe_unused]] auto previousUsed = _usedPages.fetch_sub(numPages, std::memory_order_relaxed);
+	assert(previousUsed > numPages);
+	_freePages.fetch_add(numPages, std::memory_order_relaxed);
+}
+
 PhysicalWindow::PhysicalWindow(PhysicalAddr physical, size_t size, CachingMode caching)
 : size_{size} {
 	uintptr_t lowAddr = physical & ~(kPageSize - 1);
@@ -70,16 +70,16 @@ void initializeProfile() {
 
 		uint64_t deqPtr = 0;
 		while(true) {
-			char buffer[128];
+			uintptr_t buffer[maxProfileSampleWords];
 			auto [success, recordPtr, newPtr, size] = getCpuData()->localProfileRing->dequeueAt(
-					deqPtr, buffer, 128);
+					deqPtr, buffer, sizeof(buffer));
 			deqPtr = newPtr;
 			if(!success) {
 				KernelFiber::asyncBlockCurrent(generalTimerEngine()->sleepFor(1'000'000));
 				continue;
 			}
 			assert(size);
-			assert(size <= 128);
+			assert(size <= sizeof(buffer));
 
 			globalProfileRing->enqueue(buffer, size);
 		}
@@ -4,10 +4,12 @@
 #include <thor-internal/arch-generic/ints.hpp>
 #include <thor-internal/cpu-data.hpp>
 #include <thor-internal/debug.hpp>
+#include <thor-internal/load-balancing.hpp>
 #include <thor-internal/ostrace.hpp>
 #include <thor-internal/schedule.hpp>
 #include <thor-internal/thread.hpp>
 #include <thor-internal/timer.hpp>
+#include <thor-internal/work-queue.hpp>
 
 namespace thor {
 
@@ -30,6 +32,8 @@ namespace {
 			runOnStack([] (Continuation) {
 				if(logIdle)
 					infoLogger() << "System is idle" << frg::endlog;
+				LoadBalancer::singleton().notifyIdle(getCpuData());
+				WorkQueue::notifyIdle(getCpuData());
 				// Restore IPL (as in restoreExecutor() for threads/fibers).
 				iplLeaveContext(IplState{.context = ipl::passive, .current = ipl::exceptional});
 				suspendSelf();
@@ -147,6 +151,8 @@ void Scheduler::resume(ScheduleEntity *entity) {
 		wasEmpty = self->_pendingList.empty();
 		self->_pendingList.push_back(entity);
 	}
+	// Prevent other wakers from picking this CPU before it reschedules.
+	self->_idle.store(false, std::memory_order_relaxed);
 
 	if(wasEmpty) {
 		if(self == &localScheduler.get()) {
@@ -325,6 +331,7 @@ void Scheduler::forceReschedule() {
 	_current = _scheduled;
 	_scheduled = nullptr;
 	_sliceClock = _refClock;
+	_idle.store(_current->type() == ScheduleType::idle, std::memory_order_relaxed);
 	_mustCallPreemption = false;
 
 	if(!getPreemptionDeadline())
@@ -278,6 +278,11 @@ coroutine<void> executeModule(frg::string_view name, MfsRegular *module,
 		panicLogger() << "thor: Failed to create address space" << frg::endlog;
 	auto space = std::move(*spaceOutcome);
 
+	// Servers (e.g., mbus, POSIX and block device drivers) can be on the I/O path of
+	// the swap area. Swapping them out could deadlock, hence they are exempt from swapping.
+	auto exemptOutcome = co_await space->exemptFromSwap();
+	assert(exemptOutcome);
+
 	ImageInfo exec_info = co_await loadModuleImage(space, 0, module->getMemory());
 
 	if(size_t n = frg::string_view(exec_info.interpreter).find_first('\0'); n != size_t(-1))
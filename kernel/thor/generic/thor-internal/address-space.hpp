@@ -9,6 +9,8 @@
 #include <async/recurring-event.hpp>
 #include <frg/container_of.hpp>
 #include <frg/expected.hpp>
+#include <frg/list.hpp>
+#include <frg/vector.hpp>
 #include <thor-internal/coroutine.hpp>
 #include <thor-internal/memory-view.hpp>
 #include <thor-internal/mm-rc.hpp>
@@ -41,6 +43,21 @@ private:
 
 struct VirtualSpace;
 
+struct FaultAroundStatistics {
+	// Size of the fault-around window (in pages, including the faulting page).
+	size_t window;
+	// Number of read and execute faults that mapped neighbouring pages.
+	uint64_t numFaults;
+	// Number of neighbouring pages that were mapped by these faults.
+	uint64_t numPages;
+};
+
+FaultAroundStatistics getFaultAroundStatistics();
+
+// The window is given in pages; a window of one page disables fault-around.
+// Returns false if the window is not a power of two or too large.
+bool setFaultAroundWindow(size_t window);
+
 struct PagesAffected {
 	ptrdiff_t rssIncrease{0};
 	ptrdiff_t rssDecrease{0};
@@ -65,6 +82,15 @@ inline CachingMode determineCachingMode(CachingMode physicalRangeCaching,
 	return physicalRangeCaching;
 }
 
+// Invokes fn on the PFN descriptors of all 4 KiB pages that make up a huge page.
+template<typename F>
+void forEachHugePagePfn(PhysicalAddr physical, F fn) {
+	for(size_t pg = 0; pg < kHugePageSize; pg += kPageSize) {
+		if(auto descriptor = globalPfnDb().find(physical + pg))
+			fn(*descriptor);
+	}
+}
+
 template<typename Cursor, typename PageSpace>
 frg::expected<Error, PagesAffected> mapPresentPagesByCursor(PageSpace *ps, VirtualAddr va,
 		MemoryView *view, uintptr_t offset, size_t size, PageFlags flags, CachingMode mode,
@@ -89,6 +115,35 @@ frg::expected<Error, PagesAffected> mapPresentPagesByCursor(PageSpace *ps, Virtu
 		auto effectiveFlags = flags;
 		if (!physicalRange.isMutable)
 			effectiveFlags &= ~page_access::write;
+
+		if constexpr (Cursor::supportsHuge) {
+			if(enableHugePages
+					&& !(c.virtualAddress() & (kHugePageSize - 1))
+					&& progress + kHugePageSize <= size
+					&& !(physicalRange.physical & (kHugePageSize - 1))
+					&& physicalRange.size >= kHugePageSize) {
+				auto result = c.map2m(physicalRange.physical, effectiveFlags,
+						determineCachingMode(physicalRange.cachingMode, mode));
+				if(result) {
+					auto [status, oldPhysical] = *result;
+					forEachHugePagePfn(physicalRange.physical, [] (PfnDescriptor d) {
+						incrementUses(d);
+					});
+					affected.rssIncrease += kHugePageSize;
+					if(status & page_status::present) {
+						forEachHugePagePfn(oldPhysical, [&] (PfnDescriptor d) {
+							if(status & page_status::dirty)
+								markDirty(d);
+							decrementUses(d);
+						});
+						affected.rssDecrease += kHugePageSize;
+					}
+					c.advance2m();
+					continue;
+				}
+			}
+		}
+
 		if(auto descriptor = globalPfnDb().find(physicalRange.physical))
 			incrementUses(*descriptor);
 		auto [status, oldPhysical] = c.map4k(physicalRange.physical, effectiveFlags,
@@ -115,6 +170,65 @@ frg::expected<Error, PagesAffected> mapPresentPagesByCursor(PageSpace *ps, Virtu
 			typename Cursor::PolicyType{});
 }
 
+// Like mapPresentPagesByCursor() but only fills in PTEs that are not present yet
+// (and never maps huge pages). Used to map the neighbours of a faulting page.
+template<typename Cursor, typename PageSpace>
+frg::expected<Error, PagesAffected> mapAbsentPagesByCursor(PageSpace *ps, VirtualAddr va,
+		MemoryView *view, uintptr_t offset, size_t size, PageFlags flags, CachingMode mode,
+		typename Cursor::PolicyType policy) {
+	assert(!(va & (kPageSize - 1)));
+	assert(!(offset & (kPageSize - 1)));
+	assert(!(size & (kPageSize - 1)));
+	// At least one access bit is always set; see VirtualOperations.
+	assert(flags & (page_access::read | page_access::write | page_access::execute));
+
+	PagesAffected affected{};
+	Cursor c{ps, va, policy};
+	while(c.virtualAddress() < va + size) {
+		if(c.isPresent()) {
+			c.advance4k();
+			continue;
+		}
+
+		auto progress = c.virtualAddress() - va;
+		auto physicalRange = view->peekRange(offset + progress, fetchNone);
+		if(physicalRange.physical == PhysicalAddr(-1)) {
+			c.advance4k();
+			continue;
+		}
+		assert(!(physicalRange.physical & (kPageSize - 1)));
+
+		auto effectiveFlags = flags;
+		if (!physicalRange.isMutable)
+			effectiveFlags &= ~page_access::write;
+
+		if(auto descriptor = globalPfnDb().find(physicalRange.physical))
+			incrementUses(*descriptor);
+		auto [status, oldPhysical] = c.map4k(physicalRange.physical, effectiveFlags,
+			determineCachingMode(physicalRange.cachingMode, mode));
+		affected.rssIncrease += kPageSize;
+		// A concurrent fault may have mapped the page in the meantime.
+		if(status & page_status::present) {
+			if(auto descriptor = globalPfnDb().find(oldPhysical)) {
+				if(status & page_status::dirty)
+					markDirty(*descriptor);
+				decrementUses(*descriptor);
+			}
+			affected.rssDecrease += kPageSize;
+			affected.anyRevoked = true;
+		}
+		c.advance4k();
+	}
+	return affected;
+}
+
+template<typename Cursor, typename PageSpace>
+frg::expected<Error, PagesAffected> mapAbsentPagesByCursor(PageSpace *ps, VirtualAddr va,
+		MemoryView *view, uintptr_t offset, size_t size, PageFlags flags, CachingMode mode) {
+	return mapAbsentPagesByCursor<Cursor>(ps, va, view, offset, size, flags, mode,
+			typename Cursor::PolicyType{});
+}
+
 template<typename Cursor, typename PageSpace>
 frg::expected<Error, PagesAffected> restrictPagesByCursor(PageSpace *ps, VirtualAddr va,
 		size_t size, PageFlags flags, CachingMode mode,
@@ -127,6 +241,20 @@ frg::expected<Error, PagesAffected> restrictPagesByCursor(PageSpace *ps, Virtual
 	PagesAffected affected{};
 	Cursor c{ps, va, policy};
 	while(c.virtualAddress() < va + size) {
+		if constexpr (Cursor::supportsHuge) {
+			if(!(c.virtualAddress() & (kHugePageSize - 1))
+					&& c.virtualAddress() + kHugePageSize <= va + size
+					&& c.isHuge()) {
+				auto [status, physical, restricted] = c.restrict2m(flags, mode);
+				if((status & page_status::present) && (status & page_status::dirty))
+					forEachHugePagePfn(physical, [] (PfnDescriptor d) { markDirty(d); });
+				if(restricted)
+					affected.anyRevoked = true;
+				c.advance2m();
+				continue;
+			}
+		}
+
 		auto [status, physical, restricted] = c.restrict4k(flags, mode);
 		if((status & page_status::present) && (status & page_status::dirty)) {
 			if(auto descriptor = globalPfnDb().find(physical))
@@ -199,6 +327,19 @@ frg::expected<Error, PagesAffected> cleanPagesByCursor(PageSpace *ps, VirtualAdd
 	PagesAffected affected{};
 	Cursor c{ps, va, policy};
 	while(c.findDirty(va + size)) {
+		if constexpr (Cursor::supportsHuge) {
+			if(!(c.virtualAddress() & (kHugePageSize - 1))
+					&& c.virtualAddress() + kHugePageSize <= va + size
+					&& c.isHuge()) {
+				auto [status, physical] = c.clean2m();
+				assert(status & page_status::dirty);
+				forEachHugePagePfn(physical, [] (PfnDescriptor d) { markDirty(d); });
+				affected.anyRevoked = true;
+				c.advance2m();
+				continue;
+			}
+		}
+
 		auto [status, physical] = c.clean4k();
 		assert(status & page_status::present);
 		assert(status & page_status::dirty);
@@ -224,6 +365,24 @@ frg::expected<Error, PagesAffected> unmapPagesByCursor(PageSpace *ps, VirtualAdd
 	PagesAffected affected{};
 	Cursor c{ps, va, policy};
 	while(c.findPresent(va + size)) {
+		if constexpr (Cursor::supportsHuge) {
+			if(!(c.virtualAddress() & (kHugePageSize - 1))
+					&& c.virtualAddress() + kHugePageSize <= va + size
+					&& c.isHuge()) {
+				auto [status, physical] = c.unmap2m();
+				assert(status & page_status::present);
+				forEachHugePagePfn(physical, [&] (PfnDescriptor d) {
+					if(status & page_status::dirty)
+						markDirty(d);
+					decrementUses(d);
+				});
+				affected.rssDecrease += kHugePageSize;
+				affected.anyRevoked = true;
+				c.advance2m();
+				continue;
+			}
+		}
+
 		auto [status, physical] = c.unmap4k();
 		assert(status & page_status::present);
 		if(status & page_status::dirty) {
@@ -254,6 +413,26 @@ frg::expected<Error, PagesAffected> agePagesByCursor(PageSpace *ps, VirtualAddr
 	PagesAffected affected{};
 	Cursor c{ps, va, policy};
 	while(c.findPresent(va + size)) {
+		if constexpr (Cursor::supportsHuge) {
+			if(!(c.virtualAddress() & (kHugePageSize - 1))
+					&& c.virtualAddress() + kHugePageSize <= va + size
+					&& c.isHuge()) {
+				affected.scanned += kHugePageSize;
+				auto [status, physical, unmapped] = c.age2m(vacate);
+				if(unmapped) {
+					forEachHugePagePfn(physical, [&] (PfnDescriptor d) {
+						if(status & page_status::dirty)
+							markDirty(d);
+						decrementUses(d);
+					});
+					affected.rssDecrease += kHugePageSize;
+					affected.anyRevoked = true;
+				}
+				c.advance2m();
+				continue;
+			}
+		}
+
 		affected.scanned += kPageSize;
 		auto [status, physical, unmapped] = c.age4k(vacate);
 		if(unmapped) {
@@ -286,6 +465,14 @@ struct VirtualOperations {
 	virtual frg::expected<Error, PagesAffected> mapPresentPages(VirtualAddr va, MemoryView *view,
 			uintptr_t offset, size_t size, PageFlags flags, CachingMode mode) = 0;
 
+	// Maps the present pages of the range whose PTEs are not present yet (see fault-around).
+	// Operations that do not override this do not map any pages.
+	// Precondition: flags has at least one access bit (read/write/execute) set.
+	virtual frg::expected<Error, PagesAffected> mapAbsentPages(VirtualAddr, MemoryView *,
+			uintptr_t, size_t, PageFlags, CachingMode) {
+		return PagesAffected{};
+	}
+
 	// Precondition: flags has at least one access bit (read/write/execute) set.
 	virtual frg::expected<Error, PagesAffected> restrictPages(VirtualAddr va,
 			size_t size, PageFlags flags, CachingMode mode) = 0;
@@ -495,7 +682,7 @@ struct Mapping {
 	const smarter::shared_ptr<MemoryView> view;
 	const size_t viewOffset;
 
-	// Protected against writes by _consistencyMutex.
+	// Protected against writes by _consistencyMutex and _rangeLock.
 	// May be read without holding any mutex.
 	std::atomic<MappingFlags> flags;
 	// Protected against writes by _consistencyMutex.
@@ -573,6 +760,66 @@ using MappingTree = frg::rbtree<
 	MappingLess
 >;
 
+// Serializes operations on overlapping ranges of virtual addresses.
+// Operations on disjoint ranges can hold the lock concurrently.
+struct AddressRangeLock {
+	struct Node {
+		Node(VirtualAddr address, size_t length)
+		: address{address}, length{length} { }
+
+		Node(const Node &) = delete;
+
+		Node &operator= (const Node &) = delete;
+
+		const VirtualAddr address;
+		const size_t length;
+
+		frg::default_list_hook<Node> hook;
+	};
+
+	// Releases a node when it goes out of scope.
+	struct Guard {
+		Guard(AddressRangeLock *lock, Node *node)
+		: lock_{lock}, node_{node} { }
+
+		Guard(const Guard &) = delete;
+
+		~Guard() {
+			lock_->unlock(node_);
+		}
+
+		Guard &operator= (const Guard &) = delete;
+
+	private:
+		AddressRangeLock *lock_;
+		Node *node_;
+	};
+
+	// Waits until no other node overlaps with the given node, then acquires it.
+	coroutine<void> lock(Node *node);
+
+	void unlock(Node *node);
+
+private:
+	// Callers must hold mutex_.
+	bool overlaps_(Node *node);
+
+	frg::ticket_spinlock mutex_;
+
+	// Protected by mutex_.
+	frg::intrusive_list<
+		Node,
+		frg::locate_member<
+			Node,
+			frg::default_list_hook<Node>,
+			&Node::hook
+		>
+	> nodes_;
+
+	// Raised whenever a node is released.
+	async::recurring_event releaseEvent_;
+};
+
 struct VirtualSpace {
 	friend struct Mapping;
 
@@ -607,6 +854,10 @@ public:
 	map(smarter::borrowed_ptr<MemorySlice> view,
 			VirtualAddr address, size_t offset, size_t length, uint32_t flags);
 
+	// Exempts the memory of all current and future mappings from swapping.
+	// This is used for servers on the I/O path of the swap area; cannot be undone.
+	coroutine<frg::expected<Error>> exemptFromSwap();
+
 	coroutine<frg::expected<Error>>
 	protect(VirtualAddr address, size_t length, uint32_t flags);
 
@@ -721,6 +972,42 @@ public:
 		return {this};
 	}
 
+	// ----------------------------------------------------------------------------------
+	// Page loaning support.
+	// ----------------------------------------------------------------------------------
+
+	// A page that is lent to the kernel, e.g., to transfer it to an IPC peer
+	// without copying it into a kernel buffer first.
+	// While this object is alive, the page is locked in its MemoryView, i.e., it is
+	// neither evicted nor swapped out (even if the mapping is unmapped concurrently).
+	struct LoanedPage {
+		LoanedPage(smarter::shared_ptr<Mapping> loanedMapping, uintptr_t loanedOffset)
+		: mapping{std::move(loanedMapping)}, viewOffset{loanedOffset} { }
+
+		LoanedPage(const LoanedPage &) = delete;
+
+		~LoanedPage() {
+			if(locked)
+				mapping->view->unlockRange(viewOffset, kPageSize);
+		}
+
+		LoanedPage &operator= (const LoanedPage &) = delete;
+
+		// Returns false if the mapping was unmapped since the page was loaned.
+		bool stillMapped() {
+			return mapping->state.load(std::memory_order_relaxed) == MappingState::active;
+		}
+
+		smarter::shared_ptr<Mapping> mapping;
+		uintptr_t viewOffset;
+		bool locked{false};
+		PhysicalAddr physical{PhysicalAddr(-1)};
+	};
+
+	// Loans the page at the given (page aligned) address, which must be readable.
+	// On success, page is engaged.
+	coroutine<frg::expected<Error>> loanPage(VirtualAddr address, frg::optional<LoanedPage> &page);
+
 	// ----------------------------------------------------------------------------------
 
 	smarter::borrowed_ptr<VirtualSpace> selfPtr;
@@ -759,19 +1046,36 @@ private:
 	coroutine<frg::tuple<Mapping *, Mapping *>> _splitMappings(uintptr_t address, size_t size);
 
 	// Used in conjunction with _splitMappings.
-	// Unmaps and removes all mappings between start and end that fall within the specified range.
-	// Returns whether shootdown needs to be performed (any of the mappings got unmapped).
+	// Moves all mappings between start and end that fall within the specified range
+	// into MappingState::zombie and appends them to victims.
+	// Callers must hold _consistencyMutex exclusively.
+	void _zombifyMappings(VirtualAddr address, size_t length, Mapping *start, Mapping *end,
+			frg::vector<smarter::shared_ptr<Mapping>, KernelAlloc> &victims);
+
+	// Unmaps the pages of zombie mappings and performs shootdown.
+	// Callers must hold _rangeLock for the range of the victims,
+	// but they do not need to hold _consistencyMutex.
+	coroutine<void> _revokeMappings(frg::vector<smarter::shared_ptr<Mapping>, KernelAlloc> &victims);
+
+	// Removes zombie mappings from the mapping tree and returns their ranges to the hole tree.
 	// Callers must hold _consistencyMutex exclusively.
-	coroutine<void> _unmapMappings(VirtualAddr address, size_t length, Mapping *start, Mapping *end);
+	coroutine<void> _removeMappings(frg::vector<smarter::shared_ptr<Mapping>, KernelAlloc> &victims);
 
 	VirtualOperations *_ops;
 
-	// _consistencyMutex MUST be taken while:
-	// * Mappings are added.
+	// _rangeLock MUST be taken for the affected range while:
 	// * Mappings are removed.
 	// * The flags of mappings are modified.
-	// In case of mapping removal and mapping flag change, the mutex must be held until the
-	// page tables are changed, shootdown is complete (and the eviction loop is exited, if applicable).
+	// * Mappings are added at fixed addresses (since this may replace existing mappings).
+	// It must be held until the page tables are changed, shootdown is complete
+	// (and the eviction loop is exited, if applicable).
+	// _rangeLock must be acquired before _consistencyMutex.
+	AddressRangeLock _rangeLock;
+
+	// _consistencyMutex MUST be taken while the mapping and hole trees are modified,
+	// i.e., while mappings are added, split or removed, and while the flags of mappings
+	// are modified. In contrast to _rangeLock, it is not held while page tables are
+	// changed, such that operations on unrelated ranges do not serialize on shootdown.
 	async::shared_mutex _consistencyMutex;
 
 	// Protects _mappings against writes on code paths that do not take _consistencyMutex
@@ -791,6 +1095,9 @@ private:
 
 	std::atomic<ptrdiff_t> rss_;
 
+	// Set by exemptFromSwap().
+	std::atomic<bool> noSwap_{false};
+
 	// Number of pages faulted minus number of pages scanned by aging.
 	// This is used by shouldContinueAging_().
 	std::atomic<ptrdiff_t> agingTurnover_{0};
@@ -825,6 +1132,12 @@ public:
 					va, view, offset, size, flags, mode);
 		}
 
+		frg::expected<Error, PagesAffected> mapAbsentPages(VirtualAddr va, MemoryView *view,
+				uintptr_t offset, size_t size, PageFlags flags, CachingMode mode) override {
+			return mapAbsentPagesByCursor<ClientPageSpace::Cursor>(&space_->pageSpace_,
+					va, view, offset, size, flags, mode);
+		}
+
 		frg::expected<Error, PagesAffected> restrictPages(VirtualAddr va,
 				size_t size, PageFlags flags, CachingMode mode) override {
 			return restrictPagesByCursor<ClientPageSpace::Cursor>(&space_->pageSpace_,
@@ -887,6 +1200,11 @@ public:
 
 	FutexRealm localFutexRealm;
 
+	// Unique ID of this address space. Used to attribute profiling samples.
+	uint64_t spaceId() {
+		return spaceId_;
+	}
+
 	bool updatePageAccess(VirtualAddr address, PageFlags flags) {
 		return pageSpace_.updatePageAccess(address, flags);
 	}
@@ -894,6 +1212,7 @@ public:
 	smarter::counter _bindableCtr;
 
 private:
+	uint64_t spaceId_;
 	Operations ops_;
 	ClientPageSpace pageSpace_;
 };
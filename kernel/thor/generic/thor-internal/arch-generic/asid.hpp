@@ -85,12 +85,16 @@ inline constexpr int globalBindingId = -1;
 struct PageSpace;
 
 struct PageBinding {
+	friend struct PageSpace;
+
 	friend void swap(PageBinding &a, PageBinding &b) {
 		using std::swap;
 		swap(a.id_, b.id_);
 		swap(a.boundSpace_, b.boundSpace_);
 		swap(a.primaryStamp_, b.primaryStamp_);
 		swap(a.alreadyShotSequence_, b.alreadyShotSequence_);
+		swap(a.lazy_, b.lazy_);
+		swap(a.lazySequence_, b.lazySequence_);
 	}
 
 	PageBinding() = default;
@@ -148,9 +152,16 @@ struct PageBinding {
 	void shootdown();
 
 private:
-	void doShootdown_(PageSpace *space);
+	void doShootdown_(PageSpace *space, uint64_t upToSequence);
 	void drainShootdown_(PageSpace *space, uint64_t afterSequence, uint64_t upToSequence);
 
+	// Called when this binding stops being the primary binding on this CPU.
+	// Performs all shootdowns that were submitted while the binding was active.
+	void makeLazy_();
+	// Called when this binding (re-)becomes the primary binding on this CPU.
+	// Returns true if the ASID needs to be invalidated since shootdowns were skipped.
+	bool makeActive_();
+
 	int id_ = 0;
 
 	// TODO: Once we can use libsmarter in the kernel, we should make this a shared_ptr
@@ -161,6 +172,14 @@ private:
 	uint64_t primaryStamp_ = 0;
 
 	uint64_t alreadyShotSequence_ = 0;
+
+	// Lazy bindings are bound but not primary. They do not take part in shootdowns;
+	// instead, the whole ASID is invalidated when the binding becomes primary again
+	// (if any shootdown was submitted in the meantime).
+	bool lazy_ = false;
+
+	// Value of the space's shootSequence_ when the binding became lazy.
+	uint64_t lazySequence_ = 0;
 };
 
 
@@ -202,6 +221,9 @@ private:
 
 	unsigned int numBindings_;
 
+	// Number of bindings that are not lazy, i.e., that need to perform shootdowns.
+	unsigned int numActiveBindings_;
+
 	uint64_t shootSequence_;
 
 	ShootQueue shootQueue_;
@@ -223,6 +245,44 @@ struct AsidCpuData {
 };
 
 
+// Per-CPU state of the shootdown mechanism.
+// Unlike AsidCpuData, this is available for all CPUs (even before they are booted).
+struct ShootdownCpuData {
+	// Space of the primary binding on this CPU (nullptr for the kernel space).
+	// Only changes while the space's mutex is held. This is never dereferenced.
+	std::atomic<PageSpace *> activeSpace{nullptr};
+
+	// Set while a shootdown IPI is in flight to this CPU.
+	// Further shootdowns are picked up by the same IPI.
+	std::atomic<bool> ipiPending{false};
+
+	// Statistics. Only written by this CPU.
+	std::atomic<uint64_t> numIpisSent{0};
+	std::atomic<uint64_t> numIpisCoalesced{0};
+	std::atomic<uint64_t> numFullFlushes{0};
+	std::atomic<uint64_t> numLazyFlushes{0};
+};
+
+extern PerCpu<ShootdownCpuData> shootdownData;
+
+struct ShootdownStatistics {
+	// Number of shootdown IPIs sent to individual CPUs.
+	uint64_t numIpisSent;
+	// Number of IPIs that were not sent since an IPI was already in flight.
+	uint64_t numIpisCoalesced;
+	// Number of times that an entire ASID was invalidated instead of individual pages.
+	uint64_t numFullFlushes;
+	// Number of times that a lazy binding was invalidated when it became primary again.
+	uint64_t numLazyFlushes;
+};
+
+// Sums up the shootdown statistics of all CPUs.
+ShootdownStatistics getShootdownStatistics();
+
+// Called by the architecture-specific code when a shootdown IPI is received.
+// Precondition: !intsAreEnabled().
+void handleShootdownIpi();
+
 template<typename R>
 struct ShootdownOperation;
 
@@ -239,10 +299,14 @@ struct [[nodiscard]] ShootdownSender {
 	VirtualAddr address;
 	size_t size;
 	WorkQueue *wq;
+	bool migratable;
 };
 
-inline ShootdownSender shootdown(PageSpace *space, VirtualAddr address, size_t size, WorkQueue *wq) {
-	return {space, address, size, wq};
+// If migratable is true, the completion may run on the general WQ of another CPU
+// (see Worklet::setup()).
+inline ShootdownSender shootdown(PageSpace *space, VirtualAddr address, size_t size,
+		WorkQueue *wq, bool migratable = false) {
+	return {space, address, size, wq, migratable};
 }
 
 template<typename R>
@@ -272,7 +336,7 @@ struct ShootdownOperation {
 				frg::destruct(getCoreAllocator(), static_cast<Node *>(r));
 			});
 			async::execution::set_value(op->receiver_);
-		});
+		}, s_.migratable);
 		if(s_.self->submitShootdown(node)) {
 			frg::destruct(getCoreAllocator(), node);
 			return async::execution::set_value(receiver_);
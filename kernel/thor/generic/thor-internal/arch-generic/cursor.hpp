@@ -1,9 +1,12 @@
 #pragma once
 
 #include <stddef.h>
+#include <atomic>
 #include <concepts>
+#include <string.h>
 #include <tuple>
 #include <utility>
+#include <frg/optional.hpp>
 
 #include <thor-internal/arch-generic/paging-consts.hpp>
 #include <thor-internal/arch-generic/asid.hpp>
@@ -49,12 +52,43 @@ concept CursorPolicy = requires (T policy, uint64_t pte, uint64_t *ptePtr,
 	{ policy.pteNewTable() } -> std::same_as<uint64_t>;
 };
 
+// Optional extension of CursorPolicy for policies that support huge pages,
+// i.e., leaf entries in the second to last level of the page table.
+template <typename T>
+concept HugeCursorPolicy = CursorPolicy<T> && requires (uint64_t pte,
+		PhysicalAddr pa, PageFlags flags, CachingMode cachingMode, size_t index) {
+	// Check whether the given (second to last level) PTE is a huge page leaf.
+	{ T::pteIsHuge(pte) } -> std::same_as<bool>;
+	// Get the page address from the given huge page PTE.
+	{ T::pteHugeAddress(pte) } -> std::same_as<PhysicalAddr>;
+	// Construct a new huge page PTE from the given parameters.
+	{ T::pteBuildHuge(pa, flags, cachingMode) } -> std::same_as<uint64_t>;
+	// Construct the PTE of the index-th 4 KiB page covered by the given huge page PTE.
+	// This preserves the permission, caching, accessed and dirty bits.
+	{ T::pteSplitHuge(pte, index) } -> std::same_as<uint64_t>;
+};
+
+// Whether huge pages are used for mappings that allow them (see the "thp" command line option).
+extern bool enableHugePages;
+
+struct HugePageStatistics {
+	// Number of huge page leaf entries that are currently installed.
+	std::atomic<int64_t> numMapped{0};
+	// Number of huge page leaf entries that were split into 4 KiB pages.
+	std::atomic<uint64_t> numSplits{0};
+};
+
+extern constinit HugePageStatistics hugePageStatistics;
+
 template <CursorPolicy Policy>
 struct PageCursor {
 	using PolicyType = Policy;
 
 	inline static constexpr uintptr_t levelMask = (uintptr_t{1} << Policy::bitsPerLevel) - 1;
 	inline static constexpr size_t lastLevel = Policy::maxLevels - 1;
+	// Level that contains huge page leaf entries.
+	inline static constexpr size_t hugeLevel = lastLevel - 1;
+	inline static constexpr bool supportsHuge = HugeCursorPolicy<Policy>;
 
 	PageCursor(PageSpace *space, uintptr_t va, Policy policy = {})
 	: space_{space}, va_{}, policy_{policy},
@@ -81,6 +115,24 @@ private:
 		return __atomic_exchange_n(currentPtePtr_(), value, __ATOMIC_RELAXED);
 	}
 
+	// Pointer to the second to last level PTE that covers va_.
+	// Returns nullptr if the second to last level table is not present.
+	uint64_t *hugePtePtr_() {
+		if(!accessors_[hugeLevel])
+			return nullptr;
+		return reinterpret_cast<uint64_t *>(accessors_[hugeLevel].get())
+			+ ((va_ >> levelShift(hugeLevel)) & levelMask);
+	}
+
+	// If va_ is covered by a huge page leaf, splits it into a last level table,
+	// such that 4 KiB operations can proceed. Returns whether a split was performed.
+	bool splitHugeIfPresent_() {
+		if(!isHuge())
+			return false;
+		realizePts_();
+		return true;
+	}
+
 public:
 	uintptr_t virtualAddress() {
 		return va_;
@@ -104,9 +156,38 @@ public:
 		moveTo(va_ + kPageSize);
 	}
 
+	// Advances to the next huge page boundary.
+	void advance2m() {
+		moveTo((va_ + kHugePageSize) & ~uintptr_t(kHugePageSize - 1));
+	}
+
+	// Whether va_ is covered by a present huge page leaf.
+	bool isHuge() {
+		if constexpr (supportsHuge) {
+			if(accessors_[lastLevel])
+				return false;
+			auto ptr = hugePtePtr_();
+			if(!ptr)
+				return false;
+			auto pte = __atomic_load_n(ptr, __ATOMIC_RELAXED);
+			return Policy::ptePagePresent(pte) && Policy::pteIsHuge(pte);
+		} else {
+			return false;
+		}
+	}
+
+	// Whether va_ is covered by a present 4 KiB or huge page leaf.
+	bool isPresent() {
+		if(!accessors_[lastLevel])
+			return isHuge();
+		return Policy::ptePagePresent(readCurrentPte_());
+	}
+
 	bool findPresent(uintptr_t limit) {
 		while(va_ < limit) {
 			if(!accessors_[lastLevel]) {
+				if(isHuge())
+					return true;
 				advance4k();
 				continue;
 			}
@@ -124,6 +205,13 @@ public:
 	bool findDirty(uintptr_t limit) {
 		while(va_ < limit) {
 			if(!accessors_[lastLevel]) {
+				if(isHuge()) {
+					auto pte = __atomic_load_n(hugePtePtr_(), __ATOMIC_RELAXED);
+					if(Policy::ptePageStatus(pte) & page_status::dirty)
+						return true;
+					advance2m();
+					continue;
+				}
 				advance4k();
 				continue;
 			}
@@ -168,7 +256,7 @@ public:
 	}
 
 	std::tuple<PageStatus, PhysicalAddr, bool> restrict4k(PageFlags flags, CachingMode cachingMode) {
-		if(!accessors_[lastLevel])
+		if(!accessors_[lastLevel] && !splitHugeIfPresent_())
 			return {0, PhysicalAddr(-1), false};
 
 		uint64_t oldPte = readCurrentPte_();
@@ -200,7 +288,7 @@ public:
 	}
 
 	std::tuple<PageStatus, PhysicalAddr> clean4k() {
-		if(!accessors_[lastLevel])
+		if(!accessors_[lastLevel] && !splitHugeIfPresent_())
 			return {0, PhysicalAddr(-1)};
 
 		auto ptEnt = policy_.pteClean(currentPtePtr_());
@@ -209,7 +297,7 @@ public:
 	}
 
 	std::tuple<PageStatus, PhysicalAddr> unmap4k() {
-		if(!accessors_[lastLevel])
+		if(!accessors_[lastLevel] && !splitHugeIfPresent_())
 			return {0, 0};
 
 		auto ptEnt = exchangeCurrentPte_(0);
@@ -218,7 +306,7 @@ public:
 	}
 
 	std::tuple<PageStatus, PhysicalAddr, bool> age4k(bool vacate) {
-		if(!accessors_[lastLevel])
+		if(!accessors_[lastLevel] && !splitHugeIfPresent_())
 			return {0, PhysicalAddr(-1), false};
 		auto [oldPte, unmapped] = Policy::pteAge(currentPtePtr_(), vacate);
 		if(unmapped)
@@ -226,6 +314,120 @@ public:
 		return {Policy::ptePageStatus(oldPte), Policy::ptePageAddress(oldPte), unmapped};
 	}
 
+	// ----------------------------------------------------------------------------------
+	// Huge page operations. These require va_ to be huge page aligned.
+	// Except for map2m(), they require isHuge() to be true.
+	// ----------------------------------------------------------------------------------
+
+	// Installs a huge page leaf at va_. Fails (returning frg::null_opt) if a last level
+	// table is already present for this range; callers should fall back to map4k() in that case.
+	// Otherwise, returns the status and address of the huge page leaf that was replaced (if any).
+	frg::optional<std::tuple<PageStatus, PhysicalAddr>>
+	map2m(PhysicalAddr pa, PageFlags flags, CachingMode cachingMode) requires supportsHuge {
+		assert(!(va_ & (kHugePageSize - 1)));
+		assert(!(pa & (kHugePageSize - 1)));
+
+		if(accessors_[lastLevel])
+			return frg::null_opt;
+
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&space_->tableMutex());
+
+		realizeLevel_(hugeLevel);
+		auto ptr = hugePtePtr_();
+		auto oldPte = __atomic_load_n(ptr, __ATOMIC_RELAXED);
+		bool wasHuge = Policy::ptePagePresent(oldPte) && Policy::pteIsHuge(oldPte);
+		if(!wasHuge && Policy::pteTablePresent(oldPte))
+			return frg::null_opt;
+
+		if (flags & page_access::execute) {
+			for(size_t pg = 0; pg < kHugePageSize; pg += kPageSize)
+				Policy::pteSyncICache(pa + pg);
+		}
+
+		oldPte = __atomic_exchange_n(ptr, Policy::pteBuildHuge(pa, flags, cachingMode),
+				__ATOMIC_RELEASE);
+		policy_.pteWriteBarrier(ptr);
+
+		if(!wasHuge) {
+			hugePageStatistics.numMapped.fetch_add(1, std::memory_order_relaxed);
+			return std::tuple<PageStatus, PhysicalAddr>{0, PhysicalAddr(-1)};
+		}
+		return std::tuple<PageStatus, PhysicalAddr>{Policy::ptePageStatus(oldPte),
+				Policy::pteHugeAddress(oldPte)};
+	}
+
+	std::tuple<PageStatus, PhysicalAddr, bool> restrict2m(PageFlags flags, CachingMode cachingMode)
+	requires supportsHuge {
+		assert(!(va_ & (kHugePageSize - 1)));
+		auto ptr = hugePtePtr_();
+		assert(ptr);
+
+		uint64_t oldPte = __atomic_load_n(ptr, __ATOMIC_RELAXED);
+		while (true) {
+			if(!Policy::ptePagePresent(oldPte))
+				return {0, PhysicalAddr(-1), false};
+			assert(Policy::pteIsHuge(oldPte));
+
+			PageFlags effectiveFlags = flags;
+			if(!Policy::ptePageCanAccess(oldPte, page_access::write))
+				effectiveFlags &= ~page_access::write;
+			if(!Policy::ptePageCanAccess(oldPte, page_access::execute))
+				effectiveFlags &= ~page_access::execute;
+
+			auto newPte = Policy::pteBuildHuge(Policy::pteHugeAddress(oldPte),
+					effectiveFlags, cachingMode);
+			auto success = __atomic_compare_exchange_n(
+				ptr, &oldPte, newPte, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED
+			);
+			if (success)
+				break;
+		}
+		policy_.pteWriteBarrier(ptr);
+
+		bool restricted = false;
+		if (!(flags & page_access::write) && Policy::ptePageCanAccess(oldPte, page_access::write))
+			restricted = true;
+		if (!(flags & page_access::execute) && Policy::ptePageCanAccess(oldPte, page_access::execute))
+			restricted = true;
+		return {Policy::ptePageStatus(oldPte), Policy::pteHugeAddress(oldPte), restricted};
+	}
+
+	std::tuple<PageStatus, PhysicalAddr> clean2m() requires supportsHuge {
+		assert(!(va_ & (kHugePageSize - 1)));
+		auto ptr = hugePtePtr_();
+		assert(ptr);
+
+		auto pte = policy_.pteClean(ptr);
+		policy_.pteWriteBarrier(ptr);
+		return {Policy::ptePageStatus(pte), Policy::pteHugeAddress(pte)};
+	}
+
+	std::tuple<PageStatus, PhysicalAddr> unmap2m() requires supportsHuge {
+		assert(!(va_ & (kHugePageSize - 1)));
+		auto ptr = hugePtePtr_();
+		assert(ptr);
+
+		auto pte = __atomic_exchange_n(ptr, 0, __ATOMIC_RELAXED);
+		policy_.pteWriteBarrier(ptr);
+		if(Policy::ptePagePresent(pte))
+			hugePageStatistics.numMapped.fetch_sub(1, std::memory_order_relaxed);
+		return {Policy::ptePageStatus(pte), Policy::pteHugeAddress(pte)};
+	}
+
+	std::tuple<PageStatus, PhysicalAddr, bool> age2m(bool vacate) requires supportsHuge {
+		assert(!(va_ & (kHugePageSize - 1)));
+		auto ptr = hugePtePtr_();
+		assert(ptr);
+
+		auto [oldPte, unmapped] = Policy::pteAge(ptr, vacate);
+		if(unmapped) {
+			policy_.pteWriteBarrier(ptr);
+			hugePageStatistics.numMapped.fetch_sub(1, std::memory_order_relaxed);
+		}
+		return {Policy::ptePageStatus(oldPte), Policy::pteHugeAddress(oldPte), unmapped};
+	}
+
 	// Low-level API for use by arch-specific code.
 public:
 	uint64_t *getPtePtr() {
@@ -269,6 +471,13 @@ private:
 			return;
 		}
 
+		if constexpr (supportsHuge) {
+			if(level == hugeLevel && Policy::ptePagePresent(ptEnt) && Policy::pteIsHuge(ptEnt)) {
+				splitHuge_(subPt, ptPtr, ptEnt);
+				return;
+			}
+		}
+
 		ptEnt = policy_.pteNewTable();
 		auto subPtPtr = Policy::pteTableAddress(ptEnt);
 		subPt = PageAccessor{subPtPtr};
@@ -277,6 +486,40 @@ private:
 		policy_.pteWriteBarrier(ptPtr);
 	}
 
+	// Replaces the huge page leaf at ptPtr by a last level table that maps the same pages.
+	// Must be called with the table mutex held.
+	void splitHuge_(PageAccessor &subPt, uint64_t *ptPtr, uint64_t hugePte) requires supportsHuge {
+		auto tableEnt = policy_.pteNewTable();
+		subPt = PageAccessor{Policy::pteTableAddress(tableEnt)};
+		auto tbl = reinterpret_cast<uint64_t *>(subPt.get());
+
+		bool split;
+		while(true) {
+			// The huge page may have been unmapped by aging in the meantime.
+			split = Policy::ptePagePresent(hugePte) && Policy::pteIsHuge(hugePte);
+			if(split) {
+				for(size_t i = 0; i <= levelMask; i++)
+					tbl[i] = Policy::pteSplitHuge(hugePte, i);
+			} else {
+				assert(!Policy::pteTablePresent(hugePte));
+				memset(tbl, 0, kPageSize);
+			}
+
+			// Hardware may concurrently update the accessed and dirty bits of the huge page PTE.
+			auto success = __atomic_compare_exchange_n(
+				ptPtr, &hugePte, tableEnt, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED
+			);
+			if(success)
+				break;
+		}
+		policy_.pteWriteBarrier(ptPtr);
+
+		if(split) {
+			hugePageStatistics.numMapped.fetch_sub(1, std::memory_order_relaxed);
+			hugePageStatistics.numSplits.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
 	void realizeLevel_(size_t level) {
 		if(accessors_[level]) /*[[likely]]*/
 			return;
@@ -7,7 +7,10 @@ namespace thor {
 struct CpuData;
 
 void sendPingIpi(CpuData *dstData);
+// Sends a shootdown IPI to all other CPUs.
 void sendShootdownIpi();
+// Sends a shootdown IPI to a single CPU.
+void sendShootdownIpi(CpuData *dstData);
 void sendSelfCallIpi();
 
 } // namespace thor
@@ -73,6 +73,19 @@ struct alignas(8) IntState {
 	Ipl outerIpl{ipl::bad};
 };
 
+// Position of a CPU within the cache and memory hierarchy.
+// CPUs with equal IDs at some level share the corresponding resource.
+struct CpuTopology {
+	// Physical core. SMT siblings have the same core ID.
+	uint32_t core{0};
+	// Last level cache.
+	uint32_t llc{0};
+	// NUMA node (i.e., ACPI proximity domain or DT numa-node-id).
+	uint32_t numaNode{0};
+	// Set by architecture-specific code once the IDs above are meaningful.
+	bool valid{false};
+};
+
 struct CpuData : public PlatformCpuData {
 	CpuData();
 
@@ -91,6 +104,7 @@ struct CpuData : public PlatformCpuData {
 	bool haveVirtualization;
 
 	int cpuIndex;
+	CpuTopology topology;
 
 	ExecutorContext *executorContext{nullptr};
 	smarter::borrowed_ptr<Thread> activeThread;
@@ -3,7 +3,6 @@
 #include <async/cancellation.hpp>
 #include <async/oneshot-event.hpp>
 #include <frg/functional.hpp>
-#include <frg/hash_map.hpp>
 #include <frg/list.hpp>
 #include <frg/spinlock.hpp>
 
@@ -65,28 +64,66 @@ private:
 
 	// Represents a single waiter.
 	struct Node {
+		FutexIdentity id;
 		State st{State::none};
 		frg::default_list_hook<Node> queueHook;
 		async::oneshot_primitive completionEvent;
 	};
 
-	struct Slot {
-		frg::intrusive_list<
+	using NodeList = frg::intrusive_list<
+		Node,
+		frg::locate_member<
 			Node,
-			frg::locate_member<
-				Node,
-				frg::default_list_hook<Node>,
-				&Node::queueHook
-			>
-		> queue;
+			frg::default_list_hook<Node>,
+			&Node::queueHook
+		>
+	>;
+
+	using Mutex = frg::ticket_spinlock;
+
+	// Waiters are distributed to buckets by the hash of their FutexIdentity.
+	// Each bucket has its own lock, such that operations on futexes
+	// that hash to different buckets do not contend with each other.
+	// Since waiters are linked into the bucket directly, wait() does not allocate.
+	struct Bucket {
+		Mutex mutex;
+		// Waiters of all futexes in this bucket, in FIFO order.
+		NodeList queue;
 	};
 
 public:
-	FutexRealm()
-	: _slots{FutexIdentity::Hash{}, *kernelAlloc} { }
+	// Number of buckets for per-address space realms.
+	// The global realm is shared by all processes and uses more buckets.
+	static constexpr size_t defaultNumBuckets = 16;
+	static constexpr size_t globalNumBuckets = 256;
+
+	explicit FutexRealm(size_t numBuckets = defaultNumBuckets)
+	: _numBuckets{numBuckets} {
+		assert(numBuckets && !(numBuckets & (numBuckets - 1)));
+		_buckets = static_cast<Bucket *>(kernelAlloc->allocate(sizeof(Bucket) * _numBuckets));
+		for(size_t i = 0; i < _numBuckets; ++i)
+			new (&_buckets[i]) Bucket{};
+	}
+
+	FutexRealm(const FutexRealm &) = delete;
+
+	~FutexRealm() {
+		for(size_t i = 0; i < _numBuckets; ++i)
+			_buckets[i].~Bucket();
+		kernelAlloc->deallocate(_buckets, sizeof(Bucket) * _numBuckets);
+	}
+
+	FutexRealm &operator= (const FutexRealm &) = delete;
 
 	bool empty() {
-		return _slots.empty();
+		for(size_t i = 0; i < _numBuckets; ++i) {
+			auto irqLock = frg::guard(&irqMutex());
+			auto lock = frg::guard(&_buckets[i].mutex);
+
+			if(!_buckets[i].queue.empty())
+				return false;
+		}
+		return true;
 	}
 
 	// ----------------------------------------------------------------------------------
@@ -97,27 +134,22 @@ public:
 	coroutine<Error> wait(S space, uintptr_t address, unsigned int expected,
 			async::cancellation_token ct = {}) {
 		Node node{};
-		FutexIdentity id;
+		Bucket *bucket = nullptr;
 
 		bool futexRace = false;
 		auto result = co_await space.withFutex(address, [&](auto futex) {
-			id = futex.getIdentity();
+			node.id = futex.getIdentity();
+			bucket = _getBucket(node.id);
 
 			auto irqLock = frg::guard(&irqMutex());
-			auto lock = frg::guard(&_mutex);
+			auto lock = frg::guard(&bucket->mutex);
 
 			if(futex.read() != expected) {
 				futexRace = true;
 				return;
 			}
 
-			auto sit = _slots.get(id);
-			if(!sit) {
-				_slots.insert(id, Slot());
-				sit = _slots.get(id);
-			}
-
-			sit->queue.push_back(&node);
+			bucket->queue.push_back(&node);
 		});
 		if(!result)
 			co_return result.error();
@@ -130,24 +162,15 @@ public:
 				// Remove the node from the futex's wait list.
 				{
 					auto irqLock = frg::guard(&irqMutex());
-					auto lock = frg::guard(&_mutex);
+					auto lock = frg::guard(&bucket->mutex);
 
 					if (node.st == State::done)
 						return;
 					assert(node.st == State::none);
 
-					auto sit = _slots.get(id);
-					assert(sit);
-
-					// Invariant: If the slot exists then its queue is not empty.
-					assert(!sit->queue.empty());
-
-					auto nit = sit->queue.iterator_to(&node);
-					sit->queue.erase(nit);
+					auto nit = bucket->queue.iterator_to(&node);
+					bucket->queue.erase(nit);
 					node.st = State::cancelled;
-
-					if(sit->queue.empty())
-						_slots.remove(id);
 				}
 
 				node.completionEvent.raise();
@@ -177,37 +200,31 @@ public:
 		if(!result)
 			co_return result.error();
 
-		frg::intrusive_list<
-			Node,
-			frg::locate_member<
-				Node,
-				frg::default_list_hook<Node>,
-				&Node::queueHook
-			>
-		> pending;
+		auto bucket = _getBucket(id);
+
+		NodeList pending;
 		{
 			auto irqLock = frg::guard(&irqMutex());
-			auto lock = frg::guard(&_mutex);
-
-			auto sit = _slots.get(id);
-			if(!sit)
-				co_return {};
-			// Invariant: If the slot exists then its queue is not empty.
-			assert(!sit->queue.empty());
-
-			while(!sit->queue.empty() && count) {
-				auto node = sit->queue.front();
+			auto lock = frg::guard(&bucket->mutex);
+
+			auto it = bucket->queue.begin();
+			while(it != bucket->queue.end() && count) {
+				auto node = *it;
+				if(node->id != id) {
+					++it;
+					continue;
+				}
 				assert(node->st == State::none);
-				sit->queue.pop_front();
+				auto next = it;
+				++next;
+				bucket->queue.erase(it);
+				it = next;
 
 				node->st = State::done;
 				pending.push_back(node);
 
 				count--;
 			}
-
-			if(sit->queue.empty())
-				_slots.remove(id);
 		}
 
 		while(!pending.empty()) {
@@ -219,18 +236,12 @@ public:
 	}
 
 private:
-	using Mutex = frg::ticket_spinlock;
-
-	// TODO: use a scalable hash table with fine-grained locks to
-	// improve the scalability of the futex algorithm.
-	Mutex _mutex;
+	Bucket *_getBucket(FutexIdentity id) {
+		return &_buckets[FutexIdentity::Hash{}(id) & (_numBuckets - 1)];
+	}
 
-	frg::hash_map<
-		FutexIdentity,
-		Slot,
-		FutexIdentity::Hash,
-		KernelAlloc
-	> _slots;
+	size_t _numBuckets;
+	Bucket *_buckets;
 };
 
 } // namespace thor
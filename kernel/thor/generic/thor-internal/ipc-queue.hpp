@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <expected>
 #include <span>
 
@@ -26,11 +27,14 @@ static const int kUserNotifyAlert = (1 << 15);
 static const int kKernelNotifySqProgress = (1 << 0);
 static const int kKernelNotifySupplyCqChunks = (1 << 1);
 
+static const uint32_t kQueueBatchCompletions = (1 << 0);
+
 struct QueueStruct {
 	int userNotify;
 	int kernelNotify;
 	int cqFirst;
 	int sqFirst;
+	unsigned int cqStalls;
 };
 
 static const int kNextPresent = (1 << 24);
@@ -77,9 +81,10 @@ private:
 
 public:
 	static std::expected<smarter::shared_ptr<IpcQueue>, Error>
-	create(unsigned int numChunks, size_t chunkSize, unsigned int numSqChunks);
+	create(uint32_t flags, unsigned int numChunks, size_t chunkSize, unsigned int numSqChunks);
 
-	IpcQueue(CtorToken, unsigned int numChunks, size_t chunkSize, unsigned int numSqChunks);
+	IpcQueue(CtorToken, uint32_t flags, unsigned int numChunks, size_t chunkSize,
+			unsigned int numSqChunks);
 
 	IpcQueue(const IpcQueue &) = delete;
 
@@ -128,9 +133,20 @@ public:
 		}
 	}
 
+	// Number of times that submit() had to wait for userspace to supply CQ chunks.
+	unsigned int numCqStalls() {
+		return _numCqStalls.load(std::memory_order_relaxed);
+	}
+
 private:
 	void notifyError();
 
+	// Raises _userEvent, unless processSq() batches completions.
+	// In the latter case, processSq() raises _userEvent once it is done.
+	void raiseUserEvent_();
+
+	void countCqStall_();
+
 	bool isValidCqChunk(unsigned int idx) const {
 		return idx < _numCqChunks;
 	}
@@ -142,10 +158,18 @@ private:
 	smarter::shared_ptr<ImmediateMemory> _memory;
 	ImmediateWindow _mapping;
 
+	uint32_t _flags;
 	size_t _chunkSize;
 
 	frg::vector<size_t, KernelAlloc> _chunkOffsets;
 
+	// Set while processSq() runs (if kQueueBatchCompletions is set).
+	std::atomic<bool> _batchingCompletions{false};
+	// Set if _userEvent needs to be raised at the end of processSq().
+	std::atomic<bool> _pendingUserEvent{false};
+
+	std::atomic<unsigned int> _numCqStalls{0};
+
 	// CQ state.
 	async::mutex _cqMutex;
 
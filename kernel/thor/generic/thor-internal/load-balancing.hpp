@@ -1,15 +1,34 @@
 #pragma once
 
 #include <async/barrier.hpp>
+#include <frg/array.hpp>
 #include <frg/span.hpp>
 #include <thor-internal/coroutine.hpp>
 #include <thor-internal/cpu-data.hpp>
 #include <thor-internal/thread.hpp>
+#include <thor-internal/work-queue.hpp>
 
 namespace thor {
 
 struct LbNode;
 
+// Scheduling domains, ordered from the innermost to the outermost domain.
+enum class LbDomain {
+	// CPUs on the same core (i.e., SMT siblings).
+	smt,
+	// CPUs that share the last level cache.
+	llc,
+	// CPUs on the same NUMA node.
+	numa,
+	// All CPUs.
+	system
+};
+
+inline constexpr size_t numLbDomains = 4;
+
+// Returns the innermost domain that contains both CPUs.
+LbDomain commonLbDomain(CpuData *a, CpuData *b);
+
 // Per-thread control block that is allocated by the load balancer.
 struct LbControlBlock {
 	friend struct LbNode;
@@ -65,8 +84,10 @@ private:
 	// Not necessarily the CPU that the thread runs on currently.
 	std::atomic<CpuData *> _assignedCpu{nullptr};
 
-	// Protected by the LbNode that currently owns the node.
-	LbNode *node_{nullptr};
+	// LbNode that currently owns the control block.
+	// Only modified while holding the mutex of that LbNode; may be read without it.
+	// Null while the control block is moved between two LbNodes by balanceBetween_().
+	std::atomic<LbNode *> node_{nullptr};
 
 	// Protected by the LbNode that currently owns the node.
 	frg::default_list_hook<LbControlBlock> hook_;
@@ -99,12 +120,36 @@ struct LbNode {
 		>
 	> tasks;
 
-	// Constant during main phase of load balancing.
-	uint64_t totalLoad{0};
+	// Load at the start of the last balancing round. Only written by this CPU
+	// at the start of each round (hence constant during the main phase of
+	// load balancing) but read by all CPUs.
+	std::atomic<uint64_t> totalLoad{0};
+
+	// Equal to totalLoad at the start of each round but updated whenever threads are
+	// moved (both during load balancing and by idle pulls).
+	// Only modified while holding mutex; may be read without it.
+	std::atomic<uint64_t> currentLoad{0};
+
+	// The following members are only accessed on this CPU.
+
+	// True while the periodic load balancing round runs on this CPU.
+	bool inRound{false};
 
-	// Equal to totalLoad before load balancing but updated during load balancing.
-	// Protected by mutex during main phase of load balancing.
-	uint64_t currentLoad{0};
+	// Used to request a pull of threads when this CPU becomes idle.
+	Worklet idlePullWorklet;
+	bool idlePullPending{false};
+	uint64_t lastIdlePull{0};
+	// Round in which an idle pull last found nothing to pull.
+	uint64_t idlePullFailedRound{~uint64_t{0}};
+
+	// Number of threads that were pulled to this CPU, by the domain they were pulled across.
+	frg::array<uint64_t, numLbDomains> numPulled{};
+	uint64_t numIdlePulls{0};
+
+	// Number of threads woken by this CPU that were placed on an idle CPU
+	// (instead of their previous CPU) or on this CPU due to a sync wakeup.
+	uint64_t numWakeAffine{0};
+	uint64_t numSyncWakeups{0};
 };
 
 extern PerCpu<LbNode> lbNode;
@@ -125,14 +170,39 @@ struct LoadBalancer {
 	// The thread is detached from the load balancer when the weak reference goes out of scope.
 	void connect(Thread *thread, CpuData *cpu);
 
+	// Called by the scheduler when the current CPU is about to become idle.
+	// Pulls threads from busy CPUs instead of waiting for the next balancing round.
+	// Precondition: IRQs are disabled.
+	void notifyIdle(CpuData *cpu);
+
+	// Chooses the CPU that a thread that is woken up by the current CPU should run on.
+	// prevCpu is the CPU that the thread last ran on. If sync is true, the waker is
+	// about to block. This does not update the assignment of the LbControlBlock;
+	// callers that place the thread on the returned CPU call reassign() afterwards.
+	// Precondition: IRQs are disabled.
+	CpuData *selectWakeCpu(LbControlBlock *cb, CpuData *prevCpu, bool sync);
+
+	// Moves the LbControlBlock to the LbNode of the given CPU and updates its assigned CPU.
+	// Does nothing if the control block is concurrently moved by load balancing.
+	// Precondition: IRQs are disabled. The caller does not hold the thread's mutex
+	//               (since the load balancer takes thread mutexes while holding LbNode mutexes).
+	void reassign(LbControlBlock *cb, CpuData *cpu);
+
 private:
 	coroutine<void> run_(CpuData *cpu);
 
+	void idlePull_(CpuData *cpu);
+
 	// Move tasks from srcNode to dstNode to balance load.
 	// newLoad: newLoad at dstNode after balancing.
-	void balanceBetween_(LbNode *srcNode, LbNode *dstNode, uint64_t &newLoad, uint64_t idealLoad);
+	// domain: innermost domain that contains both nodes.
+	void balanceBetween_(LbNode *srcNode, LbNode *dstNode, uint64_t &newLoad, uint64_t idealLoad,
+			LbDomain domain);
 
 	async::barrier barrier_;
+
+	// Incremented at the start of each balancing round.
+	std::atomic<uint64_t> round_{0};
 };
 
 } // namespace thor
@@ -33,6 +33,9 @@ struct AddressSpace;
 struct AddressSpaceLockHandle;
 struct FaultNode;
 struct MemoryReclaimer;
+struct ManagedSpace;
+struct CopyOnWriteMemory;
+struct AnonymousBundle;
 
 struct CacheBundle;
 
@@ -114,6 +117,90 @@ private:
 	frg::intrusive_rcu_list_hook<CacheBundle> reclaimerHook_;
 };
 
+struct ReclaimStatistics {
+	// Pages that are registered with the reclaim mechanism.
+	size_t cachePages;
+	// Used pages that are not registered with the reclaim mechanism.
+	size_t pinnedPages;
+	// Reclaim starts when less than lowWatermark pages are free
+	// and continues until highWatermark pages are free.
+	size_t lowWatermark;
+	size_t highWatermark;
+	// Number of generation rotations (and how many of them were due to memory pressure).
+	uint64_t numRotations;
+	uint64_t numPressureRotations;
+	// Number of pages that were posted to bundles for eviction and that were taken by bundles.
+	uint64_t numPostedPages;
+	uint64_t numEvictedPages;
+};
+
+ReclaimStatistics getReclaimStatistics();
+
+// Watermarks are given in pages. Returns false if lowWatermark > highWatermark
+// or if highWatermark exceeds the total amount of memory.
+bool setReclaimWatermarks(size_t lowWatermark, size_t highWatermark);
+
+struct SwapStatistics {
+	// Size of the swap area and number of slots that hold swapped out pages (in pages).
+	size_t totalPages;
+	size_t usedPages;
+	// Number of pages that were written to / read from the swap area.
+	uint64_t numSwappedOut;
+	uint64_t numSwappedIn;
+};
+
+SwapStatistics getSwapStatistics();
+
+struct ReadaheadStatistics {
+	// Maximal size of the readahead window (in pages).
+	size_t maxWindow;
+	// Number of pages that were requested by readahead.
+	uint64_t numPages;
+	// Number of pages requested by readahead that were touched (or mapped by fault-around) afterwards.
+	uint64_t numHits;
+	// Number of pages of readahead-enabled ManagedSpaces that were requested on demand.
+	uint64_t numMisses;
+};
+
+ReadaheadStatistics getReadaheadStatistics();
+
+// The window is given in pages. Returns false if it is zero or too large.
+bool setMaxReadahead(size_t maxWindow);
+
+struct WritebackStatistics {
+	// Pages of ManagedSpaces that were dirtied and are not clean yet.
+	// This includes the pages that are currently under writeback.
+	size_t dirtyPages;
+	size_t writebackPages;
+	// Background writeback starts once dirty pages exceed backgroundRatio percent of memory.
+	// Writers are throttled once dirty pages exceed dirtyRatio percent of memory.
+	unsigned int backgroundRatio;
+	unsigned int dirtyRatio;
+	// Dirty pages are written back once they have been dirty for this long.
+	uint64_t expireNanos;
+	// Number of flushes that were started because dirty pages expired,
+	// and because of the background ratio or memory pressure.
+	uint64_t numExpiredFlushes;
+	uint64_t numBackgroundFlushes;
+	// Number of times that writers were throttled and the total time that they waited.
+	uint64_t numThrottled;
+	uint64_t throttledNanos;
+};
+
+WritebackStatistics getWritebackStatistics();
+
+// Returns false if backgroundRatio exceeds dirtyRatio, if dirtyRatio exceeds 100
+// or if expireNanos is zero.
+bool setWritebackLimits(unsigned int backgroundRatio, unsigned int dirtyRatio,
+		uint64_t expireNanos);
+
+// Attaches a swap area. Anonymous memory (i.e., pages of CopyOnWriteMemory objects)
+// is written to the swap area under memory pressure.
+// The view must be the frontal part of a managed memory object
+// (e.g., the memory of a block device that is served by a userspace driver).
+// Only a single swap area is supported and it cannot be detached.
+Error attachSwap(smarter::shared_ptr<MemoryView> view);
+
 inline void markDirty(PfnDescriptor descriptor) {
 	if(descriptor.isCachePage()) {
 		auto *ptr = descriptor.cachePagePtr();
@@ -340,6 +427,11 @@ public:
 
 	virtual coroutine<frg::expected<Error, smarter::shared_ptr<MemoryView>>> fork();
 
+	// Ensures that the memory of this object is never swapped out
+	// (including memory of objects that are forked from it). Swapped out pages are read back.
+	// Only relevant for anonymous memory; other objects are never swapped out.
+	virtual coroutine<frg::expected<Error>> exemptFromSwap();
+
 	virtual coroutine<frg::expected<Error>> copyTo(uintptr_t offset,
 			const void *pointer, size_t size,
 			FetchFlags flags = 0);
@@ -383,6 +475,9 @@ public:
 	virtual Error setIndirection(size_t slot, smarter::shared_ptr<MemoryView> view,
 			uintptr_t offset, size_t size, CachingFlags flags);
 
+	// Returns the ManagedSpace that backs this view (or nullptr).
+	virtual smarter::shared_ptr<ManagedSpace> getManagedSpace();
+
 	coroutine<frg::expected<Error>>
 	touchFullRange(uintptr_t offset, size_t size, FetchFlags flags);
 
@@ -626,7 +721,15 @@ public:
 private:
 	frg::ticket_spinlock _mutex;
 
+	// Whether chunks should be grouped into huge pages when possible.
+	bool _useHugePages() {
+		return _chunkSize == kPageSize && enableHugePages;
+	}
+
 	frg::vector<PhysicalAddr, KernelAlloc> _physicalChunks;
+	// For each huge page sized block of chunks: whether the block
+	// is backed by a single huge page allocation.
+	frg::vector<bool, KernelAlloc> _hugeBlocks;
 	int _addressBits;
 	size_t _chunkSize, _chunkAlign;
 };
@@ -650,7 +753,8 @@ struct ManagedSpace : CacheBundle {
 		// Valid in LoadState::missing.
 		initialization,
 		// Page is in _dirtyList (or the draining coroutine's local pending list),
-		// waiting for a fenceDirty() to complete before being promoted to _writebackList.
+		// waiting for a flush and for a fenceDirty() to complete before being
+		// promoted to _writebackList.
 		// Valid in LoadState::present.
 		dirty,
 		// Page is in _writebackList.
@@ -710,12 +814,17 @@ struct ManagedSpace : CacheBundle {
 		// to request that the eviction coroutine raise monitor after completing
 		// the transition to LoadState::missing.
 		bool forceInvalidation{false};
+		// Whether the page was requested by readahead and was not touched since.
+		bool readahead{false};
 		unsigned int lockCount = 0;
 		CachePage cachePage;
 		frg::intrusive_shared_ptr<TransactionMonitor, Allocator> monitor;
 	};
 
-	ManagedSpace(size_t length, bool readahead);
+	// Manage requests that are larger than this are not issued by default.
+	static constexpr size_t defaultMaxRequestSize = size_t{128} << 10;
+
+	ManagedSpace(size_t length, bool readahead, size_t maxRequestSize = defaultMaxRequestSize);
 	~ManagedSpace();
 
 	void incrementUses(CachePage *page) override;
@@ -728,6 +837,33 @@ struct ManagedSpace : CacheBundle {
 	void submitManagement(ManageNode *node);
 	void _progressManagement(ManageList &pending);
 
+	// Requests writeback of all pages that are currently dirty without waiting for it.
+	// Must be called without holding locks.
+	void requestFlush();
+
+	// Like requestFlush() but waits until all pages that are currently dirty
+	// have entered writeback.
+	coroutine<void> flushDirty();
+
+	// Moves a present and clean page into TxState::dirty.
+	// Caller must hold mutex. Returns true if the writeback daemon needs to be woken up.
+	bool _enterDirty(ManagedPage *page);
+
+	// Moves the page to TxState::wantInitialization if it is missing and idle.
+	// Caller must hold mutex. Returns true if the page was moved.
+	bool _requestInitialization(ManagedPage *page);
+
+	// Updates the readahead window when the page at index is touched and requests
+	// the pages of the window. demand is true if the page itself was just requested.
+	// Caller must hold mutex. Returns true if any pages were requested.
+	bool _readahead(size_t index, bool demand);
+
+	// Transfers ownership of a physical page to this object. The page becomes the
+	// (dirty) content of the page at index; it is written back to userspace and can
+	// be reclaimed afterwards. Only succeeds if the page at index is missing and idle.
+	// Callers need to call requestFlush() (after dropping their locks) on success.
+	bool donatePage(size_t index, PhysicalAddr physical);
+
 	smarter::borrowed_ptr<ManagedSpace> selfPtr;
 
 	frg::ticket_spinlock mutex;
@@ -736,6 +872,30 @@ struct ManagedSpace : CacheBundle {
 
 	size_t numPages;
 	bool readahead;
+	// Upper bound on the number of pages that are fused into a single manage request.
+	size_t maxRequestPages;
+
+	// Readahead state. Protected by mutex.
+	// The most recent readahead window is [_raStart, _raStart + _raSize).
+	// Once a page at or after _raMarker in that window is touched,
+	// the next window is requested (without waiting for it).
+	size_t _raStart{0};
+	size_t _raSize{0};
+	size_t _raMarker{0};
+	size_t _raLastIndex{~size_t{0}};
+
+	// Writeback state. Protected by mutex.
+	// Number of pages in TxState::dirty, wantWriteback or writeback.
+	size_t numDirtyPages{0};
+	// Time at which the oldest page on _dirtyList was dirtied.
+	uint64_t _dirtiedSince{0};
+	// Number of flushes (i.e., promotions of all pages on _dirtyList to _writebackList)
+	// that were requested and that were completed by the draining coroutine.
+	uint64_t _flushSeq{0};
+	uint64_t _flushedSeq{0};
+
+	// List hook used by the writeback daemon.
+	frg::intrusive_rcu_list_hook<ManagedSpace> writebackHook;
 
 	EvictionQueue _evictQueue;
 
@@ -769,6 +929,7 @@ struct ManagedSpace : CacheBundle {
 	ManageList _managementQueue;
 
 	async::recurring_event _dirtyEvent;
+	async::recurring_event _flushedEvent;
 };
 
 struct BackingMemory final : MemoryView {
@@ -823,6 +984,7 @@ public:
 	PhysicalRange peekRange(uintptr_t offset, FetchFlags flags) override;
 	coroutine<frg::expected<Error, size_t>>
 			touchRange(uintptr_t offset, size_t sizeHint, FetchFlags flags) override;
+	smarter::shared_ptr<ManagedSpace> getManagedSpace() override;
 
 public:
 	// Contract: set by the code that constructs this object.
@@ -878,7 +1040,21 @@ private:
 enum class CowState {
 	null,
 	inProgress,
-	hasCopy
+	hasCopy,
+	// Page contents are stored in the swap area.
+	swapped
+};
+
+enum class SwapState : uint8_t {
+	// Page is not registered with the reclaimer.
+	none,
+	// Page is in the memory reclaimer's LRU queue.
+	// Valid in CowState::hasCopy with lockCount == 0 and useCount == 0.
+	inReclaimer,
+	// Page has been selected for swap-out and is awaiting fenceEphemeral().
+	performSwapOut,
+	// Page will not be swapped out but is still awaiting fenceEphemeral().
+	avertSwapOut,
 };
 
 struct CowPage {
@@ -887,6 +1063,19 @@ struct CowPage {
 	PhysicalAddr physical = -1;
 	CowState state = CowState::null;
 	unsigned int lockCount = 0;
+
+	// The following members are protected by the owner's mutex.
+	// Whether the page is owned by a CopyOnWriteMemory (and not by a CowChain)
+	// and can thus be swapped out.
+	bool swappable = false;
+	SwapState swapState{SwapState::none};
+	// Valid in CowState::swapped.
+	size_t swapSlot = 0;
+
+	// Set once when the page first becomes swappable.
+	CopyOnWriteMemory *owner = nullptr;
+	smarter::weak_ptr<CopyOnWriteMemory> weakOwner;
+	CachePage cachePage;
 };
 
 struct CowChain {
@@ -901,6 +1090,8 @@ struct CowChain {
 };
 
 struct CopyOnWriteMemory final : MemoryView /*, MemoryObserver */ {
+	friend struct AnonymousBundle;
+
 private:
 	struct CtorToken {};
 
@@ -919,6 +1110,7 @@ public:
 
 	size_t getLength() override;
 	coroutine<frg::expected<Error, smarter::shared_ptr<MemoryView>>> fork() override;
+	coroutine<frg::expected<Error>> exemptFromSwap() override;
 	Error lockRange(uintptr_t offset, size_t size) override;
 	void unlockRange(uintptr_t offset, size_t size) override;
 	PhysicalRange peekRange(uintptr_t offset, FetchFlags flags) override;
@@ -929,6 +1121,19 @@ public:
 	// Contract: set by the code that constructs this object.
 	smarter::borrowed_ptr<CopyOnWriteMemory> selfPtr;
 private:
+	// The following functions must be called with _mutex held.
+	// Moves a page to CowState::hasCopy and makes it swappable
+	// (if a swap area is attached and this object is not exempt from swapping).
+	void installPage_(CowPage *page, PhysicalAddr physical);
+	// Called before a page is moved to a CowChain.
+	void makeUnswappable_(CowPage *page);
+	// Registers the page with the reclaimer if it is swappable and unused.
+	void updateSwapState_(CowPage *page);
+
+	// Reads a page in CowState::inProgress back from the swap area.
+	// On failure, the page is moved back to CowState::swapped.
+	coroutine<frg::expected<Error>> swapIn_(CowPage *page);
+
 	frg::ticket_spinlock _mutex;
 
 	smarter::shared_ptr<MemoryView> _view;
@@ -936,6 +1141,8 @@ private:
 	size_t _length;
 	smarter::shared_ptr<CowChain> _copyChain;
 	frg::rcu_radixtree<smarter::shared_ptr<CowPage>, KernelAlloc, RcuPolicy> _ownedPages;
+	// Set by exemptFromSwap(). Protected by _mutex.
+	bool _noSwap = false;
 	async::recurring_event _copyEvent;
 	EvictionQueue _evictQueue;
 };
@@ -5,6 +5,7 @@
 #include <bragi/helpers-all.hpp>
 #include <bragi/helpers-frigg.hpp>
 #include <frg/span.hpp>
+#include <thor-internal/arch-generic/timer.hpp>
 #include <thor-internal/main.hpp>
 #include <thor-internal/ring-buffer.hpp>
 #include <ostrace.frigg_bragi.hpp>
@@ -22,8 +23,11 @@ namespace ostrace {
 // Set by the ostrace code one in-kernel ostrace is available.
 extern std::atomic<bool> available;
 
+struct Ring;
+
 struct Context {
-	frg::vector<char, KernelAlloc> buffer{*kernelAlloc};
+	// Records of this CPU are written to this ring (if ostrace is enabled).
+	Ring *ring{nullptr};
 };
 
 extern PerCpu<Context> context;
@@ -33,8 +37,11 @@ extern PerCpu<Context> context;
 // We only put it into the header for friends declarations.
 void setup();
 
-// Emit an in-kernel ostrace event.
-void emitBuffer(frg::span<char> payload);
+// Reserves space for a record of the given size in the current CPU's ring.
+// Must be called with IRQs disabled; the record becomes visible once commitReserved() is called.
+// Returns nullptr if the record cannot be stored (e.g., because it is too large).
+char *reserve(size_t size, uint64_t ts);
+void commitReserved();
 
 using ItemId = uint64_t;
 
@@ -83,8 +90,11 @@ void emit(const Event &event, Args... args) {
 	if (!available.load(std::memory_order_relaxed))
 		return;
 
+	auto now = getClockNanos();
+
 	managarm::ostrace::EventRecord<KernelAlloc> eventRecord{*kernelAlloc};
 	eventRecord.set_id(static_cast<uint64_t>(event.id()));
+	eventRecord.set_ts(now);
 
 	managarm::ostrace::EndOfRecord<KernelAlloc> endOfRecord{*kernelAlloc};
 
@@ -100,17 +110,18 @@ void emit(const Event &event, Args... args) {
 
 	{
 		auto irqLock = frg::guard(&irqMutex());
-		auto *ctx = &context.get();
 
-		ctx->buffer.resize(size);
+		// Serialize all records directly into the ring.
+		auto buffer = reserve(size, now);
+		if(!buffer)
+			return;
 
-		// Emit all records to the buffer.
 		size_t offset = 0;
 		auto emitMsg = [&] (auto &msg) {
 			auto ts = msg.size_of_tail();
 			bool encodeSuccess = bragi::write_head_tail(msg,
-					frg::span<char>(ctx->buffer.data() + offset, 8),
-					frg::span<char>(ctx->buffer.data() + offset + 8, ts));
+					frg::span<char>(buffer + offset, 8),
+					frg::span<char>(buffer + offset + 8, ts));
 			assert(encodeSuccess);
 			offset += 8 + ts;
 		};
@@ -118,7 +129,7 @@ void emit(const Event &event, Args... args) {
 		(emitMsg(args), ...);
 		emitMsg(endOfRecord);
 
-		emitBuffer({ctx->buffer.data(), size});
+		commitReserved();
 	}
 }
 
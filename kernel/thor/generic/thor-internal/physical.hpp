@@ -115,17 +115,81 @@ void poisonPhysicalAccess(PhysicalAddr physical);
 void poisonPhysicalWriteAccess(PhysicalAddr physical);
 
 
+// Per-CPU cache ("magazine") of order-0 pages in front of the buddy allocator.
+// Pages are moved between the cache and the buddy allocator in batches,
+// such that the allocator lock is only taken once per batch.
+// The pages[] array is protected by mutex; it is only contended while
+// the caches are drained (see PhysicalChunkAllocator::drainPageCaches()).
+// The counters can be read from any CPU.
+struct PhysicalPageCache {
+	static constexpr size_t capacity = 64;
+	static constexpr size_t batchSize = 32;
+
+	// Taken before PhysicalChunkAllocator::_mutex.
+	frg::ticket_spinlock mutex;
+	std::atomic<size_t> numPages{0};
+	PhysicalAddr pages[capacity];
+
+	std::atomic<uint64_t> numHits{0};
+	std::atomic<uint64_t> numMisses{0};
+	std::atomic<uint64_t> numRefills{0};
+	std::atomic<uint64_t> numDrains{0};
+};
+
+struct PhysicalPageCacheStats {
+	size_t cachedPages = 0;
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t refills = 0;
+	uint64_t drains = 0;
+};
+
+// Statistics of the memory of a single NUMA node.
+struct PhysicalNodeStats {
+	uint32_t node = 0;
+	size_t totalPages = 0;
+	// Pages that are free in the buddy allocators of this node.
+	// This does not include pages in per-CPU caches.
+	size_t freePages = 0;
+};
+
 class PhysicalChunkAllocator {
 	typedef frg::ticket_spinlock Mutex;
 public:
 	PhysicalChunkAllocator();
 	
 	void bootstrapRegion(PhysicalAddr address,
-			int order, size_t numRoots, int8_t *buddyTree);
+			int order, size_t numRoots, int8_t *buddyTree, uint32_t numaNode = 0);
 
+	// Allocations prefer memory on the NUMA node of the current CPU
+	// and fall back to other nodes if the local node is exhausted.
 	PhysicalAddr allocate(size_t size, int addressBits = 64);
 	void free(PhysicalAddr address, size_t size);
 
+	// Enables the per-CPU page caches. Must be called after the per-CPU
+	// data of all CPUs has been initialized.
+	void enablePageCaches() {
+		_pageCachesEnabled.store(true, std::memory_order_release);
+	}
+
+	PhysicalPageCacheStats pageCacheStats();
+
+	// Returns the pages of all per-CPU caches to the buddy allocator.
+	// This is done when an allocation fails and by the reclaimer under memory pressure.
+	void drainPageCaches();
+
+	// Number of NUMA nodes that have memory.
+	size_t numNodes() {
+		return _numNodes;
+	}
+
+	// Precondition: index < numNodes().
+	PhysicalNodeStats nodeStats(size_t index);
+
+	// Returns true if the address belongs to RAM that is managed by this allocator.
+	// Lock-free since regions are constant after bootstrap; safe to call from NMI context.
+	bool isManaged(PhysicalAddr address);
+
 	size_t numTotalPages() {
 		return _totalPages.load(std::memory_order_relaxed);
 	}
@@ -137,20 +201,45 @@ public:
 	}
 
 private:
+	// Both functions expect _mutex to be held.
+	PhysicalAddr _allocateLocked(int target, int addressBits, uint32_t preferredNode);
+	void _freeLocked(PhysicalAddr address, int target);
+
+	// Returns the NUMA node whose memory should be preferred on the current CPU.
+	uint32_t _localNode();
+	// Returns the NUMA node of a physical address.
+	uint32_t _nodeOf(PhysicalAddr address);
+
+	// Both functions expect the cache's mutex to be held (but not _mutex).
+	void _refillPageCache(PhysicalPageCache &cache);
+	void _drainPageCache(PhysicalPageCache &cache, size_t numPages);
+
+	void _accountAllocation(size_t numPages);
+	void _accountFree(size_t numPages);
+
 	Mutex _mutex;
 
 	struct Region {
 		PhysicalAddr physicalBase;
 		PhysicalAddr regionSize;
 		BuddyAccessor buddyAccessor;
+		uint32_t numaNode;
+		// Protected by _mutex.
+		size_t numFreePages;
 	};
 
 	Region _allRegions[eirMaxMemoryRegions];
 	int _numRegions = 0;
 
+	// IDs of all NUMA nodes that have memory. Constant after bootstrap.
+	uint32_t _nodes[eirMaxMemoryRegions];
+	size_t _numNodes = 0;
+
 	std::atomic<size_t> _totalPages{0};
 	std::atomic<size_t> _usedPages{0};
 	std::atomic<size_t> _freePages{0};
+
+	std::atomic<bool> _pageCachesEnabled{false};
 };
 
 extern constinit frg::manual_box<PhysicalChunkAllocator> physicalAllocator;
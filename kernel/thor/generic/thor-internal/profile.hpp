@@ -6,6 +6,9 @@ namespace thor {
 
 extern bool wantKernelProfile;
 
+// Upper bound on the number of words in a profiling sample.
+inline constexpr size_t maxProfileSampleWords = 36;
+
 void initializeProfile();
 LogRingBuffer *getGlobalProfileRing();
 
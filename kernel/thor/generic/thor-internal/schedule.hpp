@@ -3,6 +3,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <atomic>
 #include <frg/list.hpp>
 #include <frg/pairing_heap.hpp>
 #include <frg/spinlock.hpp>
@@ -189,6 +190,18 @@ public:
 
 	ScheduleEntity *currentRunnable();
 
+	// Returns true if this scheduler runs its idle task and no entity was resumed since.
+	// May be called from any CPU; the result is only a hint and may be stale.
+	bool isIdle() {
+		return _idle.load(std::memory_order_relaxed);
+	}
+
+	// Number of entities that wait for this CPU (excluding the current one).
+	// Must only be called on the scheduler's own CPU.
+	size_t numWaiting() {
+		return _numWaiting;
+	}
+
 private:
 	void _unschedule();
 	void _schedule();
@@ -221,6 +234,9 @@ private:
 	// See mustCallPreemption().
 	bool _mustCallPreemption{false};
 
+	// See isIdle().
+	std::atomic<bool> _idle{false};
+
 	// The last tick at which the scheduler's state (i.e. progress) was updated.
 	// In our model this is the time point at which slice T started.
 	uint64_t _refClock = 0;
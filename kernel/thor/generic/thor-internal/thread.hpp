@@ -290,6 +290,13 @@ public:
 	static void migrateOther(smarter::borrowed_ptr<Thread> thread);
 	static Error resumeOther(smarter::borrowed_ptr<Thread> thread);
 
+	// Marks the current thread as being about to block. While this is set,
+	// threads that are unblocked by this thread may be placed on this thread's CPU.
+	// Must only be called by the thread itself.
+	void setSyncWakeups(bool sync) {
+		syncWakeups_ = sync;
+	}
+
 	enum Flags : uint32_t {
 		kFlagServer = 1
 	};
@@ -468,7 +475,10 @@ private:
 
 	RunState _runState;
 	// For kRunActive: CPU that we are running on.
+	// For kRunBlocked: CPU that we ran on before blocking.
 	CpuData *activeCpu_{nullptr};
+	// See setSyncWakeups(). Only accessed by the thread itself.
+	bool syncWakeups_{false};
 	// Conditions that unblock the thread while in kRunBlocked.
 	Condition unblockConditions_{0};
 
@@ -6,11 +6,13 @@
 #include <type_traits>
 #include <utility>
 #include <frg/optional.hpp>
+#include <frg/rcu_radixtree.hpp>
 #include <assert.h>
 #include <smarter.hpp>
 #include <thor-internal/error.hpp>
 #include <thor-internal/ipl.hpp>
 #include <thor-internal/mm-rc.hpp>
+#include <thor-internal/rcu.hpp>
 #include <thor-internal/virtualization.hpp>
 
 namespace thor {
@@ -406,6 +408,15 @@ struct Universe {
 private:
 	struct CtorToken {};
 
+	// Descriptors are allocated individually and retired through RCU.
+	// This allows lookups to read them without taking the lock, see detachDescriptor().
+	struct DescriptorSlot : RcuCallable {
+		DescriptorSlot(AnyDescriptor descriptor)
+		: descriptor{std::move(descriptor)} { }
+
+		AnyDescriptor descriptor;
+	};
+
 public:
 	typedef frg::ticket_spinlock Lock;
 	typedef frg::unique_lock<frg::ticket_spinlock> Guard;
@@ -419,6 +430,9 @@ public:
 
 	std::optional<AnyDescriptor> getDescriptor(Handle handle);
 
+	// Calls fn on the descriptor associated with the handle.
+	// Lock-free but protected by RCU: fn runs with scheduling disabled
+	// and must not modify the descriptor (it can copy it or resolve its object).
 	template<typename Fn>
 	requires requires(Fn fn, AnyDescriptor &desc) {
 		{ fn(desc) };
@@ -427,13 +441,18 @@ public:
 			-> std::invoke_result_t<Fn, AnyDescriptor &> {
 		using ResultType = std::invoke_result_t<Fn, AnyDescriptor &>;
 
-		auto irqLock = frg::guard(&irqMutex());
-		Guard guard(lock);
+		if(handle < 1)
+			return ResultType{std::unexpect, Error::noDescriptor};
+
+		IplGuard<ipl::noSchedule> guard;
 
-		auto *desc = _descriptorMap.get(handle);
-		if(!desc)
+		auto it = _descriptorTree.find(static_cast<uint64_t>(handle));
+		if(!it)
+			return ResultType{std::unexpect, Error::noDescriptor};
+		auto slot = it->load(std::memory_order_acquire);
+		if(!slot)
 			return ResultType{std::unexpect, Error::noDescriptor};
-		return std::forward<Fn>(fn)(*desc);
+		return std::forward<Fn>(fn)(slot->descriptor);
 	}
 
 	// Convenience wrapper for getDescriptor() -> resolveObject().
@@ -455,15 +474,12 @@ public:
 
 	frg::optional<AnyDescriptor> detachDescriptor(Handle handle);
 
+	// Protects modifications of the descriptor table (i.e., attach and detach).
 	Lock lock;
 
 private:
-	frg::hash_map<
-		Handle,
-		AnyDescriptor,
-		frg::hash<Handle>,
-		KernelAlloc
-	> _descriptorMap;
+	// Handles are allocated sequentially, hence a radix tree keeps the table dense.
+	frg::rcu_radixtree<std::atomic<DescriptorSlot *>, KernelAlloc, RcuPolicy> _descriptorTree;
 
 	Handle _nextHandle;
 };
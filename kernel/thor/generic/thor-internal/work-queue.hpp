@@ -12,18 +12,44 @@
 
 namespace thor {
 
+struct CpuData;
+struct StealNode;
 struct WorkQueue;
 
 struct Worklet {
 	friend struct WorkQueue;
 
-	void setup(void (*run)(Worklet *));
+	// Migratable worklets may be stolen by idle CPUs if they are posted to the general WQ
+	// of a CPU that does not get around to run them. Hence, they must not depend on
+	// the CPU or the executor context that they run on.
+	// Note that currently, only DeferredWork and the completions of kernel heap and
+	// kernel stack frees are migratable; all other worklets stay on their CPU.
+	void setup(void (*run)(Worklet *), bool migratable = false);
 
 private:
 	void (*_run)(Worklet *);
+	bool _migratable{false};
+	// Value of the monotonic clock at post() time (zero if the clock is not available yet).
+	uint64_t _postedAt{0};
 	frg::default_list_hook<Worklet> _hook;
 };
 
+struct WorkQueueStatistics {
+	uint64_t numExecuted;
+	// Number of migratable worklets that were taken from other CPUs' WQs.
+	uint64_t numStolen;
+	// Number of worklets that are currently queued.
+	uint64_t depth;
+	uint64_t maxDepth;
+	// Number of executed worklets for which latency was measured.
+	uint64_t numTimed;
+	// Time between post() and execution of worklets (in ns).
+	uint64_t totalLatency;
+	uint64_t maxLatency;
+	// Longest execution time of a single worklet (in ns).
+	uint64_t maxRunTime;
+};
+
 struct WorkQueue {
 	static smarter::borrowed_ptr<WorkQueue> generalQueue();
 
@@ -47,6 +73,15 @@ struct WorkQueue {
 
 	void run();
 
+	// Called by the idle task. If the general WQ of another CPU has migratable worklets
+	// that have been waiting for too long, a worklet that steals them is posted to the
+	// general WQ of the given CPU. If the worklets are not stealable yet, a timer is armed
+	// that posts the stealing worklet once they are. Precondition: IRQs are disabled.
+	static void notifyIdle(CpuData *cpu);
+
+	// Sums up the statistics of the general WQs of all CPUs.
+	static WorkQueueStatistics generalStatistics();
+
 	// ----------------------------------------------------------------------------------
 	// schedule() and its boilerplate.
 	// ----------------------------------------------------------------------------------
@@ -142,6 +177,31 @@ protected:
 	~WorkQueue() = default;
 
 private:
+	static void _stealFromBusyCpus(CpuData *cpu);
+
+	static void _setupSteal(StealNode *node);
+
+	// Called when a migratable worklet is posted while the oldest queued one is already
+	// stealable. Wakes up an idle CPU (unless one is already waiting for migratable worklets)
+	// such that it steals them.
+	static void _kickIdleCpu();
+
+	// Returns true if the oldest migratable worklet has been waiting for too long.
+	bool _isStealable(uint64_t now);
+
+	Worklet *_popMigratable();
+
+	// Updates the migratable state after worklets were removed. Caller must hold _mutex.
+	void _removedMigratable(size_t n);
+
+	// Takes up to half of the queued migratable worklets (but at least one).
+	// Called from another CPU; the stolen worklets are dispatched on that CPU's WQ.
+	size_t _stealInto(Worklet **worklets, size_t max);
+
+	void _dispatch(Worklet *worklet);
+
+	void _collectStatistics(WorkQueueStatistics &stats);
+
 	using Queue = frg::intrusive_list<
 		Worklet,
 		frg::locate_member<
@@ -187,17 +247,41 @@ private:
 			&Worklet::_hook
 		>
 	> _lockedQueue;
+
+	// Protected by _mutex. Migratable worklets are always queued here,
+	// even if they are posted from the WQ's own executor context.
+	// _migratablePosted follows the same rules as _lockedPosted.
+	std::atomic<bool> _migratablePosted{false};
+	// _postedAt of the oldest queued migratable worklet (zero if there is none).
+	std::atomic<uint64_t> _migratableSince{0};
+
+	Queue _migratableQueue;
+
+	size_t _numMigratable{0};
+
+	// Statistics. They are read (and _depth, _maxDepth and _numStolen are written)
+	// from other CPUs, hence they are atomics.
+	std::atomic<uint64_t> _depth{0};
+	std::atomic<uint64_t> _maxDepth{0};
+	std::atomic<uint64_t> _numExecuted{0};
+	std::atomic<uint64_t> _numStolen{0};
+	std::atomic<uint64_t> _numTimed{0};
+	std::atomic<uint64_t> _totalLatency{0};
+	std::atomic<uint64_t> _maxLatency{0};
+	std::atomic<uint64_t> _maxRunTime{0};
 };
 
-inline void Worklet::setup(void (*run)(Worklet *)) {
+inline void Worklet::setup(void (*run)(Worklet *), bool migratable) {
 	_run = run;
+	_migratable = migratable;
 }
 
 template<typename P>
 requires requires(P policy) {
 	// setUp() is called inline when the work is scheduled; for example, it can increase
 	// a reference count to ensure that the state that execute() operates on is kept alive.
-	// execute() is called from the WQ.
+	// execute() is called from a general WQ; since DeferredWork is migratable,
+	// this is not necessarily the WQ of the CPU that called invoke().
 	{ policy.setUp() };
 	{ policy.execute() };
 }
@@ -219,7 +303,7 @@ struct DeferredWork {
 			assert(self->posted_.load(std::memory_order_relaxed));
 			self->posted_.store(false, std::memory_order_release);
 			self->policy_.execute();
-		});
+		}, true);
 		WorkQueue::generalQueue()->post(&worklet_);
 		return true;
 	}
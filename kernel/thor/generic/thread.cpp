@@ -490,18 +490,44 @@ void Thread::unblockOther(smarter::borrowed_ptr<Thread> thread) {
 		return;
 
 	auto irqLock = frg::guard(&irqMutex());
-	auto lock = frg::guard(&thread->_mutex);
+	CpuData *wakeCpu = nullptr;
+	{
+		auto lock = frg::guard(&thread->_mutex);
 
-	if (thread->_runState != kRunBlocked)
-		return;
-	
-	if(logRunStates)
-		infoLogger() << "thor: " << (void *)thread.get()
-				<< " is deferred (via unblock)" << frg::endlog;
+		if (thread->_runState != kRunBlocked)
+			return;
+
+		if(logRunStates)
+			infoLogger() << "thor: " << (void *)thread.get()
+					<< " is deferred (via unblock)" << frg::endlog;
+
+		thread->_updateRunTime();
+		thread->_runState = kRunDeferred;
+
+		// If the thread's previous CPU is busy, move it to an idle CPU close to the waker.
+		// Scheduler::resume() sends the IPI that makes the CPU pick up the thread.
+		auto prevCpu = thread->activeCpu_;
+		if(thread->_lbCb && prevCpu) {
+			auto waker = getCpuData()->activeThread;
+			bool sync = waker && waker->syncWakeups_;
+			auto cpu = LoadBalancer::singleton().selectWakeCpu(thread->_lbCb, prevCpu, sync);
+			if(cpu != prevCpu) {
+				if(logMigration)
+					infoLogger() << "thor: " << (void *)thread.get()
+							<< " is woken up on CPU " << cpu->cpuIndex << frg::endlog;
+				Scheduler::unassociate(thread.get());
+				Scheduler::associate(thread.get(), &localScheduler.get(cpu));
+				wakeCpu = cpu;
+			}
+		}
+		Scheduler::resume(thread.get());
+	}
 
-	thread->_updateRunTime();
-	thread->_runState = kRunDeferred;
-	Scheduler::resume(thread.get());
+	// Assign the thread to the CPU that it was woken up on, such that the load balancer
+	// accounts for it there and a later cpuMigration condition does not move it back.
+	// This needs to happen without the thread's mutex (see LoadBalancer::reassign()).
+	if(wakeCpu)
+		LoadBalancer::singleton().reassign(thread->_lbCb, wakeCpu);
 }
 
 void Thread::killOther(smarter::borrowed_ptr<Thread>) {
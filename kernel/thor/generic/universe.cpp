@@ -99,39 +99,73 @@ std::expected<smarter::shared_ptr<Universe>, Error> Universe::create() {
 }
 
 Universe::Universe(CtorToken)
-: _descriptorMap{frg::hash<Handle>{}, *kernelAlloc}, _nextHandle{1} { }
+: _descriptorTree{*kernelAlloc}, _nextHandle{1} { }
 
 Universe::~Universe() {
 	if(logCleanup)
 		debugLogger() << "thor: Universe is deallocated" << frg::endlog;
+
+	// No lookups can be in flight anymore, hence we can free the slots directly.
+	for(Handle handle = 1; handle < _nextHandle; ++handle) {
+		auto it = _descriptorTree.find(static_cast<uint64_t>(handle));
+		if(!it)
+			continue;
+		auto slot = it->load(std::memory_order_relaxed);
+		if(slot)
+			frg::destruct(*kernelAlloc, slot);
+	}
 }
 
 Handle Universe::attachDescriptor(AnyDescriptor descriptor) {
 	assert(descriptor.type() != DescriptorType::none);
 
+	auto slot = frg::construct<DescriptorSlot>(*kernelAlloc, std::move(descriptor));
+
 	auto irqLock = frg::guard(&irqMutex());
 	Guard guard(lock);
 
 	Handle handle = _nextHandle++;
-	_descriptorMap.insert(handle, std::move(descriptor));
+	auto it = _descriptorTree.insert(static_cast<uint64_t>(handle));
+	it->store(slot, std::memory_order_release);
 	return handle;
 }
 
 std::optional<AnyDescriptor> Universe::getDescriptor(Handle handle) {
-	auto irqLock = frg::guard(&irqMutex());
-	Guard guard(lock);
-
-	auto *desc = _descriptorMap.get(handle);
-	if(!desc)
+	auto outcome = inspectDescriptor(handle,
+			[](AnyDescriptor &desc) -> std::expected<AnyDescriptor, Error> {
+		return desc;
+	});
+	if(!outcome)
 		return std::nullopt;
-	return *desc;
+	return std::move(*outcome);
 }
 
 frg::optional<AnyDescriptor> Universe::detachDescriptor(Handle handle) {
-	auto irqLock = frg::guard(&irqMutex());
-	Guard guard(lock);
+	if(handle < 1)
+		return frg::null_opt;
+
+	DescriptorSlot *slot;
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		Guard guard(lock);
+
+		auto it = _descriptorTree.find(static_cast<uint64_t>(handle));
+		if(!it)
+			return frg::null_opt;
+		slot = it->exchange(nullptr, std::memory_order_relaxed);
+		if(!slot)
+			return frg::null_opt;
+		_descriptorTree.erase(static_cast<uint64_t>(handle));
+	}
 
-	return _descriptorMap.remove(handle);
+	// Concurrent lookups may still be copying the descriptor or incrementing its refcount.
+	// Hence, we return a copy and only drop the slot's reference after a grace period.
+	frg::optional<AnyDescriptor> result{slot->descriptor};
+	submitRcu(slot, [] (RcuCallable *base) {
+		auto slot = static_cast<DescriptorSlot *>(base);
+		frg::destruct(*kernelAlloc, slot);
+	});
+	return result;
 }
 
 } // namespace thor
@@ -1,8 +1,71 @@
+#include <frg/manual_box.hpp>
+#include <thor-internal/arch-generic/ints.hpp>
+#include <thor-internal/arch-generic/timer.hpp>
 #include <thor-internal/cpu-data.hpp>
+#include <thor-internal/debug.hpp>
+#include <thor-internal/main.hpp>
+#include <thor-internal/schedule.hpp>
+#include <thor-internal/timer.hpp>
 #include <thor-internal/work-queue.hpp>
 
 namespace thor {
 
+namespace {
+
+constexpr bool debugStealing = false;
+
+// Migratable worklets that wait for longer than this (in ns) are stolen by idle CPUs.
+constexpr uint64_t stealLatency = 200'000;
+
+// Maximal number of worklets that are stolen from a single WQ at a time.
+constexpr size_t maxStealBatch = 16;
+
+// Set once the monotonic clock is available.
+std::atomic<bool> haveClock{false};
+
+initgraph::Task enableWqClockTask{&globalInitEngine, "generic.enable-wq-clock",
+	initgraph::Requires{getTaskingAvailableStage()},
+	[] {
+		haveClock.store(true, std::memory_order_relaxed);
+	}
+};
+
+uint64_t wqTimestamp() {
+	// CPUs set up their timers before they set cpuInitialized.
+	if(!haveClock.load(std::memory_order_relaxed)
+			|| !getCpuData()->cpuInitialized.load(std::memory_order_relaxed))
+		return 0;
+	return getClockNanos();
+}
+
+// Statistics that are only written by the WQ's own CPU do not need an atomic RMW.
+void countStat(std::atomic<uint64_t> &counter, uint64_t n = 1) {
+	counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+void updateMax(std::atomic<uint64_t> &max, uint64_t value) {
+	auto current = max.load(std::memory_order_relaxed);
+	while(value > current
+			&& !max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+		;
+}
+
+} // namespace anonymous
+
+// Used by idle CPUs to steal worklets from other CPUs.
+struct StealNode {
+	Worklet worklet;
+	// Set while the worklet is posted or while a timer that posts it is armed.
+	// Other CPUs also set this flag when they kick an idle CPU, see _kickIdleCpu().
+	std::atomic<bool> pending{false};
+	// Only accessed on the owning CPU.
+	frg::manual_box<PrecisionTimerNode> timer;
+	bool timerArmed{false};
+};
+
+extern PerCpu<StealNode> stealNode;
+THOR_DEFINE_PERCPU(stealNode);
+
 smarter::borrowed_ptr<WorkQueue> WorkQueue::generalQueue() {
 	auto cpuData = getCpuData();
 	assert(cpuData->generalWorkQueue);
@@ -10,8 +73,27 @@ smarter::borrowed_ptr<WorkQueue> WorkQueue::generalQueue() {
 }
 
 void WorkQueue::post(Worklet *worklet) {
+	worklet->_postedAt = wqTimestamp();
+	updateMax(_maxDepth, _depth.fetch_add(1, std::memory_order_relaxed) + 1);
+
 	bool invokeWakeup;
-	if(_executorContext == currentExecutorContext()) {
+	bool kickIdle = false;
+	if(worklet->_migratable) {
+		// Always take the lock such that other CPUs can steal the worklet.
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&_mutex);
+
+		invokeWakeup = _migratableQueue.empty();
+		if(invokeWakeup) {
+			_migratableSince.store(worklet->_postedAt, std::memory_order_relaxed);
+		}else if(worklet->_postedAt && _isStealable(worklet->_postedAt)) {
+			// The WQ did not get around to run its oldest worklet in time.
+			kickIdle = true;
+		}
+		_migratableQueue.push_back(worklet);
+		_numMigratable++;
+		_migratablePosted.store(true, std::memory_order_relaxed);
+	}else if(_executorContext == currentExecutorContext()) {
 		// If we are not in interrupt context,
 		// we can push directly to the pending queue without running into races.
 		if (contextIpl() < ipl::interrupt) [[likely]] {
@@ -49,6 +131,8 @@ void WorkQueue::post(Worklet *worklet) {
 
 	if(invokeWakeup)
 		wakeup();
+	if(kickIdle)
+		_kickIdleCpu();
 }
 
 // immediatelyDispatchable() only returns true if we are already in run();
@@ -65,10 +149,11 @@ bool WorkQueue::immediatelyDispatchable() {
 
 bool WorkQueue::check() {
 	// _localPosted is only accessed from the thread/fiber that runs the WQ.
-	// For _lockedPosted, see the comment in the header file.
+	// For _lockedPosted and _migratablePosted, see the comment in the header file.
 	return !_pending.empty()
 			|| _localPosted.load(std::memory_order_relaxed)
-			|| _lockedPosted.load(std::memory_order_relaxed);
+			|| _lockedPosted.load(std::memory_order_relaxed)
+			|| _migratablePosted.load(std::memory_order_relaxed);
 }
 
 void WorkQueue::run() {
@@ -98,9 +183,19 @@ void WorkQueue::run() {
 	// Keep following accesses after the _inRun store.
 	std::atomic_signal_fence(std::memory_order_seq_cst);
 
-	while(!_pending.empty()) {
-		auto worklet = _pending.pop_front();
-		worklet->_run(worklet);
+	while(true) {
+		Worklet *worklet;
+		if(!_pending.empty()) {
+			worklet = _pending.pop_front();
+		}else{
+			// Migratable worklets are taken one at a time, such that idle CPUs
+			// can steal the remaining ones while we are busy.
+			worklet = _popMigratable();
+			if(!worklet)
+				break;
+		}
+		_depth.fetch_sub(1, std::memory_order_relaxed);
+		_dispatch(worklet);
 	}
 
 	// Keep preceeding accesses before the _inRun store.
@@ -110,4 +205,201 @@ void WorkQueue::run() {
 	iplLower(_wqIpl, previousIpl);
 }
 
+void WorkQueue::notifyIdle(CpuData *cpu) {
+	assert(!intsAreEnabled());
+
+	auto *node = &stealNode.get(cpu);
+	if(node->pending.load(std::memory_order_relaxed)
+			|| !cpu->cpuInitialized.load(std::memory_order_relaxed))
+		return;
+
+	auto now = wqTimestamp();
+	if(!now)
+		return;
+
+	// Find the oldest migratable worklet that is queued on another CPU.
+	uint64_t oldest = 0;
+	for(size_t i = 0; i < getCpuCount(); ++i) {
+		auto *other = getCpuData(i);
+		if(other == cpu || !other->cpuInitialized.load(std::memory_order_acquire))
+			continue;
+		auto since = other->generalWorkQueue->_migratableSince.load(std::memory_order_relaxed);
+		if(since && (!oldest || since < oldest))
+			oldest = since;
+	}
+	if(!oldest)
+		return;
+
+	if(node->pending.exchange(true, std::memory_order_acquire))
+		return;
+	_setupSteal(node);
+
+	if(oldest + stealLatency <= now) {
+		cpu->generalWorkQueue->post(&node->worklet);
+		// The idle task halts after this function returns. Ping ourselves such that
+		// the scheduler switches to the work queue's fiber immediately.
+		sendPingIpi(cpu);
+	}else{
+		// Check again once the worklet becomes stealable. If it is still queued by then,
+		// we steal it; otherwise, we re-arm the timer when we become idle again.
+		node->timer.initialize();
+		node->timer->setup(oldest + stealLatency, cpu->generalWorkQueue.get(), &node->worklet);
+		node->timerArmed = true;
+		generalTimerEngine()->installTimer(node->timer.get());
+	}
+}
+
+void WorkQueue::_setupSteal(StealNode *node) {
+	node->worklet.setup([] (Worklet *base) {
+		auto *node = frg::container_of(base, &StealNode::worklet);
+		if(node->timerArmed) {
+			node->timer.destruct();
+			node->timerArmed = false;
+		}
+		node->pending.store(false, std::memory_order_release);
+		_stealFromBusyCpus(getCpuData());
+	});
+}
+
+void WorkQueue::_kickIdleCpu() {
+	// Idle CPUs only look for migratable worklets when they become idle (and when their
+	// timers fire). If one of them is already waiting for worklets to become stealable,
+	// it will handle our worklets, too. Otherwise, wake up an idle CPU to steal them.
+	CpuData *target = nullptr;
+	auto *self = getCpuData();
+	for(size_t i = 0; i < getCpuCount(); ++i) {
+		auto *other = getCpuData(i);
+		if(other == self || !other->cpuInitialized.load(std::memory_order_acquire))
+			continue;
+		if(!localScheduler.get(other).isIdle())
+			continue;
+		if(stealNode.get(other).pending.load(std::memory_order_relaxed))
+			return;
+		if(!target)
+			target = other;
+	}
+	if(!target)
+		return;
+
+	auto *node = &stealNode.get(target);
+	if(node->pending.exchange(true, std::memory_order_acquire))
+		return;
+	_setupSteal(node);
+	target->generalWorkQueue->post(&node->worklet);
+}
+
+void WorkQueue::_stealFromBusyCpus(CpuData *cpu) {
+	auto *self = cpu->generalWorkQueue.get();
+	assert(self->_inRun.load(std::memory_order_relaxed));
+
+	for(size_t i = 0; i < getCpuCount(); ++i) {
+		auto *other = getCpuData(i);
+		if(other == cpu || !other->cpuInitialized.load(std::memory_order_acquire))
+			continue;
+		auto *victim = other->generalWorkQueue.get();
+		if(!victim->_isStealable(wqTimestamp()))
+			continue;
+
+		Worklet *worklets[maxStealBatch];
+		auto n = victim->_stealInto(worklets, maxStealBatch);
+		if(debugStealing)
+			infoLogger() << "thor: CPU #" << cpu->cpuIndex << " steals " << n
+					<< " worklets from CPU #" << other->cpuIndex << frg::endlog;
+
+		// We are already running the WQ of this CPU (on behalf of our own worklet).
+		for(size_t j = 0; j < n; ++j)
+			self->_dispatch(worklets[j]);
+	}
+}
+
+bool WorkQueue::_isStealable(uint64_t now) {
+	auto since = _migratableSince.load(std::memory_order_relaxed);
+	return since && since + stealLatency <= now;
+}
+
+Worklet *WorkQueue::_popMigratable() {
+	if(!_migratablePosted.load(std::memory_order_relaxed))
+		return nullptr;
+
+	auto irqLock = frg::guard(&irqMutex());
+	auto lock = frg::guard(&_mutex);
+
+	// Another CPU might have stolen the worklets in the meantime.
+	if(_migratableQueue.empty())
+		return nullptr;
+	auto worklet = _migratableQueue.pop_front();
+	_removedMigratable(1);
+	return worklet;
+}
+
+void WorkQueue::_removedMigratable(size_t n) {
+	_numMigratable -= n;
+	if(_migratableQueue.empty()) {
+		_migratablePosted.store(false, std::memory_order_relaxed);
+		_migratableSince.store(0, std::memory_order_relaxed);
+	}else{
+		_migratableSince.store(_migratableQueue.front()->_postedAt, std::memory_order_relaxed);
+	}
+}
+
+size_t WorkQueue::_stealInto(Worklet **worklets, size_t max) {
+	auto irqLock = frg::guard(&irqMutex());
+	auto lock = frg::guard(&_mutex);
+
+	// Leave half of the worklets to this WQ; it might become available again soon.
+	auto n = frg::min((_numMigratable + 1) / 2, max);
+	for(size_t i = 0; i < n; ++i)
+		worklets[i] = _migratableQueue.pop_front();
+	if(n)
+		_removedMigratable(n);
+
+	_depth.fetch_sub(n, std::memory_order_relaxed);
+	// Only written under _mutex.
+	countStat(_numStolen, n);
+	return n;
+}
+
+void WorkQueue::_dispatch(Worklet *worklet) {
+	auto start = wqTimestamp();
+	if(start && worklet->_postedAt && worklet->_postedAt <= start) {
+		auto latency = start - worklet->_postedAt;
+		countStat(_numTimed);
+		countStat(_totalLatency, latency);
+		if(latency > _maxLatency.load(std::memory_order_relaxed))
+			_maxLatency.store(latency, std::memory_order_relaxed);
+	}
+
+	// Note that the worklet may be destructed by _run().
+	worklet->_run(worklet);
+	countStat(_numExecuted);
+
+	if(start) {
+		auto runTime = wqTimestamp() - start;
+		if(runTime > _maxRunTime.load(std::memory_order_relaxed))
+			_maxRunTime.store(runTime, std::memory_order_relaxed);
+	}
+}
+
+void WorkQueue::_collectStatistics(WorkQueueStatistics &stats) {
+	stats.numExecuted += _numExecuted.load(std::memory_order_relaxed);
+	stats.numStolen += _numStolen.load(std::memory_order_relaxed);
+	stats.depth += _depth.load(std::memory_order_relaxed);
+	stats.maxDepth = frg::max(stats.maxDepth, _maxDepth.load(std::memory_order_relaxed));
+	stats.numTimed += _numTimed.load(std::memory_order_relaxed);
+	stats.totalLatency += _totalLatency.load(std::memory_order_relaxed);
+	stats.maxLatency = frg::max(stats.maxLatency, _maxLatency.load(std::memory_order_relaxed));
+	stats.maxRunTime = frg::max(stats.maxRunTime, _maxRunTime.load(std::memory_order_relaxed));
+}
+
+WorkQueueStatistics WorkQueue::generalStatistics() {
+	WorkQueueStatistics stats{};
+	for(size_t i = 0; i < getCpuCount(); i++) {
+		auto *cpu = getCpuData(i);
+		if(!cpu->cpuInitialized.load(std::memory_order_acquire))
+			continue;
+		cpu->generalWorkQueue->_collectStatistics(stats);
+	}
+	return stats;
+}
+
 } // namespace thor
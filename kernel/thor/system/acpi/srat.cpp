@@ -0,0 +1,119 @@
+#include <string.h>
+
+#include <frg/optional.hpp>
+#include <frg/scope_exit.hpp>
+#include <thor-internal/acpi/acpi.hpp>
+#include <thor-internal/debug.hpp>
+
+#include <uacpi/acpi.h>
+#include <uacpi/tables.h>
+
+namespace thor::acpi {
+
+namespace {
+
+constexpr bool logSrat = false;
+
+// Like the MADT structs, SRAT structs are marked as [[gnu::packed]]
+// since firmware does not necessarily align them.
+
+struct [[gnu::packed]] SratHeader {
+	uint32_t reserved0;
+	uint64_t reserved1;
+};
+
+struct [[gnu::packed]] SratGenericEntry {
+	uint8_t type;
+	uint8_t length;
+};
+
+struct [[gnu::packed]] SratLocalApicEntry {
+	SratGenericEntry generic;
+	uint8_t proximityDomainLow;
+	uint8_t localApicId;
+	uint32_t flags;
+	uint8_t localSapicEid;
+	uint8_t proximityDomainHigh[3];
+	uint32_t clockDomain;
+};
+
+struct [[gnu::packed]] SratLocalX2ApicEntry {
+	SratGenericEntry generic;
+	uint16_t reserved0;
+	uint32_t proximityDomain;
+	uint32_t localX2ApicId;
+	uint32_t flags;
+	uint32_t clockDomain;
+	uint32_t reserved1;
+};
+
+namespace srat_types {
+static constexpr uint8_t localApic = 0;
+static constexpr uint8_t localX2Apic = 2;
+} // namespace srat_types
+
+namespace srat_flags {
+static constexpr uint32_t enabled = 1;
+} // namespace srat_flags
+
+// Calls fn(type, entry) for each SRAT entry. Returns false if there is no SRAT.
+template<typename Fn>
+bool walkSrat(Fn fn) {
+	if (!acpiRsdpNote->rsdp)
+		return false;
+
+	uacpi_table sratTbl;
+	if (uacpi_table_find_by_signature("SRAT", &sratTbl) != UACPI_STATUS_OK)
+		return false;
+	frg::scope_exit finish{[&] { uacpi_table_unref(&sratTbl); }};
+	auto *srat = sratTbl.hdr;
+
+	size_t offset = sizeof(acpi_sdt_hdr) + sizeof(SratHeader);
+	while (offset + sizeof(SratGenericEntry) <= srat->length) {
+		SratGenericEntry generic;
+		memcpy(&generic, reinterpret_cast<char *>(sratTbl.virt_addr) + offset, sizeof(generic));
+		if (generic.length < sizeof(SratGenericEntry) || offset + generic.length > srat->length) {
+			warningLogger() << "thor: Ignoring malformed SRAT entry at offset "
+					<< offset << frg::endlog;
+			break;
+		}
+		if (fn(generic.type, reinterpret_cast<char *>(sratTbl.virt_addr) + offset, generic.length))
+			break;
+		offset += generic.length;
+	}
+	return true;
+}
+
+} // namespace
+
+frg::optional<uint32_t> getApicProximityDomain(uint32_t apicId) {
+	frg::optional<uint32_t> domain;
+	walkSrat([&] (uint8_t type, const char *ptr, size_t length) -> bool {
+		if (type == srat_types::localApic && length >= sizeof(SratLocalApicEntry)) {
+			SratLocalApicEntry entry;
+			memcpy(&entry, ptr, sizeof(entry));
+			if (!(entry.flags & srat_flags::enabled) || entry.localApicId != apicId)
+				return false;
+			domain = uint32_t(entry.proximityDomainLow)
+					| (uint32_t(entry.proximityDomainHigh[0]) << 8)
+					| (uint32_t(entry.proximityDomainHigh[1]) << 16)
+					| (uint32_t(entry.proximityDomainHigh[2]) << 24);
+			return true;
+		} else if (type == srat_types::localX2Apic && length >= sizeof(SratLocalX2ApicEntry)) {
+			SratLocalX2ApicEntry entry;
+			memcpy(&entry, ptr, sizeof(entry));
+			if (!(entry.flags & srat_flags::enabled) || entry.localX2ApicId != apicId)
+				return false;
+			domain = entry.proximityDomain;
+			return true;
+		}
+		return false;
+	});
+
+	if (logSrat && domain)
+		infoLogger() << "thor: APIC " << apicId << " is in proximity domain "
+				<< *domain << frg::endlog;
+	return domain;
+}
+
+} // namespace thor::acpi
@@ -3,6 +3,7 @@
 #include <async/oneshot-event.hpp>
 #include <async/queue.hpp>
 #include <eir/interface.hpp>
+#include <frg/optional.hpp>
 #include <initgraph.hpp>
 #include <smarter.hpp>
 #include <thor-internal/elf-notes.hpp>
@@ -58,6 +59,10 @@ initgraph::Stage *getTablesDiscoveredStage();
 initgraph::Stage *getNsAvailableStage();
 initgraph::Stage *getAcpiFiberAvailableStage();
 
+// Returns the SRAT proximity domain of the CPU with the given (x2)APIC ID.
+// Returns null_opt if there is no SRAT or if the CPU is not listed in it.
+frg::optional<uint32_t> getApicProximityDomain(uint32_t apicId);
+
 void initGlue();
 void initEc();
 void initEvents();
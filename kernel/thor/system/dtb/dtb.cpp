@@ -1,4 +1,5 @@
 #include <thor-internal/dtb/dtb.hpp>
+#include <thor-internal/cpu-data.hpp>
 #include <thor-internal/debug.hpp>
 #include <thor-internal/elf-notes.hpp>
 #include <thor-internal/main.hpp>
@@ -329,6 +330,80 @@ DeviceTreeNode *getDeviceTreeRoot() {
 	return treeRoot;
 }
 
+namespace {
+
+DeviceTreeNode *readPhandleProperty(DeviceTreeNode *node, const char *name) {
+	auto prop = node->dtNode().findProperty(name);
+	if (!prop)
+		return nullptr;
+	uint32_t phandle;
+	if (!prop->access().readCells(phandle, 1))
+		return nullptr;
+	return getDeviceTreeNodeByPhandle(phandle);
+}
+
+// Walks a level of the /cpus/cpu-map hierarchy. socketN and clusterN nodes (which may
+// be nested) are descended into; coreN nodes are numbered globally across all levels.
+// A core either references its CPU directly or contains one threadN node per SMT sibling.
+bool findCpuInCpuMap(DeviceTreeNode *parent, DeviceTreeNode *cpu, uint32_t &coreIndex) {
+	auto refersToCpu = [&] (DeviceTreeNode *n) {
+		return readPhandleProperty(n, "cpu") == cpu;
+	};
+
+	for (auto [_, entry] : parent->children()) {
+		if (entry->name().starts_with("socket") || entry->name().starts_with("cluster")) {
+			if (findCpuInCpuMap(entry, cpu, coreIndex))
+				return true;
+		} else if (entry->name().starts_with("core")) {
+			bool found = refersToCpu(entry);
+			for (auto [_, thread] : entry->children()) {
+				if (thread->name().starts_with("thread"))
+					found = found || refersToCpu(thread);
+			}
+			if (found)
+				return true;
+			coreIndex++;
+		}
+	}
+	return false;
+}
+
+} // namespace
+
+void discoverCpuTopologyFromDt(CpuData *context, DeviceTreeNode *node) {
+	// Cores are numbered by walking /cpus/cpu-map (see findCpuInCpuMap()).
+	// CPUs that are not covered by cpu-map are treated as their own cores.
+	context->topology.core = 0x8000'0000 | context->cpuIndex;
+	if (auto cpuMap = getDeviceTreeNodeByPath("/cpus/cpu-map"); cpuMap && node->phandle()) {
+		uint32_t coreIndex = 0;
+		if (findCpuInCpuMap(cpuMap, node, coreIndex))
+			context->topology.core = coreIndex;
+	}
+
+	// The last cache on the next-level-cache chain is the LLC.
+	// Phandles are never zero, hence CPUs without a shared cache get a private LLC ID.
+	context->topology.llc = 0x8000'0000 | context->cpuIndex;
+	auto cache = readPhandleProperty(node, "next-level-cache");
+	for (int depth = 0; cache && depth < 8; depth++) {
+		context->topology.llc = cache->phandle();
+		cache = readPhandleProperty(cache, "next-level-cache");
+	}
+
+	context->topology.numaNode = 0;
+	if (auto prop = node->dtNode().findProperty("numa-node-id"); prop) {
+		uint32_t numaNode;
+		if (prop->access().readCells(numaNode, 1))
+			context->topology.numaNode = numaNode;
+	}
+	context->topology.valid = true;
+
+	if (logNodeInfo)
+		infoLogger() << "thor: CPU #" << context->cpuIndex << " (" << node->path()
+				<< ") is on core " << context->topology.core
+				<< ", LLC " << context->topology.llc
+				<< ", NUMA node " << context->topology.numaNode << frg::endlog;
+}
+
 static initgraph::Task initTablesTask{&globalInitEngine, "dtb.parse-dtb",
 	initgraph::Entails{getDeviceTreeParsedStage()},
 	[] {
@@ -15,6 +15,8 @@
 
 namespace thor {
 
+struct CpuData;
+
 extern ManagarmElfNote<DtData> dtDataNote;
 
 namespace dt {
@@ -216,6 +218,10 @@ DeviceTreeNode *getDeviceTreeNodeByPath(frg::string_view path);
 DeviceTreeNode *getDeviceTreeNodeByPhandle(uint32_t phandle);
 DeviceTreeNode *getDeviceTreeRoot();
 
+// Fills in context->topology from the CPU's DT node (using /cpus/cpu-map,
+// next-level-cache and numa-node-id).
+void discoverCpuTopologyFromDt(CpuData *context, DeviceTreeNode *node);
+
 initgraph::Stage *getDeviceTreeParsedStage();
 
 static inline frg::array<frg::string_view, 12> dtGicV2Compatible = {
@@ -288,7 +288,7 @@ static initgraph::Task enumerateDmalog{&globalInitEngine, "pci.enumerate-dmalog"
 					+ frg::to_allocated_string(*kernelAlloc, pciDevice->slot)
 					+ frg::string<KernelAlloc>{*kernelAlloc, "-"}
 					+ frg::to_allocated_string(*kernelAlloc, pciDevice->function)
-					+ frg::string<KernelAlloc>{*kernelAlloc, ".0"});
+					+ frg::string<KernelAlloc>{*kernelAlloc, ".0"}, 0);
 				if(!pin) {
 					warningLogger() << "thor: could not allocate MSI for dmalog" << frg::endlog;
 				} else {
@@ -266,8 +266,8 @@ static initgraph::Task discoverAcpiRootBuses{&globalInitEngine, "pci.discover-ac
 				#ifdef __x86_64__
 					struct ApicMsiController final : PciMsiController {
 						smarter::shared_ptr<MsiPin> allocateMsiPin(
-								frg::string<KernelAlloc> name) override {
-							return allocateApicMsi(std::move(name));
+								frg::string<KernelAlloc> name, size_t cpu) override {
+							return allocateApicMsi(std::move(name), cpu);
 						}
 					};
 
@@ -549,7 +549,9 @@ protected:
 };
 
 struct PciMsiController {
-	virtual smarter::shared_ptr<MsiPin> allocateMsiPin(frg::string<KernelAlloc> name) = 0;
+	// Allocates an MSI that is delivered to the given CPU.
+	virtual smarter::shared_ptr<MsiPin> allocateMsiPin(frg::string<KernelAlloc> name,
+			size_t cpu) = 0;
 
 protected:
 	~PciMsiController() = default;
@@ -1,4 +1,8 @@
+#include <array>
+#include <format>
+#include <functional>
 #include <memory>
+#include <sstream>
 
 #include <linux/vt.h>
 
@@ -103,6 +107,9 @@ async::result<void> serve(std::shared_ptr<Process> self, std::shared_ptr<Generat
 namespace {
 	helix::UniqueLane kerncfgLane;
 	helix::UniqueLane pmLane;
+
+	// Path of the block device that is currently attached as swap (if any).
+	std::string swapDevicePath;
 };
 
 helix::UniqueLane &getKerncfgLane() {
@@ -151,6 +158,432 @@ struct CmdlineNode final : public procfs::RegularNode {
 	}
 };
 
+template<typename Resp, typename Req>
+async::result<Resp> kerncfgRequest(Req &req) {
+	auto [offer, sendReq, recvResp] =
+		co_await helix_ng::exchangeMsgs(
+			kerncfgLane,
+			helix_ng::offer(
+				helix_ng::sendBragiHeadOnly(req, frg::stl_allocator{}),
+				helix_ng::recvInline()
+			)
+		);
+
+	HEL_CHECK(offer.error());
+	HEL_CHECK(sendReq.error());
+	HEL_CHECK(recvResp.error());
+
+	auto resp = *bragi::parse_head_only<Resp>(recvResp);
+	recvResp.reset();
+	co_return resp;
+}
+
+struct MeminfoNode final : public procfs::RegularNode {
+	async::result<std::expected<std::string, Error>> show(Process *) override {
+		managarm::kerncfg::GetMemoryInformationRequest memReq;
+		auto mem = co_await kerncfgRequest<
+				managarm::kerncfg::GetMemoryInformationResponse>(memReq);
+		assert(mem.error() == managarm::kerncfg::Error::SUCCESS);
+
+		managarm::kerncfg::GetReclaimStatisticsRequest reclaimReq;
+		auto reclaim = co_await kerncfgRequest<
+				managarm::kerncfg::GetReclaimStatisticsResponse>(reclaimReq);
+		assert(reclaim.error() == managarm::kerncfg::Error::SUCCESS);
+
+		managarm::kerncfg::GetSwapStatisticsRequest swapReq;
+		auto swap = co_await kerncfgRequest<
+				managarm::kerncfg::GetSwapStatisticsResponse>(swapReq);
+		assert(swap.error() == managarm::kerncfg::Error::SUCCESS);
+
+		managarm::kerncfg::GetReadaheadStatisticsRequest readaheadReq;
+		auto readahead = co_await kerncfgRequest<
+				managarm::kerncfg::GetReadaheadStatisticsResponse>(readaheadReq);
+		assert(readahead.error() == managarm::kerncfg::Error::SUCCESS);
+
+		managarm::kerncfg::GetWritebackStatisticsRequest writebackReq;
+		auto writeback = co_await kerncfgRequest<
+				managarm::kerncfg::GetWritebackStatisticsResponse>(writebackReq);
+		assert(writeback.error() == managarm::kerncfg::Error::SUCCESS);
+
+		managarm::kerncfg::GetFaultAroundStatisticsRequest faultAroundReq;
+		auto faultAround = co_await kerncfgRequest<
+				managarm::kerncfg::GetFaultAroundStatisticsResponse>(faultAroundReq);
+		assert(faultAround.error() == managarm::kerncfg::Error::SUCCESS);
+
+		auto kib = [&] (uint64_t units) { return units * mem.memory_unit() / 1024; };
+
+		// The first lines follow the format of Linux' /proc/meminfo,
+		// the Reclaim*, Swapped*, Readahead*, Flushes*, Throttled* and FaultAround* lines
+		// are specific to Managarm.
+		std::string out;
+		auto line = [&] (std::string_view key, uint64_t value, bool inKib = true) {
+			out += std::format("{:<24}{:>12}{}\n", std::string{key} + ":", value,
+					inKib ? " kB" : "");
+		};
+		line("MemTotal", kib(mem.total_usable_memory()));
+		line("MemFree", kib(mem.available_memory()));
+		line("MemAvailable", kib(mem.available_memory() + reclaim.reclaimable_pages()));
+		line("Cached", kib(reclaim.reclaimable_pages()));
+		line("Unevictable", kib(reclaim.pinned_pages()));
+		line("SwapTotal", kib(swap.total_pages()));
+		line("SwapFree", kib(swap.total_pages() - swap.used_pages()));
+		line("Dirty", kib(writeback.dirty_pages() - writeback.writeback_pages()));
+		line("Writeback", kib(writeback.writeback_pages()));
+		line("ReclaimLowWatermark", kib(reclaim.low_watermark()));
+		line("ReclaimHighWatermark", kib(reclaim.high_watermark()));
+		line("ReclaimRotations", reclaim.rotations(), false);
+		line("ReclaimPressureRotations", reclaim.pressure_rotations(), false);
+		line("ReclaimPosted", kib(reclaim.posted_pages()));
+		line("ReclaimEvicted", kib(reclaim.evicted_pages()));
+		line("SwappedOut", swap.swapped_out_pages(), false);
+		line("SwappedIn", swap.swapped_in_pages(), false);
+		line("Readahead", kib(readahead.readahead_pages()));
+		line("ReadaheadHits", readahead.readahead_hits(), false);
+		line("ReadaheadMisses", readahead.readahead_misses(), false);
+		line("FlushesExpired", writeback.expired_flushes(), false);
+		line("FlushesBackground", writeback.background_flushes(), false);
+		line("ThrottledWriters", writeback.throttled_writers(), false);
+		line("ThrottledMs", writeback.throttled_time() / 1'000'000, false);
+		line("FaultArounds", faultAround.fault_arounds(), false);
+		line("FaultAroundMapped", kib(faultAround.fault_around_pages()));
+		co_return out;
+	}
+
+	async::result<void> store(std::string) override {
+		throw std::runtime_error("Cannot store to /proc/meminfo");
+	}
+};
+
+// Reads and sets the low and high reclaim watermarks (in KiB of free memory).
+struct ReclaimWatermarksNode final : public procfs::RegularNode {
+	async::result<std::expected<std::string, Error>> show(Process *) override {
+		managarm::kerncfg::GetMemoryInformationRequest memReq;
+		auto mem = co_await kerncfgRequest<
+				managarm::kerncfg::GetMemoryInformationResponse>(memReq);
+
+		managarm::kerncfg::GetReclaimStatisticsRequest reclaimReq;
+		auto reclaim = co_await kerncfgRequest<
+				managarm::kerncfg::GetReclaimStatisticsResponse>(reclaimReq);
+
+		co_return std::format("{} {}\n",
+				reclaim.low_watermark() * mem.memory_unit() / 1024,
+				reclaim.high_watermark() * mem.memory_unit() / 1024);
+	}
+
+	bool writeRequiresPrivilege() override {
+		return true;
+	}
+
+	async::result<void> store(std::string buffer) override {
+		uint64_t lowKib, highKib;
+		std::istringstream stream{buffer};
+		if(!(stream >> lowKib >> highKib)) {
+			std::cout << "posix: Expected two values for reclaim_watermarks" << std::endl;
+			co_return;
+		}
+
+		managarm::kerncfg::GetMemoryInformationRequest memReq;
+		auto mem = co_await kerncfgRequest<
+				managarm::kerncfg::GetMemoryInformationResponse>(memReq);
+
+		managarm::kerncfg::SetReclaimWatermarksRequest req;
+		req.set_low_watermark(lowKib * 1024 / mem.memory_unit());
+		req.set_high_watermark(highKib * 1024 / mem.memory_unit());
+		auto resp = co_await kerncfgRequest<managarm::kerncfg::SvrResponse>(req);
+		if(resp.error() != managarm::kerncfg::Error::SUCCESS)
+			std::cout << "posix: Kernel rejected reclaim watermarks " << lowKib
+					<< " KiB / " << highKib << " KiB" << std::endl;
+	}
+};
+
+// Reads and sets the maximal readahead window of file-backed memory (in KiB).
+struct MaxReadaheadNode final : public procfs::RegularNode {
+	async::result<std::expected<std::string, Error>> show(Process *) override {
+		managarm::kerncfg::GetMemoryInformationRequest memReq;
+		auto mem = co_await kerncfgRequest<
+				managarm::kerncfg::GetMemoryInformationResponse>(memReq);
+
+		managarm::kerncfg::GetReadaheadStatisticsRequest readaheadReq;
+		auto readahead = co_await kerncfgRequest<
+				managarm::kerncfg::GetReadaheadStatisticsResponse>(readaheadReq);
+
+		co_return std::format("{}\n", readahead.max_window_pages() * mem.memory_unit() / 1024);
+	}
+
+	bool writeRequiresPrivilege() override {
+		return true;
+	}
+
+	async::result<void> store(std::string buffer) override {
+		uint64_t windowKib;
+		std::istringstream stream{buffer};
+		if(!(stream >> windowKib)) {
+			std::cout << "posix: Expected a value for max_readahead_kb" << std::endl;
+			co_return;
+		}
+
+		managarm::kerncfg::GetMemoryInformationRequest memReq;
+		auto mem = co_await kerncfgRequest<
+				managarm::kerncfg::GetMemoryInformationResponse>(memReq);
+
+		managarm::kerncfg::SetMaxReadaheadRequest req;
+		req.set_max_window_pages(windowKib * 1024 / mem.memory_unit());
+		auto resp = co_await kerncfgRequest<managarm::kerncfg::SvrResponse>(req);
+		if(resp.error() != managarm::kerncfg::Error::SUCCESS)
+			std::cout << "posix: Kernel rejected readahead window of "
+					<< windowKib << " KiB" << std::endl;
+	}
+};
+
+// Reads and sets the fault-around window (in bytes, like Linux' fault_around_bytes).
+struct FaultAroundBytesNode final : public procfs::RegularNode {
+	async::result<std::expected<std::string, Error>> show(Process *) override {
+		managarm::kerncfg::GetMemoryInformationRequest memReq;
+		auto mem = co_await kerncfgRequest<
+				managarm::kerncfg::GetMemoryInformationResponse>(memReq);
+
+		managarm::kerncfg::GetFaultAroundStatisticsRequest faultAroundReq;
+		auto faultAround = co_await kerncfgRequest<
+				managarm::kerncfg::GetFaultAroundStatisticsResponse>(faultAroundReq);
+
+		co_return std::format("{}\n", faultAround.window_pages() * mem.memory_unit());
+	}
+
+	bool writeRequiresPrivilege() override {
+		return true;
+	}
+
+	async::result<void> store(std::string buffer) override {
+		uint64_t windowBytes;
+		std::istringstream stream{buffer};
+		if(!(stream >> windowBytes)) {
+			std::cout << "posix: Expected a value for fault_around_bytes" << std::endl;
+			co_return;
+		}
+
+		managarm::kerncfg::GetMemoryInformationRequest memReq;
+		auto mem = co_await kerncfgRequest<
+				managarm::kerncfg::GetMemoryInformationResponse>(memReq);
+
+		managarm::kerncfg::SetFaultAroundWindowRequest req;
+		req.set_window_pages(windowBytes / mem.memory_unit());
+		auto resp = co_await kerncfgRequest<managarm::kerncfg::SvrResponse>(req);
+		if(resp.error() != managarm::kerncfg::Error::SUCCESS)
+			std::cout << "posix: Kernel rejected fault-around window of "
+					<< windowBytes << " bytes" << std::endl;
+	}
+};
+
+// Reads and sets one of the limits of dirty-page writeback, i.e., the ratios
+// (in percent of total memory) and the expiry time (in centiseconds, as on Linux).
+struct DirtyLimitNode final : public procfs::RegularNode {
+	enum class Limit {
+		backgroundRatio,
+		dirtyRatio,
+		expireCentisecs
+	};
+
+	DirtyLimitNode(Limit limit)
+	: limit_{limit} { }
+
+	async::result<std::expected<std::string, Error>> show(Process *) override {
+		managarm::kerncfg::GetWritebackStatisticsRequest writebackReq;
+		auto writeback = co_await kerncfgRequest<
+				managarm::kerncfg::GetWritebackStatisticsResponse>(writebackReq);
+
+		switch(limit_) {
+		case Limit::backgroundRatio:
+			co_return std::format("{}\n", writeback.background_ratio());
+		case Limit::dirtyRatio:
+			co_return std::format("{}\n", writeback.dirty_ratio());
+		case Limit::expireCentisecs:
+			co_return std::format("{}\n", writeback.expire_time() / 10'000'000);
+		}
+		__builtin_unreachable();
+	}
+
+	bool writeRequiresPrivilege() override {
+		return true;
+	}
+
+	async::result<void> store(std::string buffer) override {
+		uint64_t value;
+		std::istringstream stream{buffer};
+		if(!(stream >> value)) {
+			std::cout << "posix: Expected a value for the dirty-page limit" << std::endl;
+			co_return;
+		}
+
+		managarm::kerncfg::GetWritebackStatisticsRequest writebackReq;
+		auto writeback = co_await kerncfgRequest<
+				managarm::kerncfg::GetWritebackStatisticsResponse>(writebackReq);
+
+		managarm::kerncfg::SetWritebackLimitsRequest req;
+		req.set_background_ratio(writeback.background_ratio());
+		req.set_dirty_ratio(writeback.dirty_ratio());
+		req.set_expire_time(writeback.expire_time());
+		switch(limit_) {
+		case Limit::backgroundRatio:
+			req.set_background_ratio(value);
+			break;
+		case Limit::dirtyRatio:
+			req.set_dirty_ratio(value);
+			break;
+		case Limit::expireCentisecs:
+			req.set_expire_time(value * 10'000'000);
+			break;
+		}
+		auto resp = co_await kerncfgRequest<managarm::kerncfg::SvrResponse>(req);
+		if(resp.error() != managarm::kerncfg::Error::SUCCESS)
+			std::cout << "posix: Kernel rejected dirty-page limit " << value << std::endl;
+	}
+
+private:
+	Limit limit_;
+};
+
+struct SwapsNode final : public procfs::RegularNode {
+	async::result<std::expected<std::string, Error>> show(Process *) override {
+		// Same format as Linux' /proc/swaps.
+		std::string out = "Filename\t\t\t\tType\t\tSize\t\tUsed\t\tPriority\n";
+		if(swapDevicePath.empty())
+			co_return out;
+
+		managarm::kerncfg::GetMemoryInformationRequest memReq;
+		auto mem = co_await kerncfgRequest<
+				managarm::kerncfg::GetMemoryInformationResponse>(memReq);
+
+		managarm::kerncfg::GetSwapStatisticsRequest swapReq;
+		auto swap = co_await kerncfgRequest<
+				managarm::kerncfg::GetSwapStatisticsResponse>(swapReq);
+
+		out += std::format("{:<40}partition\t{}\t\t{}\t\t-2\n", swapDevicePath,
+				swap.total_pages() * mem.memory_unit() / 1024,
+				swap.used_pages() * mem.memory_unit() / 1024);
+		co_return out;
+	}
+
+	async::result<void> store(std::string) override {
+		throw std::runtime_error("Cannot store to /proc/swaps");
+	}
+};
+
+// Writing a path to a block device attaches that device as swap area.
+// Managarm does not support swapoff yet, hence only a single write succeeds.
+struct SwapDeviceNode final : public procfs::RegularNode {
+	async::result<std::expected<std::string, Error>> show(Process *) override {
+		if(swapDevicePath.empty())
+			co_return std::string{};
+		co_return swapDevicePath + '\n';
+	}
+
+	bool writeRequiresPrivilege() override {
+		return true;
+	}
+
+	async::result<void> store(std::string buffer) override {
+		auto path = buffer.substr(0, buffer.find_last_not_of(" \t\n") + 1);
+		if(path.empty())
+			co_return;
+
+		if(!swapDevicePath.empty()) {
+			std::cout << "posix: Swap is already attached to " << swapDevicePath << std::endl;
+			co_return;
+		}
+
+		auto root = rootPath();
+		auto resolveResult = co_await resolve(root, root, path, nullptr);
+		if(!resolveResult) {
+			std::cout << "posix: Could not resolve swap device " << path << std::endl;
+			co_return;
+		}
+		auto node = resolveResult.value().second->getTarget();
+		if(node->getType() != VfsType::blockDevice) {
+			std::cout << "posix: Swap device " << path << " is not a block device" << std::endl;
+			co_return;
+		}
+
+		// Refuse devices that back a mounted file system; the kernel would
+		// otherwise overwrite file system blocks with swapped out pages.
+		auto id = node->readDevice();
+		std::function<bool(std::shared_ptr<MountView>)> isMounted =
+			[&](std::shared_ptr<MountView> mount) -> bool {
+			auto dev = mount->getDevice();
+			if(dev.second && dev.second->getTarget()->getType() == VfsType::blockDevice
+					&& dev.second->getTarget()->readDevice() == id)
+				return true;
+			for(auto child : mount->mounts())
+				if(isMounted(child))
+					return true;
+			return false;
+		};
+		if(isMounted(root.first)) {
+			std::cout << "posix: Swap device " << path << " is mounted" << std::endl;
+			co_return;
+		}
+
+		auto file = co_await open(root, root, path, nullptr, 0, semanticRead);
+		if(!file) {
+			std::cout << "posix: Could not open swap device " << path << std::endl;
+			co_return;
+		}
+
+		// Only accept devices that were prepared by mkswap, which stores
+		// the signature at the end of the first page.
+		std::array<char, 4096> header;
+		size_t progress = 0;
+		while(progress < header.size()) {
+			auto chunk = co_await file.value()->readSome(nullptr, header.data() + progress,
+					header.size() - progress, {});
+			if(!chunk || !chunk.value())
+				break;
+			progress += chunk.value();
+		}
+		constexpr std::string_view swapSignature{"SWAPSPACE2"};
+		if(progress < header.size()
+				|| std::string_view{header.data() + header.size() - swapSignature.size(),
+					swapSignature.size()} != swapSignature) {
+			std::cout << "posix: Swap device " << path << " lacks a swap signature" << std::endl;
+			co_return;
+		}
+
+		auto memory = co_await file.value()->accessMemory();
+		if(!memory) {
+			std::cout << "posix: Swap device " << path << " does not support mapping" << std::endl;
+			co_return;
+		}
+
+		managarm::kerncfg::AttachSwapRequest req;
+
+		auto [offer, sendReq, pushMemory, recvResp] =
+			co_await helix_ng::exchangeMsgs(
+				kerncfgLane,
+				helix_ng::offer(
+					helix_ng::sendBragiHeadOnly(req, frg::stl_allocator{}),
+					helix_ng::pushDescriptor(memory),
+					helix_ng::recvInline()
+				)
+			);
+
+		HEL_CHECK(offer.error());
+		HEL_CHECK(sendReq.error());
+		HEL_CHECK(pushMemory.error());
+		HEL_CHECK(recvResp.error());
+
+		auto resp = *bragi::parse_head_only<managarm::kerncfg::SvrResponse>(recvResp);
+		recvResp.reset();
+		if(resp.error() == managarm::kerncfg::Error::ALREADY_EXISTS) {
+			std::cout << "posix: Swap is already attached to " << swapDevicePath << std::endl;
+			co_return;
+		}else if(resp.error() != managarm::kerncfg::Error::SUCCESS) {
+			std::cout << "posix: Kernel rejected swap device " << path << std::endl;
+			co_return;
+		}
+
+		swapDevicePath = path;
+	}
+};
+
 async::result<void> enumerateKerncfg() {
 	auto filter = mbus_ng::Conjunction{{
 		mbus_ng::EqualsFilter{"class", "kerncfg"}
@@ -165,6 +598,23 @@ async::result<void> enumerateKerncfg() {
 
 	auto procfsRoot = std::static_pointer_cast<procfs::DirectoryNode>(getProcfs()->getTarget());
 	procfsRoot->directMkregular("cmdline", std::make_shared<CmdlineNode>());
+	procfsRoot->directMkregular("meminfo", std::make_shared<MeminfoNode>());
+	procfsRoot->directMkregular("swaps", std::make_shared<SwapsNode>());
+
+	auto sysLink = co_await procfsRoot->getLink("sys");
+	assert(sysLink && sysLink.value());
+	auto sys = std::static_pointer_cast<procfs::DirectoryNode>(sysLink.value()->getTarget());
+	auto vm = std::static_pointer_cast<procfs::DirectoryNode>(sys->directMkdir("vm")->getTarget());
+	vm->directMkregular("reclaim_watermarks", std::make_shared<ReclaimWatermarksNode>());
+	vm->directMkregular("swap_device", std::make_shared<SwapDeviceNode>());
+	vm->directMkregular("max_readahead_kb", std::make_shared<MaxReadaheadNode>());
+	vm->directMkregular("fault_around_bytes", std::make_shared<FaultAroundBytesNode>());
+	vm->directMkregular("dirty_background_ratio",
+			std::make_shared<DirtyLimitNode>(DirtyLimitNode::Limit::backgroundRatio));
+	vm->directMkregular("dirty_ratio",
+			std::make_shared<DirtyLimitNode>(DirtyLimitNode::Limit::dirtyRatio));
+	vm->directMkregular("dirty_expire_centisecs",
+			std::make_shared<DirtyLimitNode>(DirtyLimitNode::Limit::expireCentisecs));
 }
 
 async::result<void> enumeratePm() {
@@ -42,40 +42,59 @@ async::result<std::shared_ptr<VmContext>> VmContext::clone(std::shared_ptr<VmCon
 	HEL_CHECK(helCreateSpace(&space));
 	context->_space = helix::UniqueDescriptor(space);
 
+	// Fork all areas in batches; the kernel clones the mappings
+	// (and forks the copy-on-write memory objects) in a single request per batch.
+	std::vector<uintptr_t> batch;
+	std::vector<HelForkArea> recipes;
+	auto submitBatch = [&] () -> async::result<void> {
+		auto forkResult = co_await helix_ng::forkSpace(context->_space, recipes,
+				kHelForkSpacePopulate);
+		HEL_CHECK(forkResult.error());
+		auto copyViews = forkResult.descriptors();
+
+		for(size_t i = 0; i < batch.size(); i++) {
+			const auto &area = original->_areaTree.at(batch[i]);
+
+			Area copy;
+			copy.copyOnWrite = area.copyOnWrite;
+			copy.areaSize = area.areaSize;
+			copy.nativeFlags = area.nativeFlags;
+			copy.fileView = area.fileView.dup();
+			copy.copyView = std::move(copyViews[i]);
+			copy.file = area.file;
+			copy.offset = area.offset;
+			copy.effectiveOffset = area.effectiveOffset;
+			context->_areaTree.emplace(batch[i], std::move(copy));
+		}
+
+		batch.clear();
+		recipes.clear();
+	};
+
 	for(const auto &entry : original->_areaTree) {
 		const auto &[address, area] = entry;
 
-		helix::UniqueDescriptor copyView;
+		HelForkArea recipe{};
+		recipe.mapFlags = area.nativeFlags & (kHelMapProtRead | kHelMapProtWrite
+				| kHelMapProtExecute | kHelMapDontRequireBacking);
+		recipe.address = address;
+		recipe.length = area.areaSize;
 		if(area.copyOnWrite) {
-			auto forkResult = co_await helix_ng::forkMemory(area.copyView);
-			HEL_CHECK(forkResult.error());
-			copyView = forkResult.descriptor();
-
-			void *pointer;
-			HelError error = helMapMemory(copyView.getHandle(), context->_space.getHandle(),
-					reinterpret_cast<void *>(address),
-					area.effectiveOffset, area.areaSize, area.nativeFlags, &pointer);
-			if(error != kHelErrNone && error != kHelErrAlreadyExists) {
-				HEL_CHECK(error);
-			}
+			recipe.memory = area.copyView.getHandle();
+			recipe.flags = kHelForkAreaCopyOnWrite;
+			recipe.offset = area.effectiveOffset;
 		}else{
-			void *pointer;
-			HEL_CHECK(helMapMemory(area.fileView.getHandle(), context->_space.getHandle(),
-					reinterpret_cast<void *>(address),
-					area.offset, area.areaSize, area.nativeFlags, &pointer));
+			recipe.memory = area.fileView.getHandle();
+			recipe.offset = area.offset;
 		}
 
-		Area copy;
-		copy.copyOnWrite = area.copyOnWrite;
-		copy.areaSize = area.areaSize;
-		copy.nativeFlags = area.nativeFlags;
-		copy.fileView = area.fileView.dup();
-		copy.copyView = std::move(copyView);
-		copy.file = area.file;
-		copy.offset = area.offset;
-		copy.effectiveOffset = area.effectiveOffset;
-		context->_areaTree.emplace(address, std::move(copy));
+		batch.push_back(address);
+		recipes.push_back(recipe);
+		if(recipes.size() == kHelForkSpaceMaxAreas)
+			co_await submitBatch();
 	}
+	if(!recipes.empty())
+		co_await submitBatch();
 
 	co_return context;
 }
@@ -96,10 +96,12 @@ RegularFile::readSome(Process *process, void *data, size_t max_length, async::ca
 }
 
 async::result<frg::expected<Error, size_t>>
-RegularFile::writeAll(Process *, const void *data, size_t length) {
+RegularFile::writeAll(Process *process, const void *data, size_t length) {
 	assert(length > 0);
 
 	auto node = static_cast<RegularNode *>(associatedLink()->getTarget().get());
+	if(node->writeRequiresPrivilege() && (!process || process->threadGroup()->euid() != 0))
+		co_return Error::accessDenied;
 	co_await node->store(std::string{reinterpret_cast<const char *>(data), length});
 	co_return length;
 }
@@ -224,7 +226,7 @@ async::result<frg::expected<Error, FileStats>> RegularNode::getStats() {
 	stats.inodeNumber = 0; // FIXME
 	stats.numLinks = 1;
 	stats.fileSize = 4096; // Same as in Linux.
-	stats.mode = 0666; // TODO: Some files can be written.
+	stats.mode = writeRequiresPrivilege() ? 0644 : 0666;
 	stats.uid = 0;
 	stats.gid = 0;
 	stats.atimeSecs = now.tv_sec;
@@ -244,7 +246,7 @@ async::result<frg::expected<Error, FileStats>> RegularNode::getStatsInternal(Thr
 	stats.inodeNumber = 0; // FIXME
 	stats.numLinks = 1;
 	stats.fileSize = 4096; // Same as in Linux.
-	stats.mode = 0666; // TODO: Some files can be written.
+	stats.mode = writeRequiresPrivilege() ? 0644 : 0666;
 	stats.uid = tg->uid();
 	stats.gid = tg->gid();
 	stats.atimeSecs = now.tv_sec;
@@ -1075,6 +1077,11 @@ async::result<std::expected<std::string, Error>> StatusNode::show(Process *) {
 	stream << "Mems_allowed_list: N/A\n";
 	stream << "voluntary_ctxt_switches: N/A\n";
 	stream << "nonvoluntary_ctxt_switches: N/A\n";
+	// Managarm-specific: the kernel tags profiling samples by thread credentials.
+	stream << "Credentials: ";
+	for(auto c : p->credentials())
+		stream << std::format("{:02x}", static_cast<uint8_t>(c));
+	stream << "\n";
 	co_return stream.str();
 }
 
@@ -116,6 +116,11 @@ protected:
 	virtual async::result<std::expected<std::string, Error>> show(Process *) = 0;
 	virtual async::result<void> store(std::string buffer) = 0;
 
+	// Nodes that change global system state only accept writes from root.
+	virtual bool writeRequiresPrivilege() {
+		return false;
+	}
+
 	async::result<frg::expected<Error, FileStats>> getStatsInternal(ThreadGroup *);
 };
 
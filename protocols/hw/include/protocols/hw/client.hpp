@@ -154,7 +154,7 @@ struct Device {
 	async::result<helix::UniqueDescriptor> accessBar(int index);
 	async::result<helix::UniqueDescriptor> accessExpansionRom();
 	async::result<helix::UniqueDescriptor> accessIrq(size_t index = 0);
-	async::result<helix::UniqueDescriptor> installMsi(int index);
+	async::result<helix::UniqueDescriptor> installMsi(int index, unsigned int cpu = 0);
 
 	async::result<DtInfo> getDtInfo();
 	async::result<std::string> getDtPath();
@@ -1,12 +1,21 @@
+#include <errno.h>
 #include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include <async/result.hpp>
 #include <async/algorithm.hpp>
 #include <async/wait-group.hpp>
+#include <helix/dispatcher-pool.hpp>
 #include <helix/ipc.hpp>
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <print>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -50,6 +59,103 @@ private:
 	std::chrono::time_point<clock> ref_;
 };
 
+// If set, latency benchmarks print one JSON object per line instead of human-readable text.
+bool jsonOutput = false;
+
+// Collects the latency of individual operations and reports percentiles and a histogram.
+struct LatencyBenchmark {
+	using clock = std::chrono::high_resolution_clock;
+
+	static constexpr int numSamples = 100'000;
+
+	LatencyBenchmark(std::string name, std::string variant)
+	: name_{std::move(name)}, variant_{std::move(variant)} {
+		samples_.reserve(numSamples);
+		if(!jsonOutput)
+			std::cout << name_ << " latency (" << variant_ << ")" << std::endl;
+	}
+
+	template<typename F>
+	void measure(F f) {
+		auto ref = clock::now();
+		f();
+		record(clock::now() - ref);
+	}
+
+	void record(clock::duration elapsed) {
+		samples_.push_back(duration_cast<std::chrono::nanoseconds>(elapsed).count());
+	}
+
+	void finalizeStatistics() {
+		if(samples_.empty())
+			return;
+		std::ranges::sort(samples_);
+
+		// Bucket i counts samples in [2^i, 2^(i + 1)) ns.
+		std::array<uint64_t, 64> histogram{};
+		for(uint64_t n : samples_)
+			histogram[n ? 63 - __builtin_clzll(n) : 0]++;
+
+		if(jsonOutput) {
+			std::cout << "{\"benchmark\": \"" << name_ << "\", \"variant\": \"" << variant_ << "\""
+					<< ", \"samples\": " << samples_.size()
+					<< ", \"min_ns\": " << samples_.front()
+					<< ", \"p50_ns\": " << percentile_(0.5)
+					<< ", \"p99_ns\": " << percentile_(0.99)
+					<< ", \"p999_ns\": " << percentile_(0.999)
+					<< ", \"max_ns\": " << samples_.back()
+					<< ", \"histogram\": [";
+			bool first = true;
+			for(size_t i = 0; i < histogram.size(); ++i) {
+				if(!histogram[i])
+					continue;
+				std::cout << (first ? "" : ", ") << "{\"lt_ns\": " << (uint64_t{2} << i)
+						<< ", \"count\": " << histogram[i] << "}";
+				first = false;
+			}
+			std::cout << "]}" << std::endl;
+		}else{
+			std::cout << "    p50: " << percentile_(0.5) << " ns, p99: " << percentile_(0.99)
+					<< " ns, p999: " << percentile_(0.999) << " ns, max: " << samples_.back()
+					<< " ns" << std::endl;
+		}
+	}
+
+private:
+	uint64_t percentile_(double q) {
+		return samples_[std::min(samples_.size() - 1, static_cast<size_t>(q * samples_.size()))];
+	}
+
+	std::string name_;
+	std::string variant_;
+	std::vector<uint64_t> samples_;
+};
+
+// Restricts the calling thread to a single CPU.
+void pinToCpu(unsigned int cpu) {
+	std::vector<uint8_t> mask(cpu / 8 + 1);
+	mask[cpu / 8] |= 1 << (cpu % 8);
+	HEL_CHECK(helSetAffinity(kHelThisThread, mask.data(), mask.size()));
+}
+
+// Allows the calling thread to run on all CPUs again.
+void unpin() {
+	unsigned int numCpus = std::thread::hardware_concurrency();
+	std::vector<uint8_t> mask((numCpus + 7) / 8);
+	for(unsigned int cpu = 0; cpu < numCpus; ++cpu)
+		mask[cpu / 8] |= 1 << (cpu % 8);
+	HEL_CHECK(helSetAffinity(kHelThisThread, mask.data(), mask.size()));
+}
+
+// Returns the CPU of the second thread for pinned (same CPU) and cross-CPU variants.
+unsigned int peerCpu(bool crossCpu) {
+	return crossCpu ? 1 : 0;
+}
+
+const char *variantName(bool crossCpu) {
+	return crossCpu ? "cross-cpu" : "pinned";
+}
+
 void doNopBenchmark() {
 	std::cout << "syscall ops" << std::endl;
 
@@ -119,6 +225,40 @@ async::result<void> doMultiSubmitAsyncNopBenchmark() {
 	bench.finalizeStatistics();
 }
 
+// Submits many operations at once to exercise the growth of the CQ.
+void doBurstAsyncNopBenchmark(int burst) {
+	std::cout << "ipc ops, bursts of " << burst << std::endl;
+
+	auto &dispatcher = helix::Dispatcher::global();
+	IterationsPerSecondBenchmark bench;
+	for(int k = 0; k < 5; ++k) {
+		uint64_t n = 0;
+		bench.launchRepetition();
+		while(!bench.isRepetitionDone()) {
+			int pending = 0;
+			for(int i = 0; i < burst; ++i) {
+				++pending;
+				async::detach(async::transform(
+					helix_ng::asyncNop(),
+					[&] (auto result) {
+						HEL_CHECK(result.error());
+						--pending;
+					}
+				));
+			}
+			while(pending)
+				dispatcher.wait();
+			n += burst;
+		}
+		bench.announceIterations(n);
+	}
+	bench.finalizeStatistics();
+
+	std::cout << "    active CQ chunks: " << dispatcher.numActiveCqChunks()
+			<< ", CQ stalls: " << dispatcher.numCqStalls()
+			<< ", SQ stalls: " << dispatcher.numSqStalls() << std::endl;
+}
+
 void doParallelAsyncNopBenchmark() {
 	unsigned int numCpus = std::thread::hardware_concurrency();
 	std::cout << "ipc ops (parallel, " << numCpus << " threads)" << std::endl;
@@ -177,6 +317,45 @@ void doParallelAsyncNopBenchmark() {
 	bench.finalizeStatistics();
 }
 
+async::result<void> doPoolAsyncNopWorker(std::atomic<bool> *stop,
+		std::atomic<uint64_t> *totalIterations, std::atomic<unsigned int> *numDone) {
+	uint64_t n = 0;
+	while(!stop->load(std::memory_order_relaxed)) {
+		for(int i = 0; i < 100; ++i) {
+			auto result = co_await helix_ng::asyncNop();
+			HEL_CHECK(result.error());
+		}
+		n += 100;
+	}
+	totalIterations->fetch_add(n, std::memory_order_relaxed);
+	numDone->fetch_add(1, std::memory_order_release);
+}
+
+// Same as doParallelAsyncNopBenchmark() but the work is spread by a DispatcherPool.
+void doPoolAsyncNopBenchmark() {
+	// Pools are never torn down.
+	static helix::DispatcherPool pool;
+	std::cout << "ipc ops (dispatcher pool, " << pool.size() << " threads)" << std::endl;
+
+	IterationsPerSecondBenchmark bench;
+	for(int k = 0; k < 5; ++k) {
+		std::atomic<bool> stop{false};
+		std::atomic<uint64_t> totalIterations{0};
+		std::atomic<unsigned int> numDone{0};
+
+		bench.launchRepetition();
+		for(unsigned int c = 0; c < pool.size(); ++c)
+			pool.detach(doPoolAsyncNopWorker(&stop, &totalIterations, &numDone));
+		while(!bench.isRepetitionDone())
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		stop.store(true, std::memory_order_relaxed);
+		while(numDone.load(std::memory_order_acquire) < pool.size())
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		bench.announceIterations(totalIterations.load(std::memory_order_relaxed));
+	}
+	bench.finalizeStatistics();
+}
+
 void doFutexBenchmark() {
 	std::cout << "futex waits" << std::endl;
 
@@ -196,6 +375,102 @@ void doFutexBenchmark() {
 	bench.finalizeStatistics();
 }
 
+// The threads pass a token around a ring; all of them block on the same futex word.
+// The word counts the turns; thread c owns the token while word % numThreads == c.
+// Each pass wakes all waiters, hence the futex is contended by all threads.
+void doContendedFutexBenchmark(unsigned int numThreads) {
+	std::cout << "contended futex wait/wake (" << numThreads << " threads)" << std::endl;
+
+	IterationsPerSecondBenchmark bench;
+	for(int k = 0; k < 5; ++k) {
+		alignas(64) int word = 0;
+		std::atomic<bool> stop{false};
+		std::atomic<uint64_t> totalIterations{0};
+
+		std::vector<std::thread> threads;
+		threads.reserve(numThreads);
+		for(unsigned int c = 0; c < numThreads; ++c) {
+			threads.emplace_back([&, c] {
+				uint64_t n = 0;
+				while(true) {
+					auto turn = __atomic_load_n(&word, __ATOMIC_ACQUIRE);
+					if(static_cast<unsigned int>(turn) % numThreads != c) {
+						auto error = helFutexWait(&word, turn, -1);
+						if(error != kHelErrFutexRace)
+							HEL_CHECK(error);
+						continue;
+					}
+
+					// Pass the token on, even when stopping, such that the next thread
+					// can observe the stop flag as well.
+					bool done = stop.load(std::memory_order_relaxed);
+					__atomic_store_n(&word, turn + 1, __ATOMIC_RELEASE);
+					HEL_CHECK(helFutexWake(&word, numThreads));
+					if(done)
+						break;
+					++n;
+				}
+				totalIterations.fetch_add(n, std::memory_order_relaxed);
+			});
+		}
+
+		bench.launchRepetition();
+		while(!bench.isRepetitionDone())
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		stop.store(true, std::memory_order_relaxed);
+		for(auto &t : threads)
+			t.join();
+		bench.announceIterations(totalIterations.load(std::memory_order_relaxed));
+	}
+	bench.finalizeStatistics();
+}
+
+// Each thread performs wait/wake pairs on its own futex word.
+// The words hold 0 while the threads wait for 1, hence each wait fails with kHelErrFutexRace
+// after the kernel has looked up the futex. Since the words are distinct, throughput should
+// scale with the number of threads unless the kernel serializes unrelated futexes.
+void doDistinctFutexBenchmark(unsigned int numThreads) {
+	std::cout << "distinct futex wait/wake (" << numThreads << " threads)" << std::endl;
+
+	struct alignas(64) Word {
+		int futex = 0;
+	};
+	std::vector<Word> words(numThreads);
+
+	IterationsPerSecondBenchmark bench;
+	for(int k = 0; k < 5; ++k) {
+		std::atomic<bool> stop{false};
+		std::atomic<uint64_t> totalIterations{0};
+
+		std::vector<std::thread> threads;
+		threads.reserve(numThreads);
+		for(unsigned int c = 0; c < numThreads; ++c) {
+			threads.emplace_back([&, c] {
+				uint64_t n = 0;
+				while(!stop.load(std::memory_order_relaxed)) {
+					for(int i = 0; i < 100; ++i) {
+						auto error = helFutexWait(&words[c].futex, 1, -1);
+						if(error != kHelErrFutexRace)
+							HEL_CHECK(error);
+						HEL_CHECK(helFutexWake(&words[c].futex, 1));
+						++n;
+					}
+				}
+				totalIterations.fetch_add(n, std::memory_order_relaxed);
+			});
+		}
+
+		bench.launchRepetition();
+		while(!bench.isRepetitionDone())
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		stop.store(true, std::memory_order_relaxed);
+		for(auto &t : threads)
+			t.join();
+		bench.announceIterations(totalIterations.load(std::memory_order_relaxed));
+	}
+	bench.finalizeStatistics();
+}
+
 void doAllocateBenchmark(size_t size) {
 	std::cout << "allocate memory, size = " << (size / (1024 * 1024)) << " MiB" << std::endl;
 
@@ -341,6 +616,48 @@ async::result<void> doSendRecvBufferBenchmark(size_t size) {
 	bench.finalizeStatistics();
 }
 
+// Compares page-aligned send buffers (which the kernel lends to the receiver)
+// against buffers that are misaligned by a single byte (which are copied).
+async::result<void> doAlignedSendRecvBufferBenchmark(size_t size, size_t misalign) {
+	auto [lane1, lane2] = helix::createStream();
+	std::vector<std::byte> sStorage(size + 2 * 4096);
+	std::vector<std::byte> rBuf(size);
+	auto sAligned = (reinterpret_cast<uintptr_t>(sStorage.data()) + 4095) & ~uintptr_t{4095};
+	auto sBuf = reinterpret_cast<std::byte *>(sAligned + misalign);
+
+	std::cout << "send/recv, size = " << (size / 1024) << " KiB, "
+			<< (misalign ? "misaligned" : "page-aligned") << std::endl;
+
+	IterationsPerSecondBenchmark bench;
+	for(int k = 0; k < 5; ++k) {
+		uint64_t n = 0;
+		bench.launchRepetition();
+		while(!bench.isRepetitionDone()) {
+			for(int i = 0; i < 10; ++i) {
+				co_await async::when_all(
+					async::transform(
+						helix_ng::exchangeMsgs(lane1, helix_ng::sendBuffer(sBuf, size)
+					), [&] (auto result) {
+						auto [send] = std::move(result);
+						HEL_CHECK(send.error());
+					}),
+					async::transform(
+						helix_ng::exchangeMsgs(lane2, helix_ng::recvBuffer(rBuf.data(), size)
+					), [&] (auto result) {
+						auto [recv] = std::move(result);
+						HEL_CHECK(recv.error());
+						assert(recv.actualLength() == size);
+					})
+				);
+				++n;
+			}
+		}
+		std::cout << "    " << (n * size / (1024 * 1024)) << " MiB per second" << std::endl;
+		bench.announceIterations(n);
+	}
+	bench.finalizeStatistics();
+}
+
 void doCrossThreadSendRecvBufferBenchmark(size_t size) {
 	auto [lane1, lane2] = helix::createStream();
 
@@ -415,14 +732,362 @@ void doCrossThreadSendRecvBufferBenchmark(size_t size) {
 	bench.finalizeStatistics();
 }
 
+void doNopLatencyBenchmark() {
+	pinToCpu(0);
+	LatencyBenchmark bench{"helNop", "pinned"};
+	for(int i = 0; i < LatencyBenchmark::numSamples; ++i)
+		bench.measure([] {
+			HEL_CHECK(helNop());
+		});
+	bench.finalizeStatistics();
+	unpin();
+}
+
+async::result<void> doAsyncNopLatencyBenchmark() {
+	pinToCpu(0);
+	LatencyBenchmark bench{"asyncNop", "pinned"};
+	for(int i = 0; i < LatencyBenchmark::numSamples; ++i) {
+		auto ref = LatencyBenchmark::clock::now();
+		auto result = co_await helix_ng::asyncNop();
+		HEL_CHECK(result.error());
+		bench.record(LatencyBenchmark::clock::now() - ref);
+	}
+	bench.finalizeStatistics();
+	unpin();
+}
+
+// Measures the round-trip latency of a 1-byte ping-pong between two threads.
+// With a non-zero pollBudget, both threads busy-poll their queues instead of sleeping.
+void doPingPongLatencyBenchmark(bool crossCpu, unsigned int pollBudget) {
+	auto [lane1, lane2] = helix::createStream();
+
+	std::thread echo{[&] {
+		pinToCpu(peerCpu(crossCpu));
+		helix::Dispatcher::global().setPollBudget(pollBudget);
+		async::run([&] () -> async::result<void> {
+			char buf[1];
+			for(int i = 0; i < LatencyBenchmark::numSamples; ++i) {
+				auto [recv] = co_await helix_ng::exchangeMsgs(lane2, helix_ng::recvBuffer(buf, 1));
+				HEL_CHECK(recv.error());
+				auto [send] = co_await helix_ng::exchangeMsgs(lane2, helix_ng::sendBuffer(buf, 1));
+				HEL_CHECK(send.error());
+			}
+		}(), helix::currentDispatcher);
+	}};
+
+	pinToCpu(0);
+	auto &dispatcher = helix::Dispatcher::global();
+	dispatcher.setPollBudget(pollBudget);
+	LatencyBenchmark bench{pollBudget ? "stream ping-pong (busy-poll)" : "stream ping-pong",
+			variantName(crossCpu)};
+	async::run([&] () -> async::result<void> {
+		char buf[1] = {0};
+		for(int i = 0; i < LatencyBenchmark::numSamples; ++i) {
+			auto ref = LatencyBenchmark::clock::now();
+			auto [send] = co_await helix_ng::exchangeMsgs(lane1, helix_ng::sendBuffer(buf, 1));
+			HEL_CHECK(send.error());
+			auto [recv] = co_await helix_ng::exchangeMsgs(lane1, helix_ng::recvBuffer(buf, 1));
+			HEL_CHECK(recv.error());
+			bench.record(LatencyBenchmark::clock::now() - ref);
+		}
+	}(), helix::currentDispatcher);
+	dispatcher.setPollBudget(0);
+
+	echo.join();
+	bench.finalizeStatistics();
+	unpin();
+}
+
+// The futex word can change between the load and helFutexWait();
+// callers re-check the word in a loop, so races are not errors.
+void checkFutexWait(HelError error) {
+	if(error != kHelErrFutexRace)
+		HEL_CHECK(error);
+}
+
+// Measures the time until a futex wake is answered by a wake from the woken thread.
+void doFutexWakeLatencyBenchmark(bool crossCpu) {
+	// Even values belong to the measuring thread, odd values to the peer.
+	alignas(64) int word = 0;
+
+	std::thread peer{[&] {
+		pinToCpu(peerCpu(crossCpu));
+		for(int i = 0; i < LatencyBenchmark::numSamples; ++i) {
+			while(__atomic_load_n(&word, __ATOMIC_ACQUIRE) != 2 * i + 1)
+				checkFutexWait(helFutexWait(&word, 2 * i, -1));
+			__atomic_store_n(&word, 2 * i + 2, __ATOMIC_RELEASE);
+			HEL_CHECK(helFutexWake(&word, 1));
+		}
+	}};
+
+	pinToCpu(0);
+	LatencyBenchmark bench{"futex wake", variantName(crossCpu)};
+	for(int i = 0; i < LatencyBenchmark::numSamples; ++i) {
+		bench.measure([&] {
+			__atomic_store_n(&word, 2 * i + 1, __ATOMIC_RELEASE);
+			HEL_CHECK(helFutexWake(&word, 1));
+			while(__atomic_load_n(&word, __ATOMIC_ACQUIRE) != 2 * i + 2)
+				checkFutexWait(helFutexWait(&word, 2 * i + 1, -1));
+		});
+	}
+
+	peer.join();
+	bench.finalizeStatistics();
+	unpin();
+}
+
+// Measures the stream ping-pong latency between two unpinned threads, i.e.,
+// the kernel decides where woken threads run. With background load, half of the CPUs
+// are kept busy by spinning threads such that the woken thread's previous CPU may be taken.
+void doWakeAffineLatencyBenchmark(bool withLoad) {
+	std::atomic<bool> stop{false};
+	std::vector<std::thread> spinners;
+	if(withLoad) {
+		for(unsigned int i = 0; i < std::thread::hardware_concurrency() / 2; ++i)
+			spinners.emplace_back([&] {
+				while(!stop.load(std::memory_order_relaxed))
+					;
+			});
+	}
+
+	auto [lane1, lane2] = helix::createStream();
+
+	std::thread echo{[&] {
+		async::run([&] () -> async::result<void> {
+			char buf[1];
+			for(int i = 0; i < LatencyBenchmark::numSamples; ++i) {
+				auto [recv] = co_await helix_ng::exchangeMsgs(lane2, helix_ng::recvBuffer(buf, 1));
+				HEL_CHECK(recv.error());
+				auto [send] = co_await helix_ng::exchangeMsgs(lane2, helix_ng::sendBuffer(buf, 1));
+				HEL_CHECK(send.error());
+			}
+		}(), helix::currentDispatcher);
+	}};
+
+	LatencyBenchmark bench{"stream ping-pong (unpinned)", withLoad ? "loaded" : "idle"};
+	async::run([&] () -> async::result<void> {
+		char buf[1] = {0};
+		for(int i = 0; i < LatencyBenchmark::numSamples; ++i) {
+			auto ref = LatencyBenchmark::clock::now();
+			auto [send] = co_await helix_ng::exchangeMsgs(lane1, helix_ng::sendBuffer(buf, 1));
+			HEL_CHECK(send.error());
+			auto [recv] = co_await helix_ng::exchangeMsgs(lane1, helix_ng::recvBuffer(buf, 1));
+			HEL_CHECK(recv.error());
+			bench.record(LatencyBenchmark::clock::now() - ref);
+		}
+	}(), helix::currentDispatcher);
+
+	echo.join();
+	stop.store(true, std::memory_order_relaxed);
+	for(auto &spinner : spinners)
+		spinner.join();
+	bench.finalizeStatistics();
+}
+
+void doPageFaultLatencyBenchmark() {
+	constexpr size_t size = 1 << 20;
+
+	pinToCpu(0);
+	LatencyBenchmark bench{"page fault", "pinned"};
+	int n = 0;
+	while(n < LatencyBenchmark::numSamples) {
+		HelHandle handle;
+		HEL_CHECK(helAllocateMemory(size, 0, nullptr, &handle));
+		void *window;
+		HEL_CHECK(helMapMemory(handle, kHelNullHandle, nullptr, 0, size,
+				kHelMapProtRead | kHelMapProtWrite, &window));
+
+		auto p = reinterpret_cast<volatile std::byte *>(window);
+		for(size_t progress = 0; progress < size; progress += 0x1000, ++n)
+			bench.measure([&] {
+				p[progress] = static_cast<std::byte>(0);
+			});
+
+		HEL_CHECK(helUnmapMemory(kHelNullHandle, window, size));
+		HEL_CHECK(helCloseDescriptor(kHelThisUniverse, handle));
+	}
+	bench.finalizeStatistics();
+	unpin();
+}
+
+// Populates memory on a CPU of one NUMA node and measures the cost of faulting it
+// into a fresh mapping on a CPU of the same node (local) and of another node (remote).
+void doNumaFaultLatencyBenchmark() {
+	constexpr size_t size = 1 << 20;
+
+	std::array<HelMemoryNodeStats, 64> nodes;
+	size_t numNodes;
+	HEL_CHECK(helQueryMemoryNodes(nodes.data(), nodes.size(), &numNodes));
+	numNodes = std::min(numNodes, nodes.size());
+	for(size_t i = 0; i < numNodes; ++i) {
+		if(jsonOutput) {
+			std::cout << "{\"memory_node\": " << nodes[i].node
+					<< ", \"first_cpu\": " << nodes[i].firstCpu
+					<< ", \"total_pages\": " << nodes[i].totalPages
+					<< ", \"free_pages\": " << nodes[i].freePages
+					<< ", \"used_pages\": " << nodes[i].usedPages << "}" << std::endl;
+		}else{
+			std::cout << "NUMA node " << nodes[i].node << " (first CPU: " << nodes[i].firstCpu
+					<< "): " << nodes[i].freePages << " free / " << nodes[i].usedPages
+					<< " used pages" << std::endl;
+		}
+	}
+
+	// We need two nodes that have both CPUs and memory.
+	std::vector<unsigned int> cpus;
+	for(size_t i = 0; i < numNodes; ++i) {
+		if(nodes[i].firstCpu >= 0)
+			cpus.push_back(nodes[i].firstCpu);
+	}
+	if(cpus.size() < 2) {
+		if(!jsonOutput)
+			std::cout << "NUMA fault latency: skipped (less than two NUMA nodes)" << std::endl;
+		return;
+	}
+
+	for(bool remote : {false, true}) {
+		LatencyBenchmark bench{"numa fault", remote ? "remote" : "local"};
+		int n = 0;
+		while(n < LatencyBenchmark::numSamples) {
+			HelHandle handle;
+			HEL_CHECK(helAllocateMemory(size, 0, nullptr, &handle));
+
+			// Populate the memory on the first node.
+			pinToCpu(cpus[0]);
+			void *window;
+			HEL_CHECK(helMapMemory(handle, kHelNullHandle, nullptr, 0, size,
+					kHelMapProtRead | kHelMapProtWrite, &window));
+			auto p = reinterpret_cast<volatile std::byte *>(window);
+			for(size_t progress = 0; progress < size; progress += 0x1000)
+				p[progress] = static_cast<std::byte>(0);
+			HEL_CHECK(helUnmapMemory(kHelNullHandle, window, size));
+
+			// Fault it into a fresh mapping on the same or on another node.
+			pinToCpu(cpus[remote ? 1 : 0]);
+			HEL_CHECK(helMapMemory(handle, kHelNullHandle, nullptr, 0, size,
+					kHelMapProtRead | kHelMapProtWrite, &window));
+			p = reinterpret_cast<volatile std::byte *>(window);
+			for(size_t progress = 0; progress < size; progress += 0x1000, ++n)
+				bench.measure([&] {
+					p[progress] = static_cast<std::byte>(1);
+				});
+
+			HEL_CHECK(helUnmapMemory(kHelNullHandle, window, size));
+			HEL_CHECK(helCloseDescriptor(kHelThisUniverse, handle));
+		}
+		bench.finalizeStatistics();
+	}
+	unpin();
+}
+
+void doMapUnmapLatencyBenchmark() {
+	pinToCpu(0);
+	HelHandle handle;
+	HEL_CHECK(helAllocateMemory(0x1000, 0, nullptr, &handle));
+
+	LatencyBenchmark bench{"map/unmap", "pinned"};
+	for(int i = 0; i < LatencyBenchmark::numSamples; ++i)
+		bench.measure([&] {
+			void *window;
+			HEL_CHECK(helMapMemory(handle, kHelNullHandle, nullptr, 0, 0x1000,
+					kHelMapProtRead | kHelMapProtWrite, &window));
+			HEL_CHECK(helUnmapMemory(kHelNullHandle, window, 0x1000));
+		});
+	bench.finalizeStatistics();
+
+	HEL_CHECK(helCloseDescriptor(kHelThisUniverse, handle));
+	unpin();
+}
+
+// Measures fork() until the child has exited and was reaped.
+// Before forking, rss bytes of private anonymous memory are populated.
+void doForkLatencyBenchmark(size_t rss) {
+	void *window = nullptr;
+	if(rss) {
+		window = mmap(nullptr, rss, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(window == MAP_FAILED) {
+			std::cout << "mmap() failed: " << strerror(errno) << std::endl;
+			return;
+		}
+		auto p = reinterpret_cast<volatile std::byte *>(window);
+		for(size_t progress = 0; progress < rss; progress += 0x1000)
+			p[progress] = static_cast<std::byte>(1);
+	}
+
+	pinToCpu(0);
+	LatencyBenchmark bench{"fork", "pinned, rss = " + std::to_string(rss / 1024) + " KiB"};
+	for(int i = 0; i < 1000; ++i)
+		bench.measure([] {
+			auto pid = fork();
+			if(!pid)
+				_exit(0);
+			assert(pid > 0);
+			int status;
+			if(waitpid(pid, &status, 0) != pid)
+				std::cout << "waitpid() failed: " << strerror(errno) << std::endl;
+		});
+	bench.finalizeStatistics();
+	unpin();
+
+	if(rss)
+		munmap(window, rss);
+}
+
+void doLatencyBenchmarks() {
+	bool haveCrossCpu = std::thread::hardware_concurrency() > 1;
+
+	doNopLatencyBenchmark();
+	async::run(doAsyncNopLatencyBenchmark(), helix::currentDispatcher);
+	for(bool crossCpu : {false, true}) {
+		if(crossCpu && !haveCrossCpu)
+			continue;
+		doPingPongLatencyBenchmark(crossCpu, 0);
+		doFutexWakeLatencyBenchmark(crossCpu);
+	}
+	// Busy-polling is pointless if both threads share a CPU.
+	if(haveCrossCpu) {
+		doPingPongLatencyBenchmark(true, 100'000);
+		doWakeAffineLatencyBenchmark(false);
+		doWakeAffineLatencyBenchmark(true);
+	}
+	doPageFaultLatencyBenchmark();
+	doNumaFaultLatencyBenchmark();
+	doMapUnmapLatencyBenchmark();
+	for(size_t rss : {size_t{0}, size_t{1} << 20, size_t{16} << 20, size_t{64} << 20})
+		doForkLatencyBenchmark(rss);
+}
+
 } // anonymous namespace
 
-int main() {
+int main(int argc, char **argv) {
+	bool latencyOnly = false;
+	for(int i = 1; i < argc; ++i) {
+		if(!strcmp(argv[i], "--json")) {
+			jsonOutput = true;
+		}else if(!strcmp(argv[i], "--latency-only")) {
+			latencyOnly = true;
+		}else{
+			std::cout << "kernel-bench: unknown argument " << argv[i] << std::endl;
+			return 1;
+		}
+	}
+
+	doLatencyBenchmarks();
+	if(latencyOnly)
+		return 0;
+
 	doNopBenchmark();
 	doFutexBenchmark();
+	// At least two threads are required to pass the token.
+	for(unsigned int n = 2; n <= std::max(2u, std::thread::hardware_concurrency()); n *= 2)
+		doContendedFutexBenchmark(n);
+	for(unsigned int n = 1; n <= std::thread::hardware_concurrency(); n *= 2)
+		doDistinctFutexBenchmark(n);
 	async::run(doAsyncNopBenchmark(), helix::currentDispatcher);
 	async::run(doMultiSubmitAsyncNopBenchmark(), helix::currentDispatcher);
+	doBurstAsyncNopBenchmark(512);
 	doParallelAsyncNopBenchmark();
+	doPoolAsyncNopBenchmark();
 	doAllocateBenchmark(1 << 20);
 	doMapBenchmark(1 << 20);
 	doMapPopulatedBenchmark(1 << 20);
@@ -432,6 +1097,10 @@ int main() {
 	async::run(doSendRecvBufferBenchmark(16 * 1024), helix::currentDispatcher);
 	async::run(doSendRecvBufferBenchmark(64 * 1024), helix::currentDispatcher);
 	async::run(doSendRecvBufferBenchmark(1024 * 1024), helix::currentDispatcher);
+	async::run(doAlignedSendRecvBufferBenchmark(64 * 1024, 0), helix::currentDispatcher);
+	async::run(doAlignedSendRecvBufferBenchmark(64 * 1024, 1), helix::currentDispatcher);
+	async::run(doAlignedSendRecvBufferBenchmark(1024 * 1024, 0), helix::currentDispatcher);
+	async::run(doAlignedSendRecvBufferBenchmark(1024 * 1024, 1), helix::currentDispatcher);
 	doCrossThreadSendRecvBufferBenchmark(1);
 	doCrossThreadSendRecvBufferBenchmark(4096);
 	doCrossThreadSendRecvBufferBenchmark(16 * 1024);
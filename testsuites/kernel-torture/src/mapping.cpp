@@ -0,0 +1,87 @@
+#include <atomic>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <thread>
+
+#include <hel.h>
+#include <hel-syscalls.h>
+
+#include "testsuite.hpp"
+
+namespace {
+
+constexpr size_t numPages = 16;
+constexpr size_t regionSize = numPages * 0x1000;
+
+void touchPages(void *window, size_t offset, size_t size) {
+	for(size_t p = offset; p < offset + size; p += 0x1000)
+		*reinterpret_cast<volatile uintptr_t *>(reinterpret_cast<char *>(window) + p) = p;
+}
+
+// Faults that hit the region after it was unmapped raise SIGSEGV;
+// the handler returns to the fault loop of the thread.
+thread_local sigjmp_buf *faultRecovery;
+
+void handleSegv(int) {
+	siglongjmp(*faultRecovery, 1);
+}
+
+void installSegvHandler() {
+	static bool installed = [] {
+		struct sigaction sa{};
+		sa.sa_handler = handleSegv;
+		sigemptyset(&sa.sa_mask);
+		if(sigaction(SIGSEGV, &sa, nullptr))
+			abort();
+		return true;
+	}();
+	(void)installed;
+}
+
+// Keeps reading the pages of the region, while the test case splits and unmaps it.
+// Reads never clobber other mappings that may take the place of the region.
+void faultLoop(char *window, std::atomic<bool> *done) {
+	sigjmp_buf recovery;
+	faultRecovery = &recovery;
+
+	size_t p = 0;
+	while(!done->load(std::memory_order_relaxed)) {
+		if(!sigsetjmp(recovery, 1))
+			(void)*reinterpret_cast<volatile uintptr_t *>(window + p);
+		p = (p + 0x1000) % regionSize;
+	}
+}
+
+} // anonymous namespace
+
+DEFINE_TEST(concurrentFaultUnmap, ([] {
+	installSegvHandler();
+
+	HelHandle handle;
+	HEL_CHECK(helAllocateMemory(regionSize, 0, nullptr, &handle));
+
+	void *window;
+	HEL_CHECK(helMapMemory(handle, kHelNullHandle, nullptr, 0, regionSize,
+			kHelMapProtRead | kHelMapProtWrite, &window));
+
+	std::atomic<bool> done{false};
+	std::thread faulters[2];
+	for(auto &t : faulters)
+		t = std::thread{faultLoop, reinterpret_cast<char *>(window), &done};
+
+	touchPages(window, 0, regionSize);
+
+	// Split the mapping by unmapping its middle, then fault on both remaining parts.
+	auto middle = reinterpret_cast<char *>(window) + regionSize / 4;
+	HEL_CHECK(helUnmapMemory(kHelNullHandle, middle, regionSize / 2));
+	touchPages(window, 0, regionSize / 4);
+	touchPages(window, 3 * regionSize / 4, regionSize / 4);
+
+	HEL_CHECK(helUnmapMemory(kHelNullHandle, window, regionSize));
+
+	done.store(true, std::memory_order_relaxed);
+	for(auto &t : faulters)
+		t.join();
+	HEL_CHECK(helCloseDescriptor(kHelThisUniverse, handle));
+}))
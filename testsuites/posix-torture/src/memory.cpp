@@ -1,4 +1,8 @@
+#include <algorithm>
 #include <cassert>
+#include <fstream>
+#include <iostream>
+#include <string>
 #include <sys/mman.h>
 
 #include "testsuite.hpp"
@@ -9,3 +13,59 @@ DEFINE_TEST(map_unmap_anonymous, ([] {
 	assert(window != MAP_FAILED);
 	munmap(window, 0x1000);
 }))
+
+namespace {
+
+// Returns the value of a /proc/meminfo field (in KiB) or zero if it does not exist.
+size_t readMeminfo(const std::string &key) {
+	std::ifstream meminfo{"/proc/meminfo"};
+	std::string name;
+	size_t value;
+	while(meminfo >> name >> value) {
+		if(name == key + ":")
+			return value;
+		meminfo.ignore(256, '\n');
+	}
+	return 0;
+}
+
+} // anonymous namespace
+
+// Maps more anonymous memory than there is RAM and touches one page per run.
+// The first pass over the region writes a tag into each page,
+// subsequent passes verify that swapped out pages come back intact.
+DEFINE_TEST(overcommit_anonymous, ([] {
+	static bool initialized = false;
+	static char *region = nullptr;
+	static size_t numPages = 0;
+	static size_t run = 0;
+
+	if(!initialized) {
+		initialized = true;
+		auto memTotal = readMeminfo("MemTotal");
+		auto swapTotal = readMeminfo("SwapTotal");
+		if(!swapTotal) {
+			std::cout << "posix-torture: No swap attached, skipping overcommit_anonymous"
+					<< std::endl;
+			return;
+		}
+
+		size_t size = std::min(memTotal * 3 / 2, memTotal + swapTotal / 2) * 1024;
+		void *window = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		assert(window != MAP_FAILED);
+		region = static_cast<char *>(window);
+		numPages = size / 0x1000;
+	}
+	if(!region)
+		return;
+
+	auto page = run % numPages;
+	auto tag = reinterpret_cast<size_t *>(region + page * 0x1000);
+	if(run < numPages) {
+		*tag = page ^ 0x5A5A5A5A;
+	}else{
+		assert(*tag == (page ^ 0x5A5A5A5A));
+	}
+	run++;
+}))
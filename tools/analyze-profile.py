@@ -90,6 +90,11 @@ with open(args.profile_path, 'rb') as f:
 			continue
 		n_traces += 1
 
+		# Samples from user mode are handled by tools/profile/extract-user-profile.
+		if flags & 2:
+			n_user += 1
+			continue
+
 		any_user = False
 		for ip in ips:
 			if ip < (1 << 63):
@@ -4,6 +4,9 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <vector>
+
 #include <bragi/helpers-std.hpp>
 #include <CLI/App.hpp>
 #include <CLI/Formatter.hpp>
@@ -17,8 +20,26 @@ void FRG_INTF(panic)(const char *cstring) {
 
 namespace {
 
+// The kernel merges the records of all sources (i.e., CPUs) into a single stream of frames.
+struct FrameHeader {
+	// Size of the payload that follows the header.
+	uint32_t size;
+	// Source (i.e., CPU) that emitted the records.
+	uint32_t source;
+	// Timestamp at which the kernel received the records.
+	uint64_t ts;
+};
+static_assert(sizeof(FrameHeader) == 16);
+
+struct Frame {
+	uint32_t source;
+	uint64_t ts;
+	frg::span<const char> payload;
+};
+
 template<typename T>
-concept Policy = requires(T &a, managarm::ostrace::EventRecord &event, managarm::ostrace::Definition &def, managarm::ostrace::UintAttribute &uintAttr, managarm::ostrace::BufferAttribute &bufferAttr, size_t pass) {
+concept Policy = requires(T &a, Frame &frame, managarm::ostrace::EventRecord &event, managarm::ostrace::Definition &def, managarm::ostrace::UintAttribute &uintAttr, managarm::ostrace::BufferAttribute &bufferAttr, size_t pass) {
+	{ a.onFrame(frame, pass) } -> std::same_as<bool>;
 	{ a.onEvent(event, pass) } -> std::same_as<bool>;
 	{ a.onDefinition(def, pass) } -> std::same_as<bool>;
 	{ a.onEndOfRecord(pass) } -> std::same_as<bool>;
@@ -34,8 +55,16 @@ concept Policy = requires(T &a, managarm::ostrace::EventRecord &event, managarm:
 };
 
 struct JsonPolicy {
+	bool onFrame(Frame &frame, size_t) {
+		frame_ = frame;
+		return true;
+	}
+
 	bool onEvent(managarm::ostrace::EventRecord &record, size_t) {
-		std::cout << "{\"_event\":\"" << terms.at(record.id()) << "\",\"_ts\":" << record.ts();
+		// Fall back to the kernel's timestamp if the emitter did not provide one.
+		auto ts = record.ts() ? record.ts() : frame_.ts;
+		std::cout << "{\"_event\":\"" << terms.at(record.id()) << "\",\"_ts\":" << ts
+				<< ",\"_source\":" << frame_.source;
 		return true;
 	}
 
@@ -68,6 +97,9 @@ struct JsonPolicy {
 
 	std::unordered_map<uint64_t, std::string> terms;
 	size_t parsedRecords;
+
+private:
+	Frame frame_{};
 };
 
 struct WiresharkPolicy {
@@ -102,9 +134,14 @@ struct WiresharkPolicy {
 		"fs.request",
 	};
 
+	bool onFrame(Frame &frame, size_t) {
+		frameTs_ = frame.ts;
+		return true;
+	}
+
 	bool onEvent(managarm::ostrace::EventRecord &record, size_t) {
 		if(requests.contains(terms.at(record.id())))
-			state_.ts = record.ts();
+			state_.ts = record.ts() ? record.ts() : frameTs_;
 		return true;
 	}
 
@@ -208,6 +245,7 @@ struct WiresharkPolicy {
 private:
 	int pcapfd_;
 	size_t frame_id = 1;
+	uint64_t frameTs_ = 0;
 
 	struct pcap_packet_state {
 		pid_t last_pid = 0;
@@ -343,54 +381,62 @@ int main(int argc, char **argv) {
 		return false;
 	};
 
-	auto extractRecords = [&handleMessage]<Policy T>(T &policy, frg::span<const char> &bufferView, size_t pass) -> bool {
-		struct Header {
-			uint32_t size;
-		};
-
-		if (bufferView.size() < sizeof(Header)) {
+	// Split the input into frames. Frames from different sources are only approximately
+	// ordered by the kernel, hence we sort them by their timestamp.
+	// Definitions have a timestamp of zero and are thus ordered before all events.
+	std::vector<Frame> frames;
+	while(fileBuffer.size()) {
+		if(fileBuffer.size() < sizeof(FrameHeader)) {
 			std::cerr << "failed to extract header" << std::endl;
-			return false;
+			break;
+		}
+		FrameHeader hdr;
+		memcpy(&hdr, fileBuffer.data(), sizeof(FrameHeader));
+		if(fileBuffer.size() < sizeof(FrameHeader) + hdr.size) {
+			std::cerr << "failed to extract truncated frame" << std::endl;
+			break;
 		}
-		Header hdr;
-		memcpy(&hdr, bufferView.data(), sizeof(Header));
 
-		auto buffer = bufferView.subspan(sizeof(Header), hdr.size);
+		frames.push_back({hdr.source, hdr.ts, fileBuffer.subspan(sizeof(FrameHeader), hdr.size)});
+		fileBuffer = fileBuffer.subspan(sizeof(FrameHeader) + hdr.size);
+	}
+	std::ranges::stable_sort(frames, {}, &Frame::ts);
+
+	auto extractRecords = [&handleMessage]<Policy T>(T &policy, Frame &frame, size_t pass) -> bool {
+		if(!policy.onFrame(frame, pass))
+			return false;
+
+		auto buffer = frame.payload;
 		while (buffer.size()) {
 			if(!handleMessage(policy, buffer, pass)) {
 				return false;
 			}
 			++policy.parsedRecords;
 		}
-
-		bufferView = bufferView.subspan(sizeof(Header) + hdr.size);
 		return true;
 	};
 
-	auto parseWithPolicy = [&extractRecords]<Policy T>(T &policy, frg::span<const char> &fileBuffer) {
+	auto parseWithPolicy = [&extractRecords, &frames, &fileBuffer]<Policy T>(T &policy) {
 		for(size_t pass = 0; pass < policy.passes(); pass++) {
-			auto bufferView = fileBuffer.subspan(0);
 			policy.parsedRecords = 0;
 			policy.reset();
 
-			while (bufferView.size()) {
-				if (!extractRecords(policy, bufferView, pass))
+			for(auto &frame : frames) {
+				if (!extractRecords(policy, frame, pass))
 					break;
 			}
-
-			if(pass == policy.passes() - 1)
-				fileBuffer = bufferView;
 		}
 
-		std::cerr << "extracted " << policy.parsedRecords << " records"
+		std::cerr << "extracted " << policy.parsedRecords << " records from "
+			<< frames.size() << " frames"
 			<< " (" << fileBuffer.size() << " bytes remain)" << std::endl;
 	};
 
 	if(pcap) {
 		auto policy = WiresharkPolicy{};
-		parseWithPolicy(policy, fileBuffer);
+		parseWithPolicy(policy);
 	} else {
 		auto policy = JsonPolicy{};
-		parseWithPolicy(policy, fileBuffer);
+		parseWithPolicy(policy);
 	}
 }
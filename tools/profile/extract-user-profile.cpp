@@ -0,0 +1,355 @@
+#include <cxxabi.h>
+#include <elf.h>
+#include <err.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <CLI/App.hpp>
+#include <CLI/Formatter.hpp>
+#include <CLI/Config.hpp>
+
+namespace {
+
+// Flag in the upper half of the first word of each sample.
+constexpr uint64_t sampleUser = 2;
+
+// User samples store the address space ID and the thread credentials before the IPs.
+constexpr size_t numUserTags = 3;
+
+std::string formatHex(uint64_t value) {
+	std::ostringstream stream;
+	stream << "0x" << std::hex << value;
+	return stream.str();
+}
+
+std::string formatCredentials(uint64_t lo, uint64_t hi) {
+	unsigned char bytes[16];
+	memcpy(bytes, &lo, 8);
+	memcpy(bytes + 8, &hi, 8);
+	std::ostringstream stream;
+	stream << std::hex << std::setfill('0');
+	for(auto b : bytes)
+		stream << std::setw(2) << static_cast<unsigned int>(b);
+	return stream.str();
+}
+
+struct Symbol {
+	uint64_t address;
+	uint64_t size;
+	std::string name;
+};
+
+// Symbols of an ELF file.
+struct Module {
+	static std::unique_ptr<Module> load(const std::string &path) {
+		int fd = open(path.c_str(), O_RDONLY);
+		if(fd < 0) {
+			warn("failed to open %s", path.c_str());
+			return nullptr;
+		}
+
+		struct stat st;
+		if(fstat(fd, &st) < 0)
+			err(1, "failed to stat %s", path.c_str());
+
+		auto ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if(ptr == MAP_FAILED)
+			err(1, "failed to mmap %s", path.c_str());
+
+		auto module = std::make_unique<Module>();
+		auto base = reinterpret_cast<const char *>(ptr);
+		Elf64_Ehdr ehdr;
+		memcpy(&ehdr, base, sizeof(Elf64_Ehdr));
+		if(memcmp(ehdr.e_ident, ELFMAG, SELFMAG) || ehdr.e_ident[EI_CLASS] != ELFCLASS64) {
+			warnx("%s is not a 64-bit ELF file", path.c_str());
+			munmap(ptr, st.st_size);
+			return nullptr;
+		}
+
+		for(size_t i = 0; i < ehdr.e_phnum; ++i) {
+			Elf64_Phdr phdr;
+			memcpy(&phdr, base + ehdr.e_phoff + i * ehdr.e_phentsize, sizeof(Elf64_Phdr));
+			if(phdr.p_type == PT_LOAD)
+				module->segments_.push_back(phdr);
+		}
+
+		// Prefer the full symbol table but fall back to the dynamic one for stripped files.
+		auto readSymbols = [&] (uint32_t type) {
+			for(size_t i = 0; i < ehdr.e_shnum; ++i) {
+				Elf64_Shdr shdr;
+				memcpy(&shdr, base + ehdr.e_shoff + i * ehdr.e_shentsize, sizeof(Elf64_Shdr));
+				if(shdr.sh_type != type)
+					continue;
+
+				Elf64_Shdr strtab;
+				memcpy(&strtab, base + ehdr.e_shoff + shdr.sh_link * ehdr.e_shentsize,
+						sizeof(Elf64_Shdr));
+
+				for(size_t j = 0; j < shdr.sh_size / sizeof(Elf64_Sym); ++j) {
+					Elf64_Sym sym;
+					memcpy(&sym, base + shdr.sh_offset + j * sizeof(Elf64_Sym), sizeof(Elf64_Sym));
+					if(ELF64_ST_TYPE(sym.st_info) != STT_FUNC || !sym.st_value)
+						continue;
+					module->symbols_.push_back({sym.st_value, sym.st_size,
+							demangle(base + strtab.sh_offset + sym.st_name)});
+				}
+			}
+		};
+		readSymbols(SHT_SYMTAB);
+		if(module->symbols_.empty())
+			readSymbols(SHT_DYNSYM);
+		std::ranges::sort(module->symbols_, {}, &Symbol::address);
+
+		munmap(ptr, st.st_size);
+		return module;
+	}
+
+	// Translates an offset into the file to a virtual address of the ELF image.
+	std::optional<uint64_t> offsetToAddress(uint64_t offset) {
+		for(auto &phdr : segments_) {
+			if(offset >= phdr.p_offset && offset < phdr.p_offset + phdr.p_filesz)
+				return phdr.p_vaddr + (offset - phdr.p_offset);
+		}
+		return std::nullopt;
+	}
+
+	const Symbol *findSymbol(uint64_t address) {
+		auto it = std::ranges::upper_bound(symbols_, address, {}, &Symbol::address);
+		if(it == symbols_.begin())
+			return nullptr;
+		--it;
+		// Symbols with unknown size cover everything up to the next symbol.
+		if(it->size && address >= it->address + it->size)
+			return nullptr;
+		return &*it;
+	}
+
+private:
+	static std::string demangle(const char *name) {
+		int status;
+		auto demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+		if(status)
+			return name;
+		std::string result{demangled};
+		free(demangled);
+		return result;
+	}
+
+	std::vector<Elf64_Phdr> segments_;
+	std::vector<Symbol> symbols_;
+};
+
+// Contents of a /proc/<pid>/maps file.
+struct AddressMap {
+	struct Area {
+		uint64_t start;
+		uint64_t end;
+		uint64_t offset;
+		std::string path;
+	};
+
+	static AddressMap load(const std::string &path) {
+		std::ifstream file{path};
+		if(!file)
+			err(1, "failed to open maps file %s", path.c_str());
+
+		AddressMap map;
+		std::string line;
+		while(std::getline(file, line)) {
+			std::istringstream stream{line};
+			std::string range, perms, offset, device, inode, areaPath;
+			if(!(stream >> range >> perms >> offset >> device >> inode))
+				continue;
+			stream >> areaPath;
+
+			auto dash = range.find('-');
+			if(dash == std::string::npos)
+				continue;
+			map.areas.push_back({std::stoull(range.substr(0, dash), nullptr, 16),
+					std::stoull(range.substr(dash + 1), nullptr, 16),
+					std::stoull(offset, nullptr, 16), areaPath});
+			if(map.name.empty() && !areaPath.empty())
+				map.name = areaPath;
+		}
+		return map;
+	}
+
+	const Area *find(uint64_t address) const {
+		for(auto &area : areas) {
+			if(address >= area.start && address < area.end)
+				return &area;
+		}
+		return nullptr;
+	}
+
+	// Path of the first mapped file (i.e., usually the main executable).
+	std::string name;
+	std::vector<Area> areas;
+};
+
+struct Resolver {
+	Resolver(std::string sysroot)
+	: sysroot_{std::move(sysroot)} { }
+
+	std::string resolve(const AddressMap *map, uint64_t ip) {
+		if(!map)
+			return formatHex(ip);
+
+		auto area = map->find(ip);
+		if(!area || area->path.empty())
+			return formatHex(ip);
+
+		auto moduleName = std::filesystem::path{area->path}.filename().string();
+		auto module = getModule(area->path);
+		if(!module)
+			return formatHex(ip) + " [" + moduleName + "]";
+
+		auto address = module->offsetToAddress(ip - area->start + area->offset);
+		if(!address)
+			return formatHex(ip) + " [" + moduleName + "]";
+
+		auto symbol = module->findSymbol(*address);
+		if(!symbol)
+			return formatHex(*address) + " [" + moduleName + "]";
+		return symbol->name + " [" + moduleName + "]";
+	}
+
+private:
+	Module *getModule(const std::string &path) {
+		auto it = modules_.find(path);
+		if(it == modules_.end())
+			it = modules_.emplace(path, Module::load(sysroot_ + path)).first;
+		return it->second.get();
+	}
+
+	std::string sysroot_;
+	std::unordered_map<std::string, std::unique_ptr<Module>> modules_;
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+	std::string path{"kernel-profile.bin"};
+	std::string sysroot;
+	std::vector<std::string> mapsArgs;
+	std::string splitDir;
+	bool perThread = false;
+
+	CLI::App app{"extract-user-profile: produce folded stacks from user samples of kernel profiles"};
+	app.add_option("path", path, "Path to the profile");
+	app.add_option("--maps", mapsArgs,
+			"<credentials>=<file>: /proc/<pid>/maps of a process and the Credentials"
+			" shown in /proc/<pid>/task/<tid>/status of any of its threads");
+	app.add_option("--sysroot", sysroot, "Directory that contains the ELF files of the system");
+	app.add_option("--split", splitDir, "Write one file of folded stacks per address space to this directory");
+	app.add_flag("--per-thread", perThread, "Distinguish stacks of different threads");
+	CLI11_PARSE(app, argc, argv);
+
+	std::unordered_map<std::string, AddressMap> mapsByCredentials;
+	for(auto &arg : mapsArgs) {
+		auto eq = arg.find('=');
+		if(eq == std::string::npos)
+			errx(1, "expected <credentials>=<file> in --maps argument %s", arg.c_str());
+		mapsByCredentials.emplace(arg.substr(0, eq), AddressMap::load(arg.substr(eq + 1)));
+	}
+
+	std::ifstream file{path, std::ios::binary};
+	if(!file)
+		err(1, "failed to open input file %s", path.c_str());
+
+	struct Sample {
+		uint64_t space;
+		std::string credentials;
+		std::vector<uint64_t> ips;
+	};
+	std::vector<Sample> samples;
+	// Threads share the address map of their address space.
+	std::unordered_map<uint64_t, const AddressMap *> mapsBySpace;
+
+	size_t numKernelSamples = 0;
+	uint64_t header;
+	while(file.read(reinterpret_cast<char *>(&header), sizeof(uint64_t))) {
+		auto count = header & 0xFFFF'FFFF;
+		auto flags = header >> 32;
+
+		std::vector<uint64_t> words(count);
+		if(!file.read(reinterpret_cast<char *>(words.data()), count * sizeof(uint64_t))) {
+			warnx("halting due to truncated sample");
+			break;
+		}
+
+		if(!(flags & sampleUser)) {
+			++numKernelSamples;
+			continue;
+		}
+		if(count <= numUserTags) {
+			warnx("halting due to broken user sample");
+			break;
+		}
+
+		Sample sample{words[0], formatCredentials(words[1], words[2]),
+				{words.begin() + numUserTags, words.end()}};
+		if(!mapsBySpace.contains(sample.space)) {
+			auto it = mapsByCredentials.find(sample.credentials);
+			if(it != mapsByCredentials.end())
+				mapsBySpace[sample.space] = &it->second;
+		}
+		samples.push_back(std::move(sample));
+	}
+
+	// Aggregate folded stacks per address space.
+	Resolver resolver{sysroot};
+	std::map<uint64_t, std::map<std::string, size_t>> stacksBySpace;
+	for(auto &sample : samples) {
+		const AddressMap *map = nullptr;
+		if(auto it = mapsBySpace.find(sample.space); it != mapsBySpace.end())
+			map = it->second;
+
+		std::string stack = map ? map->name : "space-" + std::to_string(sample.space);
+		if(perThread)
+			stack += ";thread-" + sample.credentials;
+		// Outermost frames come first in folded stacks.
+		for(size_t i = sample.ips.size(); i-- > 0;) {
+			// Except for the sampled IP, IPs are return addresses that point after the call.
+			auto ip = i ? sample.ips[i] - 1 : sample.ips[i];
+			auto frame = resolver.resolve(map, ip);
+			std::ranges::replace(frame, ';', ':');
+			stack += ";" + frame;
+		}
+		++stacksBySpace[sample.space][stack];
+	}
+
+	for(auto &[space, stacks] : stacksBySpace) {
+		std::ofstream out;
+		if(!splitDir.empty()) {
+			auto outPath = std::filesystem::path{splitDir} / ("space-" + std::to_string(space) + ".folded");
+			out.open(outPath);
+			if(!out)
+				err(1, "failed to open %s", outPath.c_str());
+		}
+		auto &stream = splitDir.empty() ? std::cout : out;
+		for(auto &[stack, count] : stacks)
+			stream << stack << " " << count << "\n";
+	}
+
+	std::cerr << "extracted " << samples.size() << " user samples from "
+		<< stacksBySpace.size() << " address spaces (skipped "
+		<< numKernelSamples << " kernel samples)" << std::endl;
+}